@@ -0,0 +1,474 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/* A playback device that consumes samples on a timer instead of a sound
+ * server so audio latency can be profiled on a headless machine. The device
+ * is modelled as a double-buffered DAC running at the stream rate (optionally
+ * skewed by a clock drift), which wakes up to request the next period when
+ * one period remains queued, delayed by a configurable scheduling jitter. */
+
+#include "interface/audiodev.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <time.h>
+
+#include "common/debug.h"
+#include "common/event.h"
+#include "common/locking.h"
+#include "common/option.h"
+#include "common/thread.h"
+#include "common/util.h"
+
+enum NullState
+{
+  NULL_STATE_IDLE,
+  NULL_STATE_RUN,
+  NULL_STATE_QUIT
+};
+
+struct Null
+{
+  LGThread     * thread;
+  LGEvent      * wakeup;
+  _Atomic(int)   state;
+  uint64_t       rng;
+
+  // the option values
+  int            period;
+  double         jitterNs;
+  double         drift;
+  const char   * wavFile;
+
+  // protects everything below, held by the device thread for each period
+  LG_Lock        lock;
+
+  int            channels;
+  int            sampleRate;
+  int            periodFrames;
+  LG_AudioPullFn pullFn;
+  float        * buffer;
+
+  bool           running;
+  uint64_t       startTime;
+  uint64_t       written;
+
+  uint64_t       periods;
+  uint64_t       shortPeriods;
+  uint64_t       underruns;
+
+  FILE         * wav;
+  uint32_t       wavBytes;
+};
+
+static struct Null n = { 0 };
+
+// true on the device thread so stop can be called from within the pull
+static _Thread_local bool inDeviceThread = false;
+
+static struct Option null_options[] =
+{
+  {
+    .module       = "null",
+    .name         = "enable",
+    .description  = "Use the null audio device instead of a sound server",
+    .type         = OPTION_TYPE_BOOL,
+    .value.x_bool = false
+  },
+  {
+    .module       = "null",
+    .name         = "period",
+    .description  = "The device period in frames (0 = as requested)",
+    .type         = OPTION_TYPE_INT,
+    .value.x_int  = 0
+  },
+  {
+    .module        = "null",
+    .name          = "jitter",
+    .description   = "The standard deviation of the wakeup delay in ms",
+    .type          = OPTION_TYPE_FLOAT,
+    .value.x_float = 0.0f
+  },
+  {
+    .module        = "null",
+    .name          = "drift",
+    .description   = "The device clock error in ppm",
+    .type          = OPTION_TYPE_FLOAT,
+    .value.x_float = 0.0f
+  },
+  {
+    .module         = "null",
+    .name           = "wavFile",
+    .description    = "Write the played samples to this WAV file",
+    .type           = OPTION_TYPE_STRING,
+    .value.x_string = NULL
+  },
+
+  {0}
+};
+
+static uint64_t null_clock(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double null_rate(void)
+{
+  return n.sampleRate * (1.0 + n.drift * 1e-6);
+}
+
+// the number of frames the DAC has played at the given time
+static uint64_t null_framesAt(uint64_t time)
+{
+  if (time <= n.startTime)
+    return 0;
+  return (uint64_t)((time - n.startTime) * 1e-9 * null_rate());
+}
+
+// the time at which the DAC will have played the given number of frames
+static uint64_t null_timeAt(uint64_t frames)
+{
+  return n.startTime + (uint64_t)llrint(frames * 1e9 / null_rate());
+}
+
+// the absolute value of a normally distributed sample, wakeups are never early
+static double null_jitter(void)
+{
+  if (n.jitterNs <= 0.0)
+    return 0.0;
+
+  // xorshift64*
+  double u[2];
+  for(int i = 0; i < 2; ++i)
+  {
+    n.rng ^= n.rng >> 12;
+    n.rng ^= n.rng << 25;
+    n.rng ^= n.rng >> 27;
+    u[i] = ((n.rng * 0x2545F4914F6CDD1DULL) >> 11) * 0x1.0p-53;
+  }
+
+  return fabs(sqrt(-2.0 * log(u[0] + 0x1.0p-53)) * cos(2.0 * M_PI * u[1]) *
+      n.jitterNs);
+}
+
+static void null_wavWrite32(uint32_t value)
+{
+  fwrite(&value, sizeof(value), 1, n.wav);
+}
+
+static void null_wavWrite16(uint16_t value)
+{
+  fwrite(&value, sizeof(value), 1, n.wav);
+}
+
+static void null_wavOpen(void)
+{
+  if (!n.wavFile || !*n.wavFile)
+    return;
+
+  n.wav = fopen(n.wavFile, "wb");
+  if (!n.wav)
+  {
+    DEBUG_ERROR("Failed to open %s", n.wavFile);
+    return;
+  }
+
+  // IEEE float PCM, the sizes are filled in when the file is closed
+  const int stride = n.channels * sizeof(float);
+  fwrite("RIFF", 4, 1, n.wav);
+  null_wavWrite32(0);
+  fwrite("WAVEfmt ", 8, 1, n.wav);
+  null_wavWrite32(16);
+  null_wavWrite16(3);
+  null_wavWrite16(n.channels);
+  null_wavWrite32(n.sampleRate);
+  null_wavWrite32(n.sampleRate * stride);
+  null_wavWrite16(stride);
+  null_wavWrite16(32);
+  fwrite("data", 4, 1, n.wav);
+  null_wavWrite32(0);
+  n.wavBytes = 0;
+}
+
+static void null_wavClose(void)
+{
+  if (!n.wav)
+    return;
+
+  fseek(n.wav, 4, SEEK_SET);
+  null_wavWrite32(36 + n.wavBytes);
+  fseek(n.wav, 40, SEEK_SET);
+  null_wavWrite32(n.wavBytes);
+  fclose(n.wav);
+  n.wav = NULL;
+}
+
+static void null_printStats(void)
+{
+  if (!n.periods)
+    return;
+
+  DEBUG_INFO("Played %" PRIu64 " periods, %" PRIu64 " short, "
+      "%" PRIu64 " underruns", n.periods, n.shortPeriods, n.underruns);
+  n.periods = n.shortPeriods = n.underruns = 0;
+}
+
+// called with the lock held, returns when the next period should be pulled
+static uint64_t null_tick(uint64_t now)
+{
+  if (!n.running)
+  {
+    n.running   = true;
+    n.startTime = now;
+    n.written   = 0;
+  }
+  else if (null_framesAt(now) > n.written)
+  {
+    // the DAC ran dry, it stalls until it is fed again
+    ++n.underruns;
+    n.startTime = now - (null_timeAt(n.written) - n.startTime);
+  }
+
+  const int frames = n.periodFrames;
+  int pulled = n.pullFn((uint8_t *)n.buffer, frames);
+  if (pulled < frames)
+  {
+    ++n.shortPeriods;
+    memset(n.buffer + pulled * n.channels, 0,
+        (frames - pulled) * n.channels * sizeof(float));
+  }
+
+  ++n.periods;
+  n.written += frames;
+
+  if (n.wav)
+  {
+    const size_t bytes = frames * n.channels * sizeof(float);
+    fwrite(n.buffer, bytes, 1, n.wav);
+    n.wavBytes += bytes;
+  }
+
+  // the next period is requested once only one period remains queued
+  return null_timeAt(n.written - frames) + (uint64_t)null_jitter();
+}
+
+static int null_thread(void * opaque)
+{
+  inDeviceThread = true;
+
+  // request the most precise wakeups the kernel can provide
+  prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+
+  while(atomic_load(&n.state) != NULL_STATE_QUIT)
+  {
+    if (atomic_load(&n.state) != NULL_STATE_RUN)
+    {
+      lgWaitEvent(n.wakeup, TIMEOUT_INFINITE);
+      continue;
+    }
+
+    LG_LOCK(n.lock);
+    uint64_t next = 0;
+    if (atomic_load(&n.state) == NULL_STATE_RUN)
+      next = null_tick(null_clock());
+    LG_UNLOCK(n.lock);
+
+    if (!next)
+      continue;
+
+    struct timespec ts =
+    {
+      .tv_sec  = next / 1000000000ULL,
+      .tv_nsec = next % 1000000000ULL
+    };
+    int ret;
+    while((ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+        == EINTR) {}
+
+    if (ret != 0)
+    {
+      DEBUG_ERROR("clock_nanosleep failed: %s", strerror(ret));
+      break;
+    }
+  }
+
+  return 0;
+}
+
+static void null_earlyInit(void)
+{
+  option_register(null_options);
+}
+
+static bool null_init(void)
+{
+  if (!option_get_bool("null", "enable"))
+    return false;
+
+  n.period   = option_get_int  ("null", "period" );
+  n.jitterNs = option_get_float("null", "jitter" ) * 1e6;
+  n.drift    = option_get_float("null", "drift"  );
+  n.wavFile  = option_get_string("null", "wavFile");
+  n.rng      = 0x9E3779B97F4A7C15ULL;
+
+  if (n.period < 0)
+  {
+    DEBUG_ERROR("Invalid period: %d", n.period);
+    return false;
+  }
+
+  LG_LOCK_INIT(n.lock);
+  atomic_store(&n.state, NULL_STATE_IDLE);
+
+  n.wakeup = lgCreateEvent(true, 0);
+  if (!n.wakeup)
+  {
+    DEBUG_ERROR("Failed to create the wakeup event");
+    return false;
+  }
+
+  if (!lgCreateThread("nullAudio", null_thread, NULL, &n.thread))
+  {
+    DEBUG_ERROR("Failed to create the device thread");
+    lgFreeEvent(n.wakeup);
+    n.wakeup = NULL;
+    return false;
+  }
+
+  return true;
+}
+
+static void null_free(void)
+{
+  atomic_store(&n.state, NULL_STATE_QUIT);
+  lgSignalEvent(n.wakeup);
+  lgJoinThread(n.thread, NULL);
+  n.thread = NULL;
+
+  lgFreeEvent(n.wakeup);
+  n.wakeup = NULL;
+
+  null_printStats();
+  null_wavClose();
+  free(n.buffer);
+  n.buffer = NULL;
+  LG_LOCK_FREE(n.lock);
+}
+
+static void null_setup(int channels, int sampleRate, int requestedPeriodFrames,
+    int * maxPeriodFrames, int * startFrames, LG_AudioPullFn pullFn)
+{
+  const int periodFrames = n.period ? n.period : requestedPeriodFrames;
+
+  LG_LOCK(n.lock);
+  if (n.buffer && n.channels == channels && n.sampleRate == sampleRate)
+  {
+    *maxPeriodFrames = n.periodFrames;
+    *startFrames     = n.periodFrames * 2;
+    LG_UNLOCK(n.lock);
+    return;
+  }
+
+  float * buffer = realloc(n.buffer, periodFrames * channels * sizeof(float));
+  if (!buffer)
+  {
+    DEBUG_ERROR("Out of memory");
+    LG_UNLOCK(n.lock);
+    return;
+  }
+
+  null_wavClose();
+
+  n.buffer       = buffer;
+  n.channels     = channels;
+  n.sampleRate   = sampleRate;
+  n.periodFrames = periodFrames;
+  n.pullFn       = pullFn;
+  n.running      = false;
+
+  null_wavOpen();
+  LG_UNLOCK(n.lock);
+
+  *maxPeriodFrames = periodFrames;
+  *startFrames     = periodFrames * 2;
+}
+
+static void null_start(void)
+{
+  if (!n.buffer)
+    return;
+
+  atomic_store(&n.state, NULL_STATE_RUN);
+  lgSignalEvent(n.wakeup);
+}
+
+static void null_stop(void)
+{
+  if (inDeviceThread)
+  {
+    atomic_store(&n.state, NULL_STATE_IDLE);
+    n.running = false;
+    return;
+  }
+
+  // wait for any period in progress so the pull function is not called again
+  LG_LOCK(n.lock);
+  atomic_store(&n.state, NULL_STATE_IDLE);
+  n.running = false;
+  null_printStats();
+  LG_UNLOCK(n.lock);
+}
+
+static uint64_t null_latency(void)
+{
+  LG_LOCK(n.lock);
+  uint64_t latency = 0;
+  if (n.running)
+  {
+    const uint64_t played = null_framesAt(null_clock());
+    if (played < n.written)
+      latency = n.written - played;
+  }
+  LG_UNLOCK(n.lock);
+  return latency;
+}
+
+struct LG_AudioDevOps LGAD_Null =
+{
+  .name      = "Null",
+  .earlyInit = null_earlyInit,
+  .init      = null_init,
+  .free      = null_free,
+  .playback  =
+  {
+    .setup   = null_setup,
+    .start   = null_start,
+    .stop    = null_stop,
+    .latency = null_latency
+  }
+};
@@ -0,0 +1,301 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/* A display server without a window or any input so the renderer can be
+ * benchmarked on a machine without a display, or a GPU when Mesa's llvmpipe
+ * is used. The renderer draws into an offscreen surface on the surfaceless
+ * EGL platform and the client feeds it synthetic frames instead of connecting
+ * to the guest, see bench.c. */
+
+#include "interface/displayserver.h"
+
+#include <unistd.h>
+
+#ifdef ENABLE_EGL
+#include <EGL/eglext.h>
+#include "egl_dynprocs.h"
+#endif
+
+#include "common/debug.h"
+#include "common/option.h"
+#include "common/types.h"
+#include "util.h"
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+struct Headless
+{
+  int w, h;
+};
+
+static struct Headless headless = { 0 };
+
+static struct Option headless_options[] =
+{
+  {
+    .module       = "headless",
+    .name         = "enable",
+    .description  = "Render offscreen without a window to benchmark the "
+                    "renderer",
+    .type         = OPTION_TYPE_BOOL,
+    .value.x_bool = false
+  },
+  {
+    .module       = "headless",
+    .name         = "frames",
+    .description  = "The number of frames to render before exiting",
+    .type         = OPTION_TYPE_INT,
+    .value.x_int  = 600
+  },
+  {
+    .module       = "headless",
+    .name         = "srcWidth",
+    .description  = "The width of the synthetic frames (0 = window width)",
+    .type         = OPTION_TYPE_INT,
+    .value.x_int  = 0
+  },
+  {
+    .module       = "headless",
+    .name         = "srcHeight",
+    .description  = "The height of the synthetic frames (0 = window height)",
+    .type         = OPTION_TYPE_INT,
+    .value.x_int  = 0
+  },
+  {
+    .module       = "headless",
+    .name         = "fullFrame",
+    .description  = "Damage the whole frame every time instead of a moving "
+                    "block",
+    .type         = OPTION_TYPE_BOOL,
+    .value.x_bool = false
+  },
+  {0}
+};
+
+static void headlessSetup(void)
+{
+  option_register(headless_options);
+}
+
+static bool headlessProbe(void)
+{
+  // never pick this over a real display unless asked to
+  return option_get_bool("headless", "enable");
+}
+
+static bool headlessEarlyInit(void)
+{
+  return true;
+}
+
+static bool headlessInit(const LG_DSInitParams params)
+{
+  if (params.opengl)
+  {
+    DEBUG_ERROR("Headless mode only supports the EGL renderer");
+    return false;
+  }
+
+  headless.w = params.w;
+  headless.h = params.h;
+  DEBUG_INFO("Headless: rendering offscreen at %dx%d", headless.w, headless.h);
+  return true;
+}
+
+static void headlessStartup(void)
+{
+}
+
+static void headlessShutdown(void)
+{
+}
+
+static void headlessFree(void)
+{
+}
+
+static bool headlessGetProp(LG_DSProperty prop, void * ret)
+{
+  switch(prop)
+  {
+    case LG_DS_WARP_SUPPORT:
+      *(enum LG_DSWarpSupport *)ret = LG_DS_WARP_NONE;
+      return true;
+
+    case LG_DS_OFFSCREEN:
+      *(struct Rect *)ret = (struct Rect) { .w = headless.w, .h = headless.h };
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+#ifdef ENABLE_EGL
+static EGLDisplay headlessGetEGLDisplay(void)
+{
+  const char * early_exts = eglQueryString(NULL, EGL_EXTENSIONS);
+  if (!util_hasGLExt(early_exts, "EGL_MESA_platform_surfaceless"))
+  {
+    DEBUG_ERROR("Headless mode requires EGL_MESA_platform_surfaceless");
+    return EGL_NO_DISPLAY;
+  }
+
+  if (util_hasGLExt(early_exts, "EGL_KHR_platform_base") &&
+      g_egl_dynProcs.eglGetPlatformDisplay)
+    return g_egl_dynProcs.eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+        EGL_DEFAULT_DISPLAY, NULL);
+
+  if (util_hasGLExt(early_exts, "EGL_EXT_platform_base") &&
+      g_egl_dynProcs.eglGetPlatformDisplayEXT)
+    return g_egl_dynProcs.eglGetPlatformDisplayEXT(
+        EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+
+  DEBUG_ERROR("eglGetPlatformDisplay is not available");
+  return EGL_NO_DISPLAY;
+}
+
+static EGLNativeWindowType headlessGetEGLNativeWindow(void)
+{
+  // the renderer creates a pbuffer instead, see LG_DS_OFFSCREEN
+  return (EGLNativeWindowType)0;
+}
+
+static void headlessEGLSwapBuffers(EGLDisplay display, EGLSurface surface,
+    const struct Rect * damage, int count)
+{
+  eglSwapBuffers(display, surface);
+
+  /* nothing presents the pbuffer, so wait for the frame to complete here or
+   * the driver would queue up frames and the timings would be meaningless */
+  eglWaitClient();
+}
+#endif
+
+#ifdef ENABLE_OPENGL
+static LG_DSGLContext headlessGLCreateContext(void)
+{
+  DEBUG_ERROR("Headless mode does not support OpenGL");
+  return NULL;
+}
+
+static void headlessGLDeleteContext(LG_DSGLContext context)
+{
+}
+
+static void headlessGLMakeCurrent(LG_DSGLContext context)
+{
+}
+
+static void headlessGLSetSwapInterval(int interval)
+{
+}
+
+static void headlessGLSwapBuffers(const struct Rect * damage, int count)
+{
+}
+#endif
+
+static void headlessGuestPointerUpdated(double x, double y, double localX,
+    double localY)
+{
+}
+
+static void headlessSetPointer(LG_DSPointer pointer)
+{
+}
+
+static void headlessNoop(void)
+{
+}
+
+static void headlessWarpPointer(int x, int y, bool exiting)
+{
+}
+
+static bool headlessIsValidPointerPos(int x, int y)
+{
+  return false;
+}
+
+static void headlessWait(unsigned int time)
+{
+  usleep(time * 1000U);
+}
+
+static void headlessSetWindowSize(int w, int h)
+{
+  // the pbuffer can not be resized
+}
+
+static bool headlessGetFullscreen(void)
+{
+  return false;
+}
+
+static void headlessSetFullscreen(bool fs)
+{
+}
+
+struct LG_DisplayServerOps LGDS_Headless =
+{
+  .name               = "Headless",
+  .setup              = headlessSetup,
+  .probe              = headlessProbe,
+  .earlyInit          = headlessEarlyInit,
+  .init               = headlessInit,
+  .startup            = headlessStartup,
+  .shutdown           = headlessShutdown,
+  .free               = headlessFree,
+  .getProp            = headlessGetProp,
+#ifdef ENABLE_EGL
+  .getEGLDisplay      = headlessGetEGLDisplay,
+  .getEGLNativeWindow = headlessGetEGLNativeWindow,
+  .eglSwapBuffers     = headlessEGLSwapBuffers,
+#endif
+#ifdef ENABLE_OPENGL
+  .glCreateContext    = headlessGLCreateContext,
+  .glDeleteContext    = headlessGLDeleteContext,
+  .glMakeCurrent      = headlessGLMakeCurrent,
+  .glSetSwapInterval  = headlessGLSetSwapInterval,
+  .glSwapBuffers      = headlessGLSwapBuffers,
+#endif
+  .guestPointerUpdated = headlessGuestPointerUpdated,
+  .setPointer          = headlessSetPointer,
+  .grabPointer         = headlessNoop,
+  .ungrabPointer       = headlessNoop,
+  .capturePointer      = headlessNoop,
+  .uncapturePointer    = headlessNoop,
+  .grabKeyboard        = headlessNoop,
+  .ungrabKeyboard      = headlessNoop,
+  .warpPointer         = headlessWarpPointer,
+  .realignPointer      = headlessNoop,
+  .isValidPointerPos   = headlessIsValidPointerPos,
+  .requestActivation   = headlessNoop,
+  .inhibitIdle         = headlessNoop,
+  .uninhibitIdle       = headlessNoop,
+  .wait                = headlessWait,
+  .setWindowSize       = headlessSetWindowSize,
+  .setFullscreen       = headlessSetFullscreen,
+  .getFullscreen       = headlessGetFullscreen,
+  .minimize            = headlessNoop
+};
@@ -219,8 +219,8 @@ void waylandGLSetSwapInterval(int interval)
   eglSwapInterval(wlWm.glDisplay, interval);
 }
 
-void waylandGLSwapBuffers(void)
+void waylandGLSwapBuffers(const struct Rect * damage, int count)
 {
-  waylandEGLSwapBuffers(wlWm.glDisplay, wlWm.glSurface, NULL, 0);
+  waylandEGLSwapBuffers(wlWm.glDisplay, wlWm.glSurface, damage, count);
 }
 #endif
@@ -28,13 +28,48 @@
 #include <wayland-client.h>
 
 #include "common/debug.h"
+#include "common/event.h"
 #include "common/time.h"
+#include "common/util.h"
 
 struct FrameData
 {
   struct timespec sent;
+  uint64_t        predicted;
 };
 
+static uint64_t tsToNs(const struct timespec * ts)
+{
+  return (uint64_t)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+static bool presentationNow(uint64_t * now)
+{
+  struct timespec ts;
+  if (clock_gettime(wlWm.clkId, &ts))
+  {
+    DEBUG_ERROR("clock_gettime failed: %s\n", strerror(errno));
+    return false;
+  }
+
+  *now = tsToNs(&ts);
+  return true;
+}
+
+// the first vblank at or after the given time, or 0 if it is not known
+static uint64_t predictVblank(uint64_t time)
+{
+  const uint64_t last    = atomic_load(&wlWm.pacing.lastVblank);
+  const uint32_t refresh = atomic_load(&wlWm.pacing.refresh);
+  if (!last || !refresh)
+    return 0;
+
+  if (time <= last)
+    return last;
+
+  return last + (time - last + refresh - 1) / refresh * refresh;
+}
+
 static void presentationClockId(void * data,
     struct wp_presentation * presentation, uint32_t clkId)
 {
@@ -64,6 +99,17 @@ static void presentationFeedbackPresented(void * opaque,
 
   tsDiff(&delta, &present, &data->sent);
   ringbuffer_push(wlWm.photonTimings, &(float){ delta.tv_sec + delta.tv_nsec * 1e-6f });
+
+  /* Only a fixed refresh rate can be predicted, the compositor reports zero
+   * when it is variable or unknown */
+  const uint64_t presented = tsToNs(&present);
+  atomic_store(&wlWm.pacing.lastVblank, presented);
+  atomic_store(&wlWm.pacing.refresh   , refresh  );
+
+  if (data->predicted)
+    ringbuffer_push(wlWm.pacing.errorTimings,
+        &(float){ ((int64_t)presented - (int64_t)data->predicted) * 1e-6f });
+
   free(data);
   wp_presentation_feedback_destroy(feedback);
 }
@@ -88,6 +134,9 @@ bool waylandPresentationInit(void)
     wlWm.photonTimings = ringbuffer_new(256, sizeof(float));
     wlWm.photonGraph   = app_registerGraph("PHOTON", wlWm.photonTimings,
         0.0f, 30.0f, NULL);
+    wlWm.pacing.errorTimings = ringbuffer_new(256, sizeof(float));
+    wlWm.pacing.errorGraph   = app_registerGraph("PRESENT ERR",
+        wlWm.pacing.errorTimings, -5.0f, 20.0f, NULL);
     wp_presentation_add_listener(wlWm.presentation, &presentationListener, NULL);
   }
   return true;
@@ -101,6 +150,42 @@ void waylandPresentationFree(void)
   wp_presentation_destroy(wlWm.presentation);
   app_unregisterGraph(wlWm.photonGraph);
   ringbuffer_free(&wlWm.photonTimings);
+  app_unregisterGraph(wlWm.pacing.errorGraph);
+  ringbuffer_free(&wlWm.pacing.errorTimings);
+}
+
+void waylandPresentationWait(void)
+{
+  if (!wlWm.presentation)
+    return;
+
+  uint64_t now;
+  if (!presentationNow(&now))
+    return;
+
+  wlWm.pacing.target      = 0;
+  wlWm.pacing.renderStart = now;
+  if (!wlWm.pacing.latchMargin)
+    return;
+
+  /* Aim for the first vblank we can still make and sleep until just before
+   * the compositor latches for it, so that the newest guest frame is the one
+   * rendered. Waking early is cheap, missing the latch costs a whole refresh,
+   * so the render time estimate follows spikes immediately. */
+  const uint64_t lead = wlWm.pacing.latchMargin +
+    (uint64_t)wlWm.pacing.renderEstimate;
+  const uint64_t target = predictVblank(now + lead);
+  if (!target)
+    return;
+
+  wlWm.pacing.target = target;
+  const uint64_t wake = target - lead;
+  if (wake <= now)
+    return;
+
+  // stopWaitFrame signals the frame event to cut the wait short
+  lgWaitEventNS(wlWm.frameEvent, wake - now);
+  presentationNow(&wlWm.pacing.renderStart);
 }
 
 void waylandPresentationFrame(void)
@@ -122,6 +207,21 @@ void waylandPresentationFrame(void)
     return;
   }
 
+  const uint64_t sent = tsToNs(&data->sent);
+  if (wlWm.pacing.renderStart)
+  {
+    const double duration = sent - wlWm.pacing.renderStart;
+    if (duration > wlWm.pacing.renderEstimate)
+      wlWm.pacing.renderEstimate = duration;
+    else
+      wlWm.pacing.renderEstimate +=
+        (duration - wlWm.pacing.renderEstimate) * 0.05;
+    wlWm.pacing.renderStart = 0;
+  }
+
+  data->predicted = wlWm.pacing.target ? wlWm.pacing.target :
+    predictVblank(sent + wlWm.pacing.latchMargin);
+
   struct wp_presentation_feedback * feedback = wp_presentation_feedback(wlWm.presentation, wlWm.surface);
   wp_presentation_feedback_add_listener(feedback, &presentationFeedbackListener, data);
 }
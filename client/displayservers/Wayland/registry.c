@@ -68,6 +68,11 @@ static void registryGlobalHandler(void * data, struct wl_registry * registry,
   else if (!strcmp(interface, xdg_activation_v1_interface.name))
     wlWm.xdgActivation = wl_registry_bind(wlWm.registry, name,
         &xdg_activation_v1_interface, 1);
+  else if (!strcmp(interface, wl_subcompositor_interface.name))
+    wlWm.scanout.subcompositor = wl_registry_bind(wlWm.registry, name,
+        &wl_subcompositor_interface, 1);
+  else if (!strcmp(interface, zwp_linux_dmabuf_v1_interface.name))
+    waylandScanoutBind(name, version);
   else if (wlWm.desktop->registryGlobalHandler(
         data, registry, name, interface, version))
     return;
@@ -0,0 +1,292 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "wayland.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <wayland-client.h>
+
+#include "common/debug.h"
+
+// the kvmfr buffers are plain linear memory
+#define MODIFIER_LINEAR 0
+
+static void dmabufFormat(void * data, struct zwp_linux_dmabuf_v1 * dmabuf,
+    uint32_t format)
+{
+  // superseded by the modifier event in v3
+}
+
+static void dmabufModifier(void * data, struct zwp_linux_dmabuf_v1 * dmabuf,
+    uint32_t format, uint32_t modifierHi, uint32_t modifierLo)
+{
+  const uint64_t modifier = ((uint64_t)modifierHi << 32) | modifierLo;
+  if (modifier != MODIFIER_LINEAR)
+    return;
+
+  for (int i = 0; i < wlWm.scanout.formatCount; ++i)
+    if (wlWm.scanout.formats[i] == format)
+      return;
+
+  if (wlWm.scanout.formatCount < SCANOUT_MAX_FORMATS)
+    wlWm.scanout.formats[wlWm.scanout.formatCount++] = format;
+}
+
+static const struct zwp_linux_dmabuf_v1_listener dmabufListener = {
+  .format   = dmabufFormat,
+  .modifier = dmabufModifier,
+};
+
+void waylandScanoutBind(uint32_t name, uint32_t version)
+{
+  // the modifier event is needed to know linear buffers are accepted
+  if (version < 3)
+    return;
+
+  wlWm.scanout.linuxDmabuf = wl_registry_bind(wlWm.registry, name,
+      &zwp_linux_dmabuf_v1_interface, 3);
+  zwp_linux_dmabuf_v1_add_listener(wlWm.scanout.linuxDmabuf,
+      &dmabufListener, NULL);
+}
+
+bool waylandScanoutInit(void)
+{
+  LG_LOCK_INIT(wlWm.scanout.lock);
+
+  if (!wlWm.scanout.linuxDmabuf || !wlWm.scanout.subcompositor ||
+      !wlWm.viewporter)
+  {
+    DEBUG_INFO("Direct scanout: not supported, needs zwp_linux_dmabuf_v1 v3, "
+        "wl_subcompositor and wp_viewporter");
+    return true;
+  }
+
+  // collect the supported formats
+  wl_display_roundtrip(wlWm.display);
+  if (!wlWm.scanout.formatCount)
+  {
+    DEBUG_INFO("Direct scanout: not supported, no linear formats");
+    return true;
+  }
+
+  wlWm.scanout.surface = wl_compositor_create_surface(wlWm.compositor);
+  if (!wlWm.scanout.surface)
+  {
+    DEBUG_ERROR("Failed to create the scanout surface");
+    return false;
+  }
+
+  wlWm.scanout.subsurface = wl_subcompositor_get_subsurface(
+      wlWm.scanout.subcompositor, wlWm.scanout.surface, wlWm.surface);
+  if (!wlWm.scanout.subsurface)
+  {
+    DEBUG_ERROR("Failed to create the scanout subsurface");
+    return false;
+  }
+
+  // frames are shown as they arrive, not with the next commit of the window
+  wl_subsurface_set_desync(wlWm.scanout.subsurface);
+
+  wlWm.scanout.viewport = wp_viewporter_get_viewport(wlWm.viewporter,
+      wlWm.scanout.surface);
+
+  // let all input fall through to the window below
+  struct wl_region * region = wl_compositor_create_region(wlWm.compositor);
+  wl_surface_set_input_region(wlWm.scanout.surface, region);
+  wl_region_destroy(region);
+  wl_surface_commit(wlWm.scanout.surface);
+
+  return true;
+}
+
+static void freeBuffers(void)
+{
+  for (int i = 0; i < wlWm.scanout.bufferCount; ++i)
+    wl_buffer_destroy(wlWm.scanout.buffers[i].buffer);
+  wlWm.scanout.bufferCount = 0;
+  wlWm.scanout.nextBuffer  = 0;
+}
+
+void waylandScanoutFree(void)
+{
+  freeBuffers();
+
+  if (wlWm.scanout.viewport)
+    wp_viewport_destroy(wlWm.scanout.viewport);
+
+  if (wlWm.scanout.subsurface)
+    wl_subsurface_destroy(wlWm.scanout.subsurface);
+
+  if (wlWm.scanout.surface)
+    wl_surface_destroy(wlWm.scanout.surface);
+
+  if (wlWm.scanout.linuxDmabuf)
+    zwp_linux_dmabuf_v1_destroy(wlWm.scanout.linuxDmabuf);
+
+  if (wlWm.scanout.subcompositor)
+    wl_subcompositor_destroy(wlWm.scanout.subcompositor);
+
+  LG_LOCK_FREE(wlWm.scanout.lock);
+}
+
+static bool formatSupported(const LG_DSDMABuf * dmabuf)
+{
+  if (dmabuf->modifier != MODIFIER_LINEAR)
+    return false;
+
+  for (int i = 0; i < wlWm.scanout.formatCount; ++i)
+    if (wlWm.scanout.formats[i] == dmabuf->fourcc)
+      return true;
+
+  return false;
+}
+
+/* the frame buffers are reused in turn, keep a wl_buffer for each one. The
+ * descriptors are reopened when the format changes, as is the whole cache. */
+static struct wl_buffer * getBuffer(const LG_DSDMABuf * dmabuf)
+{
+  for (int i = 0; i < wlWm.scanout.bufferCount; ++i)
+  {
+    struct ScanoutBuffer * buf = wlWm.scanout.buffers + i;
+    if (buf->fourcc != dmabuf->fourcc ||
+        buf->width  != dmabuf->width  ||
+        buf->height != dmabuf->height ||
+        buf->pitch  != dmabuf->pitch)
+    {
+      freeBuffers();
+      break;
+    }
+
+    if (buf->fd == dmabuf->fd)
+      return buf->buffer;
+  }
+
+  struct zwp_linux_buffer_params_v1 * params =
+    zwp_linux_dmabuf_v1_create_params(wlWm.scanout.linuxDmabuf);
+  if (!params)
+  {
+    DEBUG_ERROR("Failed to create the DMABUF parameters");
+    return NULL;
+  }
+
+  zwp_linux_buffer_params_v1_add(params, dmabuf->fd, 0, 0, dmabuf->pitch,
+      dmabuf->modifier >> 32, dmabuf->modifier & 0xffffffff);
+
+  struct wl_buffer * buffer = zwp_linux_buffer_params_v1_create_immed(params,
+      dmabuf->width, dmabuf->height, dmabuf->fourcc, 0);
+  zwp_linux_buffer_params_v1_destroy(params);
+
+  if (!buffer)
+  {
+    DEBUG_ERROR("Failed to create the DMABUF wl_buffer");
+    return NULL;
+  }
+
+  struct ScanoutBuffer * buf;
+  if (wlWm.scanout.bufferCount < SCANOUT_MAX_BUFFERS)
+    buf = wlWm.scanout.buffers + wlWm.scanout.bufferCount++;
+  else
+  {
+    buf = wlWm.scanout.buffers + wlWm.scanout.nextBuffer;
+    wlWm.scanout.nextBuffer =
+      (wlWm.scanout.nextBuffer + 1) % SCANOUT_MAX_BUFFERS;
+    wl_buffer_destroy(buf->buffer);
+  }
+
+  *buf = (struct ScanoutBuffer) {
+    .fd     = dmabuf->fd,
+    .fourcc = dmabuf->fourcc,
+    .width  = dmabuf->width,
+    .height = dmabuf->height,
+    .pitch  = dmabuf->pitch,
+    .buffer = buffer,
+  };
+
+  return buffer;
+}
+
+bool waylandScanoutFrame(const LG_DSDMABuf * dmabuf, const struct Rect * dest)
+{
+  if (!wlWm.scanout.surface || !formatSupported(dmabuf) ||
+      dest->w <= 0 || dest->h <= 0)
+    return false;
+
+  bool ret = false;
+  LG_LOCK(wlWm.scanout.lock);
+
+  struct wl_buffer * buffer = getBuffer(dmabuf);
+  if (!buffer)
+    goto out;
+
+  if (!wlWm.scanout.visible ||
+      wlWm.scanout.dest.x != dest->x || wlWm.scanout.dest.y != dest->y ||
+      wlWm.scanout.dest.w != dest->w || wlWm.scanout.dest.h != dest->h)
+  {
+    // the position is applied with the next commit of the window
+    wl_subsurface_set_position(wlWm.scanout.subsurface, dest->x, dest->y);
+    wp_viewport_set_destination(wlWm.scanout.viewport, dest->w, dest->h);
+
+    struct wl_region * region = wl_compositor_create_region(wlWm.compositor);
+    wl_region_add(region, 0, 0, dest->w, dest->h);
+    wl_surface_set_opaque_region(wlWm.scanout.surface, region);
+    wl_region_destroy(region);
+
+    wlWm.scanout.dest = *dest;
+  }
+
+  if (!wlWm.scanout.visible ||
+      wlWm.scanout.srcWidth  != dmabuf->srcWidth ||
+      wlWm.scanout.srcHeight != dmabuf->srcHeight)
+  {
+    wp_viewport_set_source(wlWm.scanout.viewport, 0, 0,
+        wl_fixed_from_int(dmabuf->srcWidth),
+        wl_fixed_from_int(dmabuf->srcHeight));
+
+    wlWm.scanout.srcWidth  = dmabuf->srcWidth;
+    wlWm.scanout.srcHeight = dmabuf->srcHeight;
+  }
+
+  wl_surface_attach(wlWm.scanout.surface, buffer, 0, 0);
+  wl_surface_damage(wlWm.scanout.surface, 0, 0, INT32_MAX, INT32_MAX);
+  wl_surface_commit(wlWm.scanout.surface);
+  wl_display_flush(wlWm.display);
+
+  wlWm.scanout.visible = true;
+  ret = true;
+
+out:
+  LG_UNLOCK(wlWm.scanout.lock);
+  return ret;
+}
+
+void waylandScanoutStop(void)
+{
+  LG_LOCK(wlWm.scanout.lock);
+  if (wlWm.scanout.visible)
+  {
+    wl_surface_attach(wlWm.scanout.surface, NULL, 0, 0);
+    wl_surface_commit(wlWm.scanout.surface);
+    wl_display_flush(wlWm.display);
+    wlWm.scanout.visible = false;
+  }
+  LG_UNLOCK(wlWm.scanout.lock);
+}
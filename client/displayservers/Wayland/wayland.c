@@ -28,6 +28,7 @@
 
 #include "common/debug.h"
 #include "common/option.h"
+#include "common/util.h"
 
 #include "dynamic/wayland_desktops.h"
 
@@ -47,6 +48,13 @@ static struct Option waylandOptions[] =
     .type         = OPTION_TYPE_BOOL,
     .value.x_bool = true,
   },
+  {
+    .module        = "wayland",
+    .name          = "latchMargin",
+    .description   = "Time in ms the compositor needs a frame before vblank for JIT render pacing (0 = disable)",
+    .type          = OPTION_TYPE_FLOAT,
+    .value.x_float = 2.0f,
+  },
   {0}
 };
 
@@ -133,6 +141,8 @@ static bool waylandInit(const LG_DSInitParams params)
 
   wlWm.warpSupport        = option_get_bool("wayland", "warpSupport");
   wlWm.useFractionalScale = option_get_bool("wayland", "fractionScale");
+  wlWm.pacing.latchMargin =
+    max(option_get_float("wayland", "latchMargin"), 0.0f) * 1e6;
 
   if (!waylandPollInit())
     return false;
@@ -166,6 +176,9 @@ static bool waylandInit(const LG_DSInitParams params)
   if (!waylandEGLInit(params.w, params.h))
     return false;
 
+  if (!waylandScanoutInit())
+    return false;
+
 #ifdef ENABLE_OPENGL
   if (params.opengl && !waylandOpenGLInit())
     return false;
@@ -185,6 +198,7 @@ static void waylandShutdown(void)
 static void waylandFree(void)
 {
   waylandIdleFree();
+  waylandScanoutFree();
   waylandWindowFree();
   waylandPresentationFree();
   waylandInputFree();
@@ -238,6 +252,8 @@ struct LG_DisplayServerOps LGDS_Wayland =
   .shutdown            = waylandShutdown,
   .free                = waylandFree,
   .getProp             = waylandGetProp,
+  .scanoutFrame        = waylandScanoutFrame,
+  .scanoutStop         = waylandScanoutStop,
 
 #ifdef ENABLE_EGL
   .getEGLDisplay       = waylandGetEGLDisplay,
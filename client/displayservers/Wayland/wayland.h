@@ -47,6 +47,10 @@
 #include "wayland-idle-inhibit-unstable-v1-client-protocol.h"
 #include "wayland-xdg-output-unstable-v1-client-protocol.h"
 #include "wayland-xdg-activation-v1-client-protocol.h"
+#include "wayland-linux-dmabuf-unstable-v1-client-protocol.h"
+
+#define SCANOUT_MAX_FORMATS 16
+#define SCANOUT_MAX_BUFFERS 8
 
 typedef void (*WaylandPollCallback)(uint32_t events, void * opaque);
 
@@ -75,6 +79,14 @@ struct WaylandOutput
   struct wl_list link;
 };
 
+struct ScanoutBuffer
+{
+  int      fd;
+  uint32_t fourcc;
+  int      width, height, pitch;
+  struct wl_buffer * buffer;
+};
+
 struct SurfaceOutput
 {
   struct wl_output * output;
@@ -131,6 +143,46 @@ struct WaylandDSState
   RingBuffer photonTimings;
   GraphHandle photonGraph;
 
+  /* JIT render pacing, the vblank model is updated from the Wayland thread
+   * and the rest belongs to the render thread. Times are in clkId ns. */
+  struct
+  {
+    _Atomic(uint64_t) lastVblank;
+    _Atomic(uint32_t) refresh;
+    uint64_t          latchMargin;
+    uint64_t          target;
+    uint64_t          renderStart;
+    double            renderEstimate;
+    RingBuffer        errorTimings;
+    GraphHandle       errorGraph;
+  }
+  pacing;
+
+  /* direct scanout of DMABUF frames on a subsurface, the buffers are created
+   * and shown from the frame thread */
+  struct
+  {
+    struct wl_subcompositor    * subcompositor;
+    struct zwp_linux_dmabuf_v1 * linuxDmabuf;
+    struct wl_surface          * surface;
+    struct wl_subsurface       * subsurface;
+    struct wp_viewport         * viewport;
+
+    // formats the compositor accepts with a linear modifier
+    uint32_t formats[SCANOUT_MAX_FORMATS];
+    int      formatCount;
+
+    struct ScanoutBuffer buffers[SCANOUT_MAX_BUFFERS];
+    int                  bufferCount;
+    int                  nextBuffer;
+
+    bool        visible;
+    struct Rect dest;
+    int         srcWidth, srcHeight;
+    LG_Lock     lock;
+  }
+  scanout;
+
   const char             * cursorThemeName;
   int                      cursorSize;
   int                      cursorScale;
@@ -256,7 +308,7 @@ LG_DSGLContext waylandGLCreateContext(void);
 void waylandGLDeleteContext(LG_DSGLContext context);
 void waylandGLMakeCurrent(LG_DSGLContext context);
 void waylandGLSetSwapInterval(int interval);
-void waylandGLSwapBuffers(void);
+void waylandGLSwapBuffers(const struct Rect * damage, int count);
 #endif
 
 // idle module
@@ -293,9 +345,17 @@ bool waylandPollUnregister(int fd);
 
 // presentation module
 bool waylandPresentationInit(void);
+void waylandPresentationWait(void);
 void waylandPresentationFrame(void);
 void waylandPresentationFree(void);
 
+// scanout module
+bool waylandScanoutInit(void);
+void waylandScanoutFree(void);
+void waylandScanoutBind(uint32_t name, uint32_t version);
+bool waylandScanoutFrame(const LG_DSDMABuf * buffer, const struct Rect * dest);
+void waylandScanoutStop(void);
+
 // registry module
 bool waylandRegistryInit(void);
 void waylandRegistryFree(void);
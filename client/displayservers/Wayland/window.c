@@ -151,6 +151,7 @@ static const struct wl_callback_listener frame_listener = {
 bool waylandWaitFrame(void)
 {
   lgWaitEvent(wlWm.frameEvent, TIMEOUT_INFINITE);
+  waylandPresentationWait();
 
   struct wl_callback * callback = wl_surface_frame(wlWm.surface);
   if (callback)
@@ -1557,8 +1557,9 @@ static void x11GLSetSwapInterval(int interval)
   glXSwapIntervalEXT(x11.display, x11.window, interval);
 }
 
-static void x11GLSwapBuffers(void)
+static void x11GLSwapBuffers(const struct Rect * damage, int count)
 {
+  // GLX has no way to pass damage to the compositor
   glXSwapBuffers(x11.display, x11.window);
 }
 #endif
@@ -71,6 +71,8 @@ void app_handleRenderEvent(const uint64_t timeUs);
 void app_setFullscreen(bool fs);
 bool app_getFullscreen(void);
 bool app_getProp(LG_DSProperty prop, void * ret);
+bool app_scanoutFrame(const LG_DSDMABuf * buffer, const struct Rect * dest);
+void app_scanoutStop(void);
 
 #ifdef ENABLE_EGL
 EGLDisplay app_getEGLDisplay(void);
@@ -83,7 +85,7 @@ LG_DSGLContext app_glCreateContext(void);
 void app_glDeleteContext(LG_DSGLContext context);
 void app_glMakeCurrent(LG_DSGLContext context);
 void app_glSetSwapInterval(int interval);
-void app_glSwapBuffers(void);
+void app_glSwapBuffers(const struct Rect * damage, int count);
 #endif
 
 #define MAX_OVERLAY_RECTS 10
@@ -26,6 +26,7 @@
 #include <EGL/eglext.h>
 #undef GL_KHR_debug
 #include <GLES3/gl3.h>
+#include <GLES3/gl31.h>
 #include <GLES2/gl2ext.h>
 
 struct EGLDynProcs
@@ -40,6 +41,15 @@ struct EGLDynProcs
   PFNGLBUFFERSTORAGEEXTPROC           glBufferStorageEXT;
   PFNEGLCREATEIMAGEPROC               eglCreateImage;
   PFNEGLDESTROYIMAGEPROC              eglDestroyImage;
+  PFNGLGENQUERIESEXTPROC              glGenQueriesEXT;
+  PFNGLDELETEQUERIESEXTPROC           glDeleteQueriesEXT;
+  PFNGLBEGINQUERYEXTPROC              glBeginQueryEXT;
+  PFNGLENDQUERYEXTPROC                glEndQueryEXT;
+  PFNGLGETQUERYOBJECTUIVEXTPROC       glGetQueryObjectuivEXT;
+  PFNGLGETQUERYOBJECTUI64VEXTPROC     glGetQueryObjectui64vEXT;
+  PFNGLDISPATCHCOMPUTEPROC            glDispatchCompute;
+  PFNGLBINDIMAGETEXTUREPROC           glBindImageTexture;
+  PFNGLMEMORYBARRIERPROC              glMemoryBarrier;
 };
 
 extern struct EGLDynProcs g_egl_dynProcs;
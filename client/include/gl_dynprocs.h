@@ -32,6 +32,8 @@ struct GLDynProcs
   PFNGLBUFFERDATAPROC     glBufferData;
   PFNGLBUFFERSUBDATAPROC  glBufferSubData;
   PFNGLDELETEBUFFERSPROC  glDeleteBuffers;
+  PFNGLMAPBUFFERRANGEPROC glMapBufferRange;
+  PFNGLUNMAPBUFFERPROC    glUnmapBuffer;
   PFNGLISSYNCPROC         glIsSync;
   PFNGLFENCESYNCPROC      glFenceSync;
   PFNGLCLIENTWAITSYNCPROC glClientWaitSync;
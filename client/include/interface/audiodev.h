@@ -62,7 +62,7 @@ struct LG_AudioDevOps
     /* [optional] called to set muting of the output */
     void (*mute)(bool mute);
 
-    /* return the current total playback latency in microseconds */
+    /* [optional] return the current total playback latency in frames */
     uint64_t (*latency)(void);
   }
   playback;
@@ -22,6 +22,7 @@
 #define _H_I_DISPLAYSERVER_
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <EGL/egl.h>
 #include "common/types.h"
 #include "common/debug.h"
@@ -53,6 +54,14 @@ typedef enum LG_DSProperty
    * return data type: bool
    */
   LG_DS_WARP_SUPPORT,
+
+  /**
+   * returns the size of the offscreen surface to render to, only implemented
+   * by display servers without a window
+   * if not implemented LG assumes the renderer draws to the native window
+   * return data type: struct Rect (only w & h are used)
+   */
+  LG_DS_OFFSCREEN,
 }
 LG_DSProperty;
 
@@ -108,6 +117,17 @@ typedef void (* LG_ClipboardReplyFn)(void * opaque, const LG_ClipboardData type,
 typedef struct LG_DSGLContext
   * LG_DSGLContext;
 
+typedef struct LG_DSDMABuf
+{
+  int      fd;
+  uint32_t fourcc;            // DRM format of the pixel data
+  uint64_t modifier;          // DRM format modifier
+  int      width, height;     // the size of the buffer in pixels
+  int      pitch;             // the length of a row in bytes
+  int      srcWidth, srcHeight; // the area of the buffer holding the image
+}
+LG_DSDMABuf;
+
 typedef struct LGEvent LGEvent;
 
 struct LG_DisplayServerOps
@@ -155,9 +175,23 @@ struct LG_DisplayServerOps
   void (*glDeleteContext)(LG_DSGLContext context);
   void (*glMakeCurrent)(LG_DSGLContext context);
   void (*glSetSwapInterval)(int interval);
-  void (*glSwapBuffers)(void);
+
+  /* damage is in window coordinates with the origin at the bottom left, a
+   * count of zero damages the entire window. Platforms that can not pass
+   * damage to the compositor must ignore it and perform a full swap. */
+  void (*glSwapBuffers)(const struct Rect * damage, int count);
 #endif
 
+  /* Optional direct scanout. Shows the buffer on a surface of its own above the
+   * window at dest (window coordinates, origin top left) so the compositor
+   * can put it on a plane without the renderer copying it. Called from the
+   * frame thread for every frame while active, returns false if the buffer
+   * can not be shown this way and the renderer must draw it itself. */
+  bool (*scanoutFrame)(const LG_DSDMABuf * buffer, const struct Rect * dest);
+
+  /* hide the buffer shown by scanoutFrame */
+  void (*scanoutStop)(void);
+
   /* Waits for a good time to render the next frame in time for the next vblank.
    * This is optional and a display server may choose to not implement it.
    *
@@ -247,6 +281,7 @@ struct LG_DisplayServerOps
   ASSERT_OPENGL_FN((x)->glSetSwapInterval); \
   ASSERT_OPENGL_FN((x)->glSwapBuffers    ); \
   DEBUG_ASSERT(!(x)->waitFrame == !(x)->stopWaitFrame); \
+  DEBUG_ASSERT(!(x)->scanoutFrame == !(x)->scanoutStop); \
   DEBUG_ASSERT((x)->guestPointerUpdated); \
   DEBUG_ASSERT((x)->setPointer         ); \
   DEBUG_ASSERT((x)->grabPointer        ); \
@@ -49,6 +49,12 @@ struct LG_OverlayOps
    * optional, if omitted assumes false */
   bool (*needs_overlay)(void * udata);
 
+  /* return true if the output of `render` only changes when the overlay calls
+   * `app_invalidateOverlay` or its `tick` returns true, so the last frame can
+   * be reused while nothing else is shown
+   * optional, if omitted assumes false */
+  bool (*is_static)(void * udata);
+
   /* perform the actual drawing/rendering
    *
    * `interactive` is true if the application is currently in overlay interaction
@@ -74,6 +80,11 @@ struct LG_OverlayOps
    */
   bool (*tick)(void * udata, unsigned long long tickCount);
 
+  /* return true while the overlay is animating and `tick` needs to be called,
+   * this is checked after each tick and after `app_invalidateOverlay`
+   * optional, if omitted assumes true when `tick` is set */
+  bool (*needs_tick)(void * udata);
+
   /* TODO: add load/save settings capabillity */
 };
 
@@ -187,12 +187,23 @@ typedef struct LG_RendererOps
   /* setup the spice display */
   void (*spiceConfigure)(LG_Renderer * renderer, int width, int height);
 
-  /* draw a filled rect on the spice display with the specified color */
-  void (*spiceDrawFill)(LG_Renderer * renderer, int x, int y, int width,
+  /* [optional] returns true if spiceDrawFill and spiceDrawBitmap may be called
+   * from the spice thread until the next spiceConfigure, the draws are then
+   * made directly instead of being copied through the render queue
+   * Context: renderThread */
+  bool (*spiceDirect)(LG_Renderer * renderer);
+
+  /* draw a filled rect on the spice display with the specified color, returns
+   * false if it can not be drawn from the spice thread right now and must be
+   * queued instead
+   * Context: renderThread, or spiceThread if spiceDirect returned true */
+  bool (*spiceDrawFill)(LG_Renderer * renderer, int x, int y, int width,
       int height, uint32_t color);
 
-  /* draw an image on the spice display, data is RGBA32 */
-  void (*spiceDrawBitmap)(LG_Renderer * renderer, int x, int y, int width,
+  /* draw an image on the spice display, data is RGBA32, returns false as for
+   * spiceDrawFill
+   * Context: renderThread, or spiceThread if spiceDirect returned true */
+  bool (*spiceDrawBitmap)(LG_Renderer * renderer, int x, int y, int width,
       int height, int stride, uint8_t * data, bool topDown);
 
   /* show the spice display */
@@ -0,0 +1,103 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "compute.h"
+
+#include "common/debug.h"
+#include "egl_dynprocs.h"
+
+static bool l_supported = false;
+
+void egl_computeSetup(int esMajor, int esMinor, bool enable)
+{
+  l_supported = false;
+  if (!enable)
+  {
+    DEBUG_INFO("Compute filters disabled");
+    return;
+  }
+
+  if (esMajor < 3 || (esMajor == 3 && esMinor < 1) ||
+      !g_egl_dynProcs.glDispatchCompute  ||
+      !g_egl_dynProcs.glBindImageTexture ||
+      !g_egl_dynProcs.glMemoryBarrier)
+  {
+    DEBUG_INFO("Compute filters unavailable, OpenGL ES 3.1 is required");
+    return;
+  }
+
+  DEBUG_INFO("Compute filters enabled");
+  l_supported = true;
+}
+
+bool egl_computeSupported(void)
+{
+  return l_supported;
+}
+
+const char * egl_computeImageLayout(enum EGL_PixelFormat pixFmt)
+{
+  return egl_texUtilImageFormat(pixFmt) == GL_RGBA16F ? "rgba16f" : "rgba8";
+}
+
+void egl_computeBindImage(EGL_Texture * image)
+{
+  GLuint tex;
+  EGL_PixelFormat pixFmt;
+  egl_textureGet(image, &tex, NULL, NULL, &pixFmt);
+  g_egl_dynProcs.glBindImageTexture(0, tex, 0, GL_FALSE, 0, GL_WRITE_ONLY,
+      egl_texUtilImageFormat(pixFmt));
+}
+
+static void dispatchArea(GLint offset, int x, int y, int width, int height)
+{
+  if (width <= 0 || height <= 0)
+    return;
+
+  glUniform2i(offset, x, y);
+  g_egl_dynProcs.glDispatchCompute(
+    (width  + EGL_COMPUTE_GROUP_SIZE - 1) / EGL_COMPUTE_GROUP_SIZE,
+    (height + EGL_COMPUTE_GROUP_SIZE - 1) / EGL_COMPUTE_GROUP_SIZE,
+    1);
+}
+
+void egl_computeDispatch(EGL_Shader * shader, const EGL_FilterRects * rects,
+    unsigned int width, unsigned int height)
+{
+  const GLint offset = egl_shaderGetUniform(shader, "uOffset");
+
+  if (!rects->damage)
+    dispatchArea(offset, 0, 0, width, height);
+  else
+    for(int i = 0; i < rects->damage->count; ++i)
+    {
+      // scale the damage to output pixels, rounding outwards
+      const FrameDamageRect * rect = rects->damage->rects + i;
+      const uint64_t dw = rects->width;
+      const uint64_t dh = rects->height;
+      const int x1 = (uint64_t)rect->x * width  / dw;
+      const int y1 = (uint64_t)rect->y * height / dh;
+      const int x2 = ((uint64_t)(rect->x + rect->width ) * width  + dw - 1) / dw;
+      const int y2 = ((uint64_t)(rect->y + rect->height) * height + dh - 1) / dh;
+      dispatchArea(offset, x1, y1, x2 - x1, y2 - y1);
+    }
+
+  g_egl_dynProcs.glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
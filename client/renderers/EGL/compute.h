@@ -0,0 +1,54 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "filter.h"
+#include "texture.h"
+
+/* On OpenGL ES 3.1 and later filters may run as compute shaders, where each
+ * work group loads the area its output samples into shared memory once rather
+ * than every output pixel fetching all of its taps from the texture.
+ *
+ * A compute filter writes its output to an EGL_TEXTYPE_IMAGE texture bound
+ * with egl_computeBindImage and declared in the shader as
+ * layout(IMAGE_FORMAT, binding = 0) using the egl_computeImageLayout define. */
+
+// the work group size the compute shaders are built with
+#define EGL_COMPUTE_GROUP_SIZE 16
+
+/* must be called with the context current before any filter is set up */
+void egl_computeSetup(int esMajor, int esMinor, bool enable);
+
+/* true if filters should use their compute shader where they have one */
+bool egl_computeSupported(void);
+
+/* the GLSL image format qualifier matching egl_texUtilImageFormat */
+const char * egl_computeImageLayout(enum EGL_PixelFormat pixFmt);
+
+void egl_computeBindImage(EGL_Texture * image);
+
+/* runs the bound compute program over the area of the output covered by the
+ * damage in rects, the shader is given the origin of each dispatch in the
+ * uOffset uniform. Returns with the writes visible to texture fetches */
+void egl_computeDispatch(EGL_Shader * shader, const EGL_FilterRects * rects,
+    unsigned int width, unsigned int height);
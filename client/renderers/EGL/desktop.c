@@ -23,13 +23,19 @@
 #include "common/option.h"
 #include "common/locking.h"
 #include "common/array.h"
+#include "common/ringbuffer.h"
+#include "common/rects.h"
+#include "common/KVMFR.h"
 
 #include "app.h"
 #include "texture.h"
 #include "shader.h"
+#include "framebuffer.h"
+#include "gpu_timer.h"
 #include "desktop_rects.h"
 #include "cimgui.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -37,6 +43,7 @@
 #include "desktop.vert.h"
 #include "desktop_rgb.frag.h"
 #include "desktop_rgb.def.h"
+#include "desktop_cache.frag.h"
 
 #include "postprocess.h"
 #include "filters.h"
@@ -56,6 +63,22 @@ struct DesktopShader
   GLint uMapHDRPQ;
 };
 
+/* everything besides the texture content that affects what the desktop shader
+ * draws into the window */
+struct DesktopCacheKey
+{
+  unsigned int outputWidth, outputHeight;
+  float x, y, scaleX, scaleY;
+  LG_RendererRotate rotate;
+  EGL_Texture * texture;
+  int   scaleAlgo;
+  int   nvGain;
+  int   cbMode;
+  bool  hdr, hdrPQ;
+  bool  mapHDRtoSDR;
+  float mapHDRGain;
+};
+
 struct EGL_Desktop
 {
   EGL * egl;
@@ -75,6 +98,7 @@ struct EGL_Desktop
   bool useSpice;
   int spiceWidth, spiceHeight;
   EGL_Texture * spiceTexture;
+  bool spiceReady;
 
   // scale algorithm
   int scaleAlgo;
@@ -96,6 +120,26 @@ struct EGL_Desktop
 
   EGL_PostProcess * pp;
   _Atomic(bool) processFrame;
+
+  // damage since the post process chain last ran, -1 for everything
+  LG_Lock         ppDamageLock;
+  int             ppDamageCount;
+  FrameDamageRect ppDamage[KVMFR_MAX_DAMAGE_RECTS];
+
+  // megabytes uploaded to the GPU per frame
+  RingBuffer  uploadSizes;
+  GraphHandle uploadGraph;
+
+  EGL_GPUTimer * timer;
+
+  /* a copy of the desktop as last drawn to the window, frames where only the
+   * cursor or overlay moved are restored from it rather than re-rendered */
+  EGL_Framebuffer      * cache;
+  EGL_Shader           * cacheShader;
+  enum EGL_PixelFormat   cachePixFmt;
+  bool                   cacheReady;
+  bool                   cacheValid;
+  struct DesktopCacheKey cacheKey;
 };
 
 // forwards
@@ -132,6 +176,16 @@ static bool egl_initDesktopShader(
   return true;
 }
 
+static const char * uploadGraphFormatFn(const char * name,
+    float min, float max, float avg, float freq, float last)
+{
+  static char title[64];
+  snprintf(title, sizeof(title),
+      "%s: min:%4.2f max:%4.2f avg:%4.2f now:%4.2f MB",
+      name, min, max, avg, last);
+  return title;
+}
+
 bool egl_desktopInit(EGL * egl, EGL_Desktop ** desktop_, EGLDisplay * display,
     bool useDMA, int maxRects)
 {
@@ -146,24 +200,27 @@ bool egl_desktopInit(EGL * egl, EGL_Desktop ** desktop_, EGLDisplay * display,
   desktop->egl     = egl;
   desktop->display = display;
 
+  LG_LOCK_INIT(desktop->ppDamageLock);
+  desktop->ppDamageCount = -1;
+
   if (!egl_textureInit(&desktop->texture, display,
         useDMA ? EGL_TEXTYPE_DMABUF : EGL_TEXTYPE_FRAMEBUFFER))
   {
     DEBUG_ERROR("Failed to initialize the desktop texture");
-    return false;
+    goto err;
   }
 
   if (!egl_desktopRectsInit(&desktop->mesh, maxRects))
   {
     DEBUG_ERROR("Failed to initialize the desktop mesh");
-    return false;
+    goto err;
   }
 
   desktop->matrix = countedBufferNew(6 * sizeof(GLfloat));
   if (!desktop->matrix)
   {
     DEBUG_ERROR("Failed to allocate the desktop matrix buffer");
-    return false;
+    goto err;
   }
 
   if (!egl_initDesktopShader(
@@ -173,7 +230,7 @@ bool egl_desktopInit(EGL * egl, EGL_Desktop ** desktop_, EGLDisplay * display,
     false))
   {
     DEBUG_ERROR("Failed to initialize the desktop shader");
-    return false;
+    goto err;
   }
 
   if (useDMA)
@@ -184,12 +241,9 @@ bool egl_desktopInit(EGL * egl, EGL_Desktop ** desktop_, EGLDisplay * display,
       true))
     {
       DEBUG_ERROR("Failed to initialize the desktop DMA shader");
-      return false;
+      goto err;
     }
 
-  app_registerKeybind(0, 'N', toggleNV, desktop,
-      "Toggle night vision mode");
-
   desktop->nvMax     = option_get_int("egl", "nvGainMax");
   desktop->nvGain    = option_get_int("egl", "nvGain"   );
   desktop->cbMode    = option_get_int("egl", "cbMode"   );
@@ -200,10 +254,22 @@ bool egl_desktopInit(EGL * egl, EGL_Desktop ** desktop_, EGLDisplay * display,
   desktop->peakLuminance = option_get_int ("egl", "peakLuminance");
   desktop->maxCLL        = option_get_int ("egl", "maxCLL"       );
 
+  desktop->uploadSizes = ringbuffer_new(256, sizeof(float));
+  if (!desktop->uploadSizes)
+  {
+    DEBUG_ERROR("Failed to allocate the upload size buffer");
+    goto err;
+  }
+  desktop->uploadGraph = app_registerGraph("TEX UPLOAD", desktop->uploadSizes,
+      0.0f, 32.0f, uploadGraphFormatFn);
+
+  if (!egl_gpuTimerInit(&desktop->timer, "DESKTOP"))
+    goto err;
+
   if (!egl_postProcessInit(&desktop->pp))
   {
     DEBUG_ERROR("Failed to initialize the post process manager");
-    return false;
+    goto err;
   }
 
   // this MUST be first
@@ -212,7 +278,15 @@ bool egl_desktopInit(EGL * egl, EGL_Desktop ** desktop_, EGLDisplay * display,
   egl_postProcessAdd(desktop->pp, &egl_filterDownscaleOps);
   egl_postProcessAdd(desktop->pp, &egl_filterFFXCASOps   );
   egl_postProcessAdd(desktop->pp, &egl_filterFFXFSR1Ops  );
+
+  // registered last so nothing refers to the desktop if initialization fails
+  app_registerKeybind(0, 'N', toggleNV, desktop,
+      "Toggle night vision mode");
   return true;
+
+err:
+  egl_desktopFree(desktop_);
+  return false;
 }
 
 void toggleNV(int key, void * opaque)
@@ -246,10 +320,24 @@ void egl_desktopFree(EGL_Desktop ** desktop)
   egl_textureFree    (&(*desktop)->spiceTexture    );
   egl_shaderFree     (&(*desktop)->shader   .shader);
   egl_shaderFree     (&(*desktop)->dmaShader.shader);
+  egl_shaderFree     (&(*desktop)->cacheShader     );
   egl_desktopRectsFree(&(*desktop)->mesh           );
-  countedBufferRelease(&(*desktop)->matrix         );
+
+  if ((*desktop)->matrix)
+    countedBufferRelease(&(*desktop)->matrix);
+
+  if ((*desktop)->cache)
+    egl_framebufferFree(&(*desktop)->cache);
 
   egl_postProcessFree(&(*desktop)->pp);
+  egl_gpuTimerFree(&(*desktop)->timer);
+  LG_LOCK_FREE((*desktop)->ppDamageLock);
+
+  if ((*desktop)->uploadSizes)
+  {
+    app_unregisterGraph((*desktop)->uploadGraph);
+    ringbuffer_free(&(*desktop)->uploadSizes);
+  }
 
   free(*desktop);
   *desktop = NULL;
@@ -317,6 +405,19 @@ void egl_desktopConfigUI(EGL_Desktop * desktop)
   }
 }
 
+/* record an update so the post process chain re-renders the area, a count of
+ * -1 marks the whole desktop */
+static void desktopAddDamage(EGL_Desktop * desktop,
+    const FrameDamageRect * rects, int count, int width, int height)
+{
+  INTERLOCKED_SECTION(desktop->ppDamageLock, {
+    desktop->ppDamageCount = rectsAccumulate(desktop->ppDamage,
+        desktop->ppDamageCount, KVMFR_MAX_DAMAGE_RECTS, rects, count,
+        width, height);
+  });
+  atomic_store(&desktop->processFrame, true);
+}
+
 bool egl_desktopSetup(EGL_Desktop * desktop, const LG_RendererFormat format)
 {
   memcpy(&desktop->format, &format, sizeof(LG_RendererFormat));
@@ -357,6 +458,7 @@ bool egl_desktopSetup(EGL_Desktop * desktop, const LG_RendererFormat format)
   desktop->height = format.frameHeight;
   desktop->hdr    = format.hdr;
   desktop->hdrPQ  = format.hdrPQ;
+  desktopAddDamage(desktop, NULL, -1, desktop->width, desktop->height);
 
   if (!egl_textureSetup(
     desktop->texture,
@@ -381,7 +483,9 @@ bool egl_desktopUpdate(EGL_Desktop * desktop, const FrameBuffer * frame, int dma
   {
     if (likely(egl_textureUpdateFromDMA(desktop->texture, frame, dmaFd)))
     {
-      atomic_store(&desktop->processFrame, true);
+      desktopAddDamage(desktop, damageRects,
+          damageRectsCount == 0 ? -1 : damageRectsCount,
+          desktop->width, desktop->height);
       return true;
     }
 
@@ -418,16 +522,109 @@ bool egl_desktopUpdate(EGL_Desktop * desktop, const FrameBuffer * frame, int dma
   if (likely(egl_textureUpdateFromFrame(desktop->texture, frame,
         damageRects, damageRectsCount)))
   {
-    atomic_store(&desktop->processFrame, true);
+    desktopAddDamage(desktop, damageRects,
+        damageRectsCount == 0 ? -1 : damageRectsCount,
+        desktop->width, desktop->height);
     return true;
   }
 
   return false;
 }
 
+bool egl_desktopEnableCache(EGL_Desktop * desktop, enum EGL_PixelFormat pixFmt)
+{
+  if (!egl_shaderInit(&desktop->cacheShader))
+  {
+    DEBUG_ERROR("Failed to initialize the desktop cache shader");
+    return false;
+  }
+
+  if (!egl_shaderCompile(desktop->cacheShader,
+        b_shader_desktop_vert      , b_shader_desktop_vert_size,
+        b_shader_desktop_cache_frag, b_shader_desktop_cache_frag_size,
+        false, NULL))
+  {
+    DEBUG_ERROR("Failed to compile the desktop cache shader");
+    egl_shaderFree(&desktop->cacheShader);
+    return false;
+  }
+
+  if (!egl_framebufferInit(&desktop->cache))
+  {
+    DEBUG_ERROR("Failed to initialize the desktop cache framebuffer");
+    egl_shaderFree(&desktop->cacheShader);
+    return false;
+  }
+
+  /* the cache is drawn with the desktop mesh and matrix so it covers exactly
+   * the same pixels as the desktop shader did */
+  EGL_Uniform uniforms[] =
+  {
+    {
+      .type        = EGL_UNIFORM_TYPE_M3x2FV,
+      .location    = egl_shaderGetUniform(desktop->cacheShader, "transform"),
+      .m.transpose = GL_FALSE,
+      .m.v         = desktop->matrix
+    }
+  };
+  egl_shaderSetUniforms(desktop->cacheShader, uniforms, ARRAY_LENGTH(uniforms));
+
+  desktop->cachePixFmt = pixFmt;
+  return true;
+}
+
 void egl_desktopResize(EGL_Desktop * desktop, int width, int height)
 {
   atomic_store(&desktop->processFrame, true);
+
+  if (!desktop->cache)
+    return;
+
+  desktop->cacheValid = false;
+  desktop->cacheReady = width > 0 && height > 0 &&
+    egl_framebufferSetup(desktop->cache, desktop->cachePixFmt, width, height);
+
+  if (!desktop->cacheReady)
+    DEBUG_WARN("Failed to resize the desktop cache, rendering without it");
+}
+
+static void desktopGrowDamage(struct DamageRects * out,
+    const struct DamageRects * in, int width, int height)
+{
+  for (int i = 0; i < in->count; ++i)
+  {
+    const FrameDamageRect * rect = in->rects + i;
+    const int x = max(0, (int)rect->x - 1);
+    const int y = max(0, (int)rect->y - 1);
+    out->rects[i] = (FrameDamageRect) {
+      .x      = x,
+      .y      = y,
+      .width  = min(width , (int)(rect->x + rect->width ) + 1) - x,
+      .height = min(height, (int)(rect->y + rect->height) + 1) - y,
+    };
+  }
+  out->count = rectsMergeOverlapping(out->rects, in->count);
+}
+
+static inline bool desktopCacheKeyEqual(const struct DesktopCacheKey * a,
+    const struct DesktopCacheKey * b)
+{
+  return
+    a->outputWidth  == b->outputWidth  &&
+    a->outputHeight == b->outputHeight &&
+    a->x            == b->x            &&
+    a->y            == b->y            &&
+    a->scaleX       == b->scaleX       &&
+    a->scaleY       == b->scaleY       &&
+    a->rotate       == b->rotate       &&
+    a->texture      == b->texture      &&
+    a->scaleAlgo    == b->scaleAlgo    &&
+    a->nvGain       == b->nvGain       &&
+    a->cbMode       == b->cbMode       &&
+    a->hdr          == b->hdr          &&
+    a->hdrPQ        == b->hdrPQ        &&
+    a->mapHDRtoSDR  == b->mapHDRtoSDR  &&
+    a->mapHDRGain   == b->mapHDRGain;
 }
 
 bool egl_desktopRender(EGL_Desktop * desktop, unsigned int outputWidth,
@@ -457,34 +654,88 @@ bool egl_desktopRender(EGL_Desktop * desktop, unsigned int outputWidth,
   if (unlikely(outputWidth == 0 && outputHeight == 0))
     DEBUG_FATAL("outputWidth || outputHeight == 0");
 
+  /* take the damage before processing the texture, an update that lands in
+   * between leaves its damage and the flag set for the next run */
+  struct DamageRects * ppDamage = NULL;
+  bool processFrame = atomic_exchange(&desktop->processFrame, false);
+  if (processFrame)
+  {
+    ppDamage = (struct DamageRects *)alloca(
+      sizeof(struct DamageRects) +
+      KVMFR_MAX_DAMAGE_RECTS * sizeof(struct FrameDamageRect)
+    );
+
+    INTERLOCKED_SECTION(desktop->ppDamageLock, {
+      ppDamage->count = desktop->ppDamageCount;
+      if (ppDamage->count > 0)
+        memcpy(ppDamage->rects, desktop->ppDamage,
+            ppDamage->count * sizeof(*ppDamage->rects));
+      desktop->ppDamageCount = 0;
+    });
+  }
+
   enum EGL_TexStatus status;
   if (unlikely((status = egl_textureProcess(tex)) != EGL_TEX_STATUS_OK))
   {
     if (status != EGL_TEX_STATUS_NOTREADY)
       DEBUG_ERROR("Failed to process the desktop texture");
+    else
+    {
+      /* the update is still waiting in its buffer, hand the damage back and
+       * render again so the chain runs once it has been uploaded */
+      if (processFrame)
+      {
+        desktopAddDamage(desktop, ppDamage->rects, ppDamage->count,
+            width, height);
+        processFrame = false;
+        ppDamage     = NULL;
+      }
+      app_invalidateWindow(true);
+    }
+
+    // the texture may change without a new frame once it is ready
+    desktop->cacheValid = false;
   }
+  else
+    // frames that uploaded nothing count too, they are part of the average
+    ringbuffer_push(desktop->uploadSizes,
+        &(float){ tex->uploadBytes / (1024.0f * 1024.0f) });
 
   int scaleAlgo = EGL_SCALE_NEAREST;
 
   egl_desktopRectsMatrix((float *)desktop->matrix->data,
       width, height, x, y, scaleX, scaleY, rotate);
-  egl_desktopRectsUpdate(desktop->mesh, rects, width, height);
 
-  if (atomic_exchange(&desktop->processFrame, false) ||
-      egl_postProcessConfigModified(desktop->pp))
-    egl_postProcessRun(desktop->pp, tex, desktop->mesh,
-        width, height, outputWidth, outputHeight, dma);
+  /* the area of the post process output that changed, any update to the
+   * texture is followed by a frame that runs the chain with its damage */
+  bool changed = false;
+  const struct DamageRects * changedRects = NULL;
+
+  if (processFrame || egl_postProcessConfigModified(desktop->pp))
+  {
+    if (!egl_postProcessRun(desktop->pp, tex, ppDamage,
+          width, height, outputWidth, outputHeight, dma))
+    {
+      if (ppDamage)
+      {
+        // the damage was not consumed, render everything on the next run
+        INTERLOCKED_SECTION(desktop->ppDamageLock, {
+          desktop->ppDamageCount = -1;
+        });
+      }
+      desktop->cacheValid = false;
+    }
+    else
+    {
+      changed      = true;
+      changedRects = egl_postProcessGetDamage(desktop->pp);
+    }
+  }
 
   unsigned int finalSizeX, finalSizeY;
   EGL_Texture * texture = egl_postProcessGetOutput(desktop->pp,
       &finalSizeX, &finalSizeY);
 
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-  egl_resetViewport(desktop->egl);
-
-  glActiveTexture(GL_TEXTURE0);
-  egl_textureBind(texture);
-
   if (finalSizeX > width || finalSizeY > height)
     scaleType = EGL_DESKTOP_DOWNSCALE;
 
@@ -565,15 +816,131 @@ bool egl_desktopRender(EGL_Desktop * desktop, unsigned int outputWidth,
     }
   };
 
-  egl_shaderSetUniforms(shader->shader, uniforms, ARRAY_LENGTH(uniforms));
-  egl_shaderUse(shader->shader);
+  egl_gpuTimerBegin(desktop->timer);
+
+  /* the spice display is drawn into its texture outside of the frame updates
+   * so it can not be tracked, always render it */
+  const bool useCache = desktop->cacheReady && !desktop->useSpice;
+  if (!useCache)
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    egl_resetViewport(desktop->egl);
+
+    glActiveTexture(GL_TEXTURE0);
+    egl_textureBind(texture);
+
+    egl_desktopRectsUpdate(desktop->mesh, rects, width, height);
+    egl_shaderSetUniforms(shader->shader, uniforms, ARRAY_LENGTH(uniforms));
+    egl_shaderUse(shader->shader);
+    egl_desktopRectsRender(desktop->mesh);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    egl_gpuTimerEnd(desktop->timer);
+
+    desktop->cacheValid = false;
+    return true;
+  }
+
+  const struct DesktopCacheKey key =
+  {
+    .outputWidth  = outputWidth,
+    .outputHeight = outputHeight,
+    .x            = x,
+    .y            = y,
+    .scaleX       = scaleX,
+    .scaleY       = scaleY,
+    .rotate       = rotate,
+    .texture      = texture,
+    .scaleAlgo    = scaleAlgo,
+    .nvGain       = desktop->nvGain,
+    .cbMode       = desktop->cbMode,
+    .hdr          = desktop->hdr,
+    .hdrPQ        = desktop->hdrPQ,
+    .mapHDRtoSDR  = desktop->mapHDRtoSDR,
+    .mapHDRGain   = mapHDRGain
+  };
+
+  const bool stale = !desktop->cacheValid ||
+    !desktopCacheKeyEqual(&key, &desktop->cacheKey);
+
+  if (stale || changed)
+  {
+    /* a stale cache holds nothing usable so draw all of it, otherwise only
+     * the area that changed, grown by a pixel for the filtering */
+    struct DamageRects * redraw = NULL;
+    if (!stale && changedRects)
+    {
+      redraw = (struct DamageRects *)alloca(
+        sizeof(struct DamageRects) +
+        changedRects->count * sizeof(struct FrameDamageRect)
+      );
+      desktopGrowDamage(redraw, changedRects, width, height);
+    }
+
+    egl_desktopRectsUpdate(desktop->mesh, redraw, width, height);
+    egl_framebufferBind(desktop->cache);
+
+    glActiveTexture(GL_TEXTURE0);
+    egl_textureBind(texture);
+
+    egl_shaderSetUniforms(shader->shader, uniforms, ARRAY_LENGTH(uniforms));
+    egl_shaderUse(shader->shader);
+    egl_desktopRectsRender(desktop->mesh);
+
+    desktop->cacheKey   = key;
+    desktop->cacheValid = true;
+  }
+
+  // restore the damaged area of the window from the cache
+  egl_desktopRectsUpdate(desktop->mesh, rects, width, height);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  egl_resetViewport(desktop->egl);
+
+  glActiveTexture(GL_TEXTURE0);
+  egl_textureBind(egl_framebufferGetTexture(desktop->cache));
+  egl_shaderUse(desktop->cacheShader);
   egl_desktopRectsRender(desktop->mesh);
   glBindTexture(GL_TEXTURE_2D, 0);
+  egl_gpuTimerEnd(desktop->timer);
   return true;
 }
 
+bool egl_desktopCanScanout(EGL_Desktop * desktop)
+{
+  // the buffer is shown as is, anything that alters the image rules it out
+  if (!desktop->useDMA || desktop->useSpice || desktop->hdr ||
+      desktop->nvGain || desktop->cbMode)
+    return false;
+
+  // packed 24-bit frames need unpacking
+  if (desktop->format.type == FRAME_TYPE_BGR_32 ||
+      desktop->format.type == FRAME_TYPE_RGB_24)
+    return false;
+
+  // the chain must have run without any filters
+  unsigned int sizeX, sizeY;
+  return !egl_postProcessConfigModified(desktop->pp) &&
+    egl_postProcessGetOutput(desktop->pp, &sizeX, &sizeY) == desktop->texture;
+}
+
+void egl_desktopGetDMABuf(EGL_Desktop * desktop, int dmaFd,
+    LG_DSDMABuf * buffer)
+{
+  const EGL_TexFormat * fmt = &desktop->texture->format;
+  *buffer = (LG_DSDMABuf) {
+    .fd        = dmaFd,
+    .fourcc    = fmt->fourcc,
+    .modifier  = DRM_FORMAT_MOD_LINEAR,
+    .width     = fmt->width,
+    .height    = fmt->height,
+    .pitch     = fmt->pitch,
+    .srcWidth  = desktop->width,
+    .srcHeight = desktop->height,
+  };
+}
+
 void egl_desktopSpiceConfigure(EGL_Desktop * desktop, int width, int height)
 {
+  desktop->spiceReady = false;
   if (!desktop->spiceTexture)
     if (!egl_textureInit(&desktop->spiceTexture, desktop->display,
           EGL_TEXTYPE_BUFFER_MAP))
@@ -597,35 +964,53 @@ void egl_desktopSpiceConfigure(EGL_Desktop * desktop, int width, int height)
 
   desktop->spiceWidth  = width;
   desktop->spiceHeight = height;
+  desktop->spiceReady  = true;
+}
+
+bool egl_desktopSpiceDirect(EGL_Desktop * desktop)
+{
+  /* the texture is persistently mapped and updates only touch the mapping
+   * under the copy lock, they are refused while the GPU is still reading it so
+   * the draw can be queued instead, see egl_textureUpdateRect */
+  return desktop->spiceReady;
 }
 
-void egl_desktopSpiceDrawFill(EGL_Desktop * desktop, int x, int y, int width,
+bool egl_desktopSpiceDrawFill(EGL_Desktop * desktop, int x, int y, int width,
     int height, uint32_t color)
 {
-  /* this is a fairly hacky way to do this, but since it's only for the fallback
-   * spice display it's not really an issue */
+  if (width <= 0 || height <= 0)
+    return true;
 
+  // a source pitch of zero repeats the line for every row of the rect
   uint32_t line[width];
-  for(int x = 0; x < width; ++x)
-    line[x] = color;
+  for(int i = 0; i < width; ++i)
+    line[i] = color;
 
-  for(int dy = 0; dy < height; ++dy)
-    egl_textureUpdateRect(desktop->spiceTexture,
-        x, y + dy, width, 1, width, sizeof(line), (uint8_t *)line, false);
+  if (!egl_textureUpdateRect(desktop->spiceTexture,
+        x, y, width, height, width, 0, (uint8_t *)line, true))
+    return false;
 
-  atomic_store(&desktop->processFrame, true);
+  desktopAddDamage(desktop,
+      &(FrameDamageRect){ .x = x, .y = y, .width = width, .height = height },
+      1, desktop->spiceWidth, desktop->spiceHeight);
+  return true;
 }
 
-void egl_desktopSpiceDrawBitmap(EGL_Desktop * desktop, int x, int y, int width,
+bool egl_desktopSpiceDrawBitmap(EGL_Desktop * desktop, int x, int y, int width,
     int height, int stride, uint8_t * data, bool topDown)
 {
-  egl_textureUpdateRect(desktop->spiceTexture,
-      x, y, width, height, width, stride, data, topDown);
-  atomic_store(&desktop->processFrame, true);
+  if (!egl_textureUpdateRect(desktop->spiceTexture,
+        x, y, width, height, width, stride, data, topDown))
+    return false;
+
+  desktopAddDamage(desktop,
+      &(FrameDamageRect){ .x = x, .y = y, .width = width, .height = height },
+      1, desktop->spiceWidth, desktop->spiceHeight);
+  return true;
 }
 
 void egl_desktopSpiceShow(EGL_Desktop * desktop, bool show)
 {
   desktop->useSpice = show;
-  atomic_store(&desktop->processFrame, true);
+  desktopAddDamage(desktop, NULL, -1, 0, 0);
 }
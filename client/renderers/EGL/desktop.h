@@ -23,6 +23,7 @@
 #include <stdbool.h>
 
 #include "egl.h"
+#include "egltypes.h"
 #include "desktop_rects.h"
 
 typedef struct EGL_Desktop EGL_Desktop;
@@ -46,14 +47,27 @@ bool egl_desktopSetup (EGL_Desktop * desktop, const LG_RendererFormat format);
 bool egl_desktopUpdate(EGL_Desktop * desktop, const FrameBuffer * frame, int dmaFd,
     const FrameDamageRect * damageRects, int damageRectsCount);
 void egl_desktopResize(EGL_Desktop * desktop, int width, int height);
+
+/* Keep a copy of the rendered desktop in a window sized buffer of the given
+ * format, when the desktop has not changed the damaged areas are restored
+ * from it instead of running the desktop shader again */
+bool egl_desktopEnableCache(EGL_Desktop * desktop, enum EGL_PixelFormat pixFmt);
+
 bool egl_desktopRender(EGL_Desktop * desktop, unsigned int outputWidth,
     unsigned int outputHeight, const float x, const float y,
     const float scaleX, const float scaleY, enum EGL_DesktopScaleType scaleType,
     LG_RendererRotate rotate, const struct DamageRects * rects);
 
+/* Returns true if the frames can be shown by the display server without being
+ * rendered, they must be DMABUFs and nothing may alter them */
+bool egl_desktopCanScanout(EGL_Desktop * desktop);
+void egl_desktopGetDMABuf(EGL_Desktop * desktop, int dmaFd,
+    LG_DSDMABuf * buffer);
+
 void egl_desktopSpiceConfigure(EGL_Desktop * desktop, int width, int height);
-void egl_desktopSpiceDrawFill(EGL_Desktop * desktop, int x, int y, int width,
+bool egl_desktopSpiceDirect(EGL_Desktop * desktop);
+bool egl_desktopSpiceDrawFill(EGL_Desktop * desktop, int x, int y, int width,
     int height, uint32_t color);
-void egl_desktopSpiceDrawBitmap(EGL_Desktop * desktop, int x, int y, int width,
+bool egl_desktopSpiceDrawBitmap(EGL_Desktop * desktop, int x, int y, int width,
     int height, int stride, uint8_t * data, bool topDown);
 void egl_desktopSpiceShow(EGL_Desktop * desktop, bool show);
@@ -43,10 +43,14 @@
 #include "egl_dynprocs.h"
 #include "model.h"
 #include "shader.h"
+#include "shader_cache.h"
+#include "gpu_timer.h"
+#include "compute.h"
 #include "damage.h"
 #include "desktop.h"
 #include "cursor.h"
 #include "postprocess.h"
+#include "texture_buffer.h"
 #include "util.h"
 
 #define MAX_BUFFER_AGE       3
@@ -119,8 +123,22 @@ struct Inst
   RingBuffer importTimings;
   GraphHandle importGraph;
 
+  EGL_GPUTimer * cursorTimer;
+  EGL_GPUTimer * damageTimer;
+  EGL_GPUTimer * imguiTimer;
+
   bool showSpice;
   int  spiceWidth, spiceHeight;
+
+  /* direct scanout of the DMABUF frames by the display server, the render
+   * thread decides if it is possible and the frame thread shows the frames */
+  bool        directScanout;
+  bool        overlayShown;
+  LG_Lock     scanoutLock;
+  bool        scanoutEligible;
+  bool        scanoutActive;
+  bool        scanoutFailed;
+  struct Rect scanoutRect;
 };
 
 static struct Option egl_options[] =
@@ -196,6 +214,14 @@ static struct Option egl_options[] =
     .type         = OPTION_TYPE_BOOL,
     .value.x_bool = false
   },
+  {
+    .module       = "egl",
+    .name         = "uploadBuffers",
+    .description  = "The number of buffers used to stream frames to the GPU",
+    .type         = OPTION_TYPE_INT,
+    .validator    = egl_texBufferCountValidate,
+    .value.x_int  = 3
+  },
   {
     .module       = "egl",
     .name         = "scalePointer",
@@ -224,6 +250,41 @@ static struct Option egl_options[] =
     .type         = OPTION_TYPE_INT,
     .value.x_int  = 10000,
   },
+  {
+    .module       = "egl",
+    .name         = "shaderCache",
+    .description  = "Cache compiled shader programs on disk",
+    .type         = OPTION_TYPE_BOOL,
+    .value.x_bool = true,
+  },
+  {
+    .module       = "egl",
+    .name         = "gpuTimers",
+    .description  = "Measure the GPU time of each render stage and filter",
+    .type         = OPTION_TYPE_BOOL,
+    .value.x_bool = true,
+  },
+  {
+    .module       = "egl",
+    .name         = "useCompute",
+    .description  = "Use the compute shader version of filters if supported",
+    .type         = OPTION_TYPE_BOOL,
+    .value.x_bool = true,
+  },
+  {
+    .module       = "egl",
+    .name         = "directScanout",
+    .description  = "Let the compositor scan out DMABUF frames directly when possible",
+    .type         = OPTION_TYPE_BOOL,
+    .value.x_bool = false,
+  },
+  {
+    .module       = "egl",
+    .name         = "desktopCache",
+    .description  = "Restore unchanged areas of the desktop from a copy",
+    .type         = OPTION_TYPE_BOOL,
+    .value.x_bool = true,
+  },
 
   {0}
 };
@@ -275,6 +336,8 @@ static bool egl_create(LG_Renderer ** renderer, const LG_RendererParams params,
   LG_LOCK_INIT(this->desktopDamageLock);
   this->desktopDamage[0].count = -1;
 
+  LG_LOCK_INIT(this->scanoutLock);
+
   this->importTimings = ringbuffer_new(256, sizeof(float));
   this->importGraph   = app_registerGraph("IMPORT", this->importTimings,
       0.0f, 5.0f, NULL);
@@ -302,9 +365,15 @@ static void egl_deinitialize(LG_Renderer * renderer)
   egl_desktopFree(&this->desktop);
   egl_cursorFree (&this->cursor);
   egl_damageFree (&this->damage);
+  egl_shaderAsyncFree();
+
+  egl_gpuTimerFree(&this->cursorTimer);
+  egl_gpuTimerFree(&this->damageTimer);
+  egl_gpuTimerFree(&this->imguiTimer );
 
   LG_LOCK_FREE(this->lock);
   LG_LOCK_FREE(this->desktopDamageLock);
+  LG_LOCK_FREE(this->scanoutLock);
 
   eglMakeCurrent(this->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
 
@@ -483,6 +552,17 @@ void egl_resetViewport(EGL * this)
   glViewport(0, 0, this->width, this->height);
 }
 
+/* hides the directly scanned out frame, the window beneath it has not been
+ * drawn while it was shown. Must be called with scanoutLock held */
+static void egl_scanoutStop(struct Inst * this)
+{
+  if (!this->scanoutActive)
+    return;
+
+  app_scanoutStop();
+  this->scanoutActive = false;
+}
+
 static void egl_onResize(LG_Renderer * renderer, const int width, const int height, const double scale,
     const LG_RendererRect destRect, LG_RendererRotate rotate)
 {
@@ -540,6 +620,16 @@ static void egl_onResize(LG_Renderer * renderer, const int width, const int heig
 
   egl_damageResize(this->damage, this->translateX, this->translateY, this->scaleX, this->scaleY);
   egl_desktopResize(this->desktop, this->width, this->height);
+
+  // the scanout surface is placed in window coordinates before scaling
+  LG_LOCK(this->scanoutLock);
+  if (destRect.valid)
+    this->scanoutRect = (struct Rect) {
+      .x = destRect.x, .y = destRect.y, .w = destRect.w, .h = destRect.h };
+  else
+    this->scanoutRect = (struct Rect) { 0 };
+  egl_scanoutStop(this);
+  LG_UNLOCK(this->scanoutLock);
 }
 
 static bool egl_onMouseShape(LG_Renderer * renderer, const LG_RendererCursor cursor,
@@ -610,6 +700,12 @@ static bool egl_onFrameFormat(LG_Renderer * renderer, const LG_RendererFormat fo
   egl_update_scale_type(this);
   egl_damageSetup(this->damage, format.frameWidth, format.frameHeight);
 
+  // the new format may be accepted where the last was not
+  LG_LOCK(this->scanoutLock);
+  this->scanoutFailed = false;
+  egl_scanoutStop(this);
+  LG_UNLOCK(this->scanoutLock);
+
   /* we need full screen damage when the format changes */
   INTERLOCKED_SECTION(this->desktopDamageLock, {
     this->desktopDamage[this->desktopDamageIdx].count = -1;
@@ -632,21 +728,37 @@ static bool egl_onFrame(LG_Renderer * renderer, const FrameBuffer * frame, int d
   }
   ringbuffer_push(this->importTimings, &(float){ (nanotime() - start) * 1e-6f });
 
-  INTERLOCKED_SECTION(this->desktopDamageLock, {
-    struct DesktopDamage * damage = this->desktopDamage + this->desktopDamageIdx;
-    if (unlikely(
-        damage->count                    == -1 ||
-        damageRectsCount                 == 0 ||
-        damage->count + damageRectsCount >= KVMFR_MAX_DAMAGE_RECTS))
-    {
-      damage->count = -1;
-    }
-    else
+  /* the import above waited for the frame to be complete, hand it to the
+   * display server as soon as possible */
+  if (this->directScanout && dmaFd >= 0)
+  {
+    LG_LOCK(this->scanoutLock);
+    if (this->scanoutEligible && !this->scanoutFailed)
     {
-      memcpy(damage->rects + damage->count, damageRects,
-          damageRectsCount * sizeof(FrameDamageRect));
-      damage->count += damageRectsCount;
+      LG_DSDMABuf buffer;
+      egl_desktopGetDMABuf(this->desktop, dmaFd, &buffer);
+      if (app_scanoutFrame(&buffer, &this->scanoutRect))
+        this->scanoutActive = true;
+      else
+      {
+        DEBUG_INFO("Direct scanout is not possible for this frame format");
+        this->scanoutFailed = true;
+        if (this->scanoutActive)
+        {
+          egl_scanoutStop(this);
+          app_invalidateWindow(true);
+        }
+      }
     }
+    LG_UNLOCK(this->scanoutLock);
+  }
+
+  INTERLOCKED_SECTION(this->desktopDamageLock, {
+    struct DesktopDamage * damage = this->desktopDamage + this->desktopDamageIdx;
+    damage->count = rectsAccumulate(damage->rects, damage->count,
+        KVMFR_MAX_DAMAGE_RECTS, damageRects,
+        damageRectsCount == 0 ? -1 : damageRectsCount,
+        this->format.frameWidth, this->format.frameHeight);
   });
 
   return true;
@@ -741,8 +853,12 @@ static bool egl_renderStartup(LG_Renderer * renderer, bool useDMA)
 {
   struct Inst * this = UPCAST(struct Inst, renderer);
 
+  // display servers without a window have us render to a pbuffer instead
+  struct Rect offscreen;
+  const bool useOffscreen = app_getProp(LG_DS_OFFSCREEN, &offscreen);
+
   this->nativeWind = app_getEGLNativeWindow();
-  if (!this->nativeWind)
+  if (!this->nativeWind && !useOffscreen)
   {
     DEBUG_ERROR("Failed to get EGL native window");
     return false;
@@ -780,6 +896,7 @@ static bool egl_renderStartup(LG_Renderer * renderer, bool useDMA)
     EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
     EGL_SAMPLE_BUFFERS , maxSamples > 0 ? 1 : 0,
     EGL_SAMPLES        , maxSamples,
+    EGL_SURFACE_TYPE   , useOffscreen ? EGL_PBUFFER_BIT : EGL_WINDOW_BIT,
     EGL_NONE
   };
 
@@ -796,20 +913,41 @@ static bool egl_renderStartup(LG_Renderer * renderer, bool useDMA)
     EGL_NONE
   };
 
-  this->surface = eglCreateWindowSurface(this->display, this->configs, this->nativeWind, surfattr);
-  if (this->surface == EGL_NO_SURFACE)
+  if (useOffscreen)
   {
-    // On Nvidia proprietary drivers on Wayland, specifying EGL_RENDER_BUFFER can cause
-    // window creation to fail, so we try again without it.
-    this->surface = eglCreateWindowSurface(this->display, this->configs, this->nativeWind, NULL);
+    const EGLint pbufattr[] =
+    {
+      EGL_WIDTH , offscreen.w,
+      EGL_HEIGHT, offscreen.h,
+      EGL_NONE
+    };
+
+    this->surface = eglCreatePbufferSurface(this->display, this->configs,
+        pbufattr);
     if (this->surface == EGL_NO_SURFACE)
     {
-      DEBUG_ERROR("Failed to create EGL surface (eglError: 0x%x)", eglGetError());
+      DEBUG_ERROR("Failed to create EGL pbuffer (eglError: 0x%x)",
+          eglGetError());
       return false;
     }
-    else
-      DEBUG_WARN("EGL surface creation with EGL_RENDER_BUFFER failed, "
-        "egl:doubleBuffer setting may not be respected");
+  }
+  else
+  {
+    this->surface = eglCreateWindowSurface(this->display, this->configs, this->nativeWind, surfattr);
+    if (this->surface == EGL_NO_SURFACE)
+    {
+      // On Nvidia proprietary drivers on Wayland, specifying EGL_RENDER_BUFFER can cause
+      // window creation to fail, so we try again without it.
+      this->surface = eglCreateWindowSurface(this->display, this->configs, this->nativeWind, NULL);
+      if (this->surface == EGL_NO_SURFACE)
+      {
+        DEBUG_ERROR("Failed to create EGL surface (eglError: 0x%x)", eglGetError());
+        return false;
+      }
+      else
+        DEBUG_WARN("EGL surface creation with EGL_RENDER_BUFFER failed, "
+          "egl:doubleBuffer setting may not be respected");
+    }
   }
 
   const char * client_exts = eglQueryString(this->display, EGL_EXTENSIONS);
@@ -916,7 +1054,8 @@ static bool egl_renderStartup(LG_Renderer * renderer, bool useDMA)
   if (this->noSwapDamage)
     DEBUG_WARN("egl:noSwapDamage specified, disabling swap buffers with damage.");
 
-  this->scalePointer = option_get_bool("egl", "scalePointer");
+  this->scalePointer  = option_get_bool("egl", "scalePointer");
+  this->directScanout = option_get_bool("egl", "directScanout");
 
   if (!g_egl_dynProcs.glEGLImageTargetTexture2DOES)
     DEBUG_INFO("glEGLImageTargetTexture2DOES unavilable, DMA support disabled");
@@ -959,12 +1098,38 @@ static bool egl_renderStartup(LG_Renderer * renderer, bool useDMA)
 
   eglSwapInterval(this->display, this->opt.vsync ? 1 : 0);
 
+  const uint64_t shaderStart = nanotime();
+  egl_shaderCacheInit();
+  egl_shaderTakeStats();
+
+  if (!egl_shaderAsyncInit(this->display, this->configs, this->context,
+        gl_exts))
+    return false;
+
+  egl_gpuTimerSetup(gl_exts, option_get_bool("egl", "gpuTimers"));
+  egl_computeSetup(esMaj, esMin, option_get_bool("egl", "useCompute"));
+  if (!egl_gpuTimerInit(&this->cursorTimer, "CURSOR") ||
+      !egl_gpuTimerInit(&this->damageTimer, "DAMAGE") ||
+      !egl_gpuTimerInit(&this->imguiTimer , "IMGUI" ))
+    return false;
+
   if (!egl_desktopInit(this, &this->desktop, this->display, useDMA, MAX_ACCUMULATED_DAMAGE))
   {
     DEBUG_ERROR("Failed to initialize the desktop");
     return false;
   }
 
+  /* without buffer age every frame is drawn in full and the cache would only
+   * add a pass */
+  if (this->hasBufferAge && option_get_bool("egl", "desktopCache"))
+  {
+    EGLint redSize = 8;
+    eglGetConfigAttrib(this->display, this->configs, EGL_RED_SIZE, &redSize);
+    if (!egl_desktopEnableCache(this->desktop,
+          redSize > 8 ? EGL_PF_RGBA10 : EGL_PF_RGBA))
+      DEBUG_WARN("Failed to enable the desktop cache, rendering without it");
+  }
+
   if (!egl_cursorInit(&this->cursor))
   {
     DEBUG_ERROR("Failed to initialize the cursor");
@@ -985,6 +1150,11 @@ static bool egl_renderStartup(LG_Renderer * renderer, bool useDMA)
 
   app_overlayConfigRegister("EGL", egl_configUI, this);
 
+  const EGL_ShaderStats stats = egl_shaderTakeStats();
+  DEBUG_INFO("Shaders : %u compiled, %u cached, %.2f ms (setup %.2f ms)",
+      stats.compiled, stats.cached, stats.time * 1e-6,
+      (nanotime() - shaderStart) * 1e-6);
+
   this->imgui = true;
   return true;
 }
@@ -1042,6 +1212,35 @@ inline static void renderLetterBox(struct Inst * this)
   }
 }
 
+/* decides if the frames may be scanned out directly, returns true if they are
+ * and the desktop does not need to be drawn */
+static bool egl_scanoutUpdate(struct Inst * this, LG_RendererRotate rotate,
+    bool * renderAll)
+{
+  if (!this->directScanout)
+    return false;
+
+  // the scanout surface covers the desktop, nothing may be drawn over it
+  bool eligible =
+    this->formatValid && !this->showSpice && !this->cursorVisible &&
+    !this->showDamage && !this->overlayShown &&
+    rotate == LG_ROTATE_0 && this->format.rotate == LG_ROTATE_0 &&
+    egl_desktopCanScanout(this->desktop);
+
+  LG_LOCK(this->scanoutLock);
+  eligible &= this->scanoutRect.w > 0 && this->scanoutRect.h > 0;
+  this->scanoutEligible = eligible;
+  if (!eligible && this->scanoutActive)
+  {
+    egl_scanoutStop(this);
+    *renderAll = true;
+  }
+  const bool active = this->scanoutActive;
+  LG_UNLOCK(this->scanoutLock);
+
+  return active;
+}
+
 static bool egl_render(LG_Renderer * renderer, LG_RendererRotate rotate,
     const bool newFrame, const bool invalidateWindow,
     void (*preSwap)(void * udata), void * udata)
@@ -1056,6 +1255,16 @@ static bool egl_render(LG_Renderer * renderer, LG_RendererRotate rotate,
   struct CursorState cursorState = { .visible = false };
   struct DesktopDamage * desktopDamage;
 
+  egl_gpuTimerNewFrame();
+
+  /* build the overlay frame first, the scanout surface must not cover an
+   * overlay that is shown in this frame */
+  struct Rect damage[KVMFR_MAX_DAMAGE_RECTS + MAX_OVERLAY_RECTS + 2];
+  int damageIdx = app_renderOverlay(damage, MAX_OVERLAY_RECTS);
+  this->overlayShown = damageIdx != 0;
+
+  const bool scanout = egl_scanoutUpdate(this, rotate, &renderAll);
+
   struct DamageRects * accumulated = (struct DamageRects *)alloca(
     sizeof(struct DamageRects) +
     MAX_ACCUMULATED_DAMAGE * sizeof(struct FrameDamageRect)
@@ -1126,7 +1335,7 @@ static bool egl_render(LG_Renderer * renderer, LG_RendererRotate rotate,
   }
   ++this->overlayHistoryIdx;
 
-  if (likely(this->destRect.w > 0 && this->destRect.h > 0))
+  if (likely(this->destRect.w > 0 && this->destRect.h > 0) && !scanout)
   {
     if (egl_desktopRender(this->desktop,
         this->destRect.w, this->destRect.h,
@@ -1134,9 +1343,11 @@ static bool egl_render(LG_Renderer * renderer, LG_RendererRotate rotate,
         this->scaleX    , this->scaleY    ,
         this->scaleType , rotate, renderAll ? NULL : accumulated))
     {
+      egl_gpuTimerBegin(this->cursorTimer);
       cursorState = egl_cursorRender(this->cursor,
           (this->format.rotate + rotate) % LG_ROTATE_MAX,
           this->width, this->height);
+      egl_gpuTimerEnd(this->cursorTimer);
     }
     else
       hasOverlay = true;
@@ -1144,19 +1355,21 @@ static bool egl_render(LG_Renderer * renderer, LG_RendererRotate rotate,
 
   renderLetterBox(this);
 
+  egl_gpuTimerBegin(this->damageTimer);
   hasOverlay |=
     egl_damageRender(this->damage, rotate, newFrame ? desktopDamage : NULL) |
     invalidateWindow;
+  egl_gpuTimerEnd(this->damageTimer);
 
-  struct Rect damage[KVMFR_MAX_DAMAGE_RECTS + MAX_OVERLAY_RECTS + 2];
-  int damageIdx = app_renderOverlay(damage, MAX_OVERLAY_RECTS);
   if (unlikely(damageIdx != 0))
   {
     if (damageIdx == -1)
       hasOverlay = true;
 
+    egl_gpuTimerBegin(this->imguiTimer);
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplOpenGL3_RenderDrawData(igGetDrawData());
+    egl_gpuTimerEnd(this->imguiTimer);
 
     for (int i = 0; i < damageIdx; ++i)
       damage[i].y = this->height - damage[i].y - damage[i].h;
@@ -1252,18 +1465,24 @@ static void egl_spiceConfigure(LG_Renderer * renderer, int width, int height)
   egl_desktopSpiceConfigure(this->desktop, width, height);
 }
 
-static void egl_spiceDrawFill(LG_Renderer * renderer, int x, int y, int width,
+static bool egl_spiceDirect(LG_Renderer * renderer)
+{
+  struct Inst * this = UPCAST(struct Inst, renderer);
+  return egl_desktopSpiceDirect(this->desktop);
+}
+
+static bool egl_spiceDrawFill(LG_Renderer * renderer, int x, int y, int width,
     int height, uint32_t color)
 {
   struct Inst * this = UPCAST(struct Inst, renderer);
-  egl_desktopSpiceDrawFill(this->desktop, x, y, width, height, color);
+  return egl_desktopSpiceDrawFill(this->desktop, x, y, width, height, color);
 }
 
-static void egl_spiceDrawBitmap(LG_Renderer * renderer, int x, int y, int width,
+static bool egl_spiceDrawBitmap(LG_Renderer * renderer, int x, int y, int width,
     int height, int stride, uint8_t * data, bool topDown)
 {
   struct Inst * this = UPCAST(struct Inst, renderer);
-  egl_desktopSpiceDrawBitmap(this->desktop, x, y, width, height, stride,
+  return egl_desktopSpiceDrawBitmap(this->desktop, x, y, width, height, stride,
       data, topDown);
 }
 
@@ -1295,6 +1514,7 @@ struct LG_RendererOps LGR_EGL =
   .freeTexture   = egl_freeTexture,
 
   .spiceConfigure  = egl_spiceConfigure,
+  .spiceDirect     = egl_spiceDirect,
   .spiceDrawFill   = egl_spiceDrawFill,
   .spiceDrawBitmap = egl_spiceDrawBitmap,
   .spiceShow       = egl_spiceShow
@@ -28,7 +28,8 @@ typedef enum EGL_TexType
   EGL_TEXTYPE_BUFFER_MAP,
   EGL_TEXTYPE_BUFFER_STREAM,
   EGL_TEXTYPE_FRAMEBUFFER,
-  EGL_TEXTYPE_DMABUF
+  EGL_TEXTYPE_DMABUF,
+  EGL_TEXTYPE_IMAGE
 }
 EGL_TexType;
 
@@ -28,3 +28,30 @@ void egl_filterRectsRender(EGL_Shader * shader, EGL_FilterRects * rects)
       rects->width, rects->height);
   egl_desktopRectsRender(rects->rects);
 }
+
+const EGL_ShaderDefine * egl_filterUnpackDefines(enum EGL_PixelFormat pixFmt)
+{
+  static const EGL_ShaderDefine bgr[] =
+  {
+    { "UNPACK_24BIT", "bgra" },
+    { 0 }
+  };
+
+  static const EGL_ShaderDefine rgb[] =
+  {
+    { "UNPACK_24BIT", "rgba" },
+    { 0 }
+  };
+
+  switch (pixFmt)
+  {
+    case EGL_PF_BGR_32:
+      return bgr;
+
+    case EGL_PF_RGB_24_32:
+      return rgb;
+
+    default:
+      return NULL;
+  }
+}
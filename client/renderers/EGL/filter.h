@@ -22,6 +22,7 @@
 
 #include "util.h"
 #include "shader.h"
+#include "gpu_timer.h"
 #include "egltypes.h"
 #include "desktop_rects.h"
 #include "model.h"
@@ -33,6 +34,9 @@ typedef struct EGL_FilterRects
   EGL_DesktopRects * rects;
   GLfloat * matrix;
   int width, height;
+
+  // the area in desktop pixels that rects covers, NULL for the whole desktop
+  const struct DamageRects * damage;
 }
 EGL_FilterRects;
 
@@ -49,6 +53,14 @@ typedef struct EGL_FilterOps
   /* the type of this filter */
   EGL_FilterType type;
 
+  /* how far in input pixels the filter samples around each output pixel, the
+   * damaged area is grown by this much so partial updates stay seamless */
+  unsigned int damageRadius;
+
+  /* the filter can read packed 24-bit input itself, the chain will then skip
+   * the separate unpack pass when this filter is the first to run */
+  bool unpack24;
+
   /* early initialization for registration of options */
   void (*earlyInit)(void);
 
@@ -102,6 +114,7 @@ EGL_FilterOps;
 typedef struct EGL_Filter
 {
   EGL_FilterOps ops;
+  EGL_GPUTimer * timer;
 }
 EGL_Filter;
 
@@ -117,11 +130,19 @@ static inline bool egl_filterInit(const EGL_FilterOps * ops, EGL_Filter ** filte
     return false;
 
   memcpy(&(*filter)->ops, ops, sizeof(*ops));
+  if (!egl_gpuTimerInit(&(*filter)->timer, ops->id))
+  {
+    ops->free(*filter);
+    *filter = NULL;
+    return false;
+  }
+
   return true;
 }
 
 static inline void egl_filterFree(EGL_Filter ** filter)
 {
+  egl_gpuTimerFree(&(*filter)->timer);
   (*filter)->ops.free(*filter);
   *filter = NULL;
 }
@@ -175,7 +196,10 @@ static inline bool egl_filterPrepare(EGL_Filter * filter)
 static inline EGL_Texture * egl_filterRun(EGL_Filter * filter,
     EGL_FilterRects * rects, EGL_Texture * texture)
 {
-  return filter->ops.run(filter, rects, texture);
+  egl_gpuTimerBegin(filter->timer);
+  texture = filter->ops.run(filter, rects, texture);
+  egl_gpuTimerEnd(filter->timer);
+  return texture;
 }
 
 static inline void egl_filterRelease(EGL_Filter * filter)
@@ -185,3 +209,13 @@ static inline void egl_filterRelease(EGL_Filter * filter)
 }
 
 void egl_filterRectsRender(EGL_Shader * shader, EGL_FilterRects * rects);
+
+/* true if the format is 24-bit pixels packed into a 32-bit texture */
+static inline bool egl_filterIsPacked24(enum EGL_PixelFormat pixFmt)
+{
+  return pixFmt == EGL_PF_BGR_32 || pixFmt == EGL_PF_RGB_24_32;
+}
+
+/* returns the defines that make unpack_24bit.h read the given format, or NULL
+ * if the format is not packed */
+const EGL_ShaderDefine * egl_filterUnpackDefines(enum EGL_PixelFormat pixFmt);
@@ -117,16 +117,10 @@ static bool egl_filter24bitSetup(EGL_Filter * filter,
 
   if (this->useDMA != useDMA || this->format != pixFmt)
   {
-    EGL_ShaderDefine defines[] =
-    {
-      {"OUTPUT", pixFmt == EGL_PF_BGR_32 ? "fragColor.bgra" : "fragColor.rgba" },
-      {0}
-    };
-
     if (!egl_shaderCompile(this->shader,
           b_shader_basic_vert        , b_shader_basic_vert_size,
           b_shader_convert_24bit_frag, b_shader_convert_24bit_frag_size,
-          useDMA, defines)
+          useDMA, egl_filterUnpackDefines(pixFmt))
        )
     {
       DEBUG_ERROR("Failed to compile the shader");
@@ -135,7 +129,7 @@ static bool egl_filter24bitSetup(EGL_Filter * filter,
 
     this->uOutputSize.type     = EGL_UNIFORM_TYPE_2F;
     this->uOutputSize.location =
-      egl_shaderGetUniform(this->shader, "outputSize");
+      egl_shaderGetUniform(this->shader, "uUnpackSize");
 
     this->useDMA   = useDMA;
     this->prepared = false;
@@ -208,6 +202,7 @@ EGL_FilterOps egl_filter24bitOps =
   .id           = "24bit",
   .name         = "24bit",
   .type         = EGL_FILTER_TYPE_INTERNAL,
+  .damageRadius = 1,
   .earlyInit    = NULL,
   .init         = egl_filter24bitInit,
   .free         = egl_filter24bitFree,
@@ -312,7 +312,7 @@ static bool egl_filterDownscaleSetup(EGL_Filter * filter,
 
   if (this->useDMA != useDMA)
   {
-    if (!egl_shaderCompile(this->nearest,
+    if (!egl_shaderCompileAsync(this->nearest,
           b_shader_basic_vert    , b_shader_basic_vert_size,
           b_shader_downscale_frag,
           b_shader_downscale_frag_size,
@@ -323,7 +323,7 @@ static bool egl_filterDownscaleSetup(EGL_Filter * filter,
       return false;
     }
 
-    if (!egl_shaderCompile(this->linear,
+    if (!egl_shaderCompileAsync(this->linear,
           b_shader_basic_vert, b_shader_basic_vert_size,
           b_shader_downscale_linear_frag,
           b_shader_downscale_linear_frag_size,
@@ -334,7 +334,7 @@ static bool egl_filterDownscaleSetup(EGL_Filter * filter,
       return false;
     }
 
-    if (!egl_shaderCompile(this->lanczos2,
+    if (!egl_shaderCompileAsync(this->lanczos2,
           b_shader_basic_vert, b_shader_basic_vert_size,
           b_shader_downscale_lanczos2_frag,
           b_shader_downscale_lanczos2_frag_size,
@@ -345,13 +345,16 @@ static bool egl_filterDownscaleSetup(EGL_Filter * filter,
       return false;
     }
 
-    this->uNearest.type = EGL_UNIFORM_TYPE_3F;
-    this->uNearest.location =
-      egl_shaderGetUniform(this->nearest, "uConfig");
-
-    this->useDMA = useDMA;
+    this->useDMA   = useDMA;
+    this->prepared = false;
   }
 
+  // bypass the filter until the shaders are ready
+  if (egl_shaderGetStatus(this->nearest ) != EGL_SHADER_READY ||
+      egl_shaderGetStatus(this->linear  ) != EGL_SHADER_READY ||
+      egl_shaderGetStatus(this->lanczos2) != EGL_SHADER_READY)
+    return false;
+
   if (this->prepared               &&
       pixFmt       == this->pixFmt &&
       this->width  == width        &&
@@ -388,6 +391,9 @@ static bool egl_filterDownscalePrepare(EGL_Filter * filter)
   switch (this->filter)
   {
     case DOWNSCALE_NEAREST:
+      this->uNearest.type     = EGL_UNIFORM_TYPE_3F;
+      this->uNearest.location =
+        egl_shaderGetUniform(this->nearest, "uConfig");
       this->uNearest.f[0] = this->pixelSize;
       this->uNearest.f[1] = this->vOffset;
       this->uNearest.f[2] = this->hOffset;
@@ -446,6 +452,7 @@ EGL_FilterOps egl_filterDownscaleOps =
   .id           = "downscale",
   .name         = "Downscaler",
   .type         = EGL_FILTER_TYPE_DOWNSCALE,
+  .damageRadius = 2,
   .earlyInit    = egl_filterDownscaleEarlyInit,
   .init         = egl_filterDownscaleInit,
   .free         = egl_filterDownscaleFree,
@@ -20,7 +20,9 @@
 
 #include "filter.h"
 #include "framebuffer.h"
+#include "compute.h"
 
+#include "common/array.h"
 #include "common/countedbuffer.h"
 #include "common/debug.h"
 #include "common/option.h"
@@ -29,15 +31,30 @@
 
 #include "basic.vert.h"
 #include "ffx_cas.frag.h"
+#include "ffx_cas.comp.h"
+
+typedef struct CASProgram
+{
+  EGL_Shader * shader, * compute;
+
+  int useDMA;
+  const EGL_ShaderDefine * unpack;
+  bool useCompute;
+  const char * imageLayout;
+}
+CASProgram;
 
 typedef struct EGL_FilterFFXCAS
 {
   EGL_Filter base;
 
-  EGL_Shader * shader;
+  /* packed 24-bit input has its own program so the chain can keep unpacking it
+   * separately for the other while it is built */
+  CASProgram   programs[2];
+  CASProgram * program; // the program last set up
   bool         enable;
 
-  int useDMA;
+  bool useCompute, computeFailed;
   enum EGL_PixelFormat pixFmt;
   unsigned int width, height;
   float sharpness;
@@ -45,6 +62,7 @@ typedef struct EGL_FilterFFXCAS
   bool prepared;
 
   EGL_Framebuffer * fb;
+  EGL_Texture     * image;
   GLuint            sampler;
 }
 EGL_FilterFFXCAS;
@@ -82,6 +100,51 @@ static void casUpdateConsts(EGL_FilterFFXCAS * this)
       this->width, this->height);
 }
 
+static EGL_Shader * casShader(CASProgram * prog)
+{
+  return prog->useCompute ? prog->compute : prog->shader;
+}
+
+/* builds the compute shader if requested, falling back to the fragment
+ * shader if it can not be, sets useCompute to the shader that was built */
+static bool casCompile(EGL_FilterFFXCAS * this, CASProgram * prog,
+    bool useCompute, const char * imageLayout, bool useDMA,
+    const EGL_ShaderDefine * unpack)
+{
+  if (useCompute)
+  {
+    const EGL_ShaderDefine defines[] =
+    {
+      { "IMAGE_FORMAT", imageLayout },
+      unpack ? unpack[0] : (EGL_ShaderDefine){ 0 },
+      { 0 }
+    };
+
+    if (egl_shaderCompileComputeAsync(prog->compute,
+          b_shader_ffx_cas_comp, b_shader_ffx_cas_comp_size,
+          useDMA, defines))
+    {
+      prog->useCompute = true;
+      return true;
+    }
+
+    DEBUG_WARN("Failed to compile the compute shader, using the fragment shader");
+    this->computeFailed = true;
+  }
+
+  prog->useCompute = false;
+  if (!egl_shaderCompileAsync(prog->shader,
+        b_shader_basic_vert  , b_shader_basic_vert_size,
+        b_shader_ffx_cas_frag, b_shader_ffx_cas_frag_size,
+        useDMA, unpack))
+  {
+    DEBUG_ERROR("Failed to compile the shader");
+    return false;
+  }
+
+  return true;
+}
+
 static void egl_filterFFXCASSaveState(EGL_Filter * filter)
 {
   EGL_FilterFFXCAS * this = UPCAST(EGL_FilterFFXCAS, filter);
@@ -107,19 +170,29 @@ static bool egl_filterFFXCASInit(EGL_Filter ** filter)
     return false;
   }
 
-  this->useDMA = -1;
-
-  if (!egl_shaderInit(&this->shader))
+  for(int i = 0; i < ARRAY_LENGTH(this->programs); ++i)
   {
-    DEBUG_ERROR("Failed to initialize the shader");
-    goto error_this;
+    CASProgram * prog = this->programs + i;
+    prog->useDMA = -1;
+
+    if (!egl_shaderInit(&prog->shader))
+    {
+      DEBUG_ERROR("Failed to initialize the shader");
+      goto error_shaders;
+    }
+
+    if (!egl_shaderInit(&prog->compute))
+    {
+      DEBUG_ERROR("Failed to initialize the compute shader");
+      goto error_shaders;
+    }
   }
 
   this->consts = countedBufferNew(8 * sizeof(GLuint));
   if (!this->consts)
   {
     DEBUG_ERROR("Failed to allocate consts buffer");
-    goto error_shader;
+    goto error_shaders;
   }
 
   egl_filterFFXCASLoadState(&this->base);
@@ -130,6 +203,12 @@ static bool egl_filterFFXCASInit(EGL_Filter ** filter)
     goto error_consts;
   }
 
+  if (!egl_textureInit(&this->image, NULL, EGL_TEXTYPE_IMAGE))
+  {
+    DEBUG_ERROR("Failed to initialize the image");
+    goto error_fb;
+  }
+
   glGenSamplers(1, &this->sampler);
   glSamplerParameteri(this->sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glSamplerParameteri(this->sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -139,13 +218,19 @@ static bool egl_filterFFXCASInit(EGL_Filter ** filter)
   *filter = &this->base;
   return true;
 
+error_fb:
+  egl_framebufferFree(&this->fb);
+
 error_consts:
    countedBufferRelease(&this->consts);
 
-error_shader:
-  egl_shaderFree(&this->shader);
+error_shaders:
+  for(int i = 0; i < ARRAY_LENGTH(this->programs); ++i)
+  {
+    egl_shaderFree(&this->programs[i].shader );
+    egl_shaderFree(&this->programs[i].compute);
+  }
 
-error_this:
   free(this);
   return false;
 }
@@ -154,9 +239,14 @@ static void egl_filterFFXCASFree(EGL_Filter * filter)
 {
   EGL_FilterFFXCAS * this = UPCAST(EGL_FilterFFXCAS, filter);
 
-  egl_shaderFree(&this->shader);
+  for(int i = 0; i < ARRAY_LENGTH(this->programs); ++i)
+  {
+    egl_shaderFree(&this->programs[i].shader );
+    egl_shaderFree(&this->programs[i].compute);
+  }
   countedBufferRelease(&this->consts);
   egl_framebufferFree(&this->fb);
+  egl_textureFree(&this->image);
   glDeleteSamplers(1, &this->sampler);
   free(this);
 }
@@ -217,31 +307,71 @@ static bool egl_filterFFXCASSetup(EGL_Filter * filter,
   if (!this->enable)
     return false;
 
-  if (this->useDMA != useDMA)
+  // packed 24-bit input is unpacked by the shader as it is read
+  const EGL_ShaderDefine * unpack = egl_filterUnpackDefines(pixFmt);
+  if (unpack)
   {
-    if (!egl_shaderCompile(this->shader,
-          b_shader_basic_vert  , b_shader_basic_vert_size,
-          b_shader_ffx_cas_frag, b_shader_ffx_cas_frag_size,
-          useDMA, NULL)
-       )
-    {
-      DEBUG_ERROR("Failed to compile the shader");
+    pixFmt = EGL_PF_BGRA;
+    width  = desktopWidth;
+    height = desktopHeight;
+  }
+
+  CASProgram * prog = this->programs + (unpack ? 1 : 0);
+
+  const bool useCompute = egl_computeSupported() && !this->computeFailed;
+  const char * imageLayout =
+    useCompute ? egl_computeImageLayout(pixFmt) : NULL;
+
+  if (prog->useDMA != useDMA || prog->unpack != unpack ||
+      prog->useCompute != useCompute || prog->imageLayout != imageLayout)
+  {
+    if (!casCompile(this, prog, useCompute, imageLayout, useDMA, unpack))
       return false;
-    }
 
-    egl_shaderSetUniforms(this->shader, &(EGL_Uniform) {
-      .type     = EGL_UNIFORM_TYPE_4UIV,
-      .location = egl_shaderGetUniform(this->shader, "uConsts"),
-      .v        = this->consts,
-    }, 1);
+    prog->useDMA      = useDMA;
+    prog->unpack      = unpack;
+    prog->imageLayout = prog->useCompute ? imageLayout : NULL;
+    this->prepared    = false;
+  }
+
+  /* refuse the input until the shader is ready, if packed input is refused the
+   * chain unpacks it first and this filter keeps running with the other
+   * program, otherwise it is bypassed */
+  switch(egl_shaderGetStatus(casShader(prog)))
+  {
+    case EGL_SHADER_READY:
+      break;
+
+    case EGL_SHADER_FAILED:
+      if (prog->useCompute)
+      {
+        DEBUG_WARN("CAS compute shader failed, using the fragment shader");
+        this->computeFailed = true;
+        prog->useDMA        = -1;
+      }
+      return false;
+
+    default:
+      return false;
+  }
+
+  if (this->program != prog || this->useCompute != prog->useCompute)
+  {
+    // the output target differs between the shader types
+    if (this->useCompute != prog->useCompute)
+      this->width = this->height = 0;
 
-    this->useDMA = useDMA;
+    this->program    = prog;
+    this->useCompute = prog->useCompute;
+    this->prepared   = false;
   }
 
   if (pixFmt == this->pixFmt && this->width == width && this->height == height)
     return true;
 
-  if (!egl_framebufferSetup(this->fb, pixFmt, width, height))
+  if (this->useCompute ?
+      !egl_textureSetup(this->image, pixFmt, width, height, 0, 0) :
+      !egl_framebufferSetup(this->fb, pixFmt, width, height))
     return false;
 
   this->pixFmt   = pixFmt;
@@ -269,6 +399,23 @@ static bool egl_filterFFXCASPrepare(EGL_Filter * filter)
   if (this->prepared)
     return true;
 
+  EGL_Shader * shader = casShader(this->program);
+  EGL_Uniform uniforms[] =
+  {
+    {
+      .type     = EGL_UNIFORM_TYPE_4UIV,
+      .location = egl_shaderGetUniform(shader, "uConsts"),
+      .v        = this->consts,
+    },
+    {
+      .type     = EGL_UNIFORM_TYPE_2F,
+      .location = egl_shaderGetUniform(shader, "uUnpackSize"),
+      .f        = { this->width, this->height },
+    }
+  };
+
+  egl_shaderSetUniforms(shader, uniforms,
+      this->program->unpack ? ARRAY_LENGTH(uniforms) : 1);
   this->prepared = true;
 
   return true;
@@ -279,14 +426,22 @@ static EGL_Texture * egl_filterFFXCASRun(EGL_Filter * filter,
 {
   EGL_FilterFFXCAS * this = UPCAST(EGL_FilterFFXCAS, filter);
 
-  egl_framebufferBind(this->fb);
-
   glActiveTexture(GL_TEXTURE0);
   egl_textureBind(texture);
   glBindSampler(0, this->sampler);
 
-  egl_shaderUse(this->shader);
-  egl_filterRectsRender(this->shader, rects);
+  CASProgram * prog = this->program;
+  if (this->useCompute)
+  {
+    egl_shaderUse(prog->compute);
+    egl_computeBindImage(this->image);
+    egl_computeDispatch(prog->compute, rects, this->width, this->height);
+    return this->image;
+  }
+
+  egl_framebufferBind(this->fb);
+  egl_shaderUse(prog->shader);
+  egl_filterRectsRender(prog->shader, rects);
 
   return egl_framebufferGetTexture(this->fb);
 }
@@ -296,6 +451,8 @@ EGL_FilterOps egl_filterFFXCASOps =
   .id           = "ffxCAS",
   .name         = "AMD FidelityFX CAS",
   .type         = EGL_FILTER_TYPE_EFFECT,
+  .damageRadius = 1,
+  .unpack24     = true,
   .earlyInit    = egl_filterFFXCASEarlyInit,
   .init         = egl_filterFFXCASInit,
   .free         = egl_filterFFXCASFree,
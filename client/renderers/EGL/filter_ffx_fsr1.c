@@ -20,6 +20,7 @@
 
 #include "filter.h"
 #include "framebuffer.h"
+#include "compute.h"
 
 #include "common/array.h"
 #include "common/countedbuffer.h"
@@ -30,19 +31,35 @@
 
 #include "basic.vert.h"
 #include "ffx_fsr1_easu.frag.h"
+#include "ffx_fsr1_easu.comp.h"
 #include "ffx_fsr1_rcas.frag.h"
 
+typedef struct EasuProgram
+{
+  EGL_Shader * easu, * easuCompute;
+
+  int useDMA;
+  const EGL_ShaderDefine * unpack;
+  bool useCompute;
+  const char * imageLayout;
+}
+EasuProgram;
+
 typedef struct EGL_FilterFFXFSR1
 {
   EGL_Filter base;
 
-  EGL_Shader    * easu, * rcas;
+  /* packed 24-bit input has its own Easu program so the chain can keep
+   * unpacking it separately for the other while it is built */
+  EasuProgram     programs[2];
+  EasuProgram   * program; // the program last set up
+  EGL_Shader    * rcas;
   bool            enable, active;
   float           sharpness;
   CountedBuffer * consts;
-  EGL_Uniform     easuUniform[2], rcasUniform;
+  EGL_Uniform     easuUniform[3], rcasUniform;
 
-  int useDMA;
+  bool useCompute, computeFailed;
   enum EGL_PixelFormat pixFmt;
   unsigned int width, height;
   unsigned int inWidth, inHeight;
@@ -50,6 +67,7 @@ typedef struct EGL_FilterFFXFSR1
   bool prepared;
 
   EGL_Framebuffer * easuFb, * rcasFb;
+  EGL_Texture     * easuImage;
   GLuint            sampler;
 }
 EGL_FilterFFXFSR1;
@@ -85,6 +103,52 @@ static void rcasUpdateUniform(EGL_FilterFFXFSR1 * this)
   ffxFsrRcasConst(this->rcasUniform.ui, 2.0f - this->sharpness * 2.0f);
 }
 
+static EGL_Shader * easuShader(EasuProgram * prog)
+{
+  return prog->useCompute ? prog->easuCompute : prog->easu;
+}
+
+/* builds the Easu compute shader if requested, falling back to the fragment
+ * shader if it can not be, sets useCompute to the shader that was built */
+static bool easuCompile(EGL_FilterFFXFSR1 * this, EasuProgram * prog,
+    bool useCompute, const char * imageLayout, bool useDMA,
+    const EGL_ShaderDefine * unpack)
+{
+  if (useCompute)
+  {
+    const EGL_ShaderDefine defines[] =
+    {
+      { "IMAGE_FORMAT", imageLayout },
+      unpack ? unpack[0] : (EGL_ShaderDefine){ 0 },
+      { 0 }
+    };
+
+    if (egl_shaderCompileComputeAsync(prog->easuCompute,
+          b_shader_ffx_fsr1_easu_comp, b_shader_ffx_fsr1_easu_comp_size,
+          useDMA, defines))
+    {
+      prog->useCompute = true;
+      return true;
+    }
+
+    DEBUG_WARN("Failed to compile the Easu compute shader, "
+        "using the fragment shader");
+    this->computeFailed = true;
+  }
+
+  prog->useCompute = false;
+  if (!egl_shaderCompileAsync(prog->easu,
+        b_shader_basic_vert        , b_shader_basic_vert_size,
+        b_shader_ffx_fsr1_easu_frag, b_shader_ffx_fsr1_easu_frag_size,
+        useDMA, unpack))
+  {
+    DEBUG_ERROR("Failed to compile the Easu shader");
+    return false;
+  }
+
+  return true;
+}
+
 static void egl_filterFFXFSR1SaveState(EGL_Filter * filter)
 {
   EGL_FilterFFXFSR1 * this = UPCAST(EGL_FilterFFXFSR1, filter);
@@ -110,12 +174,22 @@ static bool egl_filterFFXFSR1Init(EGL_Filter ** filter)
     return false;
   }
 
-  this->useDMA = -1;
-
-  if (!egl_shaderInit(&this->easu))
+  for(int i = 0; i < ARRAY_LENGTH(this->programs); ++i)
   {
-    DEBUG_ERROR("Failed to initialize the Easu shader");
-    goto error_this;
+    EasuProgram * prog = this->programs + i;
+    prog->useDMA = -1;
+
+    if (!egl_shaderInit(&prog->easu))
+    {
+      DEBUG_ERROR("Failed to initialize the Easu shader");
+      goto error_esau;
+    }
+
+    if (!egl_shaderInit(&prog->easuCompute))
+    {
+      DEBUG_ERROR("Failed to initialize the Easu compute shader");
+      goto error_esau;
+    }
   }
 
   if (!egl_shaderInit(&this->rcas))
@@ -159,6 +233,12 @@ static bool egl_filterFFXFSR1Init(EGL_Filter ** filter)
     goto error_easuFb;
   }
 
+  if (!egl_textureInit(&this->easuImage, NULL, EGL_TEXTYPE_IMAGE))
+  {
+    DEBUG_ERROR("Failed to initialize the Easu image");
+    goto error_rcasFb;
+  }
+
   glGenSamplers(1, &this->sampler);
   glSamplerParameteri(this->sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glSamplerParameteri(this->sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -168,9 +248,12 @@ static bool egl_filterFFXFSR1Init(EGL_Filter ** filter)
   *filter = &this->base;
   return true;
 
-error_easuFb:
+error_rcasFb:
   egl_framebufferFree(&this->rcasFb);
 
+error_easuFb:
+  egl_framebufferFree(&this->easuFb);
+
 error_consts:
   countedBufferRelease(&this->consts);
 
@@ -178,9 +261,12 @@ error_rcas:
   egl_shaderFree(&this->rcas);
 
 error_esau:
-  egl_shaderFree(&this->easu);
+  for(int i = 0; i < ARRAY_LENGTH(this->programs); ++i)
+  {
+    egl_shaderFree(&this->programs[i].easu       );
+    egl_shaderFree(&this->programs[i].easuCompute);
+  }
 
-error_this:
   free(this);
   return false;
 }
@@ -189,11 +275,16 @@ static void egl_filterFFXFSR1Free(EGL_Filter * filter)
 {
   EGL_FilterFFXFSR1 * this = UPCAST(EGL_FilterFFXFSR1, filter);
 
-  egl_shaderFree(&this->easu);
+  for(int i = 0; i < ARRAY_LENGTH(this->programs); ++i)
+  {
+    egl_shaderFree(&this->programs[i].easu       );
+    egl_shaderFree(&this->programs[i].easuCompute);
+  }
   egl_shaderFree(&this->rcas);
   countedBufferRelease(&this->consts);
   egl_framebufferFree(&this->easuFb);
   egl_framebufferFree(&this->rcasFb);
+  egl_textureFree(&this->easuImage);
   glDeleteSamplers(1, &this->sampler);
   free(this);
 }
@@ -331,38 +422,78 @@ static bool egl_filterFFXFSR1Setup(EGL_Filter * filter,
   if (!this->enable)
     return false;
 
-  if (this->useDMA != useDMA)
+  // packed 24-bit input is unpacked by Easu as it is read
+  const EGL_ShaderDefine * unpack = egl_filterUnpackDefines(pixFmt);
+  if (unpack)
   {
-    if (!egl_shaderCompile(this->easu,
-          b_shader_basic_vert        , b_shader_basic_vert_size,
-          b_shader_ffx_fsr1_easu_frag, b_shader_ffx_fsr1_easu_frag_size,
-          useDMA, NULL)
-       )
-    {
-      DEBUG_ERROR("Failed to compile the Easu shader");
-      return false;
-    }
-
-    this->easuUniform[0].type = EGL_UNIFORM_TYPE_4UIV;
-    this->easuUniform[0].location =
-      egl_shaderGetUniform(this->easu, "uConsts");
-    this->easuUniform[0].v = this->consts;
-    this->easuUniform[1].type = EGL_UNIFORM_TYPE_2F;
-    this->easuUniform[1].location =
-      egl_shaderGetUniform(this->easu, "uOutRes");
-
-    this->useDMA = useDMA;
+    pixFmt = EGL_PF_BGRA;
+    width  = desktopWidth;
+    height = desktopHeight;
   }
 
+  // checked first so no program is built when there is nothing to upscale
   this->active = this->width > width && this->height > height;
   if (!this->active)
     return false;
 
+  EasuProgram * prog = this->programs + (unpack ? 1 : 0);
+
+  const bool useCompute = egl_computeSupported() && !this->computeFailed;
+  const char * imageLayout =
+    useCompute ? egl_computeImageLayout(pixFmt) : NULL;
+
+  if (prog->useDMA != useDMA || prog->unpack != unpack ||
+      prog->useCompute != useCompute || prog->imageLayout != imageLayout)
+  {
+    if (!easuCompile(this, prog, useCompute, imageLayout, useDMA, unpack))
+      return false;
+
+    prog->useDMA      = useDMA;
+    prog->unpack      = unpack;
+    prog->imageLayout = prog->useCompute ? imageLayout : NULL;
+    this->prepared    = false;
+  }
+
+  /* refuse the input until the shader is ready, if packed input is refused the
+   * chain unpacks it first and this filter keeps running with the other
+   * program, otherwise it is bypassed */
+  switch(egl_shaderGetStatus(easuShader(prog)))
+  {
+    case EGL_SHADER_READY:
+      break;
+
+    case EGL_SHADER_FAILED:
+      if (prog->useCompute)
+      {
+        DEBUG_WARN("Easu compute shader failed, using the fragment shader");
+        this->computeFailed = true;
+        prog->useDMA        = -1;
+      }
+      return false;
+
+    default:
+      return false;
+  }
+
+  if (this->program != prog || this->useCompute != prog->useCompute)
+  {
+    // the Easu output target differs between the shader types
+    if (this->useCompute != prog->useCompute)
+      this->sizeChanged = true;
+
+    this->program    = prog;
+    this->useCompute = prog->useCompute;
+    this->prepared   = false;
+  }
+
   if (pixFmt == this->pixFmt && !this->sizeChanged &&
       width == this->inWidth && height == this->inHeight)
     return true;
 
-  if (!egl_framebufferSetup(this->easuFb, pixFmt, this->width, this->height))
+  if (this->useCompute ?
+      !egl_textureSetup(this->easuImage, pixFmt, this->width, this->height,
+        0, 0) :
+      !egl_framebufferSetup(this->easuFb, pixFmt, this->width, this->height))
     return false;
 
   if (!egl_framebufferSetup(this->rcasFb, pixFmt, this->width, this->height))
@@ -401,7 +532,23 @@ static bool egl_filterFFXFSR1Prepare(EGL_Filter * filter)
   if (this->prepared)
     return true;
 
-  egl_shaderSetUniforms(this->easu, this->easuUniform, ARRAY_LENGTH(this->easuUniform));
+  // the uniforms can only be located once the program has been built
+  EGL_Shader * easu = easuShader(this->program);
+  this->easuUniform[0].type = EGL_UNIFORM_TYPE_4UIV;
+  this->easuUniform[0].location =
+    egl_shaderGetUniform(easu, "uConsts");
+  this->easuUniform[0].v = this->consts;
+  this->easuUniform[1].type = EGL_UNIFORM_TYPE_2F;
+  this->easuUniform[1].location =
+    egl_shaderGetUniform(easu, "uOutRes");
+  this->easuUniform[2].type = EGL_UNIFORM_TYPE_2F;
+  this->easuUniform[2].location =
+    egl_shaderGetUniform(easu, "uUnpackSize");
+  this->easuUniform[2].f[0] = this->inWidth;
+  this->easuUniform[2].f[1] = this->inHeight;
+
+  egl_shaderSetUniforms(easu, this->easuUniform,
+      this->program->unpack ? ARRAY_LENGTH(this->easuUniform) : 2);
   egl_shaderSetUniforms(this->rcas, &this->rcasUniform, 1);
   this->prepared = true;
 
@@ -414,13 +561,24 @@ static EGL_Texture * egl_filterFFXFSR1Run(EGL_Filter * filter,
   EGL_FilterFFXFSR1 * this = UPCAST(EGL_FilterFFXFSR1, filter);
 
   // pass 1, Easu
-  egl_framebufferBind(this->easuFb);
   glActiveTexture(GL_TEXTURE0);
   egl_textureBind(texture);
   glBindSampler(0, this->sampler);
-  egl_shaderUse(this->easu);
-  egl_filterRectsRender(this->easu, rects);
-  texture = egl_framebufferGetTexture(this->easuFb);
+  EasuProgram * prog = this->program;
+  if (this->useCompute)
+  {
+    egl_shaderUse(prog->easuCompute);
+    egl_computeBindImage(this->easuImage);
+    egl_computeDispatch(prog->easuCompute, rects, this->width, this->height);
+    texture = this->easuImage;
+  }
+  else
+  {
+    egl_framebufferBind(this->easuFb);
+    egl_shaderUse(prog->easu);
+    egl_filterRectsRender(prog->easu, rects);
+    texture = egl_framebufferGetTexture(this->easuFb);
+  }
 
   // pass 2, Rcas
   egl_framebufferBind(this->rcasFb);
@@ -439,6 +597,8 @@ EGL_FilterOps egl_filterFFXFSR1Ops =
   .id               = "ffxFSR1",
   .name             = "AMD FidelityFX FSR",
   .type             = EGL_FILTER_TYPE_UPSCALE,
+  .damageRadius     = 3,
+  .unpack24         = true,
   .earlyInit        = egl_filterFFXFSR1EarlyInit,
   .init             = egl_filterFFXFSR1Init,
   .free             = egl_filterFFXFSR1Free,
@@ -0,0 +1,192 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "gpu_timer.h"
+
+#include "common/debug.h"
+#include "common/ringbuffer.h"
+#include "common/stringutils.h"
+#include "app.h"
+#include "util.h"
+#include "egl_dynprocs.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// queries in flight per timer before a stage goes unmeasured
+#define GPU_TIMER_QUERIES 4
+
+struct EGL_GPUTimer
+{
+  char        * name;
+  GLuint        queries[GPU_TIMER_QUERIES];
+  unsigned int  head, tail;
+  bool          active;
+  float         average;
+
+  RingBuffer    timings;
+  GraphHandle   graph;
+};
+
+static bool l_enabled  = false;
+static bool l_disjoint = false;
+
+void egl_gpuTimerSetup(const char * gl_exts, bool enable)
+{
+  l_enabled = false;
+  if (!enable)
+    return;
+
+  if (!util_hasGLExt(gl_exts, "GL_EXT_disjoint_timer_query") ||
+      !g_egl_dynProcs.glGenQueriesEXT          ||
+      !g_egl_dynProcs.glDeleteQueriesEXT       ||
+      !g_egl_dynProcs.glBeginQueryEXT          ||
+      !g_egl_dynProcs.glEndQueryEXT            ||
+      !g_egl_dynProcs.glGetQueryObjectuivEXT   ||
+      !g_egl_dynProcs.glGetQueryObjectui64vEXT)
+  {
+    DEBUG_INFO("GPU timers unavailable, GL_EXT_disjoint_timer_query missing");
+    return;
+  }
+
+  l_enabled = true;
+}
+
+void egl_gpuTimerNewFrame(void)
+{
+  if (!l_enabled)
+    return;
+
+  /* the flag clears when read, if it is set any result collected this frame
+   * may span a clock change and is discarded */
+  GLint disjoint = 0;
+  glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+  l_disjoint = disjoint;
+}
+
+bool egl_gpuTimerInit(EGL_GPUTimer ** timer, const char * name)
+{
+  *timer = NULL;
+  if (!l_enabled)
+    return true;
+
+  EGL_GPUTimer * this = calloc(1, sizeof(*this));
+  if (!this)
+  {
+    DEBUG_ERROR("Failed to allocate ram");
+    return false;
+  }
+
+  if (alloc_sprintf(&this->name, "GPU %s", name) < 0)
+  {
+    DEBUG_ERROR("Failed to allocate ram");
+    free(this);
+    return false;
+  }
+
+  this->timings = ringbuffer_new(256, sizeof(float));
+  if (!this->timings)
+  {
+    DEBUG_ERROR("Failed to allocate the timing buffer");
+    free(this->name);
+    free(this);
+    return false;
+  }
+
+  g_egl_dynProcs.glGenQueriesEXT(GPU_TIMER_QUERIES, this->queries);
+  this->average = -1.0f;
+  this->graph   = app_registerGraph(this->name, this->timings,
+      0.0f, 5.0f, NULL);
+
+  *timer = this;
+  return true;
+}
+
+void egl_gpuTimerFree(EGL_GPUTimer ** timer)
+{
+  EGL_GPUTimer * this = *timer;
+  if (!this)
+    return;
+
+  app_unregisterGraph(this->graph);
+  ringbuffer_free(&this->timings);
+  g_egl_dynProcs.glDeleteQueriesEXT(GPU_TIMER_QUERIES, this->queries);
+  free(this->name);
+  free(this);
+  *timer = NULL;
+}
+
+static void collect(EGL_GPUTimer * this)
+{
+  while(this->tail != this->head)
+  {
+    const GLuint query = this->queries[this->tail % GPU_TIMER_QUERIES];
+
+    GLuint available = 0;
+    g_egl_dynProcs.glGetQueryObjectuivEXT(query,
+        GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+    if (!available)
+      break;
+
+    GLuint64 elapsed;
+    g_egl_dynProcs.glGetQueryObjectui64vEXT(query,
+        GL_QUERY_RESULT_EXT, &elapsed);
+    ++this->tail;
+
+    if (l_disjoint)
+      continue;
+
+    const float ms = elapsed * 1e-6f;
+    ringbuffer_push(this->timings, &ms);
+    this->average = this->average < 0.0f ?
+      ms : this->average * 0.9f + ms * 0.1f;
+  }
+}
+
+void egl_gpuTimerBegin(EGL_GPUTimer * this)
+{
+  if (!this)
+    return;
+
+  collect(this);
+
+  // all queries are still in flight, skip this sample rather than stall
+  if (this->head - this->tail == GPU_TIMER_QUERIES)
+    return;
+
+  g_egl_dynProcs.glBeginQueryEXT(GL_TIME_ELAPSED_EXT,
+      this->queries[this->head % GPU_TIMER_QUERIES]);
+  this->active = true;
+}
+
+void egl_gpuTimerEnd(EGL_GPUTimer * this)
+{
+  if (!this || !this->active)
+    return;
+
+  g_egl_dynProcs.glEndQueryEXT(GL_TIME_ELAPSED_EXT);
+  this->active = false;
+  ++this->head;
+}
+
+float egl_gpuTimerGetAverage(EGL_GPUTimer * this)
+{
+  return this ? this->average : -1.0f;
+}
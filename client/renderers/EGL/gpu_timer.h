@@ -0,0 +1,49 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+/* Measures how long the GPU spends on a stage of the frame using
+ * GL_EXT_disjoint_timer_query. Results are collected without stalling a few
+ * frames after they were issued and are pushed to a timing graph.
+ *
+ * When timer queries are unavailable or disabled the timers are NULL and all
+ * functions accept a NULL timer as a no-op. */
+
+typedef struct EGL_GPUTimer EGL_GPUTimer;
+
+/* must be called with the context current before any timer is created */
+void egl_gpuTimerSetup(const char * gl_exts, bool enable);
+
+/* call once at the start of each frame, before any timer is begun */
+void egl_gpuTimerNewFrame(void);
+
+bool egl_gpuTimerInit(EGL_GPUTimer ** timer, const char * name);
+void egl_gpuTimerFree(EGL_GPUTimer ** timer);
+
+/* timers can not be nested, only one may be active at any time */
+void egl_gpuTimerBegin(EGL_GPUTimer * timer);
+void egl_gpuTimerEnd(EGL_GPUTimer * timer);
+
+/* returns the smoothed time in milliseconds, or a negative value if there are
+ * no results yet */
+float egl_gpuTimerGetAverage(EGL_GPUTimer * timer);
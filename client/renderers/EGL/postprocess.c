@@ -21,6 +21,7 @@
 #define _GNU_SOURCE
 #include "postprocess.h"
 #include "filters.h"
+#include "shader.h"
 #include "app.h"
 #include "cimgui.h"
 
@@ -35,8 +36,10 @@
 #include "common/array.h"
 #include "common/option.h"
 #include "common/paths.h"
+#include "common/rects.h"
 #include "common/stringlist.h"
 #include "common/stringutils.h"
+#include "common/util.h"
 #include "common/vector.h"
 
 static const EGL_FilterOps * EGL_Filters[] =
@@ -46,14 +49,27 @@ static const EGL_FilterOps * EGL_Filters[] =
   &egl_filterFFXCASOps
 };
 
+/* what each filter in the chain produced on the last run, if anything differs
+ * the persistent output of that filter and everything after it is stale */
+struct ChainEntry
+{
+  EGL_Filter         * filter;
+  EGL_Texture        * input;
+  unsigned int         width, height;
+  enum EGL_PixelFormat pixFmt;
+};
+
 struct EGL_PostProcess
 {
   Vector filters, internalFilters;
   EGL_Texture * output;
   unsigned int outputX, outputY;
+  const struct DamageRects * outputDamage;
   _Atomic(bool) modified;
 
-  EGL_DesktopRects * rects;
+  EGL_DesktopRects   * rects;
+  struct DamageRects * damage;
+  Vector chain;
 
   StringList presets;
   char * presetDir;
@@ -453,6 +469,32 @@ static void drawDropTarget(void)
   igPopStyleColor(1);
 }
 
+// returns true if the filter ran on the last pass of the chain
+static bool filterActive(EGL_PostProcess * this, EGL_Filter * filter)
+{
+  struct ChainEntry * entry;
+  vector_forEachRef(entry, &this->chain)
+    if (entry->filter == filter)
+      return true;
+  return false;
+}
+
+/* the header label shows what the filter cost the GPU on recent frames, the
+ * id after ### keeps the ImGui state stable as the text changes */
+static void filterLabel(EGL_PostProcess * this, EGL_Filter * filter,
+    char * label, size_t size)
+{
+  const float ms = egl_gpuTimerGetAverage(filter->timer);
+  if (ms < 0.0f)
+    snprintf(label, size, "%s###%s", filter->ops.name, filter->ops.id);
+  else if (!filterActive(this, filter))
+    snprintf(label, size, "%s (inactive)###%s",
+        filter->ops.name, filter->ops.id);
+  else
+    snprintf(label, size, "%s (%.3f ms)###%s",
+        filter->ops.name, ms, filter->ops.id);
+}
+
 static void configUI(void * opaque, int * id)
 {
   struct EGL_PostProcess * this = opaque;
@@ -480,8 +522,11 @@ static void configUI(void * opaque, int * id)
     if (moving && mouseIdx < moveIdx && i == mouseIdx)
       drawDropTarget();
 
+    char label[128];
+    filterLabel(this, filter, label, sizeof(label));
+
     igPushID_Ptr(filter);
-    bool draw = igCollapsingHeader_BoolPtr(filter->ops.name, NULL, 0);
+    bool draw = igCollapsingHeader_BoolPtr(label, NULL, 0);
     if (igIsItemHovered(ImGuiHoveredFlags_AllowWhenBlockedByActiveItem))
       mouseIdx = i;
 
@@ -509,6 +554,26 @@ static void configUI(void * opaque, int * id)
       drawDropTarget();
   }
 
+  // the total includes the internal filters as they cost frame time too
+  float total = 0.0f;
+  bool  timed = false;
+  struct ChainEntry * entry;
+  vector_forEachRef(entry, &this->chain)
+  {
+    const float ms = egl_gpuTimerGetAverage(entry->filter->timer);
+    if (ms >= 0.0f)
+    {
+      total += ms;
+      timed  = true;
+    }
+  }
+
+  if (timed)
+  {
+    igSeparator();
+    igText("Filter chain GPU time: %.3f ms", total);
+  }
+
   if (moving)
   {
     igSetMouseCursor(ImGuiMouseCursor_Hand);
@@ -562,12 +627,27 @@ bool egl_postProcessInit(EGL_PostProcess ** pp)
     goto error_filters;
   }
 
-  if (!egl_desktopRectsInit(&this->rects, 1))
+  if (!vector_create(&this->chain,
+        sizeof(struct ChainEntry), ARRAY_LENGTH(EGL_Filters) + 1))
   {
-    DEBUG_ERROR("Failed to initialize the desktop rects");
+    DEBUG_ERROR("Failed to allocate the filter chain");
     goto error_internal;
   }
 
+  if (!egl_desktopRectsInit(&this->rects, KVMFR_MAX_DAMAGE_RECTS))
+  {
+    DEBUG_ERROR("Failed to initialize the desktop rects");
+    goto error_chain;
+  }
+
+  this->damage = malloc(sizeof(*this->damage) +
+      KVMFR_MAX_DAMAGE_RECTS * sizeof(*this->damage->rects));
+  if (!this->damage)
+  {
+    DEBUG_ERROR("Failed to allocate the damage rects");
+    goto error_rects;
+  }
+
   loadPresetList(this);
   reorderFilters(this);
   app_overlayConfigRegisterTab("EGL Filters", configUI, this);
@@ -575,6 +655,12 @@ bool egl_postProcessInit(EGL_PostProcess ** pp)
   *pp = this;
   return true;
 
+error_rects:
+  egl_desktopRectsFree(&this->rects);
+
+error_chain:
+  vector_destroy(&this->chain);
+
 error_internal:
   vector_destroy(&this->internalFilters);
 
@@ -606,7 +692,9 @@ void egl_postProcessFree(EGL_PostProcess ** pp)
   if (this->presets)
     stringlist_free(&this->presets);
 
+  vector_destroy(&this->chain);
   egl_desktopRectsFree(&this->rects);
+  free(this->damage);
   free(this->presetError);
   free(this);
   *pp = NULL;
@@ -630,14 +718,150 @@ bool egl_postProcessConfigModified(EGL_PostProcess * this)
   return atomic_load(&this->modified);
 }
 
+/* grow the damage by margin desktop pixels and load it into the mesh, a NULL
+ * damage list renders the whole desktop. Returns the area loaded */
+static const struct DamageRects * updateDamageRects(EGL_PostProcess * this,
+    const struct DamageRects * damage, int margin,
+    int desktopWidth, int desktopHeight)
+{
+  if (!damage || damage->count < 0)
+  {
+    egl_desktopRectsUpdate(this->rects, NULL, desktopWidth, desktopHeight);
+    return NULL;
+  }
+
+  struct DamageRects * grown = this->damage;
+  grown->count = damage->count;
+  for (int i = 0; i < damage->count; ++i)
+  {
+    const FrameDamageRect * rect = damage->rects + i;
+    const int x = max(0, (int)rect->x - margin);
+    const int y = max(0, (int)rect->y - margin);
+    grown->rects[i] = (FrameDamageRect) {
+      .x      = x,
+      .y      = y,
+      .width  = min(desktopWidth , (int)(rect->x + rect->width ) + margin) - x,
+      .height = min(desktopHeight, (int)(rect->y + rect->height) + margin) - y,
+    };
+  }
+
+  grown->count = rectsMergeOverlapping(grown->rects, grown->count);
+  egl_desktopRectsUpdate(this->rects, grown, desktopWidth, desktopHeight);
+  return grown;
+}
+
+/* the state of a pass through the filter chain */
+struct ChainRun
+{
+  const struct DamageRects * damage;
+  EGL_FilterRects          * filterRects;
+  int                        desktopWidth, desktopHeight;
+
+  EGL_Texture        * texture;
+  unsigned int         sizeX, sizeY;
+  enum EGL_PixelFormat pixFmt;
+  bool                 useDMA;
+  EGL_Filter         * lastFilter;
+
+  size_t chainIdx;
+  int    margin;
+  int    rectsMargin;
+  bool   rectsFull;
+};
+
+/* sets up and runs a single filter on the output of the previous one, returns
+ * false if the filter bypassed itself */
+static bool runFilter(EGL_PostProcess * this, struct ChainRun * run,
+    EGL_Filter * filter)
+{
+  if (!egl_filterSetup(filter, run->pixFmt, run->sizeX, run->sizeY,
+        run->desktopWidth, run->desktopHeight, run->useDMA) ||
+      !egl_filterPrepare(filter))
+    return false;
+
+  // the radius is in input pixels, convert it to desktop pixels
+  run->margin += filter->ops.damageRadius * max(
+    (run->desktopWidth  + run->sizeX - 1) / run->sizeX,
+    (run->desktopHeight + run->sizeY - 1) / run->sizeY);
+
+  struct ChainEntry entry = { .filter = filter, .input = run->texture };
+  egl_filterGetOutputRes(filter, &entry.width, &entry.height, &entry.pixFmt);
+
+  if (run->chainIdx < vector_size(&this->chain))
+  {
+    struct ChainEntry * last = vector_ptrTo(&this->chain, run->chainIdx);
+    if (last->filter != entry.filter ||
+        last->input  != entry.input  ||
+        last->width  != entry.width  ||
+        last->height != entry.height ||
+        last->pixFmt != entry.pixFmt)
+      run->damage = NULL;
+    *last = entry;
+  }
+  else
+  {
+    vector_push(&this->chain, &entry);
+    run->damage = NULL;
+  }
+  ++run->chainIdx;
+
+  if (!run->damage)
+  {
+    if (!run->rectsFull)
+      run->filterRects->damage = updateDamageRects(this, NULL, 0,
+          run->desktopWidth, run->desktopHeight);
+    run->rectsFull = true;
+  }
+  else if (run->margin != run->rectsMargin)
+  {
+    run->filterRects->damage = updateDamageRects(this, run->damage,
+        run->margin, run->desktopWidth, run->desktopHeight);
+    run->rectsMargin = run->margin;
+  }
+
+  run->texture = egl_filterRun(filter, run->filterRects, run->texture);
+  run->sizeX   = entry.width;
+  run->sizeY   = entry.height;
+  run->pixFmt  = entry.pixFmt;
+
+  if (run->lastFilter)
+    egl_filterRelease(run->lastFilter);
+
+  run->lastFilter = filter;
+
+  // the first filter to run will convert to a normal texture
+  run->useDMA = false;
+  return true;
+}
+
+/* returns true if the filter will run on the output of the held back unpack,
+ * which is set up to find the format the filter will be given */
+static bool willRunUnpacked(struct ChainRun * run, EGL_Filter * unpack,
+    EGL_Filter * filter)
+{
+  // if the unpack can not be set up flush it anyway to report the failure
+  if (!egl_filterSetup(unpack, run->pixFmt, run->sizeX, run->sizeY,
+        run->desktopWidth, run->desktopHeight, run->useDMA) ||
+      !egl_filterPrepare(unpack))
+    return true;
+
+  unsigned int    sizeX, sizeY;
+  EGL_PixelFormat pixFmt;
+  egl_filterGetOutputRes(unpack, &sizeX, &sizeY, &pixFmt);
+
+  return
+    egl_filterSetup(filter, pixFmt, sizeX, sizeY,
+      run->desktopWidth, run->desktopHeight, false) &&
+    egl_filterPrepare(filter);
+}
+
 bool egl_postProcessRun(EGL_PostProcess * this, EGL_Texture * tex,
-    EGL_DesktopRects * rects, int desktopWidth, int desktopHeight,
+    const struct DamageRects * damage, int desktopWidth, int desktopHeight,
     unsigned int targetX, unsigned int targetY, bool useDMA)
 {
   if (targetX == 0 && targetY == 0)
     DEBUG_FATAL("targetX || targetY == 0");
 
-  EGL_Filter * lastFilter = NULL;
   unsigned int sizeX, sizeY;
 
   //TODO: clean this up
@@ -647,25 +871,38 @@ bool egl_postProcessRun(EGL_PostProcess * this, EGL_Texture * tex,
         &sizeX, &sizeY, &pixFmt) != EGL_TEX_STATUS_OK)
     return false;
 
+  // a configuration change may alter the output of any filter
   if (atomic_exchange(&this->modified, false))
-  {
-    rects = this->rects;
-    egl_desktopRectsUpdate(rects, NULL, desktopWidth, desktopHeight);
-  }
+    damage = NULL;
 
   GLfloat matrix[6];
   egl_desktopRectsMatrix(matrix, desktopWidth, desktopHeight, 0.0f, 0.0f,
       1.0f, 1.0f, LG_ROTATE_0);
 
   EGL_FilterRects filterRects = {
-    .rects  = rects,
+    .rects  = this->rects,
     .matrix = matrix,
     .width  = desktopWidth,
     .height = desktopHeight,
   };
 
-  EGL_Filter * filter;
-  EGL_Texture * texture = tex;
+  /* Each filter only re-renders the damaged area of its persistent output,
+   * grown by how far the filters up to and including it sample around each
+   * pixel. Once the chain differs from the last run the output of that filter
+   * and all that follow it is stale and must be rendered in full. */
+  struct ChainRun run =
+  {
+    .damage        = damage,
+    .filterRects   = &filterRects,
+    .desktopWidth  = desktopWidth,
+    .desktopHeight = desktopHeight,
+    .texture       = tex,
+    .sizeX         = sizeX,
+    .sizeY         = sizeY,
+    .pixFmt        = pixFmt,
+    .useDMA        = useDMA,
+    .rectsMargin   = -1
+  };
 
   const Vector * lists[] =
   {
@@ -674,31 +911,77 @@ bool egl_postProcessRun(EGL_PostProcess * this, EGL_Texture * tex,
     NULL
   };
 
+  /* The unpack of packed 24-bit input is held back so the first active filter
+   * that can read the packed texture itself does so in the same pass, saving
+   * a full resolution intermediate. The only internal filter is the unpack. */
+  EGL_Filter * unpack = NULL;
+  EGL_Filter * filter;
+
   for(const Vector ** filters = lists; *filters; ++filters)
     vector_forEach(filter, *filters)
     {
       egl_filterSetOutputResHint(filter, targetX, targetY);
 
-      if (!egl_filterSetup(filter, pixFmt, sizeX, sizeY,
-            desktopWidth, desktopHeight, useDMA) ||
-          !egl_filterPrepare(filter))
+      if (filter->ops.type == EGL_FILTER_TYPE_INTERNAL &&
+          egl_filterIsPacked24(run.pixFmt))
+      {
+        unpack = filter;
         continue;
+      }
 
-      texture = egl_filterRun(filter, &filterRects, texture);
-      egl_filterGetOutputRes(filter, &sizeX, &sizeY, &pixFmt);
+      if (unpack)
+      {
+        if (filter->ops.unpack24 && runFilter(this, &run, filter))
+        {
+          unpack = NULL;
+          continue;
+        }
+
+        /* a filter may refuse packed input but take unpacked input, such as
+         * while its program for packed input is still being built. Otherwise
+         * keep holding the unpack for a later filter */
+        if (!willRunUnpacked(&run, unpack, filter))
+          continue;
+
+        runFilter(this, &run, unpack);
+        unpack = NULL;
+      }
 
-      if (lastFilter)
-        egl_filterRelease(lastFilter);
+      runFilter(this, &run, filter);
+    }
 
-      lastFilter = filter;
+  // nothing was able to take the packed input, unpack it on its own
+  if (unpack)
+    runFilter(this, &run, unpack);
 
-      // the first filter to run will convert to a normal texture
-      useDMA = false;
-    }
+  while(vector_size(&this->chain) > run.chainIdx)
+    vector_pop(&this->chain);
+
+  // filters build their shaders when first enabled or when the input changes
+  const EGL_ShaderStats stats = egl_shaderTakeStats();
+  if (unlikely(stats.compiled || stats.cached))
+    DEBUG_INFO("Filter shaders: %u compiled, %u cached, %.2f ms",
+        stats.compiled, stats.cached, stats.time * 1e-6);
+
+  /* filters whose shaders are still building were bypassed or ran with their
+   * previous program, keep re-running the chain until they are ready so they
+   * are picked up without waiting for the next frame */
+  if (egl_shaderAsyncPending())
+  {
+    atomic_store(&this->modified, true);
+    app_invalidateWindow(false);
+  }
 
-  this->output  = texture;
-  this->outputX = sizeX;
-  this->outputY = sizeY;
+  this->output  = run.texture;
+  this->outputX = run.sizeX;
+  this->outputY = run.sizeY;
+
+  // without any filters the output is the input texture and its damage
+  if (run.chainIdx == 0)
+    this->outputDamage = run.damage && run.damage->count >= 0 ?
+      run.damage : NULL;
+  else
+    this->outputDamage = filterRects.damage;
   return true;
 }
 
@@ -709,3 +992,8 @@ EGL_Texture * egl_postProcessGetOutput(EGL_PostProcess * this,
   *outputY = this->outputY;
   return this->output;
 }
+
+const struct DamageRects * egl_postProcessGetDamage(EGL_PostProcess * this)
+{
+  return this->outputDamage;
+}
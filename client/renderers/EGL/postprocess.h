@@ -38,10 +38,16 @@ bool egl_postProcessAdd(EGL_PostProcess * this, const EGL_FilterOps * ops);
 bool egl_postProcessConfigModified(EGL_PostProcess * this);
 
 /* apply the filters to the supplied texture
+ * damage is the area of the desktop changed since the last run, or NULL if the
+ * whole desktop must be processed
  * targetX/Y is the final target output dimension hint if scalers are present */
 bool egl_postProcessRun(EGL_PostProcess * this, EGL_Texture * tex,
-    EGL_DesktopRects * rects, int desktopWidth, int desktopHeight,
+    const struct DamageRects * damage, int desktopWidth, int desktopHeight,
     unsigned int targetX, unsigned int targetY, bool useDMA);
 
 EGL_Texture * egl_postProcessGetOutput(EGL_PostProcess * this,
     unsigned int * outputX, unsigned int * outputY);
+
+/* returns the area of the desktop that changed in the output of the last run,
+ * or NULL if all of it did. Only valid until the next run */
+const struct DamageRects * egl_postProcessGetDamage(EGL_PostProcess * this);
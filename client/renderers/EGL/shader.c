@@ -19,14 +19,44 @@
  */
 
 #include "shader.h"
+#include "shader_cache.h"
 #include "common/debug.h"
+#include "common/ll.h"
+#include "common/locking.h"
+#include "common/event.h"
+#include "common/thread.h"
 #include "common/stringutils.h"
+#include "common/time.h"
+#include "egl_dynprocs.h"
 #include "util.h"
 
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+// a program being built, owned by whichever thread is building it
+struct ShaderBuild
+{
+  GLuint   program;
+  GLuint   vertexShader;
+  GLuint   fragmentShader;
+  uint64_t key;
+  uint64_t start;
+};
+
+struct ShaderJob
+{
+  EGL_Shader       * shader;
+  char             * vertex_code;
+  size_t             vertex_size;
+  char             * fragment_code;
+  size_t             fragment_size;
+  struct ShaderBuild build;
+};
+
+/* the program in use is only replaced by the render thread once a build has
+ * completed, until then the previous program remains valid */
 struct EGL_Shader
 {
   bool   hasShader;
@@ -35,8 +65,61 @@ struct EGL_Shader
   EGL_Uniform * uniforms;
   int           uniformCount;
   int           uniformUsed;
+
+  // asynchronous build state
+  _Atomic(EGL_ShaderStatus) status;
+  bool               tracked; // in l_async.building
+
+  // GL_KHR_parallel_shader_compile, render thread only
+  bool               linking; // a parallel compile is in flight
+  struct ShaderBuild build;
+
+  /* the worker build, set and cleared by the render thread. The worker only
+   * writes to the job and publishes the result by setting status */
+  struct ShaderJob * job;
 };
 
+static struct
+{
+  atomic_uint        compiled;
+  atomic_uint        cached;
+  _Atomic(uint64_t)  time;
+}
+l_stats = { 0 };
+
+static struct
+{
+  // GL_KHR_parallel_shader_compile is available
+  bool parallel;
+
+  // otherwise builds are made on a worker with a shared context
+  EGLDisplay  display;
+  EGLContext  context;
+  LGThread  * thread;
+  LGEvent   * wake;
+  LGEvent   * done;
+  LG_Lock     lock;
+  struct ll * jobs;
+  bool        workerOk;
+  bool        stop;
+
+  // shaders with a build that has not yet been reported by
+  // egl_shaderAsyncPending, only used from the render thread
+  struct ll * building;
+}
+l_async = { 0 };
+
+EGL_ShaderStats egl_shaderTakeStats(void)
+{
+  return (EGL_ShaderStats) {
+    .compiled = atomic_exchange(&l_stats.compiled, 0),
+    .cached   = atomic_exchange(&l_stats.cached  , 0),
+    .time     = atomic_exchange(&l_stats.time    , 0)
+  };
+}
+
+static void shaderWaitJob(EGL_Shader * this);
+
 bool egl_shaderInit(EGL_Shader ** this)
 {
   *this = calloc(1, sizeof(EGL_Shader));
@@ -46,15 +129,42 @@ bool egl_shaderInit(EGL_Shader ** this)
     return false;
   }
 
+  atomic_init(&(*this)->status, EGL_SHADER_FAILED);
   return true;
 }
 
+static void shaderAbortLink(EGL_Shader * this)
+{
+  if (!this->linking)
+    return;
+
+  glDeleteShader(this->build.fragmentShader);
+  glDeleteShader(this->build.vertexShader  );
+  glDeleteProgram(this->build.program);
+  this->linking = false;
+}
+
+// replaces the program in use with a completed build
+static void shaderInstall(EGL_Shader * this, GLuint program)
+{
+  if (this->hasShader)
+    glDeleteProgram(this->shader);
+
+  this->shader    = program;
+  this->hasShader = true;
+}
+
 void egl_shaderFree(EGL_Shader ** shader)
 {
   EGL_Shader * this = *shader;
   if (!this)
     return;
 
+  shaderWaitJob(this);
+  shaderAbortLink(this);
+  if (this->tracked && l_async.building)
+    ll_removeData(l_async.building, this);
+
   if (this->hasShader)
     glDeleteProgram(this->shader);
 
@@ -98,121 +208,495 @@ bool egl_shaderLoad(EGL_Shader * this,
   return ret;
 }
 
-static bool shaderCompile(EGL_Shader * this, const char * vertex_code,
-    size_t vertex_size, const char * fragment_code, size_t fragment_size)
+static bool shaderCheckCompile(GLuint shader, const char * type)
 {
-  if (this->hasShader)
+  GLint result = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
+  if (result != GL_FALSE)
+    return true;
+
+  DEBUG_ERROR("Failed to compile %s shader", type);
+
+  int logLength;
+  glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLength);
+  if (logLength > 0)
   {
-    glDeleteProgram(this->shader);
-    this->hasShader = false;
+    char *log = malloc(logLength + 1);
+    if (!log)
+      DEBUG_ERROR("out of memory");
+    else
+    {
+      glGetShaderInfoLog(shader, logLength, NULL, log);
+      log[logLength] = 0;
+      DEBUG_ERROR("%s", log);
+      free(log);
+    }
   }
 
-  GLint  length;
-  GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+  return false;
+}
 
-  length = vertex_size;
-  glShaderSource(vertexShader, 1, (const char**)&vertex_code, &length);
-  glCompileShader(vertexShader);
+/* starts building the program, returns true if it was loaded from the cache
+ * and is already complete, otherwise shaderFinish must be called once the
+ * driver has finished compiling */
+static bool shaderBegin(struct ShaderBuild * build, const char * vertex_code,
+    size_t vertex_size, const char * fragment_code, size_t fragment_size)
+{
+  build->start = nanotime();
+  build->key   = egl_shaderCacheKey(
+      vertex_code, vertex_size, fragment_code, fragment_size);
 
-  GLint result = GL_FALSE;
-  glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &result);
-  if (result == GL_FALSE)
+  if (egl_shaderCacheEnabled())
   {
-    DEBUG_ERROR("Failed to compile vertex shader");
+    build->program = glCreateProgram();
+    if (egl_shaderCacheLoad(build->program, build->key))
+    {
+      atomic_fetch_add(&l_stats.cached, 1);
+      atomic_fetch_add(&l_stats.time, nanotime() - build->start);
+      return true;
+    }
+    glDeleteProgram(build->program);
+  }
+
+  GLint length;
+  build->vertexShader = 0;
+  if (vertex_code)
+  {
+    build->vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    length = vertex_size;
+    glShaderSource(build->vertexShader, 1, (const char**)&vertex_code,
+        &length);
+    glCompileShader(build->vertexShader);
+  }
 
-    int logLength;
-    glGetShaderiv(vertexShader, GL_INFO_LOG_LENGTH, &logLength);
-    if (logLength > 0)
+  // without a vertex shader the program is a compute shader
+  build->fragmentShader = glCreateShader(
+      vertex_code ? GL_FRAGMENT_SHADER : GL_COMPUTE_SHADER);
+  length = fragment_size;
+  glShaderSource(build->fragmentShader, 1, (const char**)&fragment_code,
+      &length);
+  glCompileShader(build->fragmentShader);
+
+  /* the link is issued without checking the compile status as that would wait
+   * for the compile, if either failed so will the link */
+  build->program = glCreateProgram();
+  if (build->vertexShader)
+    glAttachShader(build->program, build->vertexShader);
+  glAttachShader(build->program, build->fragmentShader);
+  if (egl_shaderCacheEnabled())
+    glProgramParameteri(build->program,
+        GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  glLinkProgram(build->program);
+  return false;
+}
+
+// completes the build, on failure the program has been deleted
+static bool shaderFinish(struct ShaderBuild * build)
+{
+  bool ok =
+    (!build->vertexShader ||
+      shaderCheckCompile(build->vertexShader, "vertex")) &&
+    shaderCheckCompile(build->fragmentShader,
+        build->vertexShader ? "fragment" : "compute");
+
+  if (ok)
+  {
+    GLint result = GL_FALSE;
+    glGetProgramiv(build->program, GL_LINK_STATUS, &result);
+    if (result == GL_FALSE)
     {
-      char *log = malloc(logLength + 1);
-      if (!log)
-        DEBUG_ERROR("out of memory");
-      else
+      DEBUG_ERROR("Failed to link shader program");
+
+      int logLength;
+      glGetProgramiv(build->program, GL_INFO_LOG_LENGTH, &logLength);
+      if (logLength > 0)
       {
-        glGetShaderInfoLog(vertexShader, logLength, NULL, log);
+        char *log = malloc(logLength + 1);
+        glGetProgramInfoLog(build->program, logLength, NULL, log);
         log[logLength] = 0;
         DEBUG_ERROR("%s", log);
         free(log);
       }
+      ok = false;
     }
+  }
+
+  if (build->vertexShader)
+    glDetachShader(build->program, build->vertexShader);
+  glDetachShader(build->program, build->fragmentShader);
+  glDeleteShader(build->fragmentShader);
+  glDeleteShader(build->vertexShader  );
 
-    glDeleteShader(vertexShader);
+  if (!ok)
+  {
+    glDeleteProgram(build->program);
     return false;
   }
 
-  GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+  egl_shaderCacheStore(build->program, build->key);
 
-  length = fragment_size;
-  glShaderSource(fragmentShader, 1, (const char**)&fragment_code, &length);
-  glCompileShader(fragmentShader);
+  atomic_fetch_add(&l_stats.compiled, 1);
+  atomic_fetch_add(&l_stats.time, nanotime() - build->start);
+  return true;
+}
+
+static bool shaderCompile(EGL_Shader * this, const char * vertex_code,
+    size_t vertex_size, const char * fragment_code, size_t fragment_size)
+{
+  shaderWaitJob(this);
+  shaderAbortLink(this);
+
+  struct ShaderBuild build;
+  const bool ok =
+    shaderBegin(&build, vertex_code, vertex_size, fragment_code,
+        fragment_size) ||
+    shaderFinish(&build);
+
+  if (ok)
+    shaderInstall(this, build.program);
+
+  atomic_store(&this->status, ok ? EGL_SHADER_READY : EGL_SHADER_FAILED);
+  return ok;
+}
 
-  glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &result);
-  if (result == GL_FALSE)
+static void shaderFreeJob(struct ShaderJob * job)
+{
+  free(job->vertex_code);
+  free(job->fragment_code);
+  free(job);
+}
+
+static int shaderWorker(void * opaque)
+{
+  l_async.workerOk = eglMakeCurrent(l_async.display,
+      EGL_NO_SURFACE, EGL_NO_SURFACE, l_async.context);
+  lgSignalEvent(l_async.done);
+  if (!l_async.workerOk)
+    return 0;
+
+  for(;;)
   {
-    DEBUG_ERROR("Failed to compile fragment shader");
+    lgWaitEvent(l_async.wake, TIMEOUT_INFINITE);
 
-    int logLength;
-    glGetShaderiv(fragmentShader, GL_INFO_LOG_LENGTH, &logLength);
-    if (logLength > 0)
+    for(;;)
     {
-      char *log = malloc(logLength + 1);
-      if (!log)
-        DEBUG_ERROR("out of memory");
-      else
+      struct ShaderJob * job;
+      LG_LOCK(l_async.lock);
+      if (l_async.stop)
       {
-        glGetShaderInfoLog(fragmentShader, logLength, NULL, log);
-        log[logLength] = 0;
-        DEBUG_ERROR("%s", log);
-        free(log);
+        LG_UNLOCK(l_async.lock);
+        goto exit;
       }
+
+      if (!ll_shift(l_async.jobs, (void **)&job))
+      {
+        LG_UNLOCK(l_async.lock);
+        break;
+      }
+      LG_UNLOCK(l_async.lock);
+
+      const bool ok =
+        shaderBegin(&job->build, job->vertex_code, job->vertex_size,
+            job->fragment_code, job->fragment_size) ||
+        shaderFinish(&job->build);
+
+      // the program must be complete before another context may use it
+      glFinish();
+
+      // the render thread takes the job back once it sees the status change
+      atomic_store(&job->shader->status,
+          ok ? EGL_SHADER_READY : EGL_SHADER_FAILED);
+      lgSignalEvent(l_async.done);
     }
+  }
 
-    glDeleteShader(fragmentShader);
-    glDeleteShader(vertexShader  );
+exit:
+  eglMakeCurrent(l_async.display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+      EGL_NO_CONTEXT);
+  return 0;
+}
+
+/* takes back a completed worker build, installing the program if it was
+ * built. Returns false if the worker has not finished with it yet */
+static bool shaderCollectJob(EGL_Shader * this)
+{
+  const EGL_ShaderStatus status = atomic_load(&this->status);
+  if (status == EGL_SHADER_PENDING)
     return false;
+
+  if (status == EGL_SHADER_READY)
+    shaderInstall(this, this->job->build.program);
+
+  shaderFreeJob(this->job);
+  this->job = NULL;
+  return true;
+}
+
+// cancels a queued job for the shader, or waits for it if it is running
+static void shaderWaitJob(EGL_Shader * this)
+{
+  if (!this->job)
+    return;
+
+  // the worker may already have been stopped with the job completed
+  bool queued = false;
+  if (l_async.jobs)
+  {
+    LG_LOCK(l_async.lock);
+    queued = ll_removeData(l_async.jobs, this->job);
+    LG_UNLOCK(l_async.lock);
   }
 
-  this->shader = glCreateProgram();
-  glAttachShader(this->shader, vertexShader  );
-  glAttachShader(this->shader, fragmentShader);
-  glLinkProgram(this->shader);
+  if (queued)
+  {
+    shaderFreeJob(this->job);
+    this->job = NULL;
+    atomic_store(&this->status, EGL_SHADER_FAILED);
+    return;
+  }
 
-  glGetProgramiv(this->shader, GL_LINK_STATUS, &result);
-  if (result == GL_FALSE)
+  while(!shaderCollectJob(this))
+    lgWaitEvent(l_async.done, TIMEOUT_INFINITE);
+}
+
+static char * shaderDup(const char * code, size_t size)
+{
+  char * copy = malloc(size);
+  if (copy)
+    memcpy(copy, code, size);
+  return copy;
+}
+
+static bool shaderCompileAsync(EGL_Shader * this, const char * vertex_code,
+    size_t vertex_size, const char * fragment_code, size_t fragment_size)
+{
+  if (!l_async.parallel && !l_async.thread)
+    return shaderCompile(this,
+        vertex_code, vertex_size, fragment_code, fragment_size);
+
+  shaderWaitJob(this);
+  shaderAbortLink(this);
+
+  if (l_async.parallel)
   {
-    DEBUG_ERROR("Failed to link shader program");
+    if (shaderBegin(&this->build,
+          vertex_code, vertex_size, fragment_code, fragment_size))
+    {
+      shaderInstall(this, this->build.program);
+      atomic_store(&this->status, EGL_SHADER_READY);
+      return true;
+    }
+    this->linking = true;
+    atomic_store(&this->status, EGL_SHADER_PENDING);
+  }
+  else
+  {
+    struct ShaderJob * job = malloc(sizeof(*job));
+    if (!job)
+    {
+      DEBUG_ERROR("out of memory");
+      return false;
+    }
 
-    int logLength;
-    glGetProgramiv(this->shader, GL_INFO_LOG_LENGTH, &logLength);
-    if (logLength > 0)
+    job->shader        = this;
+    job->vertex_code   = vertex_code ?
+      shaderDup(vertex_code, vertex_size) : NULL;
+    job->vertex_size   = vertex_size;
+    job->fragment_code = shaderDup(fragment_code, fragment_size);
+    job->fragment_size = fragment_size;
+    if ((vertex_code && !job->vertex_code) || !job->fragment_code)
     {
-      char *log = malloc(logLength + 1);
-      glGetProgramInfoLog(this->shader, logLength, NULL, log);
-      log[logLength] = 0;
-      DEBUG_ERROR("%s", log);
-      free(log);
+      DEBUG_ERROR("out of memory");
+      shaderFreeJob(job);
+      return false;
     }
 
-    glDetachShader(this->shader, vertexShader  );
-    glDetachShader(this->shader, fragmentShader);
-    glDeleteShader(fragmentShader);
-    glDeleteShader(vertexShader  );
-    glDeleteProgram(this->shader );
+    LG_LOCK(l_async.lock);
+    this->job = job;
+    atomic_store(&this->status, EGL_SHADER_PENDING);
+    ll_push(l_async.jobs, job);
+    LG_UNLOCK(l_async.lock);
+    lgSignalEvent(l_async.wake);
+  }
+
+  if (!this->tracked)
+  {
+    ll_push(l_async.building, this);
+    this->tracked = true;
+  }
+  return true;
+}
+
+EGL_ShaderStatus egl_shaderGetStatus(EGL_Shader * this)
+{
+  if (this->linking)
+  {
+    GLint complete = GL_FALSE;
+    glGetProgramiv(this->build.program, GL_COMPLETION_STATUS_KHR, &complete);
+    if (!complete)
+      return EGL_SHADER_PENDING;
+
+    this->linking = false;
+    const bool ok = shaderFinish(&this->build);
+    if (ok)
+      shaderInstall(this, this->build.program);
+
+    atomic_store(&this->status, ok ? EGL_SHADER_READY : EGL_SHADER_FAILED);
+  }
+  else if (this->job && !shaderCollectJob(this))
+    return EGL_SHADER_PENDING;
+
+  return atomic_load(&this->status);
+}
+
+bool egl_shaderAsyncPending(void)
+{
+  if (!l_async.building)
     return false;
+
+  bool changed = false;
+  EGL_Shader * shader;
+
+  ll_lock(l_async.building);
+  ll_forEachNL(l_async.building, item, shader)
+  {
+    if (egl_shaderGetStatus(shader) == EGL_SHADER_PENDING)
+      continue;
+
+    ll_removeNL(l_async.building, item);
+    free(item);
+    shader->tracked = false;
+    changed         = true;
   }
+  const bool building = ll_count(l_async.building) > 0;
+  ll_unlock(l_async.building);
 
-  glDetachShader(this->shader, vertexShader  );
-  glDetachShader(this->shader, fragmentShader);
-  glDeleteShader(fragmentShader);
-  glDeleteShader(vertexShader  );
+  return building || changed;
+}
 
-  this->hasShader = true;
+bool egl_shaderAsyncInit(EGLDisplay display, EGLConfig config,
+    EGLContext context, const char * gl_exts)
+{
+  l_async.building = ll_new();
+  if (!l_async.building)
+  {
+    DEBUG_ERROR("out of memory");
+    return false;
+  }
+
+  if (util_hasGLExt(gl_exts, "GL_KHR_parallel_shader_compile"))
+  {
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glMaxShaderCompilerThreadsKHR =
+      (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)
+      eglGetProcAddress("glMaxShaderCompilerThreadsKHR");
+
+    if (glMaxShaderCompilerThreadsKHR)
+    {
+      // let the driver choose how many threads to use
+      glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+      l_async.parallel = true;
+      DEBUG_INFO("Shaders : compiled in parallel by the driver");
+      return true;
+    }
+  }
+
+  static const EGLint attrs[] = {
+    EGL_CONTEXT_CLIENT_VERSION, 3,
+    EGL_NONE
+  };
+
+  l_async.display = display;
+  l_async.context = eglCreateContext(display, config, context, attrs);
+  if (l_async.context == EGL_NO_CONTEXT)
+  {
+    DEBUG_WARN("Failed to create the shader compiler context, "
+        "shaders will be compiled synchronously");
+    return true;
+  }
+
+  LG_LOCK_INIT(l_async.lock);
+  l_async.jobs = ll_new();
+  l_async.wake = lgCreateEvent(true, 0);
+  l_async.done = lgCreateEvent(true, 0);
+  l_async.stop = false;
+
+  if (!l_async.jobs || !l_async.wake || !l_async.done ||
+      !lgCreateThread("shaderCompiler", shaderWorker, NULL, &l_async.thread))
+  {
+    DEBUG_ERROR("Failed to start the shader compiler thread");
+    egl_shaderAsyncFree();
+    return false;
+  }
+
+  lgWaitEvent(l_async.done, TIMEOUT_INFINITE);
+  if (!l_async.workerOk)
+  {
+    DEBUG_WARN("Failed to make the shader compiler context current, "
+        "shaders will be compiled synchronously");
+    egl_shaderAsyncFree();
+    return true;
+  }
+
+  DEBUG_INFO("Shaders : compiled on a worker thread");
   return true;
 }
 
-bool egl_shaderCompile(EGL_Shader * this, const char * vertex_code,
+void egl_shaderAsyncFree(void)
+{
+  if (l_async.thread)
+  {
+    LG_LOCK(l_async.lock);
+    l_async.stop = true;
+    LG_UNLOCK(l_async.lock);
+    lgSignalEvent(l_async.wake);
+    lgJoinThread(l_async.thread, NULL);
+    l_async.thread = NULL;
+  }
+
+  if (l_async.jobs)
+  {
+    struct ShaderJob * job;
+    while(ll_shift(l_async.jobs, (void **)&job))
+    {
+      job->shader->job = NULL;
+      atomic_store(&job->shader->status, EGL_SHADER_FAILED);
+      shaderFreeJob(job);
+    }
+    ll_free(l_async.jobs);
+    l_async.jobs = NULL;
+    LG_LOCK_FREE(l_async.lock);
+  }
+
+  if (l_async.wake)
+  {
+    lgFreeEvent(l_async.wake);
+    l_async.wake = NULL;
+  }
+
+  if (l_async.done)
+  {
+    lgFreeEvent(l_async.done);
+    l_async.done = NULL;
+  }
+
+  if (l_async.context != EGL_NO_CONTEXT)
+  {
+    eglDestroyContext(l_async.display, l_async.context);
+    l_async.context = EGL_NO_CONTEXT;
+  }
+
+  if (l_async.building)
+  {
+    ll_free(l_async.building);
+    l_async.building = NULL;
+  }
+
+  l_async.parallel = false;
+}
+
+static bool shaderBuild(EGL_Shader * this, const char * vertex_code,
     size_t vertex_size, const char * fragment_code, size_t fragment_size,
-    bool useDMA, const EGL_ShaderDefine * defines)
+    bool useDMA, const EGL_ShaderDefine * defines, bool async)
 {
   bool result      = false;
   char * processed = NULL;
@@ -343,9 +827,14 @@ bool egl_shaderCompile(EGL_Shader * this, const char * vertex_code,
     fragment_size = processedLen;
   }
 
-  result = shaderCompile(this,
-      vertex_code  , vertex_size,
-      fragment_code, fragment_size);
+  if (async)
+    result = shaderCompileAsync(this,
+        vertex_code  , vertex_size,
+        fragment_code, fragment_size);
+  else
+    result = shaderCompile(this,
+        vertex_code  , vertex_size,
+        fragment_code, fragment_size);
 
 exit:
   free(processed);
@@ -353,6 +842,34 @@ exit:
   return result;
 }
 
+bool egl_shaderCompile(EGL_Shader * this, const char * vertex_code,
+    size_t vertex_size, const char * fragment_code, size_t fragment_size,
+    bool useDMA, const EGL_ShaderDefine * defines)
+{
+  return shaderBuild(this, vertex_code, vertex_size, fragment_code,
+      fragment_size, useDMA, defines, false);
+}
+
+bool egl_shaderCompileAsync(EGL_Shader * this, const char * vertex_code,
+    size_t vertex_size, const char * fragment_code, size_t fragment_size,
+    bool useDMA, const EGL_ShaderDefine * defines)
+{
+  return shaderBuild(this, vertex_code, vertex_size, fragment_code,
+      fragment_size, useDMA, defines, true);
+}
+
+bool egl_shaderCompileCompute(EGL_Shader * this, const char * code,
+    size_t size, bool useDMA, const EGL_ShaderDefine * defines)
+{
+  return shaderBuild(this, NULL, 0, code, size, useDMA, defines, false);
+}
+
+bool egl_shaderCompileComputeAsync(EGL_Shader * this, const char * code,
+    size_t size, bool useDMA, const EGL_ShaderDefine * defines)
+{
+  return shaderBuild(this, NULL, 0, code, size, useDMA, defines, true);
+}
+
 void egl_shaderSetUniforms(EGL_Shader * this, EGL_Uniform * uniforms, int count)
 {
   egl_shaderFreeUniforms(this);
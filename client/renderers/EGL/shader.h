@@ -22,7 +22,9 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
+#include <EGL/egl.h>
 #include <GLES3/gl3.h>
 
 #include "common/countedbuffer.h"
@@ -110,6 +112,53 @@ bool egl_shaderCompile(EGL_Shader * model, const char * vertex_code,
     size_t vertex_size, const char * fragment_code, size_t fragment_size,
     bool useDMA, const EGL_ShaderDefine * defines);
 
+typedef enum EGL_ShaderStatus
+{
+  EGL_SHADER_READY,
+  EGL_SHADER_PENDING,
+  EGL_SHADER_FAILED
+}
+EGL_ShaderStatus;
+
+/* starts the background shader compiler, this uses
+ * GL_KHR_parallel_shader_compile if available, otherwise a worker thread with
+ * a context shared with the one given. Must be called with context current */
+bool egl_shaderAsyncInit(EGLDisplay display, EGLConfig config,
+    EGLContext context, const char * gl_exts);
+void egl_shaderAsyncFree(void);
+
+/* as egl_shaderCompile but returns without waiting for the driver, the new
+ * program replaces the previous one when egl_shaderGetStatus returns
+ * EGL_SHADER_READY and must not be relied on before then. Falls back to
+ * compiling synchronously if there is no background compiler */
+bool egl_shaderCompileAsync(EGL_Shader * model, const char * vertex_code,
+    size_t vertex_size, const char * fragment_code, size_t fragment_size,
+    bool useDMA, const EGL_ShaderDefine * defines);
+
+/* build a compute program, the source is processed as the fragment source is
+ * by egl_shaderCompile. Requires OpenGL ES 3.1, see egl_computeSupported */
+bool egl_shaderCompileCompute(EGL_Shader * model, const char * code,
+    size_t size, bool useDMA, const EGL_ShaderDefine * defines);
+bool egl_shaderCompileComputeAsync(EGL_Shader * model, const char * code,
+    size_t size, bool useDMA, const EGL_ShaderDefine * defines);
+
+EGL_ShaderStatus egl_shaderGetStatus(EGL_Shader * model);
+
+/* returns true if an asynchronous build is still running, or has completed
+ * since the last call */
+bool egl_shaderAsyncPending(void);
+
+typedef struct EGL_ShaderStats
+{
+  unsigned compiled; // programs built from source
+  unsigned cached;   // programs loaded from the shader cache
+  uint64_t time;     // nanoseconds spent building programs
+}
+EGL_ShaderStats;
+
+/* returns the programs built since the last call and resets the counts */
+EGL_ShaderStats egl_shaderTakeStats(void);
+
 void egl_shaderSetUniforms(EGL_Shader * shader, EGL_Uniform * uniforms,
     int count);
 void egl_shaderFreeUniforms(EGL_Shader * shader);
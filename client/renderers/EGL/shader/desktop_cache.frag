@@ -0,0 +1,12 @@
+#version 300 es
+precision highp float;
+
+out highp vec4 color;
+
+uniform sampler2D sampler1;
+
+void main()
+{
+  // the cache is the size of the window, copy the pixel straight across
+  color = texelFetch(sampler1, ivec2(gl_FragCoord.xy), 0);
+}
@@ -16,9 +16,15 @@ uniform uvec4     uConsts[2];
 
 #include "ffx_a.h"
 
+#include "unpack_24bit.h"
+
 vec3 imageLoad(ivec2 point)
 {
+#ifdef UNPACK_24BIT
+  return unpack24(sampler1, point).rgb;
+#else
   return texelFetch(sampler1, point, 0).rgb;
+#endif
 }
 
 AF3 CasLoad(ASU2 p)
@@ -32,7 +38,11 @@ void CasInput(inout AF1 r,inout AF1 g,inout AF1 b) {}
 
 void main()
 {
+#ifdef UNPACK_24BIT
+  vec2  res   = uUnpackSize;
+#else
   vec2  res   = vec2(textureSize(sampler1, 0));
+#endif
   uvec2 point = uvec2(fragCoord * res);
 
   CasFilter(
@@ -20,9 +20,17 @@ uniform uvec4     uConsts[4];
 
 #define FSR_EASU_F 1
 
+#include "unpack_24bit.h"
+
+#ifdef UNPACK_24BIT
+AF4 FsrEasuRF(AF2 p){return AF4(unpack24Gather(sampler1, p, 0));}
+AF4 FsrEasuGF(AF2 p){return AF4(unpack24Gather(sampler1, p, 1));}
+AF4 FsrEasuBF(AF2 p){return AF4(unpack24Gather(sampler1, p, 2));}
+#else
 AF4 FsrEasuRF(AF2 p){return AF4(textureGather(sampler1, p, 0));}
 AF4 FsrEasuGF(AF2 p){return AF4(textureGather(sampler1, p, 1));}
 AF4 FsrEasuBF(AF2 p){return AF4(textureGather(sampler1, p, 2));}
+#endif
 
 #include "ffx_fsr1.h"
 
@@ -0,0 +1,45 @@
+/* Reads 24-bit pixels that the host packed three bytes each into a 32-bit
+ * texture, so a filter can consume the frame without a separate unpack pass.
+ * UNPACK_24BIT is the swizzle that puts the channels in order. */
+#ifdef UNPACK_24BIT
+
+// the size of the unpacked image, the packed texture may be padded
+uniform vec2 uUnpackSize;
+
+vec4 unpack24(sampler2D tex, ivec2 pos)
+{
+  uvec2 p = uvec2(clamp(pos, ivec2(0), ivec2(uUnpackSize) - 1));
+
+  uint fst = p.x * 3u / 4u;
+  vec4 color_0 = texelFetch(tex, ivec2(fst, p.y), 0);
+
+  uint snd = (p.x * 3u + 1u) / 4u;
+  vec4 color_1 = texelFetch(tex, ivec2(snd, p.y), 0);
+
+  uint trd = (p.x * 3u + 2u) / 4u;
+  vec4 color_2 = texelFetch(tex, ivec2(trd, p.y), 0);
+
+  vec4 color = vec4(
+    color_0.barg[p.x % 4u],
+    color_1.gbar[p.x % 4u],
+    color_2.rgba[p.x % 4u],
+    1.0
+  );
+
+  return color.UNPACK_24BIT;
+}
+
+// textureGather over the unpacked image
+vec4 unpack24Gather(sampler2D tex, vec2 uv, int comp)
+{
+  ivec2 p = ivec2(floor((uv * uUnpackSize) - 0.5f));
+
+  vec4 c0 = unpack24(tex, p+ivec2(0,1));
+  vec4 c1 = unpack24(tex, p+ivec2(1,1));
+  vec4 c2 = unpack24(tex, p+ivec2(1,0));
+  vec4 c3 = unpack24(tex, p+ivec2(0,0));
+
+  return vec4(c0[comp], c1[comp], c2[comp], c3[comp]);
+}
+
+#endif
@@ -0,0 +1,252 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "shader_cache.h"
+
+#include "common/debug.h"
+#include "common/option.h"
+#include "common/paths.h"
+#include "common/stringutils.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CACHE_MAGIC   0x43534c47 // LGSC
+#define CACHE_VERSION 1
+
+struct CacheHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint32_t format;
+  uint32_t length;
+};
+
+static struct
+{
+  bool     enabled;
+  char   * dir;
+  uint64_t driver;
+}
+l_cache = { 0 };
+
+// 64-bit FNV-1a
+static uint64_t hashData(uint64_t hash, const void * data, size_t size)
+{
+  const uint8_t * p = data;
+  for(size_t i = 0; i < size; ++i)
+  {
+    hash ^= p[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static uint64_t hashString(uint64_t hash, const char * str)
+{
+  return str ? hashData(hash, str, strlen(str) + 1) : hash;
+}
+
+void egl_shaderCacheInit(void)
+{
+  free(l_cache.dir);
+  l_cache.dir     = NULL;
+  l_cache.enabled = false;
+
+  if (!option_get_bool("egl", "shaderCache"))
+    return;
+
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  if (formats <= 0)
+  {
+    DEBUG_INFO("Shader cache disabled, no program binary formats supported");
+    return;
+  }
+
+  if (alloc_sprintf(&l_cache.dir, "%s/shaders", lgCacheDir()) < 0)
+  {
+    DEBUG_ERROR("out of memory");
+    return;
+  }
+
+  if (mkdir(l_cache.dir, S_IRWXU) < 0 && errno != EEXIST)
+  {
+    DEBUG_WARN("Shader cache disabled, failed to create %s", l_cache.dir);
+    free(l_cache.dir);
+    l_cache.dir = NULL;
+    return;
+  }
+
+  /* binaries are only valid for the driver that built them, drivers should
+   * reject foreign binaries but not all of them do so reliably */
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  hash = hashString(hash, (const char *)glGetString(GL_VENDOR  ));
+  hash = hashString(hash, (const char *)glGetString(GL_RENDERER));
+  hash = hashString(hash, (const char *)glGetString(GL_VERSION ));
+
+  l_cache.driver  = hash;
+  l_cache.enabled = true;
+}
+
+bool egl_shaderCacheEnabled(void)
+{
+  return l_cache.enabled;
+}
+
+uint64_t egl_shaderCacheKey(const char * vertex_code, size_t vertex_size,
+    const char * fragment_code, size_t fragment_size)
+{
+  uint64_t hash = l_cache.driver;
+  hash = hashData(hash, &vertex_size  , sizeof(vertex_size  ));
+  hash = hashData(hash, vertex_code   , vertex_size          );
+  hash = hashData(hash, &fragment_size, sizeof(fragment_size));
+  hash = hashData(hash, fragment_code , fragment_size        );
+  return hash;
+}
+
+static char * cachePath(uint64_t key)
+{
+  char * path;
+  if (alloc_sprintf(&path, "%s/%016llx.bin", l_cache.dir,
+        (unsigned long long)key) < 0)
+    return NULL;
+  return path;
+}
+
+bool egl_shaderCacheLoad(GLuint program, uint64_t key)
+{
+  if (!l_cache.enabled)
+    return false;
+
+  char * path = cachePath(key);
+  if (!path)
+    return false;
+
+  bool   result = false;
+  void * binary = NULL;
+  FILE * fp     = fopen(path, "rb");
+  if (!fp)
+    goto exit;
+
+  struct CacheHeader header;
+  if (fread(&header, sizeof(header), 1, fp) != 1 ||
+      header.magic   != CACHE_MAGIC   ||
+      header.version != CACHE_VERSION ||
+      header.key     != key           ||
+      header.length  == 0)
+    goto reject;
+
+  binary = malloc(header.length);
+  if (!binary)
+  {
+    DEBUG_ERROR("out of memory");
+    goto exit;
+  }
+
+  if (fread(binary, header.length, 1, fp) != 1)
+    goto reject;
+
+  glProgramBinary(program, header.format, binary, header.length);
+
+  GLint status = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (status == GL_FALSE)
+    goto reject;
+
+  result = true;
+  goto exit;
+
+reject:
+  // usually a driver update, drop it so it is rebuilt and stored again
+  DEBUG_INFO("Discarding stale shader cache entry %016llx",
+      (unsigned long long)key);
+  unlink(path);
+
+exit:
+  if (fp)
+    fclose(fp);
+  free(binary);
+  free(path);
+  return result;
+}
+
+void egl_shaderCacheStore(GLuint program, uint64_t key)
+{
+  if (!l_cache.enabled)
+    return;
+
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    return;
+
+  void * binary = malloc(length);
+  if (!binary)
+  {
+    DEBUG_ERROR("out of memory");
+    return;
+  }
+
+  GLenum format;
+  glGetProgramBinary(program, length, &length, &format, binary);
+
+  char * path = cachePath(key);
+  char * temp = NULL;
+  if (!path || alloc_sprintf(&temp, "%s.%d", path, (int)getpid()) < 0)
+    goto exit;
+
+  // write to a temporary file so a partial entry can never be loaded
+  FILE * fp = fopen(temp, "wb");
+  if (!fp)
+  {
+    DEBUG_WARN("Failed to create %s", temp);
+    goto exit;
+  }
+
+  const struct CacheHeader header =
+  {
+    .magic   = CACHE_MAGIC,
+    .version = CACHE_VERSION,
+    .key     = key,
+    .format  = format,
+    .length  = length
+  };
+
+  const bool ok =
+    fwrite(&header, sizeof(header), 1, fp) == 1 &&
+    fwrite(binary , length        , 1, fp) == 1;
+
+  if (fclose(fp) != 0 || !ok || rename(temp, path) < 0)
+  {
+    DEBUG_WARN("Failed to write %s", path);
+    unlink(temp);
+  }
+
+exit:
+  free(temp);
+  free(path);
+  free(binary);
+}
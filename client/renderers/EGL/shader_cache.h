@@ -0,0 +1,48 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GLES3/gl3.h>
+
+/* A disk cache of linked shader programs, keyed by their source and the GL
+ * driver that built them, so the client does not have to recompile every
+ * shader at each startup */
+
+/* must be called with the context current before any other function */
+void egl_shaderCacheInit(void);
+
+uint64_t egl_shaderCacheKey(const char * vertex_code, size_t vertex_size,
+    const char * fragment_code, size_t fragment_size);
+
+/* loads the program binary for key into program, returns false if there is no
+ * usable binary and the program must be built from source */
+bool egl_shaderCacheLoad(GLuint program, uint64_t key);
+
+/* stores the binary of the linked program, it must have been linked with
+ * GL_PROGRAM_BINARY_RETRIEVABLE_HINT set */
+void egl_shaderCacheStore(GLuint program, uint64_t key);
+
+/* true if programs should be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT */
+bool egl_shaderCacheEnabled(void);
@@ -36,6 +36,7 @@ extern const EGL_TextureOps EGL_TextureBuffer;
 extern const EGL_TextureOps EGL_TextureBufferStream;
 extern const EGL_TextureOps EGL_TextureFrameBuffer;
 extern const EGL_TextureOps EGL_TextureDMABUF;
+extern const EGL_TextureOps EGL_TextureImage;
 
 bool egl_textureInit(EGL_Texture ** texture_, EGLDisplay * display,
     EGL_TexType type)
@@ -61,6 +62,10 @@ bool egl_textureInit(EGL_Texture ** texture_, EGLDisplay * display,
       ops = &EGL_TextureDMABUF;
       break;
 
+    case EGL_TEXTYPE_IMAGE:
+      ops = &EGL_TextureImage;
+      break;
+
     default:
       return false;
   }
@@ -107,6 +107,9 @@ struct EGL_Texture
   GLuint sampler;
 
   EGL_TexFormat format;
+
+  // bytes transferred to the GPU by the last call to process
+  size_t uploadBytes;
 };
 
 bool egl_textureInit(EGL_Texture ** texture, EGLDisplay * display,
@@ -119,6 +122,8 @@ bool egl_textureSetup(EGL_Texture * texture, enum EGL_PixelFormat pixFmt,
 bool egl_textureUpdate(EGL_Texture * texture, const uint8_t * buffer,
     bool topDown);
 
+/* returns false without writing anything if the texture is still being read by
+ * the GPU and the calling thread has no context to wait for it with */
 bool egl_textureUpdateRect(EGL_Texture * texture,
     int x, int y, int width, int height, int stride, int pitch,
     const uint8_t * buffer, bool topDown);
@@ -21,12 +21,15 @@
 #include "texture_buffer.h"
 
 #include "egldebug.h"
+#include "common/option.h"
+#include "common/rects.h"
 
 #include <string.h>
 
 // forwards
 extern const EGL_TextureOps EGL_TextureBuffer;
 extern const EGL_TextureOps EGL_TextureBufferStream;
+extern const EGL_TextureOps EGL_TextureImage;
 
 // internal functions
 
@@ -101,11 +104,25 @@ bool egl_texBufferSetup(EGL_Texture * texture, const EGL_TexSetup * setup)
   }
 
   glBindTexture(GL_TEXTURE_2D, 0);
-  this->rIndex = -1;
+  this->rIndex   = -1;
+  this->inFlight = false;
+
+  // the texture contents are undefined until the first full upload
+  for(int i = 0; i < EGL_TEX_BUFFER_MAX; ++i)
+    this->upload[i].count = -1;
 
   return true;
 }
 
+void egl_texBufferAddDamage(TextureBuffer * this,
+    const FrameDamageRect * rects, int count)
+{
+  struct TexDamage * damage = &this->upload[this->bufIndex];
+  damage->count = rectsAccumulate(damage->rects, damage->count,
+      KVMFR_MAX_DAMAGE_RECTS, rects, count,
+      this->base.format.width, this->base.format.height);
+}
+
 static bool egl_texBufferUpdate(EGL_Texture * texture, const EGL_TexUpdate * update)
 {
   TextureBuffer * this = UPCAST(TextureBuffer, texture);
@@ -154,6 +171,9 @@ bool egl_texBufferStreamInit(EGL_Texture ** texture, EGL_TexType type,
   {
     case EGL_TEXTYPE_BUFFER_STREAM:
     case EGL_TEXTYPE_FRAMEBUFFER:
+      this->texCount = option_get_int("egl", "uploadBuffers");
+      break;
+
     case EGL_TEXTYPE_DMABUF:
       this->texCount = 2;
       break;
@@ -187,16 +207,38 @@ static bool egl_texBufferStreamUpdate(EGL_Texture * texture,
 
   LG_LOCK(this->copyLock);
 
+  if (unlikely(this->inFlight))
+  {
+    /* fences can only be waited on by a thread with a context, the others must
+     * try again once the upload has completed */
+    if (eglGetCurrentContext() == EGL_NO_CONTEXT)
+    {
+      LG_UNLOCK(this->copyLock);
+      return false;
+    }
+
+    // only the thread with the context clears the flag
+    LG_UNLOCK(this->copyLock);
+    egl_texUtilBufferIdle(&this->buf[this->bufIndex], GL_TIMEOUT_IGNORED);
+    LG_LOCK(this->copyLock);
+    this->inFlight = false;
+  }
+
   uint8_t * dst = this->buf[this->bufIndex].map +
     texture->format.pitch * update->y +
     update->x * texture->format.bpp;
 
-  if (update->topDown)
+  const size_t lineSize = update->width * texture->format.bpp;
+  if (update->topDown && update->pitch == texture->format.pitch &&
+      lineSize == texture->format.pitch)
+    // full width rows that are contiguous in both buffers
+    memcpy(dst, update->buffer, lineSize * update->height);
+  else if (update->topDown)
   {
     const uint8_t * src = update->buffer;
     for(int y = 0; y < update->height; ++y)
     {
-      memcpy(dst, src, update->width * texture->format.bpp);
+      memcpy(dst, src, lineSize);
       dst += texture->format.pitch;
       src += update->pitch;
     }
@@ -207,57 +249,160 @@ static bool egl_texBufferStreamUpdate(EGL_Texture * texture,
     for(int y = 0; y < update->height; ++y)
     {
       src -= update->pitch;
-      memcpy(dst, src, update->width * texture->format.bpp);
+      memcpy(dst, src, lineSize);
       dst += texture->format.pitch;
     }
   }
 
   this->buf[this->bufIndex].updated = true;
+  egl_texBufferAddDamage(this, &(FrameDamageRect) {
+      .x      = update->x,
+      .y      = update->y,
+      .width  = update->width,
+      .height = update->height
+    }, 1);
   LG_UNLOCK(this->copyLock);
 
   return true;
 }
 
+/* reduces the damage to the set of rects to upload and returns how many there
+ * are, a single bounding box is used when it is not much larger than the
+ * damage itself as each upload has a fixed cost of its own */
+static int egl_texBufferUploadRects(EGL_Texture * texture,
+    FrameDamageRect * rects, int count)
+{
+  if (count < 0)
+  {
+    rects[0] = (FrameDamageRect) {
+      .x      = 0,
+      .y      = 0,
+      .width  = texture->format.width,
+      .height = texture->format.height
+    };
+    return 1;
+  }
+
+  count = rectsMergeOverlapping(rects, count);
+  if (count <= 1)
+    return count;
+
+  uint64_t area = 0;
+  uint32_t x1 = UINT32_MAX, y1 = UINT32_MAX, x2 = 0, y2 = 0;
+  for(int i = 0; i < count; ++i)
+  {
+    const FrameDamageRect * rect = rects + i;
+    area += (uint64_t)rect->width * rect->height;
+    x1 = min(x1, rect->x);
+    y1 = min(y1, rect->y);
+    x2 = max(x2, rect->x + rect->width );
+    y2 = max(y2, rect->y + rect->height);
+  }
+
+  const uint64_t boxArea = (uint64_t)(x2 - x1) * (y2 - y1);
+  if (boxArea > area + area / 4)
+    return count;
+
+  rects[0] = (FrameDamageRect) {
+    .x      = x1,
+    .y      = y1,
+    .width  = x2 - x1,
+    .height = y2 - y1
+  };
+  return 1;
+}
+
 EGL_TexStatus egl_texBufferStreamProcess(EGL_Texture * texture)
 {
   TextureBuffer * this = UPCAST(TextureBuffer, texture);
 
+  /* the fences are only touched by this thread, retire any that have signalled
+   * so the buffers can be handed back to the producer */
+  for(int i = 0; i < this->texCount; ++i)
+    egl_texUtilBufferIdle(&this->buf[i], 0);
+
+  texture->uploadBytes = 0;
   LG_LOCK(this->copyLock);
 
-  GLuint          tex    = this->tex[this->bufIndex];
-  EGL_TexBuffer * buffer = &this->buf[this->bufIndex];
+  // a single buffer may be written again once its fence has been retired
+  const int index = this->bufIndex;
+  if (this->inFlight && !this->buf[index].sync)
+    this->inFlight = false;
 
-  if (buffer->updated && this->sync == 0)
+  if (!this->buf[index].updated)
   {
-    this->rIndex = this->bufIndex;
-    if (++this->bufIndex == this->texCount)
-      this->bufIndex = 0;
+    LG_UNLOCK(this->copyLock);
+    return EGL_TEX_STATUS_OK;
   }
 
-  LG_UNLOCK(this->copyLock);
+  /* move the producer on to the next buffer the GPU is no longer reading from,
+   * a texture with a single buffer is uploaded in place and its producers are
+   * held off by inFlight until the GPU is done with it instead */
+  int next = this->texCount == 1 ? index : -1;
+  for(int i = 1; i < this->texCount; ++i)
+  {
+    const int n = (index + i) % this->texCount;
+    if (!this->buf[n].sync)
+    {
+      next = n;
+      break;
+    }
+  }
 
-  if (buffer->updated)
+  if (unlikely(next < 0))
   {
-    buffer->updated = false;
+    /* every other buffer is still in flight, this can only happen if the GPU
+     * has fallen texCount frames behind, wait for the oldest one */
+    LG_UNLOCK(this->copyLock);
+    next = (index + 1) % this->texCount;
+    if (!egl_texUtilBufferIdle(&this->buf[next], 40000000)) // 40ms
+      return EGL_TEX_STATUS_NOTREADY;
+    LG_LOCK(this->copyLock);
+  }
+
+  EGL_TexBuffer * buffer = &this->buf[index];
+  buffer->updated = false;
+  this->bufIndex  = next;
+  this->rIndex    = index;
+  this->inFlight  = next == index;
+
+  struct TexDamage * damage = &this->upload[index];
+  FrameDamageRect rects[KVMFR_MAX_DAMAGE_RECTS];
+  int count = damage->count;
+  if (count > 0)
+    memcpy(rects, damage->rects, count * sizeof(*rects));
+  damage->count = 0;
+
+  LG_UNLOCK(this->copyLock);
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer->pbo);
+  glBindTexture(GL_TEXTURE_2D, this->tex[index]);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, texture->format.stride);
 
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer->pbo);
-    glBindTexture(GL_TEXTURE_2D, tex);
+  count = egl_texBufferUploadRects(texture, rects, count);
 
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, texture->format.stride);
+  for(int i = 0; i < count; ++i)
+  {
+    const FrameDamageRect * rect = rects + i;
     glTexSubImage2D(GL_TEXTURE_2D,
-        0, 0, 0,
-        texture->format.width,
-        texture->format.height,
+        0, rect->x, rect->y,
+        rect->width,
+        rect->height,
         texture->format.format,
         texture->format.dataType,
-        (const void *)0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        (const void *)(rect->y * texture->format.pitch +
+          rect->x * texture->format.bpp));
 
-    this->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-    glFlush();
+    texture->uploadBytes +=
+      (size_t)rect->width * rect->height * texture->format.bpp;
   }
 
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  buffer->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glFlush();
+
   return EGL_TEX_STATUS_OK;
 }
 
@@ -269,32 +414,23 @@ EGL_TexStatus egl_texBufferStreamGet(EGL_Texture * texture, GLuint * tex,
   if (this->rIndex == -1)
     return EGL_TEX_STATUS_NOTREADY;
 
-  if (this->sync)
-  {
-    switch(glClientWaitSync(this->sync, 0, 40000000)) // 40ms
-    {
-      case GL_ALREADY_SIGNALED:
-      case GL_CONDITION_SATISFIED:
-        glDeleteSync(this->sync);
-        this->sync = 0;
-        break;
-
-      case GL_TIMEOUT_EXPIRED:
-        return EGL_TEX_STATUS_NOTREADY;
-
-      case GL_WAIT_FAILED:
-      case GL_INVALID_VALUE:
-        glDeleteSync(this->sync);
-        this->sync = 0;
-        DEBUG_GL_ERROR("glClientWaitSync failed");
-        return EGL_TEX_STATUS_ERROR;
-    }
-  }
-
+  /* the upload was issued on this context so sampling is ordered after it by
+   * GL, the fence only guards the PBO against being overwritten */
   *tex = this->tex[this->rIndex];
   return EGL_TEX_STATUS_OK;
 }
 
+bool egl_texBufferCountValidate(struct Option * opt, const char ** error)
+{
+  if (opt->value.x_int >= EGL_TEX_BUFFER_MIN &&
+      opt->value.x_int <= EGL_TEX_BUFFER_MAX)
+    return true;
+
+  *error = "The upload buffer count must be between "
+    STR(EGL_TEX_BUFFER_MIN) " and " STR(EGL_TEX_BUFFER_MAX);
+  return false;
+}
+
 EGL_TexStatus egl_texBufferBind(EGL_Texture * texture)
 {
   GLuint tex;
@@ -307,6 +443,30 @@ EGL_TexStatus egl_texBufferBind(EGL_Texture * texture)
   return EGL_TEX_STATUS_OK;
 }
 
+// image functions
+
+static bool egl_texBufferImageSetup(EGL_Texture * texture,
+    const EGL_TexSetup * setup)
+{
+  TextureBuffer * this = UPCAST(TextureBuffer, texture);
+
+  egl_texBuffer_cleanup(this);
+
+  // images must have immutable storage in a sized format
+  glGenTextures(1, this->tex);
+  glBindTexture(GL_TEXTURE_2D, this->tex[0]);
+  glTexStorage2D(GL_TEXTURE_2D,
+      1,
+      egl_texUtilImageFormat(texture->format.pixFmt),
+      texture->format.width,
+      texture->format.height);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  this->rIndex = -1;
+  return true;
+}
 
 const EGL_TextureOps EGL_TextureBuffer =
 {
@@ -329,3 +489,14 @@ const EGL_TextureOps EGL_TextureBufferStream =
   .get         = egl_texBufferStreamGet,
   .bind        = egl_texBufferBind
 };
+
+const EGL_TextureOps EGL_TextureImage =
+{
+  .init        = egl_texBufferInit,
+  .free        = egl_texBufferFree,
+  .setup       = egl_texBufferImageSetup,
+  .update      = egl_texBufferUpdate,
+  .process     = egl_texBufferProcess,
+  .get         = egl_texBufferGet,
+  .bind        = egl_texBufferBind
+};
@@ -23,8 +23,18 @@
 #include "texture.h"
 #include "texture_util.h"
 #include "common/locking.h"
+#include "common/KVMFR.h"
 
-#define EGL_TEX_BUFFER_MAX 2
+#define EGL_TEX_BUFFER_MIN 2
+#define EGL_TEX_BUFFER_MAX 8
+
+struct Option;
+
+struct TexDamage
+{
+  int             count; // -1 = the entire buffer
+  FrameDamageRect rects[KVMFR_MAX_DAMAGE_RECTS];
+};
 
 typedef struct TextureBuffer
 {
@@ -35,13 +45,27 @@ typedef struct TextureBuffer
   GLuint        tex[EGL_TEX_BUFFER_MAX];
   EGL_TexBuffer buf[EGL_TEX_BUFFER_MAX];
   int           bufFree;
-  GLsync        sync;
+  GLsync        sync; // DMABUF import fence, PBO fences are per buffer
   LG_Lock       copyLock;
   int           bufIndex;
   int           rIndex;
+
+  /* a single buffer is uploaded from in place, this is set while the GPU may
+   * still be reading it, guarded by copyLock */
+  bool          inFlight;
+
+  // regions of each buffer written since it was last uploaded
+  struct TexDamage upload[EGL_TEX_BUFFER_MAX];
 }
 TextureBuffer;
 
+/* record that the region has been written into the current buffer, the caller
+ * must hold copyLock. A count of -1 marks the entire buffer */
+void egl_texBufferAddDamage(TextureBuffer * this,
+    const FrameDamageRect * rects, int count);
+
+bool egl_texBufferCountValidate(struct Option * opt, const char ** error);
+
 bool egl_texBufferInit(EGL_Texture ** texture_, EGL_TexType type,
     EGLDisplay * display);
 void egl_texBufferFree(EGL_Texture * texture_);
@@ -25,12 +25,6 @@
 #include "common/KVMFR.h"
 #include "common/rects.h"
 
-struct TexDamage
-{
-  int             count;
-  FrameDamageRect rects[KVMFR_MAX_DAMAGE_RECTS];
-};
-
 typedef struct TexFB
 {
   TextureBuffer base;
@@ -87,9 +81,17 @@ static bool egl_texFBUpdate(EGL_Texture * texture, const EGL_TexUpdate * update)
 
   LG_LOCK(parent->copyLock);
 
+  // the damage rects are in frame pixels, which are packed for 24-bit formats
+  const int frameWidth = texture->format.pixFmt == EGL_PF_BGR_32 ?
+    texture->format.width * 4 / 3 : texture->format.width;
+  const int rectCount  =
+    update->rects && update->rectCount > 0 ? update->rectCount : -1;
+
   struct TexDamage * damage = this->damage + parent->bufIndex;
-  bool damageAll = !update->rects || update->rectCount == 0 || damage->count < 0 ||
-    damage->count + update->rectCount > KVMFR_MAX_DAMAGE_RECTS;
+  damage->count = rectsAccumulate(damage->rects, damage->count,
+      KVMFR_MAX_DAMAGE_RECTS, update->rects, rectCount,
+      frameWidth, texture->format.height);
+  const bool damageAll = damage->count < 0;
 
   if (damageAll)
   {
@@ -102,13 +104,10 @@ static bool egl_texFBUpdate(EGL_Texture * texture, const EGL_TexUpdate * update)
       texture->format.bpp,
       texture->format.pitch
     );
+    egl_texBufferAddDamage(parent, NULL, -1);
   }
   else
   {
-    memcpy(damage->rects + damage->count, update->rects,
-      update->rectCount * sizeof(FrameDamageRect));
-    damage->count += update->rectCount;
-
     if (texture->format.pixFmt == EGL_PF_BGR_32)
     {
       FrameDamageRect scaledDamageRects[damage->count];
@@ -132,6 +131,7 @@ static bool egl_texFBUpdate(EGL_Texture * texture, const EGL_TexUpdate * update)
         update->frame,
         texture->format.pitch
       );
+      egl_texBufferAddDamage(parent, scaledDamageRects, damage->count);
     }
     else
     {
@@ -145,25 +145,21 @@ static bool egl_texFBUpdate(EGL_Texture * texture, const EGL_TexUpdate * update)
         update->frame,
         texture->format.pitch
       );
+      egl_texBufferAddDamage(parent, damage->rects, damage->count);
     }
   }
 
   parent->buf[parent->bufIndex].updated = true;
 
-  for (int i = 0; i < EGL_TEX_BUFFER_MAX; ++i)
+  for (int i = 0; i < parent->texCount; ++i)
   {
     struct TexDamage * damage = this->damage + i;
     if (i == parent->bufIndex)
       damage->count = 0;
-    else if (update->rects && update->rectCount > 0 && damage->count >= 0 &&
-             damage->count + update->rectCount <= KVMFR_MAX_DAMAGE_RECTS)
-    {
-      memcpy(damage->rects + damage->count, update->rects,
-        update->rectCount * sizeof(FrameDamageRect));
-      damage->count += update->rectCount;
-    }
     else
-      damage->count = -1;
+      damage->count = rectsAccumulate(damage->rects, damage->count,
+          KVMFR_MAX_DAMAGE_RECTS, update->rects, rectCount,
+          frameWidth, texture->format.height);
   }
 
   LG_UNLOCK(parent->copyLock);
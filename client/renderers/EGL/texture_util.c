@@ -103,6 +103,20 @@ bool egl_texUtilGetFormat(const EGL_TexSetup * setup, EGL_TexFormat * fmt)
   return true;
 }
 
+GLenum egl_texUtilImageFormat(EGL_PixelFormat pixFmt)
+{
+  // OpenGL ES can only bind a few formats as images, 10-bit is not one of them
+  switch(pixFmt)
+  {
+    case EGL_PF_RGBA10:
+    case EGL_PF_RGBA16F:
+      return GL_RGBA16F;
+
+    default:
+      return GL_RGBA8;
+  }
+}
+
 bool egl_texUtilGenBuffers(const EGL_TexFormat * fmt, EGL_TexBuffer * buffers,
     int count)
 {
@@ -135,6 +149,12 @@ void egl_texUtilFreeBuffers(EGL_TexBuffer * buffers, int count)
   {
     EGL_TexBuffer *buffer = &buffers[i];
 
+    if (buffer->sync)
+    {
+      glDeleteSync(buffer->sync);
+      buffer->sync = 0;
+    }
+
     if (!buffer->pbo)
       continue;
 
@@ -174,3 +194,28 @@ void egl_texUtilUnmapBuffer(EGL_TexBuffer * buffer)
   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
   buffer->map = NULL;
 }
+
+bool egl_texUtilBufferIdle(EGL_TexBuffer * buffer, GLuint64 timeout)
+{
+  if (!buffer->sync)
+    return true;
+
+  switch(glClientWaitSync(buffer->sync, 0, timeout))
+  {
+    case GL_ALREADY_SIGNALED:
+    case GL_CONDITION_SATISFIED:
+      break;
+
+    case GL_TIMEOUT_EXPIRED:
+      return false;
+
+    case GL_WAIT_FAILED:
+    case GL_INVALID_VALUE:
+      DEBUG_GL_ERROR("glClientWaitSync failed");
+      break;
+  }
+
+  glDeleteSync(buffer->sync);
+  buffer->sync = 0;
+  return true;
+}
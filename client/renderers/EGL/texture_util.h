@@ -46,15 +46,24 @@ typedef struct EGL_TexBuffer
   GLuint pbo;
   void * map;
   bool   updated;
+
+  // signalled when the GPU has finished reading from the buffer
+  GLsync sync;
 }
 EGL_TexBuffer;
 
 bool egl_texUtilGetFormat(const EGL_TexSetup * setup, EGL_TexFormat * fmt);
+
+/* the sized format used when a texture of this format is written as an image
+ * by a compute shader */
+GLenum egl_texUtilImageFormat(EGL_PixelFormat pixFmt);
+
 bool egl_texUtilGenBuffers(const EGL_TexFormat * fmt, EGL_TexBuffer * buffers,
     int count);
 void egl_texUtilFreeBuffers(EGL_TexBuffer * buffers, int count);
 bool egl_texUtilMapBuffer(EGL_TexBuffer * buffer);
 void egl_texUtilUnmapBuffer(EGL_TexBuffer * buffer);
+bool egl_texUtilBufferIdle(EGL_TexBuffer * buffer, GLuint64 timeout);
 
 /**
  * the following comes from drm_fourcc.h and is included here to avoid the
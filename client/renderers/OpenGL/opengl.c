@@ -35,6 +35,7 @@
 #include "common/option.h"
 #include "common/framebuffer.h"
 #include "common/locking.h"
+#include "common/rects.h"
 #include "gl_dynprocs.h"
 #include "util.h"
 
@@ -92,6 +93,13 @@ struct MouseRect
   int h;
 };
 
+struct FrameDamage
+{
+  // -1 when the entire frame is damaged
+  int             count;
+  FrameDamageRect rects[KVMFR_MAX_DAMAGE_RECTS];
+};
+
 struct OpenGL_Options
 {
   bool mipmap;
@@ -108,6 +116,7 @@ struct Inst
   struct OpenGL_Options opt;
 
   bool              amdPinnedMemSupport;
+  bool              hasMapBufferRange;
   bool              renderStarted;
   bool              configured;
   bool              reconfigure;
@@ -134,6 +143,18 @@ struct Inst
   LG_Lock           frameLock;
   bool              texReady;
   int               texWIndex, texRIndex;
+
+  // protected by frameLock
+  struct FrameDamage texDamage[BUFFER_COUNT]; // since each texture was uploaded
+  struct FrameDamage newDamage;               // since the last upload
+
+  // render thread only
+  bool               resetDamage;
+  bool               texRotated;
+  struct FrameDamage swapDamage[BUFFER_COUNT]; // relative to the prior upload
+  bool               lastSpiceShow;
+  bool               lastMouseVisible;
+  struct Rect        lastMouseRect;
   int               texList;
   int               mouseList;
   int               spiceList;
@@ -387,6 +408,14 @@ bool opengl_onFrameFormat(LG_Renderer * renderer, const LG_RendererFormat format
   return true;
 }
 
+static void addDamage(struct Inst * this, struct FrameDamage * dst,
+    const FrameDamageRect * rects, int count)
+{
+  dst->count = rectsAccumulate(dst->rects, dst->count, KVMFR_MAX_DAMAGE_RECTS,
+      rects, count == 0 ? -1 : count,
+      this->format.frameWidth, this->format.frameHeight);
+}
+
 bool opengl_onFrame(LG_Renderer * renderer, const FrameBuffer * frame, int dmaFd,
     const FrameDamageRect * damage, int damageCount)
 {
@@ -394,6 +423,9 @@ bool opengl_onFrame(LG_Renderer * renderer, const FrameBuffer * frame, int dmaFd
 
   LG_LOCK(this->frameLock);
   this->frame = frame;
+  for(int i = 0; i < BUFFER_COUNT; ++i)
+    addDamage(this, &this->texDamage[i], damage, damageCount);
+  addDamage(this, &this->newDamage, damage, damageCount);
   atomic_store_explicit(&this->frameUpdate, true, memory_order_release);
   LG_UNLOCK(this->frameLock);
 
@@ -451,6 +483,13 @@ bool opengl_renderStartup(LG_Renderer * renderer, bool useDMA)
     this->opt.mipmap = false;
   }
 
+  if (!this->amdPinnedMemSupport && g_gl_dynProcs.glMapBufferRange &&
+      g_gl_dynProcs.glUnmapBuffer &&
+      (maj >= 3 || util_hasGLExt(exts, "GL_ARB_map_buffer_range")))
+    this->hasMapBufferRange = true;
+  else if (!this->amdPinnedMemSupport)
+    DEBUG_WARN("glMapBufferRange is not available, damage will be ignored");
+
   glEnable(GL_TEXTURE_2D);
   glEnable(GL_COLOR_MATERIAL);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -483,6 +522,80 @@ bool opengl_renderStartup(LG_Renderer * renderer, bool useDMA)
   return true;
 }
 
+/* maps a rectangle in frame coordinates to window coordinates, grown by a
+ * pixel on each side to cover the reach of linear filtering */
+static bool frameToWindowRect(struct Inst * this, float x, float y, float w,
+    float h, struct Rect * out)
+{
+  const float sx = (float)this->destRect.w / this->format.frameWidth;
+  const float sy = (float)this->destRect.h / this->format.frameHeight;
+
+  const int x1 = max(0, (int)floorf(this->destRect.x + x * sx) - 1);
+  const int y1 = max(0, (int)floorf(this->destRect.y + y * sy) - 1);
+  const int x2 = min(this->window.x,
+      (int)ceilf(this->destRect.x + (x + w) * sx) + 1);
+  const int y2 = min(this->window.y,
+      (int)ceilf(this->destRect.y + (y + h) * sy) + 1);
+
+  if (x2 <= x1 || y2 <= y1)
+    return false;
+
+  out->x = x1;
+  out->y = y1;
+  out->w = x2 - x1;
+  out->h = y2 - y1;
+  return true;
+}
+
+/* collects the window damage for this swap in top-left window coordinates,
+ * returns -1 if the entire window needs to be presented */
+static int collectSwapDamage(struct Inst * this, struct Rect * rects,
+    bool full)
+{
+  int count = 0;
+
+  if (this->spiceShow || this->spiceShow != this->lastSpiceShow ||
+      !this->destRect.valid)
+    full = true;
+  this->lastSpiceShow = this->spiceShow;
+
+  if (this->texRotated)
+  {
+    const struct FrameDamage * damage = this->swapDamage + this->texRIndex;
+    if (damage->count == -1)
+      full = true;
+    else if (!full)
+      for(int i = 0; i < damage->count; ++i)
+      {
+        const FrameDamageRect * r = damage->rects + i;
+        if (frameToWindowRect(this, r->x, r->y, r->width, r->height,
+              rects + count))
+          ++count;
+      }
+    this->texRotated = false;
+  }
+
+  struct Rect mouseRect;
+  const bool mouseVisible = this->mouseVisible && !this->spiceShow &&
+    this->destRect.valid &&
+    frameToWindowRect(this, this->mousePos.x, this->mousePos.y,
+        this->mousePos.w, this->mousePos.h, &mouseRect);
+
+  if (this->mouseUpdate || mouseVisible != this->lastMouseVisible)
+  {
+    if (this->lastMouseVisible)
+      rects[count++] = this->lastMouseRect;
+    if (mouseVisible)
+      rects[count++] = mouseRect;
+  }
+
+  this->lastMouseVisible = mouseVisible;
+  if (mouseVisible)
+    this->lastMouseRect = mouseRect;
+
+  return full ? -1 : count;
+}
+
 bool opengl_render(LG_Renderer * renderer, LG_RendererRotate rotate, const bool newFrame,
     const bool invalidateWindow, void (*preSwap)(void * udata), void * udata)
 {
@@ -490,14 +603,18 @@ bool opengl_render(LG_Renderer * renderer, LG_RendererRotate rotate, const bool
 
   setupModelView(this);
 
+  bool fullDamage = invalidateWindow;
   switch(configure(this))
   {
     case CONFIG_STATUS_ERROR:
       DEBUG_ERROR("configure failed");
       return false;
 
-    case CONFIG_STATUS_NOOP :
     case CONFIG_STATUS_OK   :
+      fullDamage = true;
+      // fallthrough
+
+    case CONFIG_STATUS_NOOP :
       if (!drawFrame(this))
         return false;
   }
@@ -512,20 +629,38 @@ bool opengl_render(LG_Renderer * renderer, LG_RendererRotate rotate, const bool
     glCallList(this->texList + this->texRIndex);
   drawMouse(this);
 
-  if (app_renderOverlay(NULL, 0) != 0)
+  struct Rect damage[KVMFR_MAX_DAMAGE_RECTS + MAX_OVERLAY_RECTS + 2];
+  int damageCount = collectSwapDamage(this, damage, fullDamage);
+
+  const int overlayCount = app_renderOverlay(
+      damageCount >= 0 ? damage + damageCount : NULL,
+      damageCount >= 0 ? MAX_OVERLAY_RECTS : 0);
+  if (overlayCount != 0)
   {
     ImGui_ImplOpenGL2_NewFrame();
     ImGui_ImplOpenGL2_RenderDrawData(igGetDrawData());
+
+    if (overlayCount == -1)
+      damageCount = -1;
+    else if (damageCount >= 0)
+      damageCount += overlayCount;
   }
 
+  // a count of zero presents the entire window
+  if (damageCount == -1)
+    damageCount = 0;
+
+  for(int i = 0; i < damageCount; ++i)
+    damage[i].y = this->window.y - damage[i].y - damage[i].h;
+
   preSwap(udata);
   if (this->opt.preventBuffer)
   {
-    app_glSwapBuffers();
+    app_glSwapBuffers(damage, damageCount);
     glFinish();
   }
   else
-    app_glSwapBuffers();
+    app_glSwapBuffers(damage, damageCount);
 
   this->mouseUpdate = false;
   return true;
@@ -607,7 +742,7 @@ static void opengl_spiceConfigure(LG_Renderer * renderer, int width, int height)
   glEndList();
 }
 
-static void opengl_spiceDrawFill(LG_Renderer * renderer, int x, int y, int width,
+static bool opengl_spiceDrawFill(LG_Renderer * renderer, int x, int y, int width,
     int height, uint32_t color)
 {
   struct Inst * this = UPCAST(struct Inst, renderer);
@@ -636,9 +771,10 @@ static void opengl_spiceDrawFill(LG_Renderer * renderer, int x, int y, int width
       line
     );
   glBindTexture(GL_TEXTURE_2D, 0);
+  return true;
 }
 
-static void opengl_spiceDrawBitmap(LG_Renderer * renderer, int x, int y, int width,
+static bool opengl_spiceDrawBitmap(LG_Renderer * renderer, int x, int y, int width,
     int height, int stride, uint8_t * data, bool topDown)
 {
   struct Inst * this = UPCAST(struct Inst, renderer);
@@ -673,6 +809,7 @@ static void opengl_spiceDrawBitmap(LG_Renderer * renderer, int x, int y, int wid
     data
   );
   glBindTexture(GL_TEXTURE_2D, 0);
+  return true;
 }
 
 static void opengl_spiceShow(LG_Renderer * renderer, bool show)
@@ -816,6 +953,9 @@ static enum ConfigStatus configure(struct Inst * this)
   this->texSize = this->format.dataHeight * this->format.pitch;
   this->texPos  = 0;
 
+  // the new textures hold nothing yet, the first uploads must be complete
+  this->resetDamage = true;
+
   g_gl_dynProcs.glGenBuffers(BUFFER_COUNT, this->vboID);
   if (check_gl_error("glGenBuffers"))
   {
@@ -1154,6 +1294,46 @@ static bool opengl_bufferFn(void * opaque, const void * data, size_t size)
   return true;
 }
 
+/* copies only the damaged rectangles of the frame into the bound pixel buffer,
+ * the buffer keeps the packed layout of a full upload so the rectangles can be
+ * sourced from it at their natural offsets. Returns false if the buffer could
+ * not be written and a full upload is required instead. */
+static bool uploadDamage(struct Inst * this, FrameDamageRect * rects,
+    int count, int bpp)
+{
+  uint8_t * dst;
+  if (this->amdPinnedMemSupport)
+    dst = this->texPixels[this->texWIndex];
+  else
+  {
+    if (!this->hasMapBufferRange)
+      return false;
+
+    /* the fence for this buffer was waited on before it was last used, so no
+     * synchronization is needed to write into it */
+    dst = g_gl_dynProcs.glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+        this->texSize, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (!dst)
+    {
+      check_gl_error("glMapBufferRange");
+      return false;
+    }
+  }
+
+  rectsFramebufferToBuffer(rects, count, bpp, dst,
+      this->format.dataWidth * bpp, this->format.dataHeight,
+      this->frame, this->format.pitch);
+
+  if (!this->amdPinnedMemSupport &&
+      !g_gl_dynProcs.glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+  {
+    DEBUG_WARN("The pixel buffer was corrupted during the update");
+    return false;
+  }
+
+  return true;
+}
+
 static bool drawFrame(struct Inst * this)
 {
   if (g_gl_dynProcs.glIsSync(this->fences[this->texWIndex]))
@@ -1179,7 +1359,8 @@ static bool drawFrame(struct Inst * this)
     g_gl_dynProcs.glDeleteSync(this->fences[this->texWIndex]);
     this->fences[this->texWIndex] = NULL;
 
-    this->texRIndex = this->texWIndex;
+    this->texRIndex  = this->texWIndex;
+    this->texRotated = true;
     if (++this->texWIndex == BUFFER_COUNT)
       this->texWIndex = 0;
   }
@@ -1191,6 +1372,30 @@ static bool drawFrame(struct Inst * this)
     return true;
   }
 
+  if (this->resetDamage)
+  {
+    for(int i = 0; i < BUFFER_COUNT; ++i)
+      this->texDamage[i].count = -1;
+    this->newDamage.count = -1;
+    this->resetDamage     = false;
+  }
+
+  /* take the damage this texture has missed since it was last uploaded, and
+   * what this upload changes relative to the previous one for the swap */
+  FrameDamageRect rects[KVMFR_MAX_DAMAGE_RECTS];
+  int rectCount = this->texDamage[this->texWIndex].count;
+  if (rectCount > 0)
+    memcpy(rects, this->texDamage[this->texWIndex].rects,
+        rectCount * sizeof(*rects));
+  this->texDamage[this->texWIndex].count = 0;
+
+  struct FrameDamage * swapDamage = this->swapDamage + this->texWIndex;
+  swapDamage->count = this->newDamage.count;
+  if (swapDamage->count > 0)
+    memcpy(swapDamage->rects, this->newDamage.rects,
+        swapDamage->count * sizeof(*swapDamage->rects));
+  this->newDamage.count = 0;
+
   LG_LOCK(this->formatLock);
   glBindTexture(GL_TEXTURE_2D, this->frames[this->texWIndex]);
   g_gl_dynProcs.glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->vboID[this->texWIndex]);
@@ -1199,31 +1404,55 @@ static bool drawFrame(struct Inst * this)
   glPixelStorei(GL_UNPACK_ALIGNMENT , bpp < 4 ? 1 : bpp);
   glPixelStorei(GL_UNPACK_ROW_LENGTH, this->format.frameWidth);
 
-  this->texPos = 0;
-  framebuffer_read_fn(
-    this->frame,
-    this->format.dataHeight,
-    this->format.dataWidth,
-    bpp,
-    this->format.pitch,
-    opengl_bufferFn,
-    this
-  );
+  if (rectCount > 0 && !uploadDamage(this, rects, rectCount, bpp))
+    rectCount = -1;
+
+  if (rectCount <= 0)
+  {
+    this->texPos = 0;
+    framebuffer_read_fn(
+      this->frame,
+      this->format.dataHeight,
+      this->format.dataWidth,
+      bpp,
+      this->format.pitch,
+      opengl_bufferFn,
+      this
+    );
+  }
 
   LG_UNLOCK(this->frameLock);
 
   // update the texture
-  glTexSubImage2D(
-    GL_TEXTURE_2D,
-    0,
-    0,
-    0,
-    this->format.frameWidth ,
-    this->format.frameHeight,
-    this->vboFormat,
-    this->dataFormat,
-    (void*)0
-  );
+  if (rectCount > 0)
+  {
+    rectCount = rectsMergeOverlapping(rects, rectCount);
+    const int pboPitch = this->format.dataWidth * bpp;
+    for(int i = 0; i < rectCount; ++i)
+      glTexSubImage2D(
+        GL_TEXTURE_2D,
+        0,
+        rects[i].x,
+        rects[i].y,
+        rects[i].width,
+        rects[i].height,
+        this->vboFormat,
+        this->dataFormat,
+        (void*)(uintptr_t)(rects[i].y * pboPitch + rects[i].x * bpp)
+      );
+  }
+  else
+    glTexSubImage2D(
+      GL_TEXTURE_2D,
+      0,
+      0,
+      0,
+      this->format.frameWidth ,
+      this->format.frameHeight,
+      this->vboFormat,
+      this->dataFormat,
+      (void*)0
+    );
   if (check_gl_error("glTexSubImage2D"))
   {
     DEBUG_ERROR(
@@ -586,7 +586,7 @@ void app_handleRenderEvent(const uint64_t timeUs)
   }
 
   if (invalidate)
-    app_invalidateWindow(false);
+    app_invalidateOverlay(false);
 }
 
 void app_setFullscreen(bool fs)
@@ -604,6 +604,20 @@ bool app_getProp(LG_DSProperty prop, void * ret)
   return g_state.ds->getProp(prop, ret);
 }
 
+bool app_scanoutFrame(const LG_DSDMABuf * buffer, const struct Rect * dest)
+{
+  if (!g_state.ds->scanoutFrame)
+    return false;
+
+  return g_state.ds->scanoutFrame(buffer, dest);
+}
+
+void app_scanoutStop(void)
+{
+  if (g_state.ds->scanoutStop)
+    g_state.ds->scanoutStop();
+}
+
 #ifdef ENABLE_EGL
 EGLDisplay app_getEGLDisplay(void)
 {
@@ -642,9 +656,9 @@ void app_glSetSwapInterval(int interval)
   g_state.ds->glSetSwapInterval(interval);
 }
 
-void app_glSwapBuffers(void)
+void app_glSwapBuffers(const struct Rect * damage, int count)
 {
-  g_state.ds->glSwapBuffers();
+  g_state.ds->glSwapBuffers(damage, count);
 }
 #endif
 
@@ -806,6 +820,9 @@ void app_initOverlays(void)
     }
   }
   ll_unlock(g_state.overlays);
+
+  atomic_store(&g_state.overlayTicking, true);
+  atomic_store(&g_state.overlayDirty  , true);
 }
 
 static inline void mergeRect(struct Rect * dest, const struct Rect * a, const struct Rect * b)
@@ -872,6 +889,48 @@ bool app_overlayNeedsRender(void)
   return result;
 }
 
+/* returns true if the last ImGui frame is still current. When nothing is shown
+ * there is nothing to draw, and when only static overlays are shown their last
+ * draw data can be presented again, both without building a new frame. */
+static bool overlayIsCurrent(struct Rect * rects, int maxRects, int * count)
+{
+  if (atomic_load(&g_state.overlayDirty) || app_isOverlayMode())
+    return false;
+
+  int  totalRects  = 0;
+  bool totalDamage = false;
+  bool result      = true;
+  struct Overlay * overlay;
+
+  ll_lock(g_state.overlays);
+  ll_forEachNL(g_state.overlays, item, overlay)
+  {
+    if (!overlay->lastRectCount)
+      continue;
+
+    if (!overlay->ops->is_static || !overlay->ops->is_static(overlay->udata))
+    {
+      result = false;
+      break;
+    }
+
+    // unchanged, so only the area it covers needs redrawing
+    totalDamage |= overlay->lastRectCount > maxRects;
+    if (!totalDamage)
+    {
+      memcpy(rects, overlay->lastRects,
+          overlay->lastRectCount * sizeof(struct Rect));
+      rects      += overlay->lastRectCount;
+      totalRects += overlay->lastRectCount;
+      maxRects   -= overlay->lastRectCount;
+    }
+  }
+  ll_unlock(g_state.overlays);
+
+  *count = totalDamage ? -1 : totalRects;
+  return result;
+}
+
 int app_renderOverlay(struct Rect * rects, int maxRects)
 {
   int  totalRects  = 0;
@@ -879,6 +938,13 @@ int app_renderOverlay(struct Rect * rects, int maxRects)
   struct Overlay * overlay;
   struct Rect buffer[MAX_OVERLAY_RECTS];
 
+  if (overlayIsCurrent(rects, maxRects, &totalRects))
+    return totalRects;
+
+  /* cleared before building so an invalidation from another thread while the
+   * overlays render is not lost */
+  atomic_store(&g_state.overlayDirty, false);
+
   g_state.io->KeyCtrl  = g_state.modCtrl;
   g_state.io->KeyShift = g_state.modShift;
   g_state.io->KeyAlt   = g_state.modAlt;
@@ -1013,6 +1079,10 @@ void app_invalidateOverlay(bool renderTwice)
 
   if (renderTwice)
     g_state.renderImGuiTwice = true;
+
+  // the overlay may have started animating, the tick timer will check
+  atomic_store(&g_state.overlayTicking, true);
+  atomic_store(&g_state.overlayDirty  , true);
   app_invalidateWindow(false);
 }
 
@@ -25,13 +25,17 @@
 #include "common/array.h"
 #include "common/util.h"
 #include "common/ringbuffer.h"
+#include "common/resampler.h"
+#include "common/event.h"
+#include "common/thread.h"
+#include "common/time.h"
 
 #include "dynamic/audiodev.h"
 
 #include <float.h>
 #include <math.h>
-#include <samplerate.h>
 #include <stdalign.h>
+#include <stdatomic.h>
 #include <string.h>
 
 typedef enum
@@ -60,7 +64,6 @@ PlaybackDeviceData;
 
 typedef struct
 {
-  float * framesIn;
   float * framesOut;
   int     framesOutSize;
 
@@ -81,11 +84,49 @@ typedef struct
   double  offsetErrorIntegral;
 
   double  ratioIntegral;
+  double  ratio;
 
-  SRC_STATE * src;
+  Resampler resampler;
 }
 PlaybackSpiceData;
 
+typedef struct
+{
+  int     periodFrames;
+  double  periodSec;
+  int64_t nextTime;
+  int64_t position;
+  double  b;
+  double  c;
+}
+RecordDeviceData;
+
+typedef struct
+{
+  int16_t * framesIn;
+  int       framesInSize;
+  float   * framesOut;
+  int16_t * packet;
+
+  int64_t   readPosition;
+
+  int       devPeriodFrames;
+  int       devMaxPeriodFrames;
+  int64_t   devLastTime;
+  int64_t   devNextTime;
+  int64_t   devLastPosition;
+  int64_t   devNextPosition;
+
+  double    b;
+  double    c;
+  double    offsetError;
+  double    offsetErrorIntegral;
+  double    ratioIntegral;
+
+  Resampler resampler;
+}
+RecordSenderData;
+
 typedef struct
 {
   struct LG_AudioDevOps * audioDev;
@@ -125,6 +166,15 @@ typedef struct
     bool          mute;
     int           stride;
     uint32_t      time;
+    int           channels;
+    int           sampleRate;
+    int           periodFrames;
+    RingBuffer    buffer;
+    RingBuffer    deviceTiming;
+    LGEvent     * wakeup;
+    LGThread    * thread;
+    atomic_bool   threadRun;
+    atomic_bool   sending;
     int           lastChannels;
     int           lastSampleRate;
     PSAudioFormat lastFormat;
@@ -132,6 +182,14 @@ typedef struct
     int           confirmChannels;
     int           confirmSampleRate;
     PSAudioFormat confirmFormat;
+
+    RingBuffer    timings;
+    GraphHandle   graph;
+
+    /* As for playback, the device data is used by the audio device thread and
+     * the sender data by the record sender thread. */
+    alignas(64) RecordDeviceData deviceData;
+    alignas(64) RecordSenderData senderData;
   }
   record;
 }
@@ -147,6 +205,8 @@ typedef struct
 }
 PlaybackDeviceTick;
 
+typedef PlaybackDeviceTick RecordDeviceTick;
+
 static void playbackStop(void);
 
 void audio_init(void)
@@ -200,13 +260,11 @@ static void playbackStop(void)
   audio.audioDev->playback.stop();
   ringbuffer_free(&audio.playback.buffer);
   ringbuffer_free(&audio.playback.deviceTiming);
-  audio.playback.spiceData.src = src_delete(audio.playback.spiceData.src);
+  resampler_free(&audio.playback.spiceData.resampler);
 
-  if (audio.playback.spiceData.framesIn)
+  if (audio.playback.spiceData.framesOut)
   {
-    free(audio.playback.spiceData.framesIn);
     free(audio.playback.spiceData.framesOut);
-    audio.playback.spiceData.framesIn = NULL;
     audio.playback.spiceData.framesOut = NULL;
   }
 
@@ -335,17 +393,17 @@ void audio_playbackStart(int channels, int sampleRate, PSAudioFormat format,
   if (audio.playback.state != STREAM_STATE_STOP)
     playbackStop();
 
-  int srcError;
-  audio.playback.spiceData.src = src_new(SRC_SINC_FASTEST, channels, &srcError);
-  if (!audio.playback.spiceData.src)
+  audio.playback.spiceData.resampler =
+    resampler_new(channels, g_params.audioResampleQuality);
+  if (!audio.playback.spiceData.resampler)
   {
-    DEBUG_ERROR("Failed to create resampler: %s", src_strerror(srcError));
+    DEBUG_ERROR("Failed to create resampler");
     return;
   }
 
   const int bufferFrames = sampleRate;
-  audio.playback.buffer = ringbuffer_newUnbounded(bufferFrames,
-      channels * sizeof(float));
+  audio.playback.buffer = ringbuffer_newMirrored(bufferFrames,
+      channels * sizeof(float), true);
 
   audio.playback.deviceTiming = ringbuffer_new(16, sizeof(PlaybackDeviceTick));
 
@@ -368,6 +426,7 @@ void audio_playbackStart(int channels, int sampleRate, PSAudioFormat format,
   audio.playback.spiceData.offsetError         = 0.0;
   audio.playback.spiceData.offsetErrorIntegral = 0.0;
   audio.playback.spiceData.ratioIntegral       = 0.0;
+  audio.playback.spiceData.ratio               = 1.0;
 
   int requestedPeriodFrames = max(g_params.audioPeriodSize, 1);
   audio.playback.deviceMaxPeriodFrames = 0;
@@ -407,13 +466,7 @@ void audio_playbackStop(void)
       audio.playback.state = STREAM_STATE_KEEP_ALIVE;
 
       // Reset the resampler so it is safe to use for the next playback
-      int error = src_reset(audio.playback.spiceData.src);
-      if (error)
-      {
-        DEBUG_ERROR("Failed to reset resampler: %s", src_strerror(error));
-        playbackStop();
-      }
-
+      resampler_reset(audio.playback.spiceData.resampler);
       break;
     }
 
@@ -478,7 +531,6 @@ void audio_playbackData(uint8_t * data, size_t size)
   PlaybackSpiceData * spiceData = &audio.playback.spiceData;
   int64_t now = nanotime();
 
-  // Convert from s16 to f32 samples
   int spiceStride    = audio.playback.channels * sizeof(int16_t);
   int frames         = size / spiceStride;
   bool periodChanged = frames != spiceData->periodFrames;
@@ -486,20 +538,8 @@ void audio_playbackData(uint8_t * data, size_t size)
 
   if (periodChanged)
   {
-    if (spiceData->framesIn)
-    {
-      free(spiceData->framesIn);
-      free(spiceData->framesOut);
-    }
+    free(spiceData->framesOut);
     spiceData->periodFrames  = frames;
-    spiceData->framesIn      = malloc(frames * audio.playback.stride);
-    if (!spiceData->framesIn)
-    {
-      DEBUG_ERROR("Failed to malloc framesIn");
-      playbackStop();
-      return;
-    }
-
     spiceData->framesOutSize = round(frames * 1.1);
     spiceData->framesOut     =
       malloc(spiceData->framesOutSize * audio.playback.stride);
@@ -511,9 +551,6 @@ void audio_playbackData(uint8_t * data, size_t size)
     }
   }
 
-  src_short_to_float_array((int16_t *) data, spiceData->framesIn,
-    frames * audio.playback.channels);
-
   // Receive timing information from the audio device thread
   PlaybackDeviceTick deviceTick;
   while (ringbuffer_consume(audio.playback.deviceTiming, &deviceTick, 1))
@@ -612,10 +649,8 @@ void audio_playbackData(uint8_t * data, size_t size)
         // If starting a new playback we need to allow a little extra time for
         // the resampler startup latency
         if (audio.playback.state == STREAM_STATE_KEEP_ALIVE)
-        {
-          int resamplerLatencyFrames = 20;
-          targetPosition += resamplerLatencyFrames;
-        }
+          targetPosition +=
+            resampler_getLatency(audio.playback.spiceData.resampler);
 
         slewFrames = round(targetPosition - spiceData->nextPosition);
       }
@@ -678,36 +713,39 @@ void audio_playbackData(uint8_t * data, size_t size)
 
   double piOutput = kp * offsetError + ki * spiceData->ratioIntegral;
   double ratio = 1.0 + piOutput;
-
-  int consumed = 0;
-  while (consumed < frames)
+  spiceData->ratio = ratio;
+
+  /* The resampler converts the s16 samples as it buffers them and writes
+   * straight into the ring buffer. framesOut is only used if the buffer is
+   * full, in which case ringbuffer_append discards the excess. */
+  const int16_t * in = (const int16_t *) data;
+  int inFrames = frames;
+  int generated;
+  int space;
+  do
   {
-    SRC_DATA srcData =
+    space = spiceData->framesOutSize;
+    float * out = ringbuffer_acquireWrite(audio.playback.buffer, &space);
+    if (out)
     {
-      .data_in           = spiceData->framesIn +
-        consumed * audio.playback.channels,
-      .data_out          = spiceData->framesOut,
-      .input_frames      = frames - consumed,
-      .output_frames     = spiceData->framesOutSize,
-      .input_frames_used = 0,
-      .output_frames_gen = 0,
-      .end_of_input      = 0,
-      .src_ratio         = ratio
-    };
-
-    int error = src_process(spiceData->src, &srcData);
-    if (error)
+      generated = resampler_processS16(spiceData->resampler, in, inFrames,
+          out, space, ratio);
+      ringbuffer_commitWrite(audio.playback.buffer, generated);
+    }
+    else
     {
-      DEBUG_ERROR("Resampling failed: %s", src_strerror(error));
-      return;
+      space     = spiceData->framesOutSize;
+      generated = resampler_processS16(spiceData->resampler, in, inFrames,
+          spiceData->framesOut, space, ratio);
+      ringbuffer_append(audio.playback.buffer, spiceData->framesOut,
+          generated);
     }
+    spiceData->nextPosition += generated;
 
-    ringbuffer_append(audio.playback.buffer, spiceData->framesOut,
-      srcData.output_frames_gen);
-
-    consumed += srcData.input_frames_used;
-    spiceData->nextPosition += srcData.output_frames_gen;
+    in       = NULL;
+    inFrames = 0;
   }
+  while (generated == space);
 
   if (audio.playback.state == STREAM_STATE_SETUP_SPICE)
   {
@@ -747,14 +785,341 @@ bool audio_supportsRecord(void)
 
 static void recordPushFrames(uint8_t * data, int frames)
 {
-  purespice_writeAudio(data, frames * audio.record.stride, 0);
+  if (frames <= 0)
+    return;
+
+  RecordDeviceData * devData = &audio.record.deviceData;
+  int64_t now = nanotime();
+
+  // Measure the device clock the same way as for playback
+  if (frames != devData->periodFrames)
+  {
+    devData->periodFrames = frames;
+    devData->periodSec    = (double) frames / audio.record.sampleRate;
+    devData->nextTime     = now + llrint(devData->periodSec * 1.0e9);
+
+    double bandwidth = 0.05;
+    double omega = 2.0 * M_PI * bandwidth * devData->periodSec;
+    devData->b = M_SQRT2 * omega;
+    devData->c = omega * omega;
+  }
+  else
+  {
+    double error = (now - devData->nextTime) * 1.0e-9;
+    if (fabs(error) >= 0.2)
+    {
+      devData->periodSec = (double) frames / audio.record.sampleRate;
+      devData->nextTime  = now + llrint(devData->periodSec * 1.0e9);
+    }
+    else
+    {
+      devData->nextTime  += llrint((devData->b * error + devData->periodSec) * 1.0e9);
+      devData->periodSec += devData->c * error;
+    }
+  }
+
+  // The position the device will have reached when it next pushes data
+  devData->position += frames;
+  RecordDeviceTick tick =
+  {
+    .periodFrames = frames,
+    .nextTime     = devData->nextTime,
+    .nextPosition = devData->position + frames
+  };
+
+  /* Never block the realtime thread on the network, just queue the frames for
+   * the sender thread. */
+  ringbuffer_append(audio.record.buffer, data, frames);
+  ringbuffer_push(audio.record.deviceTiming, &tick);
+
+  if (!atomic_load_explicit(&audio.record.sending, memory_order_relaxed))
+    lgSignalEvent(audio.record.wakeup);
+}
+
+static double computeRecordDevicePosition(int64_t curTime)
+{
+  RecordSenderData * senderData = &audio.record.senderData;
+  return senderData->devLastPosition +
+    (senderData->devNextPosition - senderData->devLastPosition) *
+      ((double) (curTime - senderData->devLastTime) /
+        (senderData->devNextTime - senderData->devLastTime));
+}
+
+static double recordTargetLatency(void)
+{
+  /* Enough to always have a full packet buffered when one is due, plus a
+   * little extra for device timing jitter and a configurable margin */
+  RecordSenderData * senderData = &audio.record.senderData;
+  int configLatencyMs = max(g_params.micBufferLatency, 0);
+  return senderData->devMaxPeriodFrames * 1.1 + audio.record.periodFrames +
+    configLatencyMs * audio.record.sampleRate / 1000.0;
+}
+
+static void recordSendPacket(int64_t now, double periodSec)
+{
+  RecordSenderData * senderData = &audio.record.senderData;
+  const int channels     = audio.record.channels;
+  const int periodFrames = audio.record.periodFrames;
+
+  /* Measure how far behind the device the read position is, and how far this
+   * is from the target latency. Filter it as the device delivers data in
+   * whole periods, which would otherwise show up as a sawtooth. */
+  double actualOffset = computeRecordDevicePosition(now) -
+    senderData->readPosition;
+  double actualOffsetError = -(actualOffset - recordTargetLatency());
+
+  double error = actualOffsetError - senderData->offsetError;
+  double offsetError = senderData->offsetError;
+  senderData->offsetError += senderData->b * error +
+    senderData->offsetErrorIntegral;
+  senderData->offsetErrorIntegral += senderData->c * error;
+
+  /* Nothing tells us the rate at which the guest consumes the audio, so the
+   * packets are paced by the local clock and the device clock drift is taken
+   * out by resampling, using the same PI controller as playback. A surplus
+   * lowers the ratio so more device frames are consumed per packet. */
+  double kp = 0.5e-6;
+  double ki = 1.0e-16;
+
+  senderData->ratioIntegral += offsetError * periodSec;
+
+  double piOutput = kp * offsetError + ki * senderData->ratioIntegral;
+  double ratio = 1.0 + piOutput;
+
+  int generated = resampler_processS16(senderData->resampler, NULL, 0,
+      senderData->framesOut, periodFrames, ratio);
+  while (generated < periodFrames)
+  {
+    int inFrames = min(senderData->framesInSize,
+        (int) ceil((periodFrames - generated) / ratio));
+
+    /* Resample straight out of the ring buffer if it holds enough, otherwise
+     * copy out what there is and let the unbounded buffer pad with silence */
+    int available = inFrames;
+    const int16_t * in =
+      ringbuffer_acquireRead(audio.record.buffer, &available);
+    if (!in || available < inFrames)
+    {
+      ringbuffer_consume(audio.record.buffer, senderData->framesIn, inFrames);
+      in = senderData->framesIn;
+    }
+
+    generated += resampler_processS16(senderData->resampler, in, inFrames,
+        senderData->framesOut + generated * channels,
+        periodFrames - generated, ratio);
+    senderData->readPosition += inFrames;
+
+    if (in != senderData->framesIn)
+      ringbuffer_commitRead(audio.record.buffer, inFrames);
+  }
+
+  for(int i = 0; i < periodFrames * channels; ++i)
+  {
+    float sample = senderData->framesOut[i] * 32768.0f;
+    senderData->packet[i] = lrintf(clamp(sample, -32768.0f, 32767.0f));
+  }
+
+  purespice_writeAudio(senderData->packet, periodFrames * audio.record.stride,
+      0);
+
+  const int latencyFrames =
+    actualOffset + resampler_getLatency(senderData->resampler);
+  const float latency = latencyFrames * 1000.0 / audio.record.sampleRate;
+  ringbuffer_push(audio.record.timings, &latency);
+  app_invalidateGraph(audio.record.graph);
+}
+
+static int recordSenderThread(void * opaque)
+{
+  RecordSenderData * senderData = &audio.record.senderData;
+  const double  periodSec = (double) audio.record.periodFrames /
+    audio.record.sampleRate;
+  const int64_t periodNs  = llrint(periodSec * 1.0e9);
+  int64_t nextTime = 0;
+
+  double bandwidth = 0.05;
+  double omega = 2.0 * M_PI * bandwidth * periodSec;
+  senderData->b = M_SQRT2 * omega;
+  senderData->c = omega * omega;
+
+  while(atomic_load(&audio.record.threadRun))
+  {
+    int64_t now = nanotime();
+
+    // Receive timing information from the audio device thread
+    RecordDeviceTick deviceTick;
+    while (ringbuffer_consume(audio.record.deviceTiming, &deviceTick, 1))
+    {
+      senderData->devPeriodFrames    = deviceTick.periodFrames;
+      senderData->devMaxPeriodFrames =
+        max(senderData->devMaxPeriodFrames, deviceTick.periodFrames);
+      senderData->devLastTime        = senderData->devNextTime;
+      senderData->devLastPosition    = senderData->devNextPosition;
+      senderData->devNextTime        = deviceTick.nextTime;
+      senderData->devNextPosition    = deviceTick.nextPosition;
+    }
+
+    if (!atomic_load(&audio.record.sending))
+    {
+      /* Wait until the device clock is known and enough has been captured to
+       * reach the target latency, then drop any excess so that capture starts
+       * at the target latency instead of converging on it slowly. */
+      if (senderData->devLastTime == INT64_MIN ||
+          computeRecordDevicePosition(now) - senderData->readPosition <
+            recordTargetLatency())
+      {
+        lgWaitEvent(audio.record.wakeup, 10);
+        continue;
+      }
+
+      int slewFrames = computeRecordDevicePosition(now) -
+        senderData->readPosition - recordTargetLatency();
+      ringbuffer_consume(audio.record.buffer, NULL, slewFrames);
+      senderData->readPosition += slewFrames;
+
+      senderData->offsetError         = 0.0;
+      senderData->offsetErrorIntegral = 0.0;
+      senderData->ratioIntegral       = 0.0;
+
+      nextTime = now;
+      atomic_store(&audio.record.sending, true);
+    }
+    else if (now - nextTime >= 200000000LL)
+    {
+      // Too far behind (e.g. the system was suspended), start over
+      atomic_store(&audio.record.sending, false);
+      continue;
+    }
+    else if (now < nextTime)
+    {
+      nsleep(nextTime - now);
+      continue;
+    }
+
+    recordSendPacket(now, periodSec);
+    nextTime += periodNs;
+  }
+
+  return 0;
+}
+
+static void recordStreamFree(void)
+{
+  if (audio.record.thread)
+  {
+    atomic_store(&audio.record.threadRun, false);
+    lgSignalEvent(audio.record.wakeup);
+    lgJoinThread(audio.record.thread, NULL);
+    audio.record.thread = NULL;
+  }
+
+  if (audio.record.wakeup)
+  {
+    lgFreeEvent(audio.record.wakeup);
+    audio.record.wakeup = NULL;
+  }
+
+  RecordSenderData * senderData = &audio.record.senderData;
+  resampler_free(&senderData->resampler);
+  free(senderData->framesIn);
+  free(senderData->framesOut);
+  free(senderData->packet);
+  senderData->framesIn  = NULL;
+  senderData->framesOut = NULL;
+  senderData->packet    = NULL;
+
+  ringbuffer_free(&audio.record.buffer);
+  ringbuffer_free(&audio.record.deviceTiming);
+
+  if (audio.record.timings)
+  {
+    app_unregisterGraph(audio.record.graph);
+    ringbuffer_free(&audio.record.timings);
+  }
+}
+
+static bool recordStreamStart(int channels, int sampleRate)
+{
+  RecordSenderData * senderData = &audio.record.senderData;
+
+  // Send packets of 10ms, the same period Spice uses for playback
+  audio.record.channels     = channels;
+  audio.record.sampleRate   = sampleRate;
+  audio.record.periodFrames = sampleRate / 100;
+
+  senderData->framesInSize = ceil(audio.record.periodFrames * 1.1);
+  senderData->framesIn     =
+    malloc(senderData->framesInSize * audio.record.stride);
+  senderData->framesOut    =
+    malloc(audio.record.periodFrames * channels * sizeof(float));
+  senderData->packet       = malloc(audio.record.periodFrames *
+    audio.record.stride);
+  if (!senderData->framesIn || !senderData->framesOut || !senderData->packet)
+  {
+    DEBUG_ERROR("Out of memory");
+    goto err;
+  }
+
+  senderData->resampler =
+    resampler_new(channels, g_params.audioResampleQuality);
+  if (!senderData->resampler)
+  {
+    DEBUG_ERROR("Failed to create resampler");
+    goto err;
+  }
+
+  audio.record.buffer       = ringbuffer_newMirrored(sampleRate,
+      audio.record.stride, true);
+  audio.record.deviceTiming = ringbuffer_new(16, sizeof(RecordDeviceTick));
+
+  audio.record.deviceData.periodFrames = 0;
+  audio.record.deviceData.position     = 0;
+
+  senderData->readPosition       = 0;
+  senderData->devPeriodFrames    = 0;
+  senderData->devMaxPeriodFrames = 0;
+  senderData->devLastTime        = INT64_MIN;
+  senderData->devNextTime        = INT64_MIN;
+  senderData->devLastPosition    = 0;
+  senderData->devNextPosition    = 0;
+
+  audio.record.wakeup = lgCreateEvent(true, 0);
+  if (!audio.record.wakeup)
+  {
+    DEBUG_ERROR("Failed to create the record wakeup event");
+    goto err;
+  }
+
+  audio.record.timings = ringbuffer_new(1200, sizeof(float));
+  audio.record.graph   = app_registerGraph("RECORD",
+      audio.record.timings, 0.0f, 200.0f, audioGraphFormatFn);
+
+  atomic_store(&audio.record.sending  , false);
+  atomic_store(&audio.record.threadRun, true );
+  if (!lgCreateThread("recordSender", recordSenderThread, NULL,
+        &audio.record.thread))
+  {
+    DEBUG_ERROR("Failed to create the record sender thread");
+    goto err;
+  }
+
+  return true;
+
+err:
+  recordStreamFree();
+  return false;
 }
 
 static void realRecordStart(int channels, int sampleRate, PSAudioFormat format)
 {
-  audio.record.started = true;
-  audio.record.stride  = channels * sizeof(uint16_t);
+  audio.record.stride = channels * sizeof(uint16_t);
+  if (!recordStreamStart(channels, sampleRate))
+  {
+    audio.record.started = false;
+    return;
+  }
 
+  audio.record.started = true;
   audio.audioDev->record.start(channels, sampleRate, recordPushFrames);
 
   // if a volume level was stored, set it before we return
@@ -806,7 +1171,10 @@ void audio_recordStart(int channels, int sampleRate, PSAudioFormat format)
   if (audio.record.started)
   {
     if (channels != lastChannels || sampleRate != lastSampleRate)
+    {
       audio.audioDev->record.stop();
+      recordStreamFree();
+    }
     else
       return;
   }
@@ -843,6 +1211,7 @@ void audio_recordStart(int channels, int sampleRate, PSAudioFormat format)
 static void realRecordStop(void)
 {
   audio.audioDev->record.stop();
+  recordStreamFree();
   audio.record.started = false;
 
   if (g_params.micShowIndicator)
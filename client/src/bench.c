@@ -0,0 +1,272 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "bench.h"
+#include "main.h"
+#include "core.h"
+#include "overlays.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "common/debug.h"
+#include "common/framebuffer.h"
+#include "common/option.h"
+#include "common/time.h"
+#include "common/util.h"
+
+// frames rendered before measuring so shader compilation is not counted
+#define WARMUP_FRAMES 10
+
+// the size of the block that moves across the frame when not in fullFrame mode
+#define BLOCK_SIZE    256
+
+struct Stats
+{
+  uint64_t total, min, max;
+  int      count;
+};
+
+static void statsAdd(struct Stats * stats, uint64_t value)
+{
+  if (!stats->count)
+  {
+    stats->min = value;
+    stats->max = value;
+  }
+  else
+  {
+    stats->min = min(stats->min, value);
+    stats->max = max(stats->max, value);
+  }
+
+  stats->total += value;
+  ++stats->count;
+}
+
+static void statsLog(const char * name, const struct Stats * stats)
+{
+  if (!stats->count)
+    return;
+
+  DEBUG_INFO("%-7s: min:%7.3f max:%7.3f avg:%7.3f ms", name,
+      stats->min * 1e-6, stats->max * 1e-6,
+      stats->total * 1e-6 / stats->count);
+}
+
+/* Draws a pattern with some detail for the filters to work on, shifted
+ * horizontally by phase so full frame updates actually change every pixel */
+static void drawPattern(uint8_t * data, unsigned int pitch,
+    const FrameDamageRect * rect, unsigned int phase)
+{
+  for(unsigned int y = rect->y; y < rect->y + rect->height; ++y)
+  {
+    uint8_t * px = data + y * pitch + rect->x * 4;
+    for(unsigned int x = rect->x; x < rect->x + rect->width; ++x, px += 4)
+    {
+      const unsigned int sx = x + phase;
+      px[0] = sx;
+      px[1] = y;
+      px[2] = (sx ^ y) & 0x20 ? 0xff : 0x00;
+      px[3] = 0xff;
+    }
+  }
+}
+
+static void drawBlock(uint8_t * data, unsigned int pitch,
+    const FrameDamageRect * rect, unsigned int frame)
+{
+  const uint32_t color = 0xff000000 | (frame * 0x010305 & 0xffffff);
+  for(unsigned int y = rect->y; y < rect->y + rect->height; ++y)
+  {
+    uint32_t * px = (uint32_t *)(data + y * pitch) + rect->x;
+    for(unsigned int x = 0; x < rect->width; ++x)
+      px[x] = color;
+  }
+}
+
+/* bounces the block around the frame like a screensaver */
+static void moveBlock(FrameDamageRect * block, int * dx, int * dy,
+    unsigned int width, unsigned int height)
+{
+  const int x = (int)block->x + *dx;
+  const int y = (int)block->y + *dy;
+
+  if (x < 0 || x + block->width > width)
+    *dx = -*dx;
+  else
+    block->x = x;
+
+  if (y < 0 || y + block->height > height)
+    *dy = -*dy;
+  else
+    block->y = y;
+}
+
+static bool waitRendered(uint64_t frameSeq)
+{
+  while(atomic_load_explicit(&g_state.renderedFrameSeq,
+        memory_order_acquire) < frameSeq)
+  {
+    if (g_state.state != APP_STATE_RUNNING)
+      return false;
+    usleep(100);
+  }
+  return true;
+}
+
+bool bench_run(void)
+{
+  const int  frames    = option_get_int ("headless", "frames"   );
+  const bool fullFrame = option_get_bool("headless", "fullFrame");
+  unsigned int width   = option_get_int ("headless", "srcWidth" );
+  unsigned int height  = option_get_int ("headless", "srcHeight");
+
+  if (!width)
+    width = g_state.windowW;
+  if (!height)
+    height = g_state.windowH;
+
+  const LG_RendererFormat format =
+  {
+    .type         = FRAME_TYPE_BGRA,
+    .screenWidth  = width,
+    .screenHeight = height,
+    .dataWidth    = width,
+    .dataHeight   = height,
+    .frameWidth   = width,
+    .frameHeight  = height,
+    .stride       = width,
+    .pitch        = width * 4,
+    .bpp          = 32,
+    .rotate       = LG_ROTATE_0
+  };
+
+  const size_t dataSize = (size_t)format.pitch * height;
+  FrameBuffer * fb = malloc(sizeof(*fb) + dataSize);
+  if (!fb)
+  {
+    DEBUG_ERROR("out of memory");
+    return false;
+  }
+
+  LG_LOCK(g_state.lgrLock);
+  const bool formatOk = RENDERER(onFrameFormat, format);
+  LG_UNLOCK(g_state.lgrLock);
+  if (!formatOk)
+  {
+    DEBUG_ERROR("renderer failed to configure format");
+    free(fb);
+    return false;
+  }
+
+  g_state.formatValid = true;
+  g_state.srcSize.x   = width;
+  g_state.srcSize.y   = height;
+  g_state.haveSrcSize = true;
+  core_updatePositionInfo();
+  overlaySplash_show(false);
+
+  DEBUG_INFO("Benchmark: %d %s frames of %ux%u rendered at %dx%d", frames,
+      fullFrame ? "full" : "partial", width, height,
+      g_state.windowW, g_state.windowH);
+
+  uint8_t * data = framebuffer_get_data(fb);
+  const FrameDamageRect full = { .width = width, .height = height };
+  drawPattern(data, format.pitch, &full, 0);
+  framebuffer_set_write_ptr(fb, dataSize);
+
+  FrameDamageRect block =
+  {
+    .width  = min(width , (unsigned int)BLOCK_SIZE),
+    .height = min(height, (unsigned int)BLOCK_SIZE)
+  };
+  int dx = 7, dy = 5;
+
+  struct Stats upload = { 0 };
+  struct Stats frame  = { 0 };
+  uint64_t     benchStart = 0;
+  bool         ok = true;
+
+  for(int i = 0; i < WARMUP_FRAMES + frames; ++i)
+  {
+    // no damage rects is a full frame update, the first frame is always one
+    FrameDamageRect damage[2];
+    int damageCount = 0;
+
+    if (i > 0 && fullFrame)
+      drawPattern(data, format.pitch, &full, i);
+    else if (i > 0)
+    {
+      damage[damageCount++] = block;
+      drawPattern(data, format.pitch, &block, 0);
+      moveBlock(&block, &dx, &dy, width, height);
+      drawBlock(data, format.pitch, &block, i);
+      damage[damageCount++] = block;
+    }
+
+    if (i == WARMUP_FRAMES)
+      benchStart = nanotime();
+
+    const uint64_t start = nanotime();
+    if (!RENDERER(onFrame, fb, -1, damage, damageCount))
+    {
+      DEBUG_ERROR("renderer on frame returned failure");
+      ok = false;
+      break;
+    }
+    const uint64_t uploaded = nanotime();
+
+    // frameCount is reset by the UPS timer, only frameSeq can be waited on
+    atomic_fetch_add_explicit(&g_state.frameCount, 1, memory_order_relaxed);
+    const uint64_t frameSeq =
+      atomic_fetch_add_explicit(&g_state.frameSeq, 1,
+          memory_order_relaxed) + 1;
+    lgSignalEvent(g_state.frameEvent);
+
+    if (!waitRendered(frameSeq))
+    {
+      ok = false;
+      break;
+    }
+
+    if (i >= WARMUP_FRAMES)
+    {
+      statsAdd(&upload, uploaded  - start);
+      statsAdd(&frame , nanotime() - start);
+    }
+  }
+
+  if (ok && frame.count)
+  {
+    const double elapsed = (nanotime() - benchStart) * 1e-9;
+    DEBUG_INFO("Benchmark: %d frames in %.2f s (%.2f fps)",
+        frame.count, elapsed, frame.count / elapsed);
+    statsLog("onFrame", &upload);
+    statsLog("latency", &frame );
+    overlayGraph_logMetrics();
+  }
+
+  free(fb);
+  g_state.state = APP_STATE_SHUTDOWN;
+  return ok;
+}
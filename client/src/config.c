@@ -25,6 +25,7 @@
 #include "common/option.h"
 #include "common/debug.h"
 #include "common/paths.h"
+#include "common/resampler.h"
 #include "common/stringutils.h"
 
 #include <sys/stat.h>
@@ -47,6 +48,7 @@ static StringList optScancodeValues    (struct Option * opt);
 static bool       optScancodeValidate  (struct Option * opt, const char ** error);
 static char *     optScancodeToString  (struct Option * opt);
 static bool       optRotateValidate    (struct Option * opt, const char ** error);
+static bool       optResampleQualityValidate(struct Option * opt, const char ** error);
 static bool       optMicDefaultParse   (struct Option * opt, const char * str);
 static StringList optMicDefaultValues  (struct Option * opt);
 static char *     optMicDefaultToString(struct Option * opt);
@@ -529,6 +531,14 @@ static struct Option options[] =
     .type           = OPTION_TYPE_INT,
     .value.x_int    = 13
   },
+  {
+    .module         = "audio",
+    .name           = "resampleQuality",
+    .description    = "Resampler quality (0-3), each step doubles the resampling latency",
+    .type           = OPTION_TYPE_INT,
+    .validator      = optResampleQualityValidate,
+    .value.x_int    = 2
+  },
   {
     .module         = "audio",
     .name           = "micDefault",
@@ -538,6 +548,13 @@ static struct Option options[] =
     .getValues      = optMicDefaultValues,
     .toString       = optMicDefaultToString
   },
+  {
+    .module         = "audio",
+    .name           = "micBufferLatency",
+    .description    = "Additional microphone buffer latency in milliseconds",
+    .type           = OPTION_TYPE_INT,
+    .value.x_int    = 5
+  },
   {
     .module         = "audio",
     .name           = "micShowIndicator",
@@ -748,6 +765,8 @@ bool config_load(int argc, char * argv[])
 
   g_params.audioPeriodSize = option_get_int("audio", "periodSize");
   g_params.audioBufferLatency = option_get_int("audio", "bufferLatency");
+  g_params.audioResampleQuality = option_get_int("audio", "resampleQuality");
+  g_params.micBufferLatency   = option_get_int("audio", "micBufferLatency");
   g_params.micShowIndicator   = option_get_bool("audio", "micShowIndicator");
   g_params.audioSyncVolume = option_get_bool("audio", "syncVolume");
 
@@ -987,6 +1006,16 @@ static bool optRotateValidate(struct Option * opt, const char ** error)
   return false;
 }
 
+static bool optResampleQualityValidate(struct Option * opt, const char ** error)
+{
+  if (opt->value.x_int >= RESAMPLER_QUALITY_MIN &&
+      opt->value.x_int <= RESAMPLER_QUALITY_MAX)
+    return true;
+
+  *error = "Resampler quality must be between 0 and 3";
+  return false;
+}
+
 static bool optMicDefaultParse(struct Option * opt, const char * str)
 {
   if (!str)
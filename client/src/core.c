@@ -687,7 +687,7 @@ void core_updateOverlayState(void)
     core_resetOverlayInputState();
     core_setGrabQuiet(wasGrabbed);
     core_invalidatePointer(true);
-    app_invalidateWindow(false);
+    app_invalidateOverlay(false);
 
     if (!g_cursor.grab)
     {
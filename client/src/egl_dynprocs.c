@@ -46,6 +46,24 @@ void egl_dynProcsInit(void)
     eglGetProcAddress("eglCreateImage");
   g_egl_dynProcs.eglDestroyImage = (PFNEGLDESTROYIMAGEPROC)
     eglGetProcAddress("eglDestroyImage");
+  g_egl_dynProcs.glGenQueriesEXT = (PFNGLGENQUERIESEXTPROC)
+    eglGetProcAddress("glGenQueriesEXT");
+  g_egl_dynProcs.glDeleteQueriesEXT = (PFNGLDELETEQUERIESEXTPROC)
+    eglGetProcAddress("glDeleteQueriesEXT");
+  g_egl_dynProcs.glBeginQueryEXT = (PFNGLBEGINQUERYEXTPROC)
+    eglGetProcAddress("glBeginQueryEXT");
+  g_egl_dynProcs.glEndQueryEXT = (PFNGLENDQUERYEXTPROC)
+    eglGetProcAddress("glEndQueryEXT");
+  g_egl_dynProcs.glGetQueryObjectuivEXT = (PFNGLGETQUERYOBJECTUIVEXTPROC)
+    eglGetProcAddress("glGetQueryObjectuivEXT");
+  g_egl_dynProcs.glGetQueryObjectui64vEXT = (PFNGLGETQUERYOBJECTUI64VEXTPROC)
+    eglGetProcAddress("glGetQueryObjectui64vEXT");
+  g_egl_dynProcs.glDispatchCompute = (PFNGLDISPATCHCOMPUTEPROC)
+    eglGetProcAddress("glDispatchCompute");
+  g_egl_dynProcs.glBindImageTexture = (PFNGLBINDIMAGETEXTUREPROC)
+    eglGetProcAddress("glBindImageTexture");
+  g_egl_dynProcs.glMemoryBarrier = (PFNGLMEMORYBARRIERPROC)
+    eglGetProcAddress("glMemoryBarrier");
 
   if (!g_egl_dynProcs.eglCreateImage)
     g_egl_dynProcs.eglCreateImage = (PFNEGLCREATEIMAGEPROC)
@@ -0,0 +1,288 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "fonts.h"
+#include "main.h"
+#include "app.h"
+#include "util.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "common/debug.h"
+#include "common/event.h"
+#include "common/locking.h"
+#include "common/thread.h"
+
+// the number of window scales to keep atlases for, usually one per monitor
+#define FONT_CACHE_SIZE 4
+
+struct FontAtlas
+{
+  double        scale;
+  ImFontAtlas * atlas;
+  ImFont      * fontLarge;
+  uint64_t      lastUsed;
+};
+
+struct FontState
+{
+  char          * data;
+  size_t          size;
+  int             fontSize;
+  const ImWchar * ranges;
+
+  // the atlas created with the ImGui context, it is destroyed with it
+  ImFontAtlas   * contextAtlas;
+
+  LGThread      * thread;
+  LGEvent       * event;
+  atomic_bool     running;
+
+  LG_Lock          lock;
+  struct FontAtlas cache[FONT_CACHE_SIZE];
+  struct FontAtlas * current;
+  double           pending;
+  uint64_t         useCount;
+};
+
+static struct FontState l_fonts = { 0 };
+
+static bool buildAtlas(double scale, struct FontAtlas * out)
+{
+  ImFontAtlas  * atlas  = ImFontAtlas_ImFontAtlas();
+  ImFontConfig * config = ImFontConfig_ImFontConfig();
+
+  // every atlas shares the one copy of the file
+  config->FontDataOwnedByAtlas = false;
+
+  ImFont * font = ImFontAtlas_AddFontFromMemoryTTF(atlas, l_fonts.data,
+      l_fonts.size, l_fonts.fontSize * scale, config, l_fonts.ranges);
+  ImFont * fontLarge = ImFontAtlas_AddFontFromMemoryTTF(atlas, l_fonts.data,
+      l_fonts.size, 1.3f * l_fonts.fontSize * scale, config, l_fonts.ranges);
+  ImFontConfig_destroy(config);
+
+  if (!font || !fontLarge || !ImFontAtlas_Build(atlas))
+  {
+    DEBUG_ERROR("Failed to build the font atlas for scale %.2f", scale);
+    ImFontAtlas_destroy(atlas);
+    return false;
+  }
+
+  // convert to the format the renderers upload now rather than when they do
+  unsigned char * pixels;
+  int width, height, bpp;
+  ImFontAtlas_GetTexDataAsRGBA32(atlas, &pixels, &width, &height, &bpp);
+
+  out->scale     = scale;
+  out->atlas     = atlas;
+  out->fontLarge = fontLarge;
+  return true;
+}
+
+static struct FontAtlas * findAtlas(double scale)
+{
+  for(int i = 0; i < FONT_CACHE_SIZE; ++i)
+    if (l_fonts.cache[i].atlas && l_fonts.cache[i].scale == scale)
+      return l_fonts.cache + i;
+  return NULL;
+}
+
+/* returns an empty entry, or the least recently used one after freeing it.
+ * Must be called with the lock held. */
+static struct FontAtlas * allocAtlas(void)
+{
+  struct FontAtlas * lru = NULL;
+  for(int i = 0; i < FONT_CACHE_SIZE; ++i)
+  {
+    struct FontAtlas * entry = l_fonts.cache + i;
+    if (!entry->atlas)
+      return entry;
+
+    if (entry == l_fonts.current)
+      continue;
+
+    if (!lru || entry->lastUsed < lru->lastUsed)
+      lru = entry;
+  }
+
+  ImFontAtlas_destroy(lru->atlas);
+  lru->atlas = NULL;
+  return lru;
+}
+
+static int fontThread(void * unused)
+{
+  while(atomic_load(&l_fonts.running))
+  {
+    lgWaitEvent(l_fonts.event, TIMEOUT_INFINITE);
+
+    double scale;
+    INTERLOCKED_SECTION(l_fonts.lock,
+    {
+      scale           = l_fonts.pending;
+      l_fonts.pending = 0.0;
+
+      // already built for an earlier request
+      if (scale != 0.0 && findAtlas(scale))
+        scale = 0.0;
+    });
+
+    if (scale == 0.0 || !atomic_load(&l_fonts.running))
+      continue;
+
+    struct FontAtlas atlas;
+    if (!buildAtlas(scale, &atlas))
+      continue;
+
+    INTERLOCKED_SECTION(l_fonts.lock,
+    {
+      struct FontAtlas * entry = allocAtlas();
+      *entry          = atlas;
+      entry->lastUsed = ++l_fonts.useCount;
+    });
+
+    // have the render thread switch to it and upload it
+    atomic_fetch_add(&g_state.lgrResize, 1);
+    app_invalidateWindow(false);
+  }
+
+  return 0;
+}
+
+bool fonts_init(const char * fontFile, int size, const ImWchar * ranges)
+{
+  if (!fontFile)
+  {
+    DEBUG_ERROR("No UI font is available");
+    return false;
+  }
+
+  if (!util_fileGetContents(fontFile, &l_fonts.data, &l_fonts.size))
+  {
+    DEBUG_ERROR("Failed to load the font: %s", fontFile);
+    return false;
+  }
+
+  l_fonts.fontSize     = size;
+  l_fonts.ranges       = ranges;
+  l_fonts.contextAtlas = g_state.io->Fonts;
+  LG_LOCK_INIT(l_fonts.lock);
+
+  l_fonts.event = lgCreateEvent(true, 0);
+  if (!l_fonts.event)
+  {
+    DEBUG_ERROR("Failed to create the font event");
+    goto err;
+  }
+
+  atomic_store(&l_fonts.running, true);
+  if (!lgCreateThread("fontThread", fontThread, NULL, &l_fonts.thread))
+  {
+    DEBUG_ERROR("Failed to create the font thread");
+    goto err_event;
+  }
+
+  return true;
+
+err_event:
+  lgFreeEvent(l_fonts.event);
+  l_fonts.event = NULL;
+
+err:
+  free(l_fonts.data);
+  l_fonts.data = NULL;
+  return false;
+}
+
+void fonts_free(void)
+{
+  if (l_fonts.thread)
+  {
+    atomic_store(&l_fonts.running, false);
+    lgSignalEvent(l_fonts.event);
+    lgJoinThread(l_fonts.thread, NULL);
+    l_fonts.thread = NULL;
+  }
+
+  if (l_fonts.event)
+  {
+    lgFreeEvent(l_fonts.event);
+    l_fonts.event = NULL;
+  }
+
+  if (l_fonts.contextAtlas)
+    g_state.io->Fonts = l_fonts.contextAtlas;
+
+  for(int i = 0; i < FONT_CACHE_SIZE; ++i)
+    if (l_fonts.cache[i].atlas)
+    {
+      ImFontAtlas_destroy(l_fonts.cache[i].atlas);
+      l_fonts.cache[i].atlas = NULL;
+    }
+
+  l_fonts.current = NULL;
+  free(l_fonts.data);
+  l_fonts.data = NULL;
+}
+
+void fonts_setScale(double scale)
+{
+  if (!l_fonts.data)
+    return;
+
+  struct FontAtlas * entry;
+  LG_LOCK(l_fonts.lock);
+  entry = findAtlas(scale);
+  if (!entry && l_fonts.current)
+  {
+    // keep using the current atlas until the new one is built
+    l_fonts.pending = scale;
+    lgSignalEvent(l_fonts.event);
+    entry = l_fonts.current;
+  }
+
+  if (entry)
+  {
+    entry->lastUsed = ++l_fonts.useCount;
+    l_fonts.current = entry;
+  }
+  LG_UNLOCK(l_fonts.lock);
+
+  // nothing to show in the meantime, build the first atlas here
+  if (!entry)
+  {
+    struct FontAtlas atlas;
+    if (!buildAtlas(scale, &atlas))
+      DEBUG_FATAL("Failed to build font atlas: %s (%s)", g_params.uiFont,
+          g_state.fontName);
+
+    LG_LOCK(l_fonts.lock);
+    entry           = allocAtlas();
+    *entry          = atlas;
+    entry->lastUsed = ++l_fonts.useCount;
+    l_fonts.current = entry;
+    LG_UNLOCK(l_fonts.lock);
+  }
+
+  g_state.io->Fonts           = entry->atlas;
+  g_state.io->FontGlobalScale = 1.0f / entry->scale;
+  g_state.fontLarge           = entry->fontLarge;
+}
@@ -0,0 +1,39 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _H_LG_FONTS_
+#define _H_LG_FONTS_
+
+#include <stdbool.h>
+
+#include "cimgui.h"
+
+/* Loads the UI font file and starts the thread that builds the ImGui font
+ * atlases. `ranges` must remain valid until fonts_free. */
+bool fonts_init(const char * fontFile, int size, const ImWchar * ranges);
+void fonts_free(void);
+
+/* Switches ImGui to the font atlas for the window scale. Atlases are built in
+ * the background and kept for when the scale is used again, until one is ready
+ * the current atlas is scaled instead and the renderer is resized again once
+ * it is. Render thread only. */
+void fonts_setScale(double scale);
+
+#endif
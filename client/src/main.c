@@ -64,6 +64,8 @@
 #include "overlay_utils.h"
 #include "util.h"
 #include "render_queue.h"
+#include "bench.h"
+#include "fonts.h"
 
 // forwards
 static int renderThread(void * unused);
@@ -145,18 +147,40 @@ static bool tickTimerFn(void * unused)
 {
   static unsigned long long tickCount = 0;
 
+  // nothing is animating, don't poll the overlays
+  if (!atomic_load(&g_state.overlayTicking))
+  {
+    ++tickCount;
+    return true;
+  }
+
+  atomic_store(&g_state.overlayTicking, false);
+
   bool needsRender = false;
+  bool needsTick   = false;
   struct Overlay * overlay;
   ll_lock(g_state.overlays);
   ll_forEachNL(g_state.overlays, item, overlay)
   {
-    if (overlay->ops->tick && overlay->ops->tick(overlay->udata, tickCount))
+    if (!overlay->ops->tick)
+      continue;
+
+    if (overlay->ops->needs_tick && !overlay->ops->needs_tick(overlay->udata))
+      continue;
+
+    if (overlay->ops->tick(overlay->udata, tickCount))
       needsRender = true;
+
+    if (!overlay->ops->needs_tick || overlay->ops->needs_tick(overlay->udata))
+      needsTick = true;
   }
   ll_unlock(g_state.overlays);
 
+  if (needsTick)
+    atomic_store(&g_state.overlayTicking, true);
+
   if (needsRender)
-    app_invalidateWindow(false);
+    app_invalidateOverlay(false);
 
   ++tickCount;
   return true;
@@ -260,27 +284,20 @@ static int renderThread(void * unused)
         .x = g_state.windowScale,
         .y = g_state.windowScale,
       };
-      g_state.io->FontGlobalScale = 1.0f / g_state.windowScale;
-
-      ImFontAtlas_Clear(g_state.io->Fonts);
-      ImFontAtlas_AddFontFromFileTTF(g_state.io->Fonts, g_state.fontName,
-        g_params.uiSize * g_state.windowScale, NULL, g_state.fontRange.Data);
-      g_state.fontLarge = ImFontAtlas_AddFontFromFileTTF(g_state.io->Fonts,
-        g_state.fontName, 1.3f * g_params.uiSize * g_state.windowScale, NULL, g_state.fontRange.Data);
-      if (!ImFontAtlas_Build(g_state.io->Fonts))
-        DEBUG_FATAL("Failed to build font atlas: %s (%s)", g_params.uiFont, g_state.fontName);
+      fonts_setScale(g_state.windowScale);
 
       if (g_state.lgr)
         RENDERER(onResize, g_state.windowW, g_state.windowH,
             g_state.windowScale, g_state.dstRect, g_params.winRotate);
+      atomic_store(&g_state.overlayDirty, true);
       atomic_compare_exchange_weak(&g_state.lgrResize, &resize, 0);
     }
 
-    static uint64_t lastFrameCount = 0;
-    const uint64_t frameCount =
-      atomic_load_explicit(&g_state.frameCount, memory_order_relaxed);
-    const bool newFrame = frameCount != lastFrameCount;
-    lastFrameCount = frameCount;
+    static uint64_t lastFrameSeq = 0;
+    const uint64_t frameSeq =
+      atomic_load_explicit(&g_state.frameSeq, memory_order_relaxed);
+    const bool newFrame = frameSeq != lastFrameSeq;
+    lastFrameSeq = frameSeq;
 
     const bool invalidate = atomic_exchange(&g_state.invalidateWindow, false);
 
@@ -297,6 +314,9 @@ static int renderThread(void * unused)
     }
     LG_UNLOCK(g_state.lgrLock);
 
+    atomic_store_explicit(&g_state.renderedFrameSeq, frameSeq,
+        memory_order_release);
+
     const uint64_t t     = nanotime();
     const uint64_t delta = t - g_state.lastRenderTime;
 
@@ -341,6 +361,8 @@ static int renderThread(void * unused)
   core_stopCursorThread();
   core_stopFrameThread();
 
+  // the SPICE thread may still be running and drawing directly
+  renderQueue_spiceStopDirect();
   RENDERER(deinitialize);
   g_state.lgr = NULL;
   LG_LOCK_FREE(g_state.lgrLock);
@@ -825,6 +847,7 @@ int main_frameThread(void * unused)
     g_state.lastFrameTimeValid = true;
 
     atomic_fetch_add_explicit(&g_state.frameCount, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_state.frameSeq  , 1, memory_order_relaxed);
     if (g_state.jitRender)
     {
       if (atomic_load_explicit(&g_state.pendingCount, memory_order_acquire) < 10)
@@ -952,9 +975,7 @@ static void spice_setCursorRGBAImage(int width, int height, int hx, int hy,
   g_state.spiceHotX = hx;
   g_state.spiceHotY = hy;
 
-  void * copied = malloc(width * height * 4);
-  memcpy(copied, data, width * height * 4);
-  renderQueue_cursorImage(false, width, height, width * 4, copied);
+  renderQueue_cursorImage(width, height, data);
 }
 
 static void spice_setCursorMonoImage(int width, int height, int hx, int hy,
@@ -963,11 +984,7 @@ static void spice_setCursorMonoImage(int width, int height, int hx, int hy,
   g_state.spiceHotX = hx;
   g_state.spiceHotY = hy;
 
-  int stride = (width + 7) / 8;
-  uint8_t * buffer = malloc(stride * height * 2);
-  memcpy(buffer, xorMask, stride * height);
-  memcpy(buffer + stride * height, andMask, stride * height);
-  renderQueue_cursorImage(true, width, height * 2, stride, buffer);
+  renderQueue_cursorMonoImage(width, height, xorMask, andMask);
 }
 
 static void spice_setCursorState(bool visible, int x, int y)
@@ -1196,6 +1213,9 @@ static int lg_run(void)
   ImFontGlyphRangesBuilder_BuildRanges(rangeBuilder, &g_state.fontRange);
   ImFontGlyphRangesBuilder_destroy(rangeBuilder);
 
+  if (!fonts_init(g_state.fontName, g_params.uiSize, g_state.fontRange.Data))
+    return -1;
+
   // initialize metrics ringbuffers
   g_state.renderTimings  = ringbuffer_new(256, sizeof(float));
   g_state.uploadTimings  = ringbuffer_new(256, sizeof(float));
@@ -1227,6 +1247,10 @@ static int lg_run(void)
 
   ASSERT_LG_DS_VALID(g_state.ds);
 
+  // only support for the property matters here, the size is set by init
+  struct Rect offscreen;
+  g_state.headless = g_state.ds->getProp(LG_DS_OFFSCREEN, &offscreen);
+
   if (g_params.jitRender)
   {
     if (g_state.ds->waitFrame)
@@ -1247,8 +1271,16 @@ static int lg_run(void)
   signal(SIGINT , intHandler);
   signal(SIGTERM, intHandler);
 
+  if (g_state.headless)
+  {
+    // there is no guest to connect to, the frames are generated by bench.c
+    g_params.useSpice          = false;
+    g_params.useSpiceInput     = false;
+    g_params.useSpiceClipboard = false;
+    g_params.useSpiceAudio     = false;
+  }
   // try map the shared memory
-  if (!ivshmemOpen(&g_state.shm))
+  else if (!ivshmemOpen(&g_state.shm))
   {
     DEBUG_ERROR("Failed to map memory");
     return -1;
@@ -1276,7 +1308,11 @@ static int lg_run(void)
   }
 
   //setup the render command queue
-  renderQueue_init();
+  if (!renderQueue_init())
+  {
+    DEBUG_ERROR("failed to create the render queue");
+    return -1;
+  }
 
   const PSInit psInit =
   {
@@ -1337,6 +1373,7 @@ static int lg_run(void)
   }
 
   g_state.useDMA =
+    !g_state.headless &&
     g_params.allowDMA &&
     ivshmemHasDMA(&g_state.shm);
 
@@ -1416,6 +1453,9 @@ static int lg_run(void)
   if (g_state.cbAvailable)
     g_state.cbRequestList = ll_new();
 
+  if (g_state.headless)
+    return bench_run() ? 0 : -1;
+
   LGMP_STATUS status;
 
   while(g_state.state == APP_STATE_RUNNING)
@@ -1834,6 +1874,7 @@ static void lg_shutdown(void)
   ringbuffer_free(&g_state.uploadTimings);
   ringbuffer_free(&g_state.renderDuration);
 
+  fonts_free();
   free(g_state.fontName);
   ImVector_ImWchar_UnInit(&g_state.fontRange);
   igDestroyContext(NULL);
@@ -72,10 +72,13 @@ struct AppState
   bool             modSuper;
   uint64_t         lastImGuiFrame;
   bool             renderImGuiTwice;
+  atomic_bool      overlayDirty;   // the overlays need a new ImGui frame
+  atomic_bool      overlayTicking; // an overlay may need its tick called
 
   struct LG_DisplayServerOps * ds;
   bool                         dsInitialized;
   bool                         jitRender;
+  bool                         headless;
 
   uint8_t spiceUUID[16];
   bool    spiceReady;
@@ -143,6 +146,8 @@ struct AppState
 
   atomic_uint_least64_t pendingCount;
   atomic_uint_least64_t renderCount, frameCount;
+  atomic_uint_least64_t frameSeq;         // like frameCount but never reset
+  atomic_uint_least64_t renderedFrameSeq; // frameSeq at the last render
   _Atomic(float)        fps, ups;
 
   uint64_t resizeTimeout;
@@ -223,6 +228,8 @@ struct AppParams
 
   int                  audioPeriodSize;
   int                  audioBufferLatency;
+  int                  audioResampleQuality;
+  int                  micBufferLatency;
   bool                 micShowIndicator;
   enum MicDefaultState micDefaultState;
   bool                 audioSyncVolume;
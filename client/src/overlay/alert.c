@@ -108,13 +108,25 @@ static bool alert_tick(void * udata, unsigned long long tickCount)
   return true;
 }
 
+static bool alert_isStatic(void * udata)
+{
+  return true;
+}
+
+static bool alert_needsTick(void * udata)
+{
+  return l_alert.show || l_alert.redraw;
+}
+
 struct LG_OverlayOps LGOverlayAlert =
 {
   .name           = "alert",
   .init           = alert_init,
   .free           = alert_free,
+  .is_static      = alert_isStatic,
   .render         = alert_render,
   .tick           = alert_tick,
+  .needs_tick     = alert_needsTick,
 };
 
 void overlayAlert_show(LG_MsgAlert type, const char * fmt, va_list args)
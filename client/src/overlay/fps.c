@@ -31,7 +31,7 @@ static bool showFPS;
 static void showFPSKeybind(int sc, void * opaque)
 {
   showFPS ^= true;
-  app_invalidateWindow(false);
+  app_invalidateOverlay(false);
 }
 
 static void fps_earlyInit(void)
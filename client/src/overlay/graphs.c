@@ -67,7 +67,7 @@ static void configCallback(void * udata, int * id)
 static void showTimingKeybind(int sc, void * opaque)
 {
   gs.show ^= true;
-  app_invalidateWindow(false);
+  app_invalidateOverlay(false);
 }
 
 static void graphs_earlyInit(void)
@@ -126,6 +126,32 @@ static bool rbCalcMetrics(int index, void * value_, void * udata_)
   return true;
 }
 
+static void calcMetrics(GraphHandle graph, struct BufferMetrics * metrics)
+{
+  *metrics = (struct BufferMetrics) {};
+  ringbuffer_forEach(graph->buffer, rbCalcMetrics, metrics, false);
+
+  if (metrics->sum > 0.0f)
+  {
+    metrics->avg  = metrics->sum / ringbuffer_getCount(graph->buffer);
+    metrics->freq = 1000.0f / metrics->avg;
+  }
+}
+
+static const char * formatMetrics(GraphHandle graph,
+    const struct BufferMetrics * metrics)
+{
+  if (graph->formatFn)
+    return graph->formatFn(graph->name,
+        metrics->min, metrics->max, metrics->avg, metrics->freq, metrics->last);
+
+  static char title[64];
+  snprintf(title, sizeof(title),
+      "%s: min:%4.2f max:%4.2f avg:%4.2f/%4.2fHz",
+      graph->name, metrics->min, metrics->max, metrics->avg, metrics->freq);
+  return title;
+}
+
 static int graphs_render(void * udata, bool interactive,
     struct Rect * windowRects, int maxRects)
 {
@@ -175,27 +201,9 @@ static int graphs_render(void * udata, bool interactive,
     if (!graph->enabled)
       continue;
 
-    struct BufferMetrics metrics = {};
-    ringbuffer_forEach(graph->buffer, rbCalcMetrics, &metrics, false);
-
-    if (metrics.sum > 0.0f)
-    {
-      metrics.avg  = metrics.sum / ringbuffer_getCount(graph->buffer);
-      metrics.freq = 1000.0f / metrics.avg;
-    }
-
-    const char * title;
-    if (graph->formatFn)
-      title = graph->formatFn(graph->name,
-          metrics.min, metrics.max, metrics.avg, metrics.freq, metrics.last);
-    else
-    {
-      static char _title[64];
-      snprintf(_title, sizeof(_title),
-          "%s: min:%4.2f max:%4.2f avg:%4.2f/%4.2fHz",
-          graph->name, metrics.min, metrics.max, metrics.avg, metrics.freq);
-      title = _title;
-    }
+    struct BufferMetrics metrics;
+    calcMetrics(graph, &metrics);
+    const char * title = formatMetrics(graph, &metrics);
 
     igPlotLines_FloatPtr(
         "",
@@ -253,7 +261,7 @@ void overlayGraph_unregister(GraphHandle handle)
   free(handle);
 
   if (gs.show)
-    app_invalidateWindow(false);
+    app_invalidateOverlay(false);
 }
 
 void overlayGraph_iterate(void (*callback)(GraphHandle handle, const char * name,
@@ -266,6 +274,23 @@ void overlayGraph_iterate(void (*callback)(GraphHandle handle, const char * name
   ll_unlock(gs.graphs);
 }
 
+void overlayGraph_logMetrics(void)
+{
+  GraphHandle graph;
+  ll_lock(gs.graphs);
+  ll_forEachNL(gs.graphs, item, graph)
+  {
+    const int count = ringbuffer_getCount(graph->buffer);
+    if (!count)
+      continue;
+
+    struct BufferMetrics metrics;
+    calcMetrics(graph, &metrics);
+    DEBUG_INFO("%s (last %d)", formatMetrics(graph, &metrics), count);
+  }
+  ll_unlock(gs.graphs);
+}
+
 void overlayGraph_invalidate(GraphHandle handle)
 {
   if (!gs.show)
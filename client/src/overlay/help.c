@@ -87,10 +87,16 @@ static int help_render(void * udata, bool interactive, struct Rect * windowRects
   return 1;
 }
 
+static bool help_isStatic(void * udata)
+{
+  return true;
+}
+
 struct LG_OverlayOps LGOverlayHelp =
 {
   .name           = "Help",
   .init           = help_init,
   .free           = help_free,
+  .is_static      = help_isStatic,
   .render         = help_render
 };
@@ -245,13 +245,25 @@ static bool splash_tick(void * udata, unsigned long long tickCount)
   return false;
 }
 
+static bool splash_isStatic(void * udata)
+{
+  return true;
+}
+
+static bool splash_needsTick(void * udata)
+{
+  return !l_show && !l_fadeDone;
+}
+
 struct LG_OverlayOps LGOverlaySplash =
 {
-  .name   = "splash",
-  .init   = splash_init,
-  .free   = splash_free,
-  .render = splash_render,
-  .tick   = splash_tick,
+  .name       = "splash",
+  .init       = splash_init,
+  .free       = splash_free,
+  .is_static  = splash_isStatic,
+  .render     = splash_render,
+  .tick       = splash_tick,
+  .needs_tick = splash_needsTick,
 };
 
 void overlaySplash_show(bool show)
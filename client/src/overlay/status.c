@@ -74,6 +74,13 @@ static int status_render(void * udata, bool interactive, struct Rect * windowRec
   const int marginY = 10;
   const int gapX    = 5;
 
+  bool show = false;
+  for(int i = 0; i < LG_USER_STATUS_MAX; ++i)
+    show |= l_state[i];
+
+  if (!show)
+    return 0;
+
   if (g_state.windowScale > l_scale)
   {
     l_scale = g_state.windowScale;
@@ -136,13 +143,26 @@ static bool status_tick(void * udata, unsigned long long tickCount)
   return false;
 }
 
+static bool status_isStatic(void * udata)
+{
+  return true;
+}
+
+static bool status_needsTick(void * udata)
+{
+  // only the recording indicator blinks
+  return l_state[LG_USER_STATUS_RECORDING];
+}
+
 struct LG_OverlayOps LGOverlayStatus =
 {
   .name           = "status",
   .init           = status_init,
   .free           = status_free,
+  .is_static      = status_isStatic,
   .render         = status_render,
   .tick           = status_tick,
+  .needs_tick     = status_needsTick,
 };
 
 void overlayStatus_set(LGUserStatus status, bool value)
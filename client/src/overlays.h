@@ -50,6 +50,7 @@ void overlayGraph_unregister(GraphHandle handle);
 void overlayGraph_iterate(void (*callback)(GraphHandle handle, const char * name,
     bool * enabled, void * udata), void * udata);
 void overlayGraph_invalidate(GraphHandle handle);
+void overlayGraph_logMetrics(void);
 
 void overlayConfig_register(const char * title,
     void (*callback)(void * udata, int * id), void * udata);
@@ -20,124 +20,496 @@
 
 #include "render_queue.h"
 
+#include <stdatomic.h>
+#include <stdlib.h>
 #include <string.h>
 
-#include "common/ll.h"
+#include "common/debug.h"
+#include "common/time.h"
+#include "common/util.h"
 #include "main.h"
 #include "overlays.h"
 
-struct ll * l_renderQueue = NULL;
+// must be a power of two
+#define RENDER_QUEUE_SIZE 1024
+#define RENDER_QUEUE_MASK (RENDER_QUEUE_SIZE - 1)
 
-void renderQueue_init(void)
+// backing store for bitmap and cursor payloads, payloads larger than this are
+// allocated individually
+#define RENDER_QUEUE_ARENA_SIZE (16 * 1024 * 1024)
+
+typedef struct
+{
+  _Atomic(uint32_t) seq;
+  RenderCommand     cmd;
+
+  // payload bookkeeping, arenaEnd is the arena position to release up to once
+  // this command has been processed
+  size_t arenaEnd;
+  void * allocated;
+}
+QueueSlot;
+
+struct RenderQueue
 {
-  l_renderQueue = ll_new();
+  QueueSlot slots[RENDER_QUEUE_SIZE];
+  _Atomic(uint32_t) head; // next slot to be claimed by a producer
+  uint32_t          tail; // next slot to be processed, consumer only
+
+  // the payload arena is single producer (the SPICE thread) single consumer,
+  // positions increase monotonically and are wrapped on access
+  uint8_t         * arena;
+  size_t            arenaHead; // producer only
+  _Atomic(size_t)   arenaTail;
+
+  // once the renderer has processed every queued SPICE command and reported it
+  // can accept draws from the SPICE thread they bypass the queue entirely
+  uint32_t          spiceQueued; // producer only
+  _Atomic(uint32_t) spiceDone;
+  atomic_bool       spiceDirect;
+  atomic_uint       spiceDirectUsers; // direct draws in progress
+
+  // cursor state is coalesced into a single seqlock protected slot as only the
+  // most recent state is of any interest to the renderer
+  struct
+  {
+    _Atomic(uint32_t) seq;
+    atomic_bool       pending;
+    atomic_bool       visible;
+    atomic_int        x, y, hx, hy;
+  }
+  cursor;
+};
+
+static struct RenderQueue * l_rq = NULL;
+
+bool renderQueue_init(void)
+{
+  l_rq = calloc(1, sizeof(*l_rq));
+  if (!l_rq)
+  {
+    DEBUG_ERROR("out of memory");
+    return false;
+  }
+
+  // only touched pages are committed, so this costs nothing unless the SPICE
+  // display is actually used
+  l_rq->arena = malloc(RENDER_QUEUE_ARENA_SIZE);
+  if (!l_rq->arena)
+  {
+    DEBUG_ERROR("out of memory");
+    free(l_rq);
+    l_rq = NULL;
+    return false;
+  }
+
+  for(uint32_t i = 0; i < RENDER_QUEUE_SIZE; ++i)
+    atomic_init(&l_rq->slots[i].seq, i);
+
+  return true;
 }
 
 void renderQueue_free(void)
 {
-  if (!l_renderQueue)
+  if (!l_rq)
     return;
 
   renderQueue_clear();
-  ll_free(l_renderQueue);
+  free(l_rq->arena);
+  free(l_rq);
+  l_rq = NULL;
 }
 
-void renderQueue_clear(void)
+static inline bool waitForSpace(void)
+{
+  // the render thread drains the queue, make sure it is awake
+  app_invalidateWindow(true);
+  if (unlikely(g_state.state == APP_STATE_SHUTDOWN))
+    return false;
+
+  nsleep(100000);
+  return true;
+}
+
+static void * allocPayload(size_t size, size_t * arenaEnd, void ** allocated)
 {
-  RenderCommand * cmd;
-  while(ll_shift(l_renderQueue, (void **)&cmd))
+  if (unlikely(size > RENDER_QUEUE_ARENA_SIZE))
   {
-    if (cmd->op == SPICE_OP_DRAW_BITMAP)
-      free(cmd->spiceDrawBitmap.data);
-    free(cmd);
+    void * data = malloc(size);
+    if (!data)
+      DEBUG_ERROR("out of memory");
+    *arenaEnd  = l_rq->arenaHead;
+    *allocated = data;
+    return data;
   }
+
+  size_t pos    = l_rq->arenaHead;
+  size_t offset = pos % RENDER_QUEUE_ARENA_SIZE;
+
+  // payloads must be contiguous, skip the remainder of the arena if needed
+  if (offset + size > RENDER_QUEUE_ARENA_SIZE)
+  {
+    pos   += RENDER_QUEUE_ARENA_SIZE - offset;
+    offset = 0;
+  }
+
+  while(pos + size -
+      atomic_load_explicit(&l_rq->arenaTail, memory_order_acquire) >
+      RENDER_QUEUE_ARENA_SIZE)
+    if (!waitForSpace())
+      return NULL;
+
+  l_rq->arenaHead = pos + size;
+  *arenaEnd       = pos + size;
+  *allocated      = NULL;
+  return l_rq->arena + offset;
+}
+
+static QueueSlot * claimSlot(void)
+{
+  uint32_t pos = atomic_load_explicit(&l_rq->head, memory_order_relaxed);
+  for(;;)
+  {
+    QueueSlot * slot = &l_rq->slots[pos & RENDER_QUEUE_MASK];
+    const uint32_t seq =
+      atomic_load_explicit(&slot->seq, memory_order_acquire);
+    const int32_t diff = (int32_t)(seq - pos);
+
+    if (diff == 0)
+    {
+      if (atomic_compare_exchange_weak_explicit(&l_rq->head, &pos, pos + 1,
+            memory_order_relaxed, memory_order_relaxed))
+      {
+        slot->arenaEnd  = 0;
+        slot->allocated = NULL;
+        return slot;
+      }
+    }
+    else if (diff < 0)
+    {
+      // the queue is full
+      if (!waitForSpace())
+        return NULL;
+      pos = atomic_load_explicit(&l_rq->head, memory_order_relaxed);
+    }
+    else
+      pos = atomic_load_explicit(&l_rq->head, memory_order_relaxed);
+  }
+}
+
+static inline uint32_t slotPos(QueueSlot * slot)
+{
+  return atomic_load_explicit(&slot->seq, memory_order_relaxed);
+}
+
+static void publishSlot(QueueSlot * slot)
+{
+  atomic_store_explicit(&slot->seq, slotPos(slot) + 1, memory_order_release);
+}
+
+static inline bool isSpiceDraw(const RenderCommand * cmd)
+{
+  return
+    cmd->op == SPICE_OP_CONFIGURE ||
+    cmd->op == SPICE_OP_DRAW_FILL ||
+    cmd->op == SPICE_OP_DRAW_BITMAP;
+}
+
+static inline bool spiceDirect(void)
+{
+  /* draws may only skip the queue once those already queued have been done,
+   * otherwise they could be overwritten by older content */
+  return
+    atomic_load_explicit(&l_rq->spiceDone, memory_order_acquire) ==
+      l_rq->spiceQueued &&
+    atomic_load_explicit(&l_rq->spiceDirect, memory_order_relaxed);
+}
+
+/* announces a direct draw, the flag is checked again afterwards so that
+ * renderQueue_spiceStopDirect either sees the draw or the draw sees the flag
+ * cleared */
+static bool spiceDirectBegin(void)
+{
+  if (!spiceDirect())
+    return false;
+
+  atomic_fetch_add(&l_rq->spiceDirectUsers, 1);
+  if (likely(atomic_load(&l_rq->spiceDirect)))
+    return true;
+
+  atomic_fetch_sub(&l_rq->spiceDirectUsers, 1);
+  return false;
+}
+
+static inline void spiceDirectEnd(void)
+{
+  atomic_fetch_sub_explicit(&l_rq->spiceDirectUsers, 1, memory_order_release);
+}
+
+void renderQueue_spiceStopDirect(void)
+{
+  atomic_store(&l_rq->spiceDirect, false);
+  while(atomic_load(&l_rq->spiceDirectUsers))
+    nsleep(100000);
 }
 
 void renderQueue_spiceConfigure(int width, int height)
 {
-  RenderCommand * cmd = malloc(sizeof(*cmd));
+  // the renderer is about to reallocate the surface, draws must be queued
+  // behind the configure until it reports they can be direct again
+  atomic_store_explicit(&l_rq->spiceDirect, false, memory_order_relaxed);
+
+  QueueSlot * slot = claimSlot();
+  if (!slot)
+    return;
+
+  RenderCommand * cmd = &slot->cmd;
   cmd->op                    = SPICE_OP_CONFIGURE;
   cmd->spiceConfigure.width  = width;
   cmd->spiceConfigure.height = height;
-  ll_push(l_renderQueue, cmd);
+  ++l_rq->spiceQueued;
+  publishSlot(slot);
   app_invalidateWindow(true);
 }
 
 void renderQueue_spiceDrawFill(int x, int y, int width, int height,
     uint32_t color)
 {
-  RenderCommand * cmd = malloc(sizeof(*cmd));
+  // the renderer refuses the draw while the GPU still reads its surface
+  if (spiceDirectBegin())
+  {
+    const bool drawn = RENDERER(spiceDrawFill, x, y, width, height, color);
+    spiceDirectEnd();
+    if (drawn)
+    {
+      app_invalidateWindow(true);
+      return;
+    }
+  }
+
+  QueueSlot * slot = claimSlot();
+  if (!slot)
+    return;
+
+  RenderCommand * cmd = &slot->cmd;
   cmd->op                   = SPICE_OP_DRAW_FILL;
   cmd->spiceFillRect.x      = x;
   cmd->spiceFillRect.y      = y;
   cmd->spiceFillRect.width  = width;
   cmd->spiceFillRect.height = height;
   cmd->spiceFillRect.color  = color;
-  ll_push(l_renderQueue, cmd);
+  ++l_rq->spiceQueued;
+  publishSlot(slot);
   app_invalidateWindow(true);
 }
 
 void renderQueue_spiceDrawBitmap(int x, int y, int width, int height, int stride,
-    void * data, bool topDown)
+    const void * data, bool topDown)
 {
-  RenderCommand * cmd = malloc(sizeof(*cmd));
+  if (spiceDirectBegin())
+  {
+    const bool drawn = RENDERER(spiceDrawBitmap, x, y, width, height, stride,
+        (uint8_t *)data, topDown);
+    spiceDirectEnd();
+    if (drawn)
+    {
+      app_invalidateWindow(true);
+      return;
+    }
+  }
+
+  const size_t size = (size_t)height * stride;
+  size_t arenaEnd;
+  void * allocated;
+  uint8_t * payload = allocPayload(size, &arenaEnd, &allocated);
+  if (!payload)
+    return;
+
+  memcpy(payload, data, size);
+
+  QueueSlot * slot = claimSlot();
+  if (!slot)
+  {
+    free(allocated);
+    return;
+  }
+
+  slot->arenaEnd  = arenaEnd;
+  slot->allocated = allocated;
+
+  RenderCommand * cmd = &slot->cmd;
   cmd->op                      = SPICE_OP_DRAW_BITMAP;
   cmd->spiceDrawBitmap.x       = x;
   cmd->spiceDrawBitmap.y       = y;
   cmd->spiceDrawBitmap.width   = width;
   cmd->spiceDrawBitmap.height  = height;
   cmd->spiceDrawBitmap.stride  = stride;
-  cmd->spiceDrawBitmap.data    = malloc(height * stride);
+  cmd->spiceDrawBitmap.data    = payload;
   cmd->spiceDrawBitmap.topDown = topDown;
-  memcpy(cmd->spiceDrawBitmap.data, data, height * stride);
-  ll_push(l_renderQueue, cmd);
+  ++l_rq->spiceQueued;
+  publishSlot(slot);
   app_invalidateWindow(true);
 }
 
 void renderQueue_spiceShow(bool show)
 {
-  RenderCommand * cmd = malloc(sizeof(*cmd));
+  QueueSlot * slot = claimSlot();
+  if (!slot)
+    return;
+
+  RenderCommand * cmd = &slot->cmd;
   cmd->op             = SPICE_OP_SHOW;
   cmd->spiceShow.show = show;
-  ll_push(l_renderQueue, cmd);
+  publishSlot(slot);
   app_invalidateWindow(true);
 }
 
 void renderQueue_cursorState(bool visible, int x, int y, int hx, int hy)
 {
-  RenderCommand * cmd      = malloc(sizeof(*cmd));
-  cmd->op                  = CURSOR_OP_STATE;
-  cmd->cursorState.visible = visible;
-  cmd->cursorState.x       = x;
-  cmd->cursorState.y       = y;
-  cmd->cursorState.hx      = hx;
-  cmd->cursorState.hy      = hy;
-  ll_push(l_renderQueue, cmd);
+  // only the SPICE thread updates the cursor state, so this is a single writer
+  const uint32_t seq =
+    atomic_load_explicit(&l_rq->cursor.seq, memory_order_relaxed);
+
+  atomic_store_explicit(&l_rq->cursor.seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  atomic_store_explicit(&l_rq->cursor.visible, visible, memory_order_relaxed);
+  atomic_store_explicit(&l_rq->cursor.x      , x      , memory_order_relaxed);
+  atomic_store_explicit(&l_rq->cursor.y      , y      , memory_order_relaxed);
+  atomic_store_explicit(&l_rq->cursor.hx     , hx     , memory_order_relaxed);
+  atomic_store_explicit(&l_rq->cursor.hy     , hy     , memory_order_relaxed);
+
+  atomic_store_explicit(&l_rq->cursor.seq    , seq + 2, memory_order_release);
+  atomic_store_explicit(&l_rq->cursor.pending, true   , memory_order_release);
 }
 
-void renderQueue_cursorImage(bool monochrome, int width, int height, int pitch,
-    uint8_t * data)
+static void queueCursorImage(bool monochrome, int width, int height,
+    int pitch, const void * data1, size_t size1, const void * data2,
+    size_t size2)
 {
-  RenderCommand * cmd         = malloc(sizeof(*cmd));
+  size_t arenaEnd;
+  void * allocated;
+  uint8_t * payload = allocPayload(size1 + size2, &arenaEnd, &allocated);
+  if (!payload)
+    return;
+
+  memcpy(payload, data1, size1);
+  if (data2)
+    memcpy(payload + size1, data2, size2);
+
+  QueueSlot * slot = claimSlot();
+  if (!slot)
+  {
+    free(allocated);
+    return;
+  }
+
+  slot->arenaEnd  = arenaEnd;
+  slot->allocated = allocated;
+
+  RenderCommand * cmd = &slot->cmd;
   cmd->op                     = CURSOR_OP_IMAGE;
   cmd->cursorImage.monochrome = monochrome;
   cmd->cursorImage.width      = width;
   cmd->cursorImage.height     = height;
   cmd->cursorImage.pitch      = pitch;
-  cmd->cursorImage.data       = data;
-  ll_push(l_renderQueue, cmd);
+  cmd->cursorImage.data       = payload;
+  publishSlot(slot);
+}
+
+void renderQueue_cursorImage(int width, int height, const void * data)
+{
+  const size_t size = (size_t)width * height * 4;
+  queueCursorImage(false, width, height, width * 4, data, size, NULL, 0);
+}
+
+void renderQueue_cursorMonoImage(int width, int height, const void * xorMask,
+    const void * andMask)
+{
+  const int    stride = (width + 7) / 8;
+  const size_t size   = (size_t)stride * height;
+  queueCursorImage(true, width, height * 2, stride,
+      xorMask, size, andMask, size);
+}
+
+static bool popSlot(QueueSlot ** out)
+{
+  QueueSlot * slot = &l_rq->slots[l_rq->tail & RENDER_QUEUE_MASK];
+  const uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+  if ((int32_t)(seq - (l_rq->tail + 1)) < 0)
+    return false;
+
+  *out = slot;
+  return true;
+}
+
+static void releaseSlot(QueueSlot * slot)
+{
+  if (slot->allocated)
+    free(slot->allocated);
+  else if (slot->arenaEnd)
+    atomic_store_explicit(&l_rq->arenaTail, slot->arenaEnd,
+        memory_order_release);
+
+  if (isSpiceDraw(&slot->cmd))
+    atomic_fetch_add_explicit(&l_rq->spiceDone, 1, memory_order_release);
+
+  atomic_store_explicit(&slot->seq, l_rq->tail + RENDER_QUEUE_SIZE,
+      memory_order_release);
+  ++l_rq->tail;
+}
+
+void renderQueue_clear(void)
+{
+  QueueSlot * slot;
+  // a dropped configure leaves the renderer's surface in an unknown state
+  atomic_store_explicit(&l_rq->spiceDirect, false, memory_order_relaxed);
+
+  while(popSlot(&slot))
+    releaseSlot(slot);
+
+  atomic_store_explicit(&l_rq->cursor.pending, false, memory_order_relaxed);
+}
+
+static void processCursorState(void)
+{
+  if (!atomic_exchange_explicit(&l_rq->cursor.pending, false,
+        memory_order_acquire))
+    return;
+
+  uint32_t seq1, seq2;
+  bool visible;
+  int  x, y, hx, hy;
+  do
+  {
+    seq1 = atomic_load_explicit(&l_rq->cursor.seq, memory_order_acquire);
+    visible = atomic_load_explicit(&l_rq->cursor.visible, memory_order_relaxed);
+    x       = atomic_load_explicit(&l_rq->cursor.x      , memory_order_relaxed);
+    y       = atomic_load_explicit(&l_rq->cursor.y      , memory_order_relaxed);
+    hx      = atomic_load_explicit(&l_rq->cursor.hx     , memory_order_relaxed);
+    hy      = atomic_load_explicit(&l_rq->cursor.hy     , memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    seq2 = atomic_load_explicit(&l_rq->cursor.seq, memory_order_relaxed);
+  }
+  while((seq1 & 1) || seq1 != seq2);
+
+  RENDERER(onMouseEvent, visible, x, y, hx, hy);
 }
 
 void renderQueue_process(void)
 {
-  RenderCommand * cmd;
-  while(ll_shift(l_renderQueue, (void **)&cmd))
+  QueueSlot * slot;
+  while(popSlot(&slot))
   {
+    RenderCommand * cmd = &slot->cmd;
     switch(cmd->op)
     {
       case SPICE_OP_CONFIGURE:
         RENDERER(spiceConfigure,
             cmd->spiceConfigure.width, cmd->spiceConfigure.height);
+        atomic_store_explicit(&l_rq->spiceDirect,
+            g_state.lgr->ops.spiceDirect && RENDERER(spiceDirect),
+            memory_order_relaxed);
         break;
 
       case SPICE_OP_DRAW_FILL:
@@ -153,7 +525,6 @@ void renderQueue_process(void)
             cmd->spiceDrawBitmap.width , cmd->spiceDrawBitmap.height,
             cmd->spiceDrawBitmap.stride, cmd->spiceDrawBitmap.data,
             cmd->spiceDrawBitmap.topDown);
-        free(cmd->spiceDrawBitmap.data);
         break;
 
       case SPICE_OP_SHOW:
@@ -162,18 +533,15 @@ void renderQueue_process(void)
           overlaySplash_show(false);
         break;
 
-      case CURSOR_OP_STATE:
-        RENDERER(onMouseEvent, cmd->cursorState.visible, cmd->cursorState.x,
-            cmd->cursorState.y, cmd->cursorState.hx, cmd->cursorState.hy);
-        break;
-
       case CURSOR_OP_IMAGE:
         RENDERER(onMouseShape,
             cmd->cursorImage.monochrome ? LG_CURSOR_MONOCHROME : LG_CURSOR_COLOR,
             cmd->cursorImage.width, cmd->cursorImage.height,
             cmd->cursorImage.pitch, cmd->cursorImage.data);
-        free(cmd->cursorImage.data);
+        break;
     }
-    free(cmd);
+    releaseSlot(slot);
   }
+
+  processCursorState();
 }
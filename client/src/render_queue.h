@@ -18,7 +18,8 @@
  * Temple Place, Suite 330, Boston, MA 02111-1307 USA
  */
 
-#include "common/ll.h"
+#include <stdbool.h>
+#include <stdint.h>
 
 typedef struct
 {
@@ -28,7 +29,6 @@ typedef struct
     SPICE_OP_DRAW_FILL,
     SPICE_OP_DRAW_BITMAP,
     SPICE_OP_SHOW,
-    CURSOR_OP_STATE,
     CURSOR_OP_IMAGE,
   }
   op;
@@ -65,16 +65,6 @@ typedef struct
     }
     spiceShow;
 
-    struct
-    {
-      bool visible;
-      int  x;
-      int  y;
-      int  hx;
-      int  hy;
-    }
-    cursorState;
-
     struct
     {
       bool      monochrome;
@@ -88,22 +78,28 @@ typedef struct
 }
 RenderCommand;
 
-void renderQueue_init(void);
+bool renderQueue_init(void);
 void renderQueue_free(void);
 void renderQueue_clear(void);
 void renderQueue_process(void);
 
 void renderQueue_spiceConfigure(int width, int height);
 
+/* stops SPICE draws from bypassing the queue and waits for those in progress,
+ * must be called before the renderer is deinitialized */
+void renderQueue_spiceStopDirect(void);
+
 void renderQueue_spiceDrawFill(int x, int y, int width, int height,
     uint32_t color);
 
 void renderQueue_spiceDrawBitmap(int x, int y, int width, int height, int stride,
-    void * data, bool topDown);
+    const void * data, bool topDown);
 
 void renderQueue_spiceShow(bool show);
 
 void renderQueue_cursorState(bool visible, int x, int y, int hx, int hy);
 
-void renderQueue_cursorImage(bool monochrome, int width, int height, int pitch,
-    uint8_t * data);
+void renderQueue_cursorImage(int width, int height, const void * data);
+
+void renderQueue_cursorMonoImage(int width, int height, const void * xorMask,
+    const void * andMask);
@@ -48,17 +48,17 @@ bool util_fileGetContents(const char * filename, char ** buffer, size_t * length
     return false;
   }
 
-  if (fseek(fh, 0, SEEK_SET) != 0)
+  long fsize = ftell(fh);
+  if (fsize < 0)
   {
-    DEBUG_ERROR("Failed to seek");
+    DEBUG_ERROR("Failed to get the size");
     fclose(fh);
     return false;
   }
 
-  long fsize = ftell(fh);
-  if (fsize < 0)
+  if (fseek(fh, 0, SEEK_SET) != 0)
   {
-    DEBUG_ERROR("Failed to get the size");
+    DEBUG_ERROR("Failed to seek");
     fclose(fh);
     return false;
   }
@@ -0,0 +1,64 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _H_LG_COMMON_EPOCH_
+#define _H_LG_COMMON_EPOCH_
+
+#include <stdbool.h>
+
+/* Epoch based memory reclamation for lock-free readers.
+ *
+ * Each thread that reads shared objects registers with the domain and wraps
+ * every access in epoch_enter/epoch_exit. Writers that unlink an object pass
+ * it to epoch_retire instead of freeing it, the object is then freed once no
+ * thread can still hold a reference to it. The node is embedded in the object
+ * being retired so retiring never allocates. */
+
+typedef struct EpochDomain * EpochDomain;
+typedef struct EpochThread   EpochThread;
+
+struct epoch_node;
+typedef void (*EpochFreeFn)(struct epoch_node * node);
+
+struct epoch_node
+{
+  struct epoch_node * next;
+  EpochFreeFn         free;
+};
+
+EpochDomain epoch_new (unsigned int maxThreads);
+void        epoch_free(EpochDomain * domain);
+
+// returns NULL if all maxThreads slots are in use
+EpochThread * epoch_register  (EpochDomain domain);
+void          epoch_unregister(EpochThread * thread);
+
+void epoch_enter(EpochThread * thread);
+void epoch_exit (EpochThread * thread);
+
+// must be called between epoch_enter and epoch_exit
+void epoch_retire(EpochThread * thread, struct epoch_node * node,
+    EpochFreeFn free);
+
+/* blocks until every object retired by this thread has been freed, must be
+ * called outside of a critical section */
+void epoch_synchronize(EpochThread * thread);
+
+#endif
@@ -0,0 +1,115 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _H_LG_COMMON_ILIST_
+#define _H_LG_COMMON_ILIST_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* An intrusive doubly linked list. The node is embedded in the object being
+ * listed so that adding and removing items never allocates. None of these
+ * functions are thread-safe, the caller must provide any locking required. */
+
+struct ilist_node
+{
+  struct ilist_node * prev, * next;
+};
+
+struct ilist
+{
+  struct ilist_node head;
+  unsigned int      count;
+};
+
+#define ilist_entry(node, type, member) \
+  ((type *)((uintptr_t)(node) - offsetof(type, member)))
+
+#define ilist_forEach(list, node) \
+  for(struct ilist_node * node = (list)->head.next, \
+      * _next = node->next; node != &(list)->head; \
+      node = _next, _next = node->next)
+
+static inline void ilist_init(struct ilist * list)
+{
+  list->head.prev = &list->head;
+  list->head.next = &list->head;
+  list->count     = 0;
+}
+
+static inline bool ilist_empty(const struct ilist * list)
+{
+  return list->head.next == &list->head;
+}
+
+static inline unsigned int ilist_count(const struct ilist * list)
+{
+  return list->count;
+}
+
+static inline void ilist_insertAfter(struct ilist * list,
+    struct ilist_node * pos, struct ilist_node * node)
+{
+  node->prev      = pos;
+  node->next      = pos->next;
+  pos->next->prev = node;
+  pos->next       = node;
+  ++list->count;
+}
+
+static inline void ilist_push(struct ilist * list, struct ilist_node * node)
+{
+  ilist_insertAfter(list, list->head.prev, node);
+}
+
+static inline void ilist_unshift(struct ilist * list, struct ilist_node * node)
+{
+  ilist_insertAfter(list, &list->head, node);
+}
+
+static inline void ilist_remove(struct ilist * list, struct ilist_node * node)
+{
+  node->prev->next = node->next;
+  node->next->prev = node->prev;
+  node->prev       = NULL;
+  node->next       = NULL;
+  --list->count;
+}
+
+static inline struct ilist_node * ilist_peekHead(const struct ilist * list)
+{
+  return ilist_empty(list) ? NULL : list->head.next;
+}
+
+static inline struct ilist_node * ilist_peekTail(const struct ilist * list)
+{
+  return ilist_empty(list) ? NULL : list->head.prev;
+}
+
+static inline struct ilist_node * ilist_shift(struct ilist * list)
+{
+  struct ilist_node * node = ilist_peekHead(list);
+  if (node)
+    ilist_remove(list, node);
+  return node;
+}
+
+#endif
@@ -0,0 +1,33 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _H_LG_COMMON_MIRROR_
+#define _H_LG_COMMON_MIRROR_
+
+#include <stddef.h>
+
+/* Allocates size bytes of zeroed memory mapped twice back to back, so that an
+ * access running past the end of the first mapping continues at its start.
+ * Size must be a multiple of the page size. Returns NULL if the platform does
+ * not support this. */
+void * mirror_alloc(size_t size);
+void   mirror_free (void * addr, size_t size);
+
+#endif
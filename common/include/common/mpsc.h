@@ -0,0 +1,54 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _H_LG_COMMON_MPSC_
+#define _H_LG_COMMON_MPSC_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/* An unbounded, intrusive, multiple producer single consumer queue. Pushing
+ * is wait-free and never allocates as the node is embedded in the object being
+ * queued, use ilist_entry (common/ilist.h) to get back to the containing
+ * object. Any number of threads may push, but only one thread may pop. */
+
+struct mpsc_node
+{
+  _Atomic(struct mpsc_node *) next;
+};
+
+struct mpsc
+{
+  _Atomic(struct mpsc_node *) head; // producers
+  struct mpsc_node          * tail; // consumer only
+  struct mpsc_node            stub;
+};
+
+void mpsc_init(struct mpsc * queue);
+void mpsc_push(struct mpsc * queue, struct mpsc_node * node);
+
+/* Returns the oldest node or NULL if the queue is empty. NULL may also be
+ * returned briefly while a producer is part way through a push, callers that
+ * need to drain the queue must retry when mpsc_empty returns false. */
+struct mpsc_node * mpsc_pop(struct mpsc * queue);
+
+bool mpsc_empty(struct mpsc * queue);
+
+#endif
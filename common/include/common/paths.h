@@ -24,5 +24,6 @@
 void lgPathsInit(const char * appName);
 const char * lgConfigDir(void);
 const char * lgDataDir(void);
+const char * lgCacheDir(void);
 
 #endif
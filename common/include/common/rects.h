@@ -42,4 +42,16 @@ void rectsFramebufferToBuffer(FrameDamageRect * rects, int count, int bpp,
 int rectsMergeOverlapping(FrameDamageRect * rects, int count);
 int rectsRejectContained(FrameDamageRect * rects, int count);
 
+/* once accumulated damage covers this much of the frame it is cheaper to treat
+ * the entire frame as damaged */
+#define RECTS_FULL_DAMAGE_PERCENT 75
+
+/* Appends addCount rects to the count rects already held in rects, which has
+ * room for maxCount. Instead of overflowing, the rects are merged into fewer,
+ * larger ones. Returns the new count, or -1 if the damage is now the entire
+ * width x height frame. A count or addCount of -1 is the entire frame.
+ */
+int rectsAccumulate(FrameDamageRect * rects, int count, int maxCount,
+    const FrameDamageRect * add, int addCount, int width, int height);
+
 #endif
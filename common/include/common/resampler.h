@@ -0,0 +1,60 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _H_LG_COMMON_RESAMPLER_
+#define _H_LG_COMMON_RESAMPLER_
+
+#include <stdint.h>
+
+/* A windowed sinc polyphase resampler tuned for ratios very close to 1.0, as
+ * used to nudge the playback rate when tracking a drifting clock. The ratio
+ * may change on every call without resetting the filter state.
+ *
+ * Quality ranges from RESAMPLER_QUALITY_MIN to RESAMPLER_QUALITY_MAX, each
+ * step doubles the filter length, the stopband attenuation and the group
+ * delay (4, 8, 16 and 32 frames).
+ */
+
+#define RESAMPLER_QUALITY_MIN 0
+#define RESAMPLER_QUALITY_MAX 3
+
+typedef struct Resampler * Resampler;
+
+Resampler resampler_new(int channels, int quality);
+void resampler_free(Resampler * rs);
+
+/* Discards all buffered input, the next output starts from silence */
+void resampler_reset(Resampler rs);
+
+/* Returns the group delay of the filter in input frames */
+int resampler_getLatency(const Resampler rs);
+
+/* Resamples interleaved input frames into interleaved float output frames
+ * at the given ratio (output rate / input rate), returning the number of
+ * frames written to out. All input is accepted; if out is too small the
+ * remaining output is retained and can be collected by calling again with no
+ * input. The s16 variant converts the samples while buffering them.
+ */
+int resampler_processS16(Resampler rs, const int16_t * in, int inFrames,
+    float * out, int outFrames, double ratio);
+int resampler_processF32(Resampler rs, const float * in, int inFrames,
+    float * out, int outFrames, double ratio);
+
+#endif
@@ -41,7 +41,18 @@ RingBuffer ringbuffer_new(int length, size_t valueSize);
  */
 RingBuffer ringbuffer_newUnbounded(int length, size_t valueSize);
 
+/* Creates a buffer whose storage is mapped twice back to back so that the
+ * spans returned by the acquire functions below are never split at the end of
+ * the buffer. The length is rounded up to a whole number of pages. If the
+ * platform can not do this a normal buffer is returned instead. */
+RingBuffer ringbuffer_newMirrored(int length, size_t valueSize,
+    bool unbounded);
+
 void ringbuffer_free(RingBuffer * rb);
+
+/* Appends a single value, if the buffer is bounded and full the oldest value
+ * is dropped. This is safe against a concurrent ringbuffer_consume.
+ * Note: This function is thread-safe */
 void ringbuffer_push(RingBuffer rb, const void * value);
 void ringbuffer_reset(RingBuffer rb);
 
@@ -67,6 +78,23 @@ int ringbuffer_append(const RingBuffer rb, const void * values, int count);
  * Note: This function is thread-safe */
 int ringbuffer_consume(const RingBuffer rb, void * values, int count);
 
+/* Zero-copy access for a single producer and a single consumer. The acquire
+ * functions return a pointer to up to count contiguous values, updating count
+ * with the number available, or NULL if there are none. Once the values have
+ * been written or read, commit the number actually used. Unless the buffer is
+ * mirrored a span stops at the end of the storage, so call again for the rest.
+ *
+ * In an unbounded buffer a reader that has overtaken the writer sees nothing
+ * to read, use ringbuffer_consume to read the zeros it expects. Spans must not
+ * be mixed with ringbuffer_push on a full bounded buffer, which may overwrite
+ * the values being read. */
+void       * ringbuffer_acquireWrite(const RingBuffer rb, int * count);
+void         ringbuffer_commitWrite (const RingBuffer rb, int count);
+const void * ringbuffer_acquireRead (const RingBuffer rb, int * count);
+void         ringbuffer_commitRead  (const RingBuffer rb, int count);
+
+/* Iterates the values in place, if the writer overflows a bounded buffer
+ * during the iteration the oldest values may be replaced as they are read */
 typedef bool (*RingBufferIterator)(int index, void * value, void * udata);
 void ringbuffer_forEach(const RingBuffer rb, RingBufferIterator fn,
     void * udata, bool reverse);
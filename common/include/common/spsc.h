@@ -0,0 +1,59 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _H_LG_COMMON_SPSC_
+#define _H_LG_COMMON_SPSC_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A bounded, lock-free, single producer single consumer ring of fixed size
+ * values. Only one thread may call the producer functions (push, reserve,
+ * commit) and only one thread may call the consumer functions (pop, peek,
+ * release) at any one time. No allocations are performed after creation. */
+
+typedef struct SPSCRing * SPSCRing;
+
+// length is rounded up to the next power of two
+SPSCRing spsc_new(unsigned int length, size_t valueSize);
+void     spsc_free(SPSCRing * ring);
+
+unsigned int spsc_getLength(const SPSCRing ring);
+unsigned int spsc_getCount (const SPSCRing ring);
+
+// producer, returns false if the ring is full
+bool spsc_push(SPSCRing ring, const void * value);
+
+/* producer, zero-copy variant of push. Returns a pointer to the next free slot
+ * or NULL if the ring is full, the value is not visible to the consumer until
+ * spsc_commit is called */
+void * spsc_reserve(SPSCRing ring);
+void   spsc_commit (SPSCRing ring);
+
+// consumer, returns false if the ring is empty
+bool spsc_pop(SPSCRing ring, void * value);
+
+/* consumer, zero-copy variant of pop. Returns a pointer to the oldest value or
+ * NULL if the ring is empty, the slot is not reused until spsc_release is
+ * called */
+void * spsc_peek   (SPSCRing ring);
+void   spsc_release(SPSCRing ring);
+
+#endif
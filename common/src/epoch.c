@@ -0,0 +1,234 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common/epoch.h"
+#include "common/debug.h"
+#include "common/time.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// attempt to advance the global epoch after this many retirements
+#define EPOCH_RETIRE_THRESHOLD 64
+
+#define CACHELINE_SIZE 64
+
+struct EpochThread
+{
+  EpochDomain domain;
+
+  // (epoch << 1) | active, read by other threads when advancing the epoch
+  _Atomic(uint32_t) state;
+  atomic_bool       used;
+
+  // thread private
+  uint32_t            epoch;
+  struct epoch_node * limbo[3];
+  unsigned int        retired;
+
+  char pad[CACHELINE_SIZE];
+};
+
+struct EpochDomain
+{
+  _Atomic(uint32_t)  epoch;
+  unsigned int       maxThreads;
+  struct EpochThread threads[0];
+};
+
+EpochDomain epoch_new(unsigned int maxThreads)
+{
+  DEBUG_ASSERT(maxThreads > 0);
+
+  struct EpochDomain * domain = calloc(1, sizeof(*domain) +
+      sizeof(struct EpochThread) * maxThreads);
+  if (!domain)
+  {
+    DEBUG_ERROR("out of memory");
+    return NULL;
+  }
+
+  atomic_init(&domain->epoch, 0);
+  domain->maxThreads = maxThreads;
+  for(unsigned int i = 0; i < maxThreads; ++i)
+  {
+    struct EpochThread * t = &domain->threads[i];
+    t->domain = domain;
+    atomic_init(&t->state, 0);
+    atomic_init(&t->used , false);
+  }
+
+  return domain;
+}
+
+void epoch_free(EpochDomain * domain)
+{
+  if (!*domain)
+    return;
+
+  for(unsigned int i = 0; i < (*domain)->maxThreads; ++i)
+    DEBUG_ASSERT(!atomic_load(&(*domain)->threads[i].used) &&
+        "threads must be unregistered before freeing the domain");
+
+  free(*domain);
+  *domain = NULL;
+}
+
+EpochThread * epoch_register(EpochDomain domain)
+{
+  for(unsigned int i = 0; i < domain->maxThreads; ++i)
+  {
+    struct EpochThread * t = &domain->threads[i];
+    bool expected = false;
+    if (!atomic_compare_exchange_strong(&t->used, &expected, true))
+      continue;
+
+    atomic_store_explicit(&t->state, 0, memory_order_relaxed);
+    t->epoch   = atomic_load(&domain->epoch);
+    t->retired = 0;
+    for(int n = 0; n < 3; ++n)
+      t->limbo[n] = NULL;
+    return t;
+  }
+
+  DEBUG_ERROR("all %u epoch thread slots are in use", domain->maxThreads);
+  return NULL;
+}
+
+void epoch_unregister(EpochThread * thread)
+{
+  epoch_synchronize(thread);
+  atomic_store_explicit(&thread->used, false, memory_order_release);
+}
+
+static void freeList(struct epoch_node ** list, unsigned int * retired)
+{
+  struct epoch_node * node = *list;
+  *list = NULL;
+
+  while(node)
+  {
+    struct epoch_node * next = node->next;
+    node->free(node);
+    --*retired;
+    node = next;
+  }
+}
+
+static bool tryAdvance(EpochDomain domain)
+{
+  uint32_t epoch = atomic_load_explicit(&domain->epoch, memory_order_acquire);
+
+  /* pairs with the fence in epoch_enter, without it a thread that has just
+   * entered may be missed and its objects freed while it still reads them */
+  atomic_thread_fence(memory_order_seq_cst);
+
+  for(unsigned int i = 0; i < domain->maxThreads; ++i)
+  {
+    struct EpochThread * t = &domain->threads[i];
+    if (!atomic_load_explicit(&t->used, memory_order_acquire))
+      continue;
+
+    const uint32_t state =
+      atomic_load_explicit(&t->state, memory_order_acquire);
+
+    // an active thread has not yet observed the current epoch
+    if ((state & 1) && (state >> 1) != (epoch & (UINT32_MAX >> 1)))
+      return false;
+  }
+
+  return atomic_compare_exchange_strong(&domain->epoch, &epoch, epoch + 1);
+}
+
+static void reclaim(EpochThread * thread, uint32_t epoch)
+{
+  const uint32_t diff = epoch - thread->epoch;
+  thread->epoch = epoch;
+
+  if (diff == 0)
+    return;
+
+  /* objects retired two or more epochs ago can no longer be referenced as
+   * every active thread is in the current or previous epoch */
+  if (diff >= 2)
+  {
+    for(int i = 0; i < 3; ++i)
+      freeList(&thread->limbo[i], &thread->retired);
+    return;
+  }
+
+  freeList(&thread->limbo[(epoch + 1) % 3], &thread->retired);
+}
+
+void epoch_enter(EpochThread * thread)
+{
+  const uint32_t epoch =
+    atomic_load_explicit(&thread->domain->epoch, memory_order_relaxed);
+
+  atomic_store_explicit(&thread->state,
+      ((epoch & (UINT32_MAX >> 1)) << 1) | 1, memory_order_relaxed);
+
+  // the active state must be visible before any shared object is read
+  atomic_thread_fence(memory_order_seq_cst);
+
+  reclaim(thread, epoch);
+}
+
+void epoch_exit(EpochThread * thread)
+{
+  atomic_store_explicit(&thread->state, 0, memory_order_release);
+}
+
+void epoch_retire(EpochThread * thread, struct epoch_node * node,
+    EpochFreeFn free)
+{
+  DEBUG_ASSERT(atomic_load_explicit(&thread->state, memory_order_relaxed) & 1);
+
+  node->free = free;
+  node->next = thread->limbo[thread->epoch % 3];
+  thread->limbo[thread->epoch % 3] = node;
+
+  if (++thread->retired >= EPOCH_RETIRE_THRESHOLD)
+    tryAdvance(thread->domain);
+}
+
+void epoch_synchronize(EpochThread * thread)
+{
+  DEBUG_ASSERT(!(atomic_load_explicit(&thread->state,
+          memory_order_relaxed) & 1));
+
+  EpochDomain domain = thread->domain;
+  const uint32_t start =
+    atomic_load_explicit(&domain->epoch, memory_order_acquire);
+
+  while(thread->retired)
+  {
+    uint32_t epoch = atomic_load_explicit(&domain->epoch, memory_order_acquire);
+    if (epoch - start >= 2)
+    {
+      reclaim(thread, epoch);
+      break;
+    }
+
+    if (!tryAdvance(domain))
+      nsleep(100000);
+  }
+}
@@ -0,0 +1,90 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common/mpsc.h"
+
+#include <stddef.h>
+
+void mpsc_init(struct mpsc * queue)
+{
+  atomic_init(&queue->stub.next, NULL);
+  atomic_init(&queue->head, &queue->stub);
+  queue->tail = &queue->stub;
+}
+
+void mpsc_push(struct mpsc * queue, struct mpsc_node * node)
+{
+  atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+  struct mpsc_node * prev =
+    atomic_exchange_explicit(&queue->head, node, memory_order_acq_rel);
+
+  // the queue is briefly disconnected here until prev->next is set
+  atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+struct mpsc_node * mpsc_pop(struct mpsc * queue)
+{
+  struct mpsc_node * tail = queue->tail;
+  struct mpsc_node * next =
+    atomic_load_explicit(&tail->next, memory_order_acquire);
+
+  if (tail == &queue->stub)
+  {
+    if (!next)
+      return NULL;
+
+    queue->tail = next;
+    tail        = next;
+    next        = atomic_load_explicit(&next->next, memory_order_acquire);
+  }
+
+  if (next)
+  {
+    queue->tail = next;
+    return tail;
+  }
+
+  struct mpsc_node * head =
+    atomic_load_explicit(&queue->head, memory_order_acquire);
+
+  // a producer is part way through a push
+  if (tail != head)
+    return NULL;
+
+  // put the stub back so that the last node can be released
+  mpsc_push(queue, &queue->stub);
+
+  next = atomic_load_explicit(&tail->next, memory_order_acquire);
+  if (next)
+  {
+    queue->tail = next;
+    return tail;
+  }
+
+  return NULL;
+}
+
+bool mpsc_empty(struct mpsc * queue)
+{
+  return
+    queue->tail == &queue->stub &&
+    !atomic_load_explicit(&queue->stub.next, memory_order_acquire) &&
+    atomic_load_explicit(&queue->head, memory_order_acquire) == &queue->stub;
+}
@@ -0,0 +1,71 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common/mirror.h"
+#include "common/debug.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+void * mirror_alloc(size_t size)
+{
+  int fd = memfd_create("lg-mirror", MFD_CLOEXEC);
+  if (fd < 0)
+  {
+    DEBUG_ERROR("memfd_create failed");
+    return NULL;
+  }
+
+  if (ftruncate(fd, size) < 0)
+  {
+    DEBUG_ERROR("ftruncate failed");
+    goto err_fd;
+  }
+
+  // reserve the address space for both views, then map the file over it
+  char * addr = mmap(NULL, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+      -1, 0);
+  if (addr == MAP_FAILED)
+  {
+    DEBUG_ERROR("Failed to reserve the address space");
+    goto err_fd;
+  }
+
+  for(int i = 0; i < 2; ++i)
+    if (mmap(addr + size * i, size, PROT_READ | PROT_WRITE,
+          MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+      DEBUG_ERROR("Failed to map the mirror");
+      munmap(addr, size * 2);
+      goto err_fd;
+    }
+
+  close(fd);
+  return addr;
+
+err_fd:
+  close(fd);
+  return NULL;
+}
+
+void mirror_free(void * addr, size_t size)
+{
+  munmap(addr, size * 2);
+}
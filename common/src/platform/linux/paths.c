@@ -30,6 +30,7 @@
 
 static char configDir[PATH_MAX];
 static char dataDir[PATH_MAX];
+static char cacheDir[PATH_MAX];
 
 static void ensureDir(char * path, mode_t mode)
 {
@@ -75,8 +76,14 @@ void lgPathsInit(const char * appName)
   else
     snprintf(dataDir, sizeof(configDir), "%s/.local/share/%s", home, appName);
 
+  if ((dir = getenv("XDG_CACHE_HOME")) != NULL)
+    snprintf(cacheDir, sizeof(cacheDir), "%s/%s", dir, appName);
+  else
+    snprintf(cacheDir, sizeof(cacheDir), "%s/.cache/%s", home, appName);
+
   ensureDir(configDir, S_IRWXU);
   ensureDir(dataDir,   S_IRWXU);
+  ensureDir(cacheDir,  S_IRWXU);
 }
 
 const char * lgConfigDir(void)
@@ -88,3 +95,8 @@ const char * lgDataDir(void)
 {
   return dataDir;
 }
+
+const char * lgCacheDir(void)
+{
+  return cacheDir;
+}
@@ -301,6 +301,131 @@ int rectsRejectContained(FrameDamageRect * rects, int count)
   return removeRects(rects, count, removed);
 }
 
+inline static FrameDamageRect rectUnion(const FrameDamageRect * r1,
+    const FrameDamageRect * r2)
+{
+  const uint32_t x1 = min(r1->x, r2->x);
+  const uint32_t y1 = min(r1->y, r2->y);
+  return (FrameDamageRect) {
+    .x      = x1,
+    .y      = y1,
+    .width  = max(r1->x + r1->width , r2->x + r2->width ) - x1,
+    .height = max(r1->y + r1->height, r2->y + r2->height) - y1
+  };
+}
+
+inline static uint64_t rectArea(const FrameDamageRect * rect)
+{
+  return (uint64_t)rect->width * rect->height;
+}
+
+// the area the bounding box of the two rects covers that neither of them do
+inline static uint64_t rectWaste(const FrameDamageRect * r1,
+    const FrameDamageRect * r2)
+{
+  const FrameDamageRect u = rectUnion(r1, r2);
+  const uint64_t used = rectArea(r1) + rectArea(r2);
+  const uint64_t area = rectArea(&u);
+  return area > used ? area - used : 0;
+}
+
+static void rectBestPartner(const FrameDamageRect * rects, int count, int i,
+    int * partner, uint64_t * waste)
+{
+  *partner = -1;
+  *waste   = UINT64_MAX;
+  for (int j = 0; j < count; ++j)
+  {
+    if (j == i)
+      continue;
+
+    const uint64_t w = rectWaste(rects + i, rects + j);
+    if (w < *waste)
+    {
+      *partner = j;
+      *waste   = w;
+    }
+  }
+}
+
+int rectsAccumulate(FrameDamageRect * rects, int count, int maxCount,
+    const FrameDamageRect * add, int addCount, int width, int height)
+{
+  if (count < 0 || addCount < 0)
+    return -1;
+
+  if (count + addCount <= maxCount)
+  {
+    memcpy(rects + count, add, addCount * sizeof(*add));
+    return count + addCount;
+  }
+
+  FrameDamageRect all[count + addCount];
+  memcpy(all, rects, count * sizeof(*rects));
+  memcpy(all + count, add, addCount * sizeof(*add));
+  count = rectsMergeOverlapping(all, count + addCount);
+
+  /* join the pairs that waste the least area until there is headroom left for
+   * the next few updates, so a burst does not pay for this on every frame. The
+   * best partner of each rect is tracked so only those affected by a join need
+   * to be searched again */
+  const int target = maxCount - maxCount / 4;
+  if (count > target)
+  {
+    int      partner[count];
+    uint64_t waste  [count];
+
+    for (int i = 0; i < count; ++i)
+      rectBestPartner(all, count, i, partner + i, waste + i);
+
+    while (count > target)
+    {
+      int best = 0;
+      for (int i = 1; i < count; ++i)
+        if (waste[i] < waste[best])
+          best = i;
+
+      const int keep = min(best, partner[best]);
+      const int drop = max(best, partner[best]);
+      all[keep] = rectUnion(all + keep, all + drop);
+
+      // move the last rect into the hole left by the dropped one
+      --count;
+      all    [drop] = all    [count];
+      partner[drop] = partner[count];
+      waste  [drop] = waste  [count];
+      for (int i = 0; i < count; ++i)
+        if (partner[i] == count)
+          partner[i] = drop;
+
+      for (int i = 0; i < count; ++i)
+      {
+        if (i == keep || partner[i] == keep || partner[i] == drop)
+          rectBestPartner(all, count, i, partner + i, waste + i);
+        else
+        {
+          const uint64_t w = rectWaste(all + i, all + keep);
+          if (w < waste[i])
+          {
+            partner[i] = keep;
+            waste  [i] = w;
+          }
+        }
+      }
+    }
+  }
+
+  uint64_t area = 0;
+  for (int i = 0; i < count; ++i)
+    area += rectArea(all + i);
+
+  if (area > (uint64_t)width * height * RECTS_FULL_DAMAGE_PERCENT / 100)
+    return -1;
+
+  memcpy(rects, all, count * sizeof(*rects));
+  return count;
+}
+
 static void rectCopyUnaligned_memcpy(
     uint8_t *restrict dst, const uint8_t *restrict src,
     int ystart, int yend, int dx, int dstPitch, int srcPitch, int width)
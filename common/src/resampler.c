@@ -0,0 +1,427 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common/resampler.h"
+#include "common/cpuinfo.h"
+#include "common/debug.h"
+#include "common/util.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+/* The number of filter phases between two input frames, coefficients for
+ * positions in between are linearly interpolated from the two nearest */
+#define RESAMPLER_PHASES 256
+
+// the initial buffer size in frames, grown if a larger input is given
+#define RESAMPLER_BUFFER 4096
+
+static const struct
+{
+  int    taps;
+  double cutoff; // fraction of the input nyquist frequency
+  double beta;   // kaiser window shape
+}
+qualities[] =
+{
+  { .taps =  8, .cutoff = 0.80, .beta = 5.0 },
+  { .taps = 16, .cutoff = 0.87, .beta = 6.5 },
+  { .taps = 32, .cutoff = 0.92, .beta = 8.0 },
+  { .taps = 64, .cutoff = 0.95, .beta = 9.5 }
+};
+
+struct Resampler
+{
+  int     channels;
+  int     taps;
+  float * coeffs;   // RESAMPLER_PHASES + 1 rows of taps
+  float * interp;   // the interpolated coefficients for the current frame
+
+  // planar input frames, one row of capacity frames per channel
+  float * buffer;
+  int     capacity;
+  int     count;
+  double  pos;
+};
+
+typedef int (*ResampleFn)(struct Resampler * rs, float * restrict out,
+    int outFrames, double step);
+
+static ResampleFn resample;
+
+static double besselI0(double x)
+{
+  double sum  = 1.0;
+  double term = 1.0;
+  for(int k = 1; k < 32; ++k)
+  {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum  += term;
+  }
+  return sum;
+}
+
+static void buildCoeffs(struct Resampler * rs, double cutoff, double beta)
+{
+  const int    taps   = rs->taps;
+  const double center = taps / 2 - 1;
+  const double norm   = besselI0(beta);
+
+  for(int p = 0; p <= RESAMPLER_PHASES; ++p)
+  {
+    float * row = rs->coeffs + p * taps;
+    const double frac = (double)p / RESAMPLER_PHASES;
+
+    double sum = 0.0;
+    for(int k = 0; k < taps; ++k)
+    {
+      const double t = k - center - frac;
+      const double r = t / (taps / 2);
+      const double w = fabs(r) >= 1.0 ? 0.0 :
+        besselI0(beta * sqrt(1.0 - r * r)) / norm;
+      const double x = M_PI * cutoff * t;
+      const double s = x == 0.0 ? 1.0 : sin(x) / x;
+
+      row[k] = w * s;
+      sum   += row[k];
+    }
+
+    // normalize each phase to unity gain
+    for(int k = 0; k < taps; ++k)
+      row[k] /= sum;
+  }
+}
+
+// msvcrt has no aligned_alloc, and memory from _aligned_malloc needs its own free
+static void * alignedAlloc(size_t alignment, size_t size)
+{
+#if defined(_WIN32)
+  return _aligned_malloc(size, alignment);
+#else
+  void * ptr;
+  if (posix_memalign(&ptr, alignment, size) != 0)
+    return NULL;
+  return ptr;
+#endif
+}
+
+static void alignedFree(void * ptr)
+{
+#if defined(_WIN32)
+  _aligned_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+Resampler resampler_new(int channels, int quality)
+{
+  DEBUG_ASSERT(channels > 0);
+  quality = max(RESAMPLER_QUALITY_MIN, min(RESAMPLER_QUALITY_MAX, quality));
+
+  struct Resampler * rs = calloc(1, sizeof(*rs));
+  if (!rs)
+  {
+    DEBUG_ERROR("out of memory");
+    return NULL;
+  }
+
+  rs->channels = channels;
+  rs->taps     = qualities[quality].taps;
+  rs->capacity = RESAMPLER_BUFFER + rs->taps;
+
+  rs->coeffs = alignedAlloc(32,
+      sizeof(float) * rs->taps * (RESAMPLER_PHASES + 1));
+  rs->interp = alignedAlloc(32, sizeof(float) * rs->taps);
+  rs->buffer = malloc(sizeof(float) * rs->capacity * channels);
+  if (!rs->coeffs || !rs->interp || !rs->buffer)
+  {
+    DEBUG_ERROR("out of memory");
+    resampler_free(&rs);
+    return NULL;
+  }
+
+  buildCoeffs(rs, qualities[quality].cutoff, qualities[quality].beta);
+  resampler_reset(rs);
+  return rs;
+}
+
+void resampler_free(Resampler * rs)
+{
+  if (!*rs)
+    return;
+
+  alignedFree((*rs)->coeffs);
+  alignedFree((*rs)->interp);
+  free((*rs)->buffer);
+  free(*rs);
+  *rs = NULL;
+}
+
+void resampler_reset(Resampler rs)
+{
+  /* prime with enough silence that the first input frame lands at the centre
+   * of the filter, output frame n then samples the input at n / ratio */
+  rs->count = rs->taps / 2 - 1;
+  rs->pos   = 0.0;
+  for(int ch = 0; ch < rs->channels; ++ch)
+    memset(rs->buffer + ch * rs->capacity, 0, sizeof(float) * rs->count);
+}
+
+int resampler_getLatency(const Resampler rs)
+{
+  return rs->taps / 2;
+}
+
+/* Ensures there is space for frames more input frames, discarding the input
+ * that has already been consumed */
+static bool prepareBuffer(struct Resampler * rs, int frames)
+{
+  const int drop = (int)rs->pos;
+  if (drop > 0)
+  {
+    rs->count -= drop;
+    rs->pos   -= drop;
+    for(int ch = 0; ch < rs->channels; ++ch)
+    {
+      float * row = rs->buffer + ch * rs->capacity;
+      memmove(row, row + drop, sizeof(float) * rs->count);
+    }
+  }
+
+  if (rs->count + frames <= rs->capacity)
+    return true;
+
+  const int capacity = rs->count + frames + rs->taps;
+  float * buffer = malloc(sizeof(float) * capacity * rs->channels);
+  if (!buffer)
+  {
+    DEBUG_ERROR("out of memory");
+    return false;
+  }
+
+  for(int ch = 0; ch < rs->channels; ++ch)
+    memcpy(buffer + ch * capacity, rs->buffer + ch * rs->capacity,
+        sizeof(float) * rs->count);
+
+  free(rs->buffer);
+  rs->buffer   = buffer;
+  rs->capacity = capacity;
+  return true;
+}
+
+static void bufferS16(struct Resampler * rs, const int16_t * in, int frames)
+{
+  const float scale = 1.0f / 32768.0f;
+  float * dst = rs->buffer + rs->count;
+  int i = 0;
+
+  if (rs->channels == 2)
+  {
+    float * l = dst;
+    float * r = dst + rs->capacity;
+    const __m128 vscale = _mm_set1_ps(scale);
+    for(; i + 4 <= frames; i += 4)
+    {
+      // 4 interleaved stereo frames, sign extended to 32 bits
+      const __m128i v  = _mm_loadu_si128((const __m128i *)(in + i * 2));
+      const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+      const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+      const __m128  a  = _mm_mul_ps(_mm_cvtepi32_ps(lo), vscale);
+      const __m128  b  = _mm_mul_ps(_mm_cvtepi32_ps(hi), vscale);
+
+      _mm_storeu_ps(l + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+      _mm_storeu_ps(r + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+  }
+
+  for(; i < frames; ++i)
+    for(int ch = 0; ch < rs->channels; ++ch)
+      dst[ch * rs->capacity + i] = in[i * rs->channels + ch] * scale;
+}
+
+static void bufferF32(struct Resampler * rs, const float * in, int frames)
+{
+  float * dst = rs->buffer + rs->count;
+  for(int i = 0; i < frames; ++i)
+    for(int ch = 0; ch < rs->channels; ++ch)
+      dst[ch * rs->capacity + i] = in[i * rs->channels + ch];
+}
+
+static inline float hsum_sse(__m128 v)
+{
+  v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+  v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+  return _mm_cvtss_f32(v);
+}
+
+static int resample_sse(struct Resampler * rs, float * restrict out,
+    int outFrames, double step)
+{
+  const int taps = rs->taps;
+  int n;
+
+  for(n = 0; n < outFrames; ++n)
+  {
+    const int i0 = (int)rs->pos;
+    if (i0 + taps > rs->count)
+      break;
+
+    const double phase = (rs->pos - i0) * RESAMPLER_PHASES;
+    const int    p     = (int)phase;
+    const __m128 a     = _mm_set1_ps((float)(phase - p));
+    const float * c0   = rs->coeffs + p * taps;
+    const float * c1   = c0 + taps;
+
+    for(int k = 0; k < taps; k += 4)
+    {
+      const __m128 v0 = _mm_load_ps(c0 + k);
+      const __m128 v1 = _mm_load_ps(c1 + k);
+      _mm_store_ps(rs->interp + k,
+          _mm_add_ps(v0, _mm_mul_ps(a, _mm_sub_ps(v1, v0))));
+    }
+
+    for(int ch = 0; ch < rs->channels; ++ch)
+    {
+      const float * s = rs->buffer + ch * rs->capacity + i0;
+      __m128 acc0 = _mm_setzero_ps();
+      __m128 acc1 = _mm_setzero_ps();
+      for(int k = 0; k < taps; k += 8)
+      {
+        acc0 = _mm_add_ps(acc0,
+            _mm_mul_ps(_mm_loadu_ps(s + k    ), _mm_load_ps(rs->interp + k    )));
+        acc1 = _mm_add_ps(acc1,
+            _mm_mul_ps(_mm_loadu_ps(s + k + 4), _mm_load_ps(rs->interp + k + 4)));
+      }
+      *out++ = hsum_sse(_mm_add_ps(acc0, acc1));
+    }
+
+    rs->pos += step;
+  }
+
+  return n;
+}
+
+#ifdef __clang__
+  #pragma clang attribute push (__attribute__((target("avx2,fma"))), apply_to=function)
+#else
+  #pragma GCC push_options
+  #pragma GCC target ("avx2,fma")
+#endif
+static int resample_avx2(struct Resampler * rs, float * restrict out,
+    int outFrames, double step)
+{
+  const int taps = rs->taps;
+  int n;
+
+  for(n = 0; n < outFrames; ++n)
+  {
+    const int i0 = (int)rs->pos;
+    if (i0 + taps > rs->count)
+      break;
+
+    const double phase = (rs->pos - i0) * RESAMPLER_PHASES;
+    const int    p     = (int)phase;
+    const __m256 a     = _mm256_set1_ps((float)(phase - p));
+    const float * c0   = rs->coeffs + p * taps;
+    const float * c1   = c0 + taps;
+
+    for(int k = 0; k < taps; k += 8)
+    {
+      const __m256 v0 = _mm256_load_ps(c0 + k);
+      const __m256 v1 = _mm256_load_ps(c1 + k);
+      _mm256_store_ps(rs->interp + k,
+          _mm256_fmadd_ps(a, _mm256_sub_ps(v1, v0), v0));
+    }
+
+    for(int ch = 0; ch < rs->channels; ++ch)
+    {
+      const float * s = rs->buffer + ch * rs->capacity + i0;
+      __m256 acc = _mm256_setzero_ps();
+      for(int k = 0; k < taps; k += 8)
+        acc = _mm256_fmadd_ps(_mm256_loadu_ps(s + k),
+            _mm256_load_ps(rs->interp + k), acc);
+
+      *out++ = hsum_sse(_mm_add_ps(
+            _mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1)));
+    }
+
+    rs->pos += step;
+  }
+
+  return n;
+}
+#ifdef __clang__
+  #pragma clang attribute pop
+#else
+  #pragma GCC pop_options
+#endif
+
+static int _resample(struct Resampler * rs, float * restrict out,
+    int outFrames, double step)
+{
+  const CPUInfoFeatures * features = cpuInfo_getFeatures();
+  if (features->avx2 && features->fma)
+    resample = &resample_avx2;
+  else
+    resample = &resample_sse;
+
+  return resample(rs, out, outFrames, step);
+}
+
+static ResampleFn resample = &_resample;
+
+int resampler_processS16(Resampler rs, const int16_t * in, int inFrames,
+    float * out, int outFrames, double ratio)
+{
+  if (!prepareBuffer(rs, inFrames))
+    return 0;
+
+  if (inFrames > 0)
+  {
+    bufferS16(rs, in, inFrames);
+    rs->count += inFrames;
+  }
+
+  return resample(rs, out, outFrames, 1.0 / ratio);
+}
+
+int resampler_processF32(Resampler rs, const float * in, int inFrames,
+    float * out, int outFrames, double ratio)
+{
+  if (!prepareBuffer(rs, inFrames))
+    return 0;
+
+  if (inFrames > 0)
+  {
+    bufferF32(rs, in, inFrames);
+    rs->count += inFrames;
+  }
+
+  return resample(rs, out, outFrames, 1.0 / ratio);
+}
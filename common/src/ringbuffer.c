@@ -20,6 +20,8 @@
 
 #include "common/ringbuffer.h"
 #include "common/debug.h"
+#include "common/mirror.h"
+#include "common/sysinfo.h"
 #include "common/util.h"
 
 #include <stdatomic.h>
@@ -33,10 +35,14 @@ struct RingBuffer
   _Atomic(uint32_t) readPos;
   _Atomic(uint32_t) writePos;
   bool              unbounded;
-  char              values[0];
+
+  // the size of each view if the values are mapped twice, otherwise zero
+  size_t            mirrorSize;
+  char            * values;
+  char              storage[0];
 };
 
-RingBuffer ringbuffer_newInternal(int length, size_t valueSize,
+static RingBuffer ringbuffer_newInternal(int length, size_t valueSize,
     bool unbounded)
 {
   DEBUG_ASSERT(valueSize > 0 && valueSize < UINT32_MAX);
@@ -53,6 +59,7 @@ RingBuffer ringbuffer_newInternal(int length, size_t valueSize,
   atomic_store(&rb->readPos , 0);
   atomic_store(&rb->writePos, 0);
   rb->unbounded = unbounded;
+  rb->values    = rb->storage;
   return rb;
 }
 
@@ -66,19 +73,81 @@ RingBuffer ringbuffer_newUnbounded(int length, size_t valueSize)
   return ringbuffer_newInternal(length, valueSize, true);
 }
 
+static size_t gcd(size_t a, size_t b)
+{
+  while(b)
+  {
+    size_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+RingBuffer ringbuffer_newMirrored(int length, size_t valueSize,
+    bool unbounded)
+{
+  DEBUG_ASSERT(valueSize > 0 && valueSize < UINT32_MAX);
+
+  // each view must be a whole number of pages and a whole number of values
+  const size_t pageSize = sysinfo_getPageSize();
+  const size_t unit     = pageSize / gcd(pageSize, valueSize);
+  const size_t rounded  = (length + unit - 1) / unit * unit;
+  const size_t size     = rounded * valueSize;
+
+  void * values = mirror_alloc(size);
+  if (!values)
+  {
+    DEBUG_WARN("Mirrored mapping unavailable, spans may be split");
+    return ringbuffer_newInternal(length, valueSize, unbounded);
+  }
+
+  struct RingBuffer * rb = calloc(1, sizeof(*rb));
+  if (!rb)
+  {
+    DEBUG_ERROR("out of memory");
+    mirror_free(values, size);
+    return NULL;
+  }
+
+  rb->length     = rounded;
+  rb->valueSize  = valueSize;
+  atomic_store(&rb->readPos , 0);
+  atomic_store(&rb->writePos, 0);
+  rb->unbounded  = unbounded;
+  rb->mirrorSize = size;
+  rb->values     = values;
+  return rb;
+}
+
 void ringbuffer_free(RingBuffer * rb)
 {
   if (!*rb)
     return;
 
+  if ((*rb)->mirrorSize)
+    mirror_free((*rb)->values, (*rb)->mirrorSize);
+
   free(*rb);
   *rb = NULL;
 }
 
 void ringbuffer_push(RingBuffer rb, const void * value)
 {
-  if (!rb->unbounded && ringbuffer_getCount(rb) == rb->length)
-    ringbuffer_consume(rb, NULL, 1);
+  if (!rb->unbounded)
+  {
+    /* If the buffer is full drop the oldest value. The reader may be consuming
+     * at the same time, in which case it has already made room and the read
+     * position must be left alone, so only advance it if it is unchanged. */
+    uint32_t readPos =
+      atomic_load_explicit(&rb->readPos, memory_order_acquire);
+    uint32_t writePos =
+      atomic_load_explicit(&rb->writePos, memory_order_relaxed);
+
+    if (writePos - readPos >= rb->length)
+      atomic_compare_exchange_strong_explicit(&rb->readPos, &readPos,
+          readPos + 1, memory_order_acq_rel, memory_order_acquire);
+  }
 
   ringbuffer_append(rb, value, 1);
 }
@@ -202,9 +271,13 @@ int ringbuffer_consume(const RingBuffer rb, void * values, int count)
   if (count < 0 && !rb->unbounded)
     return 0;
 
-  uint32_t readPos = atomic_load_explicit(&rb->readPos, memory_order_relaxed);
+  uint32_t readPos;
+  uint32_t newReadPos;
+
+retry:
+  readPos = atomic_load_explicit(&rb->readPos, memory_order_acquire);
   uint32_t writePos = atomic_load_explicit(&rb->writePos, memory_order_acquire);
-  uint32_t newReadPos = readPos;
+  newReadPos = readPos;
 
   if (count < 0)
   {
@@ -261,11 +334,74 @@ int ringbuffer_consume(const RingBuffer rb, void * values, int count)
     }
   }
 
-  atomic_store_explicit(&rb->readPos, newReadPos, memory_order_release);
+  if (rb->unbounded)
+    atomic_store_explicit(&rb->readPos, newReadPos, memory_order_release);
+  else if (!atomic_compare_exchange_strong_explicit(&rb->readPos, &readPos,
+        newReadPos, memory_order_acq_rel, memory_order_acquire))
+  {
+    /* ringbuffer_push dropped the oldest value while we were reading, which
+     * may have been overwritten, so read again */
+    goto retry;
+  }
 
   return newReadPos - readPos;
 }
 
+void * ringbuffer_acquireWrite(const RingBuffer rb, int * count)
+{
+  uint32_t readPos = atomic_load_explicit(&rb->readPos, memory_order_acquire);
+  uint32_t writePos = atomic_load_explicit(&rb->writePos, memory_order_relaxed);
+
+  /* In an unbounded buffer the reader may be ahead of the writer, the values
+   * it has skipped are never read so all of the storage is free */
+  int32_t writeOffset = writePos - readPos;
+  int32_t available = rb->length - max(writeOffset, 0);
+  if (available <= 0)
+  {
+    *count = 0;
+    return NULL;
+  }
+
+  uint32_t writeIndex = writePos % rb->length;
+  if (!rb->mirrorSize)
+    available = min(available, (int32_t)(rb->length - writeIndex));
+
+  *count = min(*count, available);
+  return rb->values + writeIndex * rb->valueSize;
+}
+
+void ringbuffer_commitWrite(const RingBuffer rb, int count)
+{
+  DEBUG_ASSERT(count >= 0);
+  atomic_fetch_add_explicit(&rb->writePos, count, memory_order_release);
+}
+
+const void * ringbuffer_acquireRead(const RingBuffer rb, int * count)
+{
+  uint32_t readPos = atomic_load_explicit(&rb->readPos, memory_order_relaxed);
+  uint32_t writePos = atomic_load_explicit(&rb->writePos, memory_order_acquire);
+
+  int32_t available = min((int32_t)(writePos - readPos), (int32_t)rb->length);
+  if (available <= 0)
+  {
+    *count = 0;
+    return NULL;
+  }
+
+  uint32_t readIndex = readPos % rb->length;
+  if (!rb->mirrorSize)
+    available = min(available, (int32_t)(rb->length - readIndex));
+
+  *count = min(*count, available);
+  return rb->values + readIndex * rb->valueSize;
+}
+
+void ringbuffer_commitRead(const RingBuffer rb, int count)
+{
+  DEBUG_ASSERT(count >= 0);
+  atomic_fetch_add_explicit(&rb->readPos, count, memory_order_release);
+}
+
 void ringbuffer_forEach(const RingBuffer rb, RingBufferIterator fn,
     void * udata, bool reverse)
 {
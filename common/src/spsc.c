@@ -0,0 +1,160 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common/spsc.h"
+#include "common/debug.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHELINE_SIZE 64
+
+struct SPSCRing
+{
+  uint32_t mask;
+  uint32_t valueSize;
+
+  // keep the producer and consumer positions on separate cache lines
+  _Atomic(uint32_t) writePos;
+  uint32_t          cachedReadPos; // producer only
+  char              pad0[CACHELINE_SIZE];
+
+  _Atomic(uint32_t) readPos;
+  uint32_t          cachedWritePos; // consumer only
+  char              pad1[CACHELINE_SIZE];
+
+  char values[0];
+};
+
+SPSCRing spsc_new(unsigned int length, size_t valueSize)
+{
+  DEBUG_ASSERT(length > 0 && length <= (1U << 31));
+  DEBUG_ASSERT(valueSize > 0 && valueSize < UINT32_MAX);
+
+  uint32_t size = 1;
+  while(size < length)
+    size <<= 1;
+
+  struct SPSCRing * ring = calloc(1, sizeof(*ring) + valueSize * size);
+  if (!ring)
+  {
+    DEBUG_ERROR("out of memory");
+    return NULL;
+  }
+
+  ring->mask      = size - 1;
+  ring->valueSize = valueSize;
+  atomic_init(&ring->writePos, 0);
+  atomic_init(&ring->readPos , 0);
+  return ring;
+}
+
+void spsc_free(SPSCRing * ring)
+{
+  if (!*ring)
+    return;
+
+  free(*ring);
+  *ring = NULL;
+}
+
+unsigned int spsc_getLength(const SPSCRing ring)
+{
+  return ring->mask + 1;
+}
+
+unsigned int spsc_getCount(const SPSCRing ring)
+{
+  return
+    atomic_load_explicit(&ring->writePos, memory_order_acquire) -
+    atomic_load_explicit(&ring->readPos , memory_order_acquire);
+}
+
+void * spsc_reserve(SPSCRing ring)
+{
+  const uint32_t writePos =
+    atomic_load_explicit(&ring->writePos, memory_order_relaxed);
+
+  // only reload the consumer position when the cached copy says we are full
+  if (writePos - ring->cachedReadPos > ring->mask)
+  {
+    ring->cachedReadPos =
+      atomic_load_explicit(&ring->readPos, memory_order_acquire);
+    if (writePos - ring->cachedReadPos > ring->mask)
+      return NULL;
+  }
+
+  return ring->values + (size_t)(writePos & ring->mask) * ring->valueSize;
+}
+
+void spsc_commit(SPSCRing ring)
+{
+  const uint32_t writePos =
+    atomic_load_explicit(&ring->writePos, memory_order_relaxed);
+  atomic_store_explicit(&ring->writePos, writePos + 1, memory_order_release);
+}
+
+bool spsc_push(SPSCRing ring, const void * value)
+{
+  void * slot = spsc_reserve(ring);
+  if (!slot)
+    return false;
+
+  memcpy(slot, value, ring->valueSize);
+  spsc_commit(ring);
+  return true;
+}
+
+void * spsc_peek(SPSCRing ring)
+{
+  const uint32_t readPos =
+    atomic_load_explicit(&ring->readPos, memory_order_relaxed);
+
+  if (readPos == ring->cachedWritePos)
+  {
+    ring->cachedWritePos =
+      atomic_load_explicit(&ring->writePos, memory_order_acquire);
+    if (readPos == ring->cachedWritePos)
+      return NULL;
+  }
+
+  return ring->values + (size_t)(readPos & ring->mask) * ring->valueSize;
+}
+
+void spsc_release(SPSCRing ring)
+{
+  const uint32_t readPos =
+    atomic_load_explicit(&ring->readPos, memory_order_relaxed);
+  atomic_store_explicit(&ring->readPos, readPos + 1, memory_order_release);
+}
+
+bool spsc_pop(SPSCRing ring, void * value)
+{
+  void * slot = spsc_peek(ring);
+  if (!slot)
+    return false;
+
+  if (value)
+    memcpy(value, slot, ring->valueSize);
+  spsc_release(ring);
+  return true;
+}
@@ -0,0 +1,519 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/* Offline simulation of the client's audio playback clock recovery.
+ *
+ * The client's audio.c is compiled into this program with nanotime() replaced
+ * by a virtual clock, then driven by a synthetic SPICE packet schedule and a
+ * simulated audio device, both with their own clock drift and jitter. Nothing
+ * runs in real time so a minute of playback simulates in milliseconds and
+ * every run with the same options produces the same result.
+ */
+
+#include "common/time.h"
+
+static uint64_t simTime = 0;
+static uint64_t simNanotime(void)
+{
+  return simTime;
+}
+
+#define nanotime simNanotime
+#include "audio.c"
+#undef nanotime
+
+#include "common/option.h"
+
+#include <stdio.h>
+
+struct AppState  g_state  = { 0 };
+struct AppParams g_params = { 0 };
+
+static struct Option options[] =
+{
+  {
+    .module       = "sim",
+    .name         = "duration",
+    .description  = "Length of the simulated playback in seconds",
+    .type         = OPTION_TYPE_INT,
+    .value.x_int  = 180
+  },
+  {
+    .module       = "sim",
+    .name         = "settle",
+    .description  = "Seconds to ignore at the start of playback for statistics, "
+                    "this must cover the initial convergence",
+    .type         = OPTION_TYPE_INT,
+    .value.x_int  = 90
+  },
+  {
+    .module       = "sim",
+    .name         = "seed",
+    .description  = "Random seed for the jitter model",
+    .type         = OPTION_TYPE_INT,
+    .value.x_int  = 1
+  },
+  {
+    .module       = "sim",
+    .name         = "sampleRate",
+    .description  = "Stream sample rate",
+    .type         = OPTION_TYPE_INT,
+    .value.x_int  = 48000
+  },
+  {
+    .module       = "sim",
+    .name         = "spicePeriod",
+    .description  = "Frames per SPICE packet",
+    .type         = OPTION_TYPE_INT,
+    .value.x_int  = 480
+  },
+  {
+    .module        = "sim",
+    .name          = "spiceJitter",
+    .description   = "Standard deviation of the SPICE packet arrival in ms",
+    .type          = OPTION_TYPE_FLOAT,
+    .value.x_float = 1.0f
+  },
+  {
+    .module        = "sim",
+    .name          = "spiceBurst",
+    .description   = "Probability of a packet being held back and delivered "
+                     "with the next one",
+    .type          = OPTION_TYPE_FLOAT,
+    .value.x_float = 0.01f
+  },
+  {
+    .module        = "sim",
+    .name          = "drift",
+    .description   = "Device clock drift relative to the guest in ppm",
+    .type          = OPTION_TYPE_FLOAT,
+    .value.x_float = 100.0f
+  },
+  {
+    .module       = "sim",
+    .name         = "devicePeriod",
+    .description  = "Frames per device period",
+    .type         = OPTION_TYPE_INT,
+    .value.x_int  = 256
+  },
+  {
+    .module       = "sim",
+    .name         = "deviceMaxPeriod",
+    .description  = "Maximum frames per device period",
+    .type         = OPTION_TYPE_INT,
+    .value.x_int  = 1024
+  },
+  {
+    .module        = "sim",
+    .name          = "deviceJitter",
+    .description   = "Standard deviation of the device wakeups in ms",
+    .type          = OPTION_TYPE_FLOAT,
+    .value.x_float = 0.2f
+  },
+  {
+    .module       = "sim",
+    .name         = "periodSwitch",
+    .description  = "Toggle the device between the period and max period every "
+                    "N seconds (0 to disable)",
+    .type         = OPTION_TYPE_INT,
+    .value.x_int  = 0
+  },
+  {
+    .module       = "sim",
+    .name         = "maxUnderruns",
+    .description  = "Exit with an error if more underruns than this occur",
+    .type         = OPTION_TYPE_INT,
+    .value.x_int  = 0
+  },
+  {
+    .module       = "audio",
+    .name         = "bufferLatency",
+    .description  = "Additional buffer latency in milliseconds",
+    .type         = OPTION_TYPE_INT,
+    .value.x_int  = 13
+  },
+  {
+    .module       = "audio",
+    .name         = "resampleQuality",
+    .description  = "Resampler quality (0-3)",
+    .type         = OPTION_TYPE_INT,
+    .value.x_int  = 2
+  },
+  {0}
+};
+
+// the level of the test signal, anything well below it was not real audio
+#define SIGNAL_LEVEL 8192
+
+static struct
+{
+  int    sampleRate;
+  double settleTime;
+
+  // the simulated device
+  LG_AudioPullFn pullFn;
+  bool     running;
+  int      period;
+  int      lastPeriod;
+  int      maxPeriod;
+  double   rate;        // device frames per second of simulated time
+  double   queued;      // frames handed to the device not yet played
+  uint64_t queuedTime;
+  float  * pullBuffer;
+
+  // results
+  bool     playing;
+  int      underruns;
+  int      underrunFrames;
+  bool     inUnderrun;
+  double   latencySum, latencySq, latencyMin, latencyMax;
+  int      latencyCount;
+  double   ratioSum, ratioSq;
+  int      ratioCount;
+  double   convergeTime;
+}
+sim;
+
+static uint64_t rngState;
+
+static double rngUniform(void)
+{
+  // xorshift64*, good enough for a jitter model and reproducible everywhere
+  rngState ^= rngState >> 12;
+  rngState ^= rngState << 25;
+  rngState ^= rngState >> 27;
+  return ((rngState * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double rngGauss(double stddev)
+{
+  const double u1 = max(rngUniform(), 1e-12);
+  const double u2 = rngUniform();
+  return stddev * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static double simSeconds(void)
+{
+  return simTime * 1e-9;
+}
+
+// the simulated audio device
+
+static bool simInit(void)
+{
+  return true;
+}
+
+static void simFree(void)
+{
+}
+
+static void simSetup(int channels, int sampleRate, int requestedPeriodFrames,
+    int * maxPeriodFrames, int * startFrames, LG_AudioPullFn pullFn)
+{
+  sim.pullFn     = pullFn;
+  *maxPeriodFrames = sim.maxPeriod;
+  *startFrames     = sim.period;
+
+  free(sim.pullBuffer);
+  sim.pullBuffer = malloc(sizeof(float) * channels * sim.maxPeriod);
+}
+
+static void simStart(void)
+{
+  sim.running    = true;
+  sim.queued     = 0.0;
+  sim.queuedTime = simTime;
+}
+
+static void simStop(void)
+{
+  sim.running = false;
+}
+
+static void simUpdateQueue(void)
+{
+  sim.queued = max(0.0,
+      sim.queued - (simTime - sim.queuedTime) * 1e-9 * sim.rate);
+  sim.queuedTime = simTime;
+}
+
+static uint64_t simLatency(void)
+{
+  simUpdateQueue();
+  return llrint(sim.queued);
+}
+
+static struct LG_AudioDevOps simAudioDev =
+{
+  .name  = "Simulator",
+  .init  = simInit,
+  .free  = simFree,
+  .playback =
+  {
+    .setup   = simSetup,
+    .start   = simStart,
+    .stop    = simStop,
+    .latency = simLatency
+  }
+};
+
+struct LG_AudioDevOps * LG_AudioDevs[] = { &simAudioDev, NULL };
+
+// client functions audio.c depends upon
+
+static RingBuffer timings;
+
+GraphHandle app_registerGraph(const char * name, RingBuffer buffer,
+    float min, float max, GraphFormatFn formatFn)
+{
+  timings = buffer;
+  return (GraphHandle)1;
+}
+
+void app_unregisterGraph(GraphHandle handle)
+{
+  timings = NULL;
+}
+
+static bool latestTiming(int index, void * value, void * udata)
+{
+  *(float *)udata = *(float *)value;
+  return false;
+}
+
+void app_invalidateGraph(GraphHandle handle)
+{
+  if (!timings || !sim.playing || simSeconds() < sim.settleTime)
+    return;
+
+  float latency;
+  ringbuffer_forEach(timings, latestTiming, &latency, true);
+
+  sim.latencySum += latency;
+  sim.latencySq  += latency * latency;
+  sim.latencyMin  = min(sim.latencyMin, latency);
+  sim.latencyMax  = max(sim.latencyMax, latency);
+  ++sim.latencyCount;
+
+  const double ppm = (audio.playback.spiceData.ratio - 1.0) * 1e6;
+  sim.ratioSum += ppm;
+  sim.ratioSq  += ppm * ppm;
+  ++sim.ratioCount;
+}
+
+void app_alert(LG_MsgAlert type, const char * fmt, ...)
+{
+}
+
+MsgBoxHandle app_confirmMsgBox(const char * caption,
+    MsgBoxConfirmCallback callback, void * opaque, const char * fmt, ...)
+{
+  return NULL;
+}
+
+void app_msgBoxClose(MsgBoxHandle handle)
+{
+}
+
+void app_showRecord(bool show)
+{
+}
+
+bool purespice_writeAudio(void * data, size_t size, uint32_t time)
+{
+  return true;
+}
+
+static void devicePull(void)
+{
+  if (!sim.lastPeriod)
+    sim.lastPeriod = sim.period;
+
+  simUpdateQueue();
+  sim.queued += sim.period;
+
+  const int frames = sim.pullFn((uint8_t *)sim.pullBuffer, sim.period);
+  const int channels = audio.playback.channels;
+  const float threshold = SIGNAL_LEVEL / 2 / 32768.0f;
+
+  for(int i = 0; i < frames; ++i)
+  {
+    const bool silent = fabsf(sim.pullBuffer[i * channels]) < threshold;
+    if (!sim.playing)
+    {
+      // the startup silence is intentional
+      sim.playing = !silent;
+      continue;
+    }
+
+    if (silent && simSeconds() >= sim.settleTime)
+    {
+      ++sim.underrunFrames;
+      if (!sim.inUnderrun)
+        ++sim.underruns;
+    }
+    sim.inUnderrun = silent;
+  }
+}
+
+static int simulate(void)
+{
+  const int    duration     = option_get_int  ("sim", "duration"    );
+  const int    spicePeriod  = option_get_int  ("sim", "spicePeriod" );
+  const double spiceJitter  = option_get_float("sim", "spiceJitter" ) * 1e6;
+  const double spiceBurst   = option_get_float("sim", "spiceBurst"  );
+  const double drift        = option_get_float("sim", "drift"       );
+  const double deviceJitter = option_get_float("sim", "deviceJitter") * 1e6;
+  const int    periodSwitch = option_get_int  ("sim", "periodSwitch");
+
+  sim.sampleRate = option_get_int("sim", "sampleRate");
+  sim.settleTime = option_get_int("sim", "settle");
+  sim.period     = option_get_int("sim", "devicePeriod");
+  sim.maxPeriod  = max(sim.period, option_get_int("sim", "deviceMaxPeriod"));
+  sim.rate       = sim.sampleRate * (1.0 + drift * 1e-6);
+  sim.latencyMin = INFINITY;
+  sim.latencyMax = -INFINITY;
+  rngState       = (uint64_t)option_get_int("sim", "seed") * 0x9E3779B97F4A7C15ULL + 1;
+
+  g_params.audioPeriodSize      = sim.period;
+  g_params.audioBufferLatency   = option_get_int("audio", "bufferLatency");
+  g_params.audioResampleQuality = option_get_int("audio", "resampleQuality");
+
+  const int channels = 2;
+  int16_t * packet = malloc(sizeof(int16_t) * channels * spicePeriod * 2);
+  for(int i = 0; i < channels * spicePeriod * 2; ++i)
+    packet[i] = SIGNAL_LEVEL;
+
+  audio_init();
+  audio_playbackStart(channels, sim.sampleRate, PS_AUDIO_FMT_S16, 0);
+
+  const double   spiceInterval = 1e9 * spicePeriod / sim.sampleRate;
+  const uint64_t end           = (uint64_t)duration * 1000000000ULL;
+
+  int      packets      = 0;
+  uint64_t nextPacket   = 0;
+  bool     heldBack     = false;
+  uint64_t nextPull     = 0;
+  double   pullClock    = 0.0;
+  uint64_t nextSwitch   = periodSwitch ? periodSwitch * 1000000000ULL : end;
+  bool     small        = true;
+
+  while(simTime < end)
+  {
+    // SPICE packets are scheduled by the guest clock with arrival jitter
+    const bool pull = sim.running && nextPull <= nextPacket;
+    simTime = pull ? nextPull : nextPacket;
+
+    if (simTime >= nextSwitch)
+    {
+      small      = !small;
+      sim.period = small ? option_get_int("sim", "devicePeriod") : sim.maxPeriod;
+      nextSwitch += periodSwitch * 1000000000ULL;
+    }
+
+    if (pull)
+    {
+      devicePull();
+
+      /* device wakeups follow its own clock, jitter does not accumulate. The
+       * device is double buffered, it asks for the next buffer once the one
+       * before the buffer just filled has played, so a period size change
+       * takes one wakeup to affect the interval */
+      pullClock     += 1e9 * sim.lastPeriod / sim.rate;
+      sim.lastPeriod = sim.period;
+      nextPull = max(simTime + 1,
+          (uint64_t)max(0.0, pullClock + rngGauss(deviceJitter)));
+      continue;
+    }
+
+    if (!heldBack && rngUniform() < spiceBurst)
+      heldBack = true;
+    else
+    {
+      const int count = heldBack ? 2 : 1;
+      audio_playbackData((uint8_t *)packet,
+          sizeof(int16_t) * channels * spicePeriod * count);
+      heldBack = false;
+
+      // the last time the filtered latency error exceeded one SPICE period
+      if (sim.playing &&
+          fabs(audio.playback.spiceData.offsetError) >= spicePeriod)
+        sim.convergeTime = simSeconds();
+    }
+
+    ++packets;
+    nextPacket = max(simTime + 1, (uint64_t)max(0.0,
+          packets * spiceInterval + rngGauss(spiceJitter)));
+
+    if (sim.running && nextPull == 0)
+    {
+      pullClock = simTime;
+      nextPull  = simTime;
+    }
+  }
+
+  audio_free();
+  free(packet);
+  free(sim.pullBuffer);
+
+  const double latencyAvg = sim.latencySum / max(sim.latencyCount, 1);
+  const double latencyDev = sqrt(max(0.0,
+        sim.latencySq / max(sim.latencyCount, 1) - latencyAvg * latencyAvg));
+  const double ratioAvg   = sim.ratioSum / max(sim.ratioCount, 1);
+  const double ratioDev   = sqrt(max(0.0,
+        sim.ratioSq / max(sim.ratioCount, 1) - ratioAvg * ratioAvg));
+
+  fprintf(stdout,
+      "latency  avg:%7.2f ms  min:%7.2f ms  max:%7.2f ms  stddev:%6.2f ms\n"
+      "ratio    avg:%+8.1f ppm  stddev:%7.1f ppm  (drift %+.1f ppm)\n"
+      "converged after %.2f s\n"
+      "underrun events:%d  frames:%d\n",
+      latencyAvg, sim.latencyMin, sim.latencyMax, latencyDev,
+      ratioAvg, ratioDev, drift,
+      sim.convergeTime,
+      sim.underruns, sim.underrunFrames);
+
+  if (!sim.playing)
+  {
+    DEBUG_ERROR("Playback never started");
+    return -1;
+  }
+
+  if (sim.convergeTime > sim.settleTime)
+    DEBUG_WARN("Converged after the settle time, the statistics include the "
+        "startup, increase sim:settle and sim:duration");
+
+  return sim.underruns > option_get_int("sim", "maxUnderruns") ? -1 : 0;
+}
+
+int main(int argc, char * argv[])
+{
+  option_register(options);
+  if (!option_parse(argc, argv) || !option_validate())
+  {
+    option_free();
+    return -1;
+  }
+
+  const int ret = simulate();
+  option_free();
+  return ret;
+}
@@ -0,0 +1,414 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/* Records the frames and cursor updates a running host publishes to a stream
+ * file for profiler-replay. It subscribes to the queues like any other client
+ * so it may run alongside the real one. Only the damaged areas of each frame
+ * are stored, except for the first frame, the first one after a format change
+ * and the first one after a skipped frame. */
+
+#include "stream.h"
+
+#include "common/debug.h"
+#include "common/option.h"
+#include "common/KVMFR.h"
+#include "common/framebuffer.h"
+#include "common/ivshmem.h"
+#include "common/rects.h"
+#include "common/time.h"
+#include "common/util.h"
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <lgmp/client.h>
+
+struct state
+{
+  volatile bool  running;
+  struct IVSHMEM shmDev;
+  FILE         * fp;
+  uint64_t       startTime;
+
+  uint8_t      * image;
+  size_t         imageSize;
+
+  // set when a frame was skipped, the damage of the next one is not enough
+  bool           forceFull;
+
+  unsigned int   frames;
+  unsigned int   cursors;
+  uint64_t       bytes;
+};
+
+static struct state state;
+
+static struct Option options[] =
+{
+  {
+    .module         = "record",
+    .name           = "file",
+    .description    = "The file to write the stream to",
+    .shortopt       = 'o',
+    .type           = OPTION_TYPE_STRING,
+    .value.x_string = "looking-glass.lgs"
+  },
+  {
+    .module         = "record",
+    .name           = "seconds",
+    .description    = "Stop recording after this many seconds (0 = when "
+                      "interrupted)",
+    .type           = OPTION_TYPE_INT,
+    .value.x_int    = 0
+  },
+  {0}
+};
+
+static void intHandler(int sig)
+{
+  state.running = false;
+}
+
+static bool writeRecord(uint32_t type, size_t size)
+{
+  const StreamRecord record =
+  {
+    .type      = type,
+    .size      = size,
+    .timestamp = nanotime() - state.startTime
+  };
+
+  state.bytes += sizeof(record) + size;
+  return fwrite(&record, sizeof(record), 1, state.fp) == 1;
+}
+
+static bool recordFrame(PLGMPClientQueue queue, const KVMFRFrame * frame,
+    bool full)
+{
+  KVMFRFrame header = *frame;
+  if (full || state.forceFull)
+    header.damageRectsCount = 0;
+
+  FrameDamageRect rects[KVMFR_MAX_DAMAGE_RECTS];
+  int bpp;
+  const int count = stream_frameRects(&header, rects, &bpp);
+
+  const size_t frameSize = (size_t)header.dataHeight * header.pitch;
+  if (frameSize > state.shmDev.size)
+  {
+    DEBUG_ERROR("Invalid frame size");
+    lgmpClientMessageDone(queue);
+    return false;
+  }
+
+  if (frameSize > state.imageSize)
+  {
+    free(state.image);
+    state.image = malloc(frameSize);
+    if (!state.image)
+    {
+      DEBUG_ERROR("out of memory");
+      state.imageSize = 0;
+      lgmpClientMessageDone(queue);
+      return false;
+    }
+    state.imageSize = frameSize;
+  }
+
+  // take a copy so the host can reuse the buffer before it is written out
+  const FrameBuffer * fb =
+    (const FrameBuffer *)((const uint8_t *)frame + frame->offset);
+  bool ok;
+  if (count)
+  {
+    // the rect copy does not report a timeout, so wait for the data first
+    ok = framebuffer_wait(fb, frameSize);
+    if (ok)
+      rectsFramebufferToBuffer(rects, count, bpp, state.image, header.pitch,
+          header.dataHeight, fb, header.pitch);
+  }
+  else
+    ok = framebuffer_read_linear(fb, state.image, frameSize);
+
+  lgmpClientMessageDone(queue);
+
+  if (!ok)
+  {
+    DEBUG_WARN("Timed out reading the frame, skipped");
+    state.forceFull = true;
+    return true;
+  }
+
+  const size_t dataSize = stream_frameDataSize(&header, rects, count, bpp);
+  if (!writeRecord(STREAM_RECORD_FRAME, sizeof(header) + dataSize) ||
+      fwrite(&header, sizeof(header), 1, state.fp) != 1)
+    goto err_write;
+
+  if (count)
+  {
+    if (!stream_writeRects(state.fp, state.image, header.pitch, rects, count,
+          bpp))
+      goto err_write;
+  }
+  else if (fwrite(state.image, frameSize, 1, state.fp) != 1)
+    goto err_write;
+
+  state.forceFull = false;
+  ++state.frames;
+  return true;
+
+err_write:
+  DEBUG_ERROR("Failed to write the frame to the stream");
+  return false;
+}
+
+static bool recordCursor(uint32_t flags, const KVMFRCursor * cursor)
+{
+  const size_t shapeSize =
+    flags & CURSOR_FLAG_SHAPE ? cursor->height * cursor->pitch : 0;
+
+  if (!writeRecord(STREAM_RECORD_CURSOR,
+        sizeof(flags) + sizeof(*cursor) + shapeSize) ||
+      fwrite(&flags , sizeof(flags)  , 1, state.fp) != 1 ||
+      fwrite(cursor , sizeof(*cursor), 1, state.fp) != 1 ||
+      (shapeSize && fwrite(cursor + 1, shapeSize, 1, state.fp) != 1))
+  {
+    DEBUG_ERROR("Failed to write the cursor to the stream");
+    return false;
+  }
+
+  ++state.cursors;
+  return true;
+}
+
+static bool subscribe(PLGMPClient lgmp, uint32_t queueID,
+    PLGMPClientQueue * queue)
+{
+  LGMP_STATUS status;
+  while(state.running)
+  {
+    if ((status = lgmpClientSubscribe(lgmp, queueID, queue)) == LGMP_OK)
+      return true;
+
+    if (status != LGMP_ERR_NO_SUCH_QUEUE)
+    {
+      DEBUG_ERROR("lgmpClientSubscribe: %s", lgmpStatusString(status));
+      return false;
+    }
+
+    usleep(1000);
+  }
+  return false;
+}
+
+static int record(void)
+{
+  PLGMPClient      lgmp;
+  PLGMPClientQueue frameQueue   = NULL;
+  PLGMPClientQueue pointerQueue = NULL;
+  int              ret          = -1;
+
+  LGMP_STATUS status;
+  if ((status = lgmpClientInit(state.shmDev.mem, state.shmDev.size, &lgmp))
+      != LGMP_OK)
+  {
+    DEBUG_ERROR("lgmpClientInit: %s", lgmpStatusString(status));
+    return -1;
+  }
+
+  uint32_t udataSize;
+  KVMFR  * udata;
+  bool     waiting = false;
+  while(state.running)
+  {
+    status = lgmpClientSessionInit(lgmp, &udataSize, (uint8_t **)&udata, NULL);
+    if (status == LGMP_OK)
+      break;
+
+    if (status != LGMP_ERR_INVALID_SESSION && status != LGMP_ERR_INVALID_MAGIC)
+    {
+      DEBUG_ERROR("lgmpClientSessionInit: %s", lgmpStatusString(status));
+      goto out;
+    }
+
+    if (!waiting)
+      DEBUG_INFO("Waiting for the host application to start...");
+    waiting = true;
+    usleep(100000);
+  }
+
+  if (!state.running)
+    goto out;
+
+  if (udataSize < sizeof(KVMFR) ||
+      memcmp(udata->magic, KVMFR_MAGIC, sizeof(udata->magic)) != 0 ||
+      udata->version != KVMFR_VERSION)
+  {
+    DEBUG_ERROR("The host application is not compatible with this recorder");
+    DEBUG_ERROR("Expected KVMFR version %d", KVMFR_VERSION);
+    goto out;
+  }
+
+  const StreamHeader header =
+  {
+    .magic        = STREAM_MAGIC,
+    .version      = STREAM_VERSION,
+    .kvmfrVersion = KVMFR_VERSION,
+    .udataSize    = udataSize
+  };
+
+  if (fwrite(&header, sizeof(header), 1, state.fp) != 1 ||
+      fwrite(udata, udataSize, 1, state.fp) != 1)
+  {
+    DEBUG_ERROR("Failed to write the stream header");
+    goto out;
+  }
+
+  if (!subscribe(lgmp, LGMP_Q_FRAME  , &frameQueue  ) ||
+      !subscribe(lgmp, LGMP_Q_POINTER, &pointerQueue))
+    goto out;
+
+  DEBUG_INFO("Recording, press ^C to stop");
+
+  const uint64_t duration =
+    (uint64_t)option_get_int("record", "seconds") * 1000000000ULL;
+
+  uint32_t frameSerial = 0;
+  uint32_t formatVer   = 0;
+  bool     haveFormat  = false;
+
+  state.startTime = nanotime();
+  while(state.running)
+  {
+    if (duration && nanotime() - state.startTime >= duration)
+      break;
+
+    bool idle = true;
+    LGMPMessage msg;
+
+    if ((status = lgmpClientProcess(pointerQueue, &msg)) == LGMP_OK)
+    {
+      idle = false;
+      const bool ok = recordCursor(msg.udata, (const KVMFRCursor *)msg.mem);
+      lgmpClientMessageDone(pointerQueue);
+      if (!ok)
+        goto out;
+    }
+    else if (status != LGMP_ERR_QUEUE_EMPTY)
+      goto err_process;
+
+    if ((status = lgmpClientProcess(frameQueue, &msg)) == LGMP_OK)
+    {
+      idle = false;
+      const KVMFRFrame * frame = (const KVMFRFrame *)msg.mem;
+
+      // the host repeats the last frame to new clients, skip it like they do
+      if (haveFormat && frame->frameSerial == frameSerial)
+        lgmpClientMessageDone(frameQueue);
+      else
+      {
+        const bool full = !haveFormat || frame->formatVer != formatVer;
+        frameSerial = frame->frameSerial;
+        formatVer   = frame->formatVer;
+        haveFormat  = true;
+
+        if (!recordFrame(frameQueue, frame, full))
+          goto out;
+      }
+    }
+    else if (status != LGMP_ERR_QUEUE_EMPTY)
+      goto err_process;
+
+    if (idle)
+      usleep(100);
+  }
+
+  ret = 0;
+  goto out;
+
+err_process:
+  if (status == LGMP_ERR_INVALID_SESSION)
+  {
+    DEBUG_WARN("The host restarted, recording stopped");
+    ret = 0;
+  }
+  else
+    DEBUG_ERROR("lgmpClientProcess: %s", lgmpStatusString(status));
+
+out:
+  if (state.startTime)
+  {
+    const double seconds = (nanotime() - state.startTime) * 1e-9;
+    fprintf(stdout,
+        "recorded %u frames and %u cursor updates in %.2f s, "
+        "%.2f MiB (%.2f MiB/s)\n",
+        state.frames, state.cursors, seconds,
+        state.bytes / 1048576.0, state.bytes / 1048576.0 / seconds);
+  }
+
+  lgmpClientUnsubscribe(&pointerQueue);
+  lgmpClientUnsubscribe(&frameQueue);
+  lgmpClientFree(&lgmp);
+  return ret;
+}
+
+int main(int argc, char * argv[])
+{
+  DEBUG_INFO("Looking Glass (" BUILD_VERSION ") - Frame Recorder");
+
+  option_register(options);
+  ivshmemOptionsInit();
+
+  if (!option_parse(argc, argv) || !option_validate())
+  {
+    option_free();
+    return -1;
+  }
+
+  const char * file = option_get_string("record", "file");
+  state.fp = fopen(file, "wb");
+  if (!state.fp)
+  {
+    DEBUG_ERROR("Failed to open %s for writing", file);
+    option_free();
+    return -1;
+  }
+
+  signal(SIGINT , intHandler);
+  signal(SIGTERM, intHandler);
+  state.running = true;
+
+  int ret = -1;
+  if (ivshmemOpen(&state.shmDev))
+    ret = record();
+
+  if (fclose(state.fp) != 0)
+  {
+    DEBUG_ERROR("Failed to write %s", file);
+    ret = -1;
+  }
+
+  free(state.image);
+  ivshmemClose(&state.shmDev);
+  option_free();
+  return ret;
+}
@@ -0,0 +1,621 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/* Plays a stream written by profiler-record back into the shared memory file
+ * in place of the host application, so the client can be profiled against the
+ * exact same sequence of frames and cursor updates every run. The LGMP setup
+ * mirrors the host's, see lgmpSetup in host/src/app.c. */
+
+#include "stream.h"
+
+#include "common/debug.h"
+#include "common/option.h"
+#include "common/KVMFR.h"
+#include "common/framebuffer.h"
+#include "common/ivshmem.h"
+#include "common/rects.h"
+#include "common/sysinfo.h"
+#include "common/time.h"
+#include "common/util.h"
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <lgmp/host.h>
+
+#define POINTER_SHAPE_BUFFERS 3
+#define MAX_POINTER_SIZE (sizeof(KVMFRCursor) + (512 * 512 * 4))
+
+static const struct LGMPQueueConfig FRAME_QUEUE_CONFIG =
+{
+  .queueID     = LGMP_Q_FRAME,
+  .numMessages = LGMP_Q_FRAME_LEN,
+  .subTimeout  = 1000
+};
+
+static const struct LGMPQueueConfig POINTER_QUEUE_CONFIG =
+{
+  .queueID     = LGMP_Q_POINTER,
+  .numMessages = LGMP_Q_POINTER_LEN,
+  .subTimeout  = 1000
+};
+
+struct state
+{
+  volatile bool  running;
+  struct IVSHMEM shmDev;
+  FILE         * fp;
+  long           dataStart;
+
+  PLGMPHost      lgmp;
+  PLGMPHostQueue frameQueue;
+  PLGMPHostQueue pointerQueue;
+  LGTimer      * lgmpTimer;
+
+  PLGMPMemory    frameMemory[LGMP_Q_FRAME_LEN];
+  KVMFRFrame   * frame      [LGMP_Q_FRAME_LEN];
+  FrameBuffer  * frameBuffer[LGMP_Q_FRAME_LEN];
+  unsigned int   frameIndex;
+  uint32_t       frameSerial;
+  uint32_t       formatVer;
+  unsigned int   alignSize;
+  size_t         maxFrameSize;
+
+  /* the damage since each frame buffer was last written, -1 is the entire
+   * frame */
+  FrameDamageRect damage[LGMP_Q_FRAME_LEN][KVMFR_MAX_DAMAGE_RECTS];
+  int             damageCount[LGMP_Q_FRAME_LEN];
+
+  PLGMPMemory    pointerMemory     [LGMP_Q_POINTER_LEN   ];
+  PLGMPMemory    pointerShapeMemory[POINTER_SHAPE_BUFFERS];
+  unsigned int   pointerIndex;
+  unsigned int   pointerShapeIndex;
+
+  uint8_t      * image;
+  size_t         imageSize;
+
+  unsigned int   frames;
+  unsigned int   cursors;
+  unsigned int   stalls;
+};
+
+static struct state state;
+
+static struct Option options[] =
+{
+  {
+    .module         = "replay",
+    .name           = "file",
+    .description    = "The stream to play back",
+    .shortopt       = 'i',
+    .type           = OPTION_TYPE_STRING,
+    .value.x_string = "looking-glass.lgs"
+  },
+  {
+    .module         = "replay",
+    .name           = "speed",
+    .description    = "The playback speed multiplier (0 = as fast as the "
+                      "client accepts frames)",
+    .type           = OPTION_TYPE_FLOAT,
+    .value.x_float  = 1.0f
+  },
+  {
+    .module         = "replay",
+    .name           = "loop",
+    .description    = "Play the stream back until interrupted",
+    .type           = OPTION_TYPE_BOOL,
+    .value.x_bool   = false
+  },
+  {0}
+};
+
+static void intHandler(int sig)
+{
+  state.running = false;
+}
+
+static bool lgmpTimer(void * opaque)
+{
+  LGMP_STATUS status;
+  if ((status = lgmpHostProcess(state.lgmp)) != LGMP_OK)
+  {
+    DEBUG_ERROR("lgmpHostProcess Failed: %s", lgmpStatusString(status));
+    state.running = false;
+    return false;
+  }
+
+  // there is no guest to move the cursor for, discard the requests
+  uint8_t data[LGMP_MSGS_SIZE];
+  size_t size;
+  while(lgmpHostReadData(state.pointerQueue, &data, &size) == LGMP_OK)
+    lgmpHostAckData(state.pointerQueue);
+
+  return true;
+}
+
+static bool lgmpSetup(const void * udata, uint32_t udataSize)
+{
+  LGMP_STATUS status;
+  if ((status = lgmpHostInit(state.shmDev.mem, state.shmDev.size, &state.lgmp,
+          udataSize, (uint8_t *)udata)) != LGMP_OK)
+  {
+    DEBUG_ERROR("lgmpHostInit Failed: %s", lgmpStatusString(status));
+    return false;
+  }
+
+  if ((status = lgmpHostQueueNew(state.lgmp, FRAME_QUEUE_CONFIG,
+          &state.frameQueue)) != LGMP_OK)
+  {
+    DEBUG_ERROR("lgmpHostQueueNew Failed (Frame): %s",
+        lgmpStatusString(status));
+    return false;
+  }
+
+  if ((status = lgmpHostQueueNew(state.lgmp, POINTER_QUEUE_CONFIG,
+          &state.pointerQueue)) != LGMP_OK)
+  {
+    DEBUG_ERROR("lgmpHostQueueNew Failed (Pointer): %s",
+        lgmpStatusString(status));
+    return false;
+  }
+
+  for(int i = 0; i < LGMP_Q_POINTER_LEN; ++i)
+  {
+    if ((status = lgmpHostMemAlloc(state.lgmp, sizeof(KVMFRCursor),
+            &state.pointerMemory[i])) != LGMP_OK)
+    {
+      DEBUG_ERROR("lgmpHostMemAlloc Failed (Pointer): %s",
+          lgmpStatusString(status));
+      return false;
+    }
+    memset(lgmpHostMemPtr(state.pointerMemory[i]), 0, sizeof(KVMFRCursor));
+  }
+
+  for(int i = 0; i < POINTER_SHAPE_BUFFERS; ++i)
+  {
+    if ((status = lgmpHostMemAlloc(state.lgmp, MAX_POINTER_SIZE,
+            &state.pointerShapeMemory[i])) != LGMP_OK)
+    {
+      DEBUG_ERROR("lgmpHostMemAlloc Failed (Pointer Shapes): %s",
+          lgmpStatusString(status));
+      return false;
+    }
+    memset(lgmpHostMemPtr(state.pointerShapeMemory[i]), 0, MAX_POINTER_SIZE);
+  }
+
+  state.maxFrameSize = lgmpHostMemAvail(state.lgmp);
+  state.maxFrameSize = (state.maxFrameSize - (state.alignSize - 1)) &
+    ~(state.alignSize - 1);
+  state.maxFrameSize /= LGMP_Q_FRAME_LEN;
+  DEBUG_INFO("Max Frame Size   : %u MiB",
+      (unsigned int)(state.maxFrameSize / 1048576LL));
+
+  for(int i = 0; i < LGMP_Q_FRAME_LEN; ++i)
+  {
+    if ((status = lgmpHostMemAllocAligned(state.lgmp, state.maxFrameSize,
+            state.alignSize, &state.frameMemory[i])) != LGMP_OK)
+    {
+      DEBUG_ERROR("lgmpHostMemAlloc Failed (Frame): %s",
+          lgmpStatusString(status));
+      return false;
+    }
+
+    state.frame[i] = lgmpHostMemPtr(state.frameMemory[i]);
+
+    // the same layout as the host so the client takes the same DMA path
+    const unsigned alignOffset = state.alignSize - sizeof(FrameBuffer);
+    state.frame[i]->offset = alignOffset;
+    state.frameBuffer[i] =
+      (FrameBuffer *)(((uint8_t *)state.frame[i]) + alignOffset);
+  }
+
+  if (!lgCreateTimer(10, lgmpTimer, NULL, &state.lgmpTimer))
+  {
+    DEBUG_ERROR("Failed to create the LGMP timer");
+    return false;
+  }
+
+  return true;
+}
+
+static void lgmpShutdown(void)
+{
+  if (state.lgmpTimer)
+    lgTimerDestroy(state.lgmpTimer);
+
+  for(int i = 0; i < LGMP_Q_FRAME_LEN; ++i)
+    lgmpHostMemFree(&state.frameMemory[i]);
+  for(int i = 0; i < LGMP_Q_POINTER_LEN; ++i)
+    lgmpHostMemFree(&state.pointerMemory[i]);
+  for(int i = 0; i < POINTER_SHAPE_BUFFERS; ++i)
+    lgmpHostMemFree(&state.pointerShapeMemory[i]);
+  lgmpHostFree(&state.lgmp);
+}
+
+static bool ensureSize(uint8_t ** buffer, size_t * size, size_t required)
+{
+  if (required <= *size)
+    return true;
+
+  free(*buffer);
+  *buffer = malloc(required);
+  if (!*buffer)
+  {
+    DEBUG_ERROR("out of memory");
+    *size = 0;
+    return false;
+  }
+
+  *size = required;
+  return true;
+}
+
+static bool replayFrame(const StreamRecord * record)
+{
+  KVMFRFrame header;
+  if (record->size < sizeof(header) ||
+      fread(&header, sizeof(header), 1, state.fp) != 1)
+    goto err_read;
+
+  FrameDamageRect rects[KVMFR_MAX_DAMAGE_RECTS];
+  int bpp = 0;
+  const int count = stream_frameRects(&header, rects, &bpp);
+
+  const size_t frameSize = (size_t)header.dataHeight * header.pitch;
+  if (record->size != sizeof(header) +
+        stream_frameDataSize(&header, rects, count, bpp))
+    goto err_read;
+
+  if (header.formatVer != state.formatVer)
+  {
+    for(int i = 0; i < LGMP_Q_FRAME_LEN; ++i)
+      state.damageCount[i] = -1;
+    state.formatVer = header.formatVer;
+  }
+
+  if (!ensureSize(&state.image, &state.imageSize, frameSize))
+    return false;
+
+  if (count)
+  {
+    if (!stream_readRects(state.fp, state.image, header.pitch, rects, count,
+          bpp))
+      goto err_read;
+  }
+  else if (fread(state.image, frameSize, 1, state.fp) != 1)
+    goto err_read;
+
+  if (frameSize + state.alignSize > state.maxFrameSize)
+  {
+    DEBUG_ERROR("The frame is too large for the shared memory, %u MiB "
+        "required", (unsigned int)((frameSize + state.alignSize) / 1048576LL));
+    return false;
+  }
+
+  // wait for the client to release a buffer, as the host does
+  if (lgmpHostQueuePending(state.frameQueue) == LGMP_Q_FRAME_LEN)
+  {
+    ++state.stalls;
+    while(state.running &&
+        lgmpHostQueuePending(state.frameQueue) == LGMP_Q_FRAME_LEN)
+      usleep(1);
+
+    if (!state.running)
+      return true;
+  }
+
+  for(int i = 0; i < LGMP_Q_FRAME_LEN; ++i)
+    state.damageCount[i] = rectsAccumulate(state.damage[i],
+        state.damageCount[i], KVMFR_MAX_DAMAGE_RECTS, rects,
+        count ? count : -1, header.dataWidth, header.dataHeight);
+
+  const unsigned int index = state.frameIndex;
+  if (++state.frameIndex == LGMP_Q_FRAME_LEN)
+    state.frameIndex = 0;
+
+  KVMFRFrame  * frame = state.frame[index];
+  FrameBuffer * fb    = state.frameBuffer[index];
+
+  header.offset      = frame->offset;
+  header.frameSerial = ++state.frameSerial;
+  memcpy(frame, &header, sizeof(header));
+
+  framebuffer_prepare(fb);
+
+  LGMP_STATUS status;
+  if ((status = lgmpHostQueuePost(state.frameQueue, 0,
+          state.frameMemory[index])) != LGMP_OK)
+  {
+    DEBUG_ERROR("lgmpHostQueuePost Failed (Frame): %s",
+        lgmpStatusString(status));
+    return false;
+  }
+
+  /* only what changed since this buffer was last used needs writing, the
+   * client may be reading from it already */
+  if (state.damageCount[index] < 0)
+    framebuffer_write(fb, state.image, frameSize);
+  else
+    rectsBufferToFramebuffer(state.damage[index], state.damageCount[index],
+        bpp, fb, header.pitch, header.dataHeight, state.image, header.pitch);
+  state.damageCount[index] = 0;
+
+  ++state.frames;
+  return true;
+
+err_read:
+  DEBUG_ERROR("The stream is truncated or corrupt");
+  return false;
+}
+
+static bool replayCursor(const StreamRecord * record)
+{
+  uint32_t flags;
+  KVMFRCursor cursor;
+
+  if (record->size < sizeof(flags) + sizeof(cursor) ||
+      fread(&flags , sizeof(flags) , 1, state.fp) != 1 ||
+      fread(&cursor, sizeof(cursor), 1, state.fp) != 1)
+    goto err_read;
+
+  const size_t shapeSize = record->size - sizeof(flags) - sizeof(cursor);
+  PLGMPMemory mem;
+  if (flags & CURSOR_FLAG_SHAPE)
+  {
+    if (shapeSize > MAX_POINTER_SIZE - sizeof(cursor))
+    {
+      DEBUG_ERROR("The cursor shape is too large");
+      return false;
+    }
+
+    mem = state.pointerShapeMemory[state.pointerShapeIndex];
+    if (++state.pointerShapeIndex == POINTER_SHAPE_BUFFERS)
+      state.pointerShapeIndex = 0;
+  }
+  else
+  {
+    if (shapeSize)
+      goto err_read;
+
+    mem = state.pointerMemory[state.pointerIndex];
+    if (++state.pointerIndex == LGMP_Q_POINTER_LEN)
+      state.pointerIndex = 0;
+  }
+
+  KVMFRCursor * dst = lgmpHostMemPtr(mem);
+  memcpy(dst, &cursor, sizeof(cursor));
+  if (shapeSize && fread(dst + 1, shapeSize, 1, state.fp) != 1)
+    goto err_read;
+
+  LGMP_STATUS status;
+  while((status = lgmpHostQueuePost(state.pointerQueue, flags, mem))
+      != LGMP_OK)
+  {
+    if (status != LGMP_ERR_QUEUE_FULL)
+    {
+      DEBUG_ERROR("lgmpHostQueuePost Failed (Pointer): %s",
+          lgmpStatusString(status));
+      return false;
+    }
+
+    if (!state.running)
+      return true;
+
+    usleep(1);
+  }
+
+  ++state.cursors;
+  return true;
+
+err_read:
+  DEBUG_ERROR("The stream is truncated or corrupt");
+  return false;
+}
+
+static bool replay(void)
+{
+  const float speed = option_get_float("replay", "speed");
+  const bool  loop  = option_get_bool ("replay", "loop" );
+
+  DEBUG_INFO("Waiting for the client to connect...");
+  while(state.running && !lgmpHostQueueHasSubs(state.frameQueue))
+    usleep(1000);
+
+  if (!state.running)
+    return true;
+
+  DEBUG_INFO("Playing back, press ^C to stop");
+
+  for(int i = 0; i < LGMP_Q_FRAME_LEN; ++i)
+    state.damageCount[i] = -1;
+
+  const uint64_t start     = nanotime();
+  uint64_t       loopStart = start;
+  uint64_t       firstTs   = 0;
+  bool           first     = true;
+  bool           ok        = true;
+
+  while(state.running)
+  {
+    StreamRecord record;
+    if (fread(&record, sizeof(record), 1, state.fp) != 1)
+    {
+      if (ferror(state.fp))
+      {
+        DEBUG_ERROR("Failed to read the stream");
+        ok = false;
+        break;
+      }
+
+      if (!loop)
+        break;
+
+      if (fseek(state.fp, state.dataStart, SEEK_SET) != 0)
+      {
+        DEBUG_ERROR("Failed to rewind the stream");
+        ok = false;
+        break;
+      }
+
+      loopStart = nanotime();
+      first     = true;
+      continue;
+    }
+
+    if (first)
+    {
+      firstTs = record.timestamp;
+      first   = false;
+    }
+
+    if (speed > 0.0f)
+    {
+      const uint64_t target = loopStart +
+        (uint64_t)((record.timestamp - firstTs) / speed);
+      const uint64_t now = nanotime();
+      if (target > now)
+        nsleep(target - now);
+    }
+
+    switch(record.type)
+    {
+      case STREAM_RECORD_FRAME:
+        ok = replayFrame(&record);
+        break;
+
+      case STREAM_RECORD_CURSOR:
+        ok = replayCursor(&record);
+        break;
+
+      default:
+        // skip records added by later versions
+        ok = fseek(state.fp, record.size, SEEK_CUR) == 0;
+        break;
+    }
+
+    if (!ok)
+      break;
+  }
+
+  const double seconds = (nanotime() - start) * 1e-9;
+  fprintf(stdout,
+      "played %u frames (%.2f fps) and %u cursor updates in %.2f s, "
+      "waited on the client %u times\n",
+      state.frames, state.frames / seconds, state.cursors, seconds,
+      state.stalls);
+
+  return ok;
+}
+
+static bool readHeader(void ** udata, uint32_t * udataSize)
+{
+  StreamHeader header;
+  if (fread(&header, sizeof(header), 1, state.fp) != 1 ||
+      memcmp(header.magic, STREAM_MAGIC, sizeof(header.magic)) != 0)
+  {
+    DEBUG_ERROR("Not a Looking Glass stream");
+    return false;
+  }
+
+  if (header.version != STREAM_VERSION)
+  {
+    DEBUG_ERROR("Unsupported stream version %u, expected %u",
+        header.version, STREAM_VERSION);
+    return false;
+  }
+
+  if (header.kvmfrVersion != KVMFR_VERSION)
+  {
+    DEBUG_ERROR("The stream was recorded with KVMFR version %u, expected %u",
+        header.kvmfrVersion, KVMFR_VERSION);
+    return false;
+  }
+
+  *udata = malloc(header.udataSize);
+  if (!*udata)
+  {
+    DEBUG_ERROR("out of memory");
+    return false;
+  }
+
+  if (fread(*udata, header.udataSize, 1, state.fp) != 1)
+  {
+    DEBUG_ERROR("The stream is truncated");
+    free(*udata);
+    return false;
+  }
+
+  *udataSize      = header.udataSize;
+  state.dataStart = ftell(state.fp);
+  return true;
+}
+
+int main(int argc, char * argv[])
+{
+  DEBUG_INFO("Looking Glass (" BUILD_VERSION ") - Frame Replay");
+
+  option_register(options);
+  ivshmemOptionsInit();
+
+  if (!option_parse(argc, argv) || !option_validate())
+  {
+    option_free();
+    return -1;
+  }
+
+  const char * file = option_get_string("replay", "file");
+  state.fp = fopen(file, "rb");
+  if (!state.fp)
+  {
+    DEBUG_ERROR("Failed to open %s", file);
+    option_free();
+    return -1;
+  }
+
+  int        ret = -1;
+  void     * udata;
+  uint32_t   udataSize;
+  if (!readHeader(&udata, &udataSize))
+    goto out_file;
+
+  if (!ivshmemOpen(&state.shmDev))
+    goto out_udata;
+
+  signal(SIGINT , intHandler);
+  signal(SIGTERM, intHandler);
+  state.running   = true;
+  state.alignSize = sysinfo_getPageSize();
+
+  if (lgmpSetup(udata, udataSize) && replay())
+    ret = 0;
+
+  lgmpShutdown();
+  ivshmemClose(&state.shmDev);
+
+out_udata:
+  free(udata);
+out_file:
+  free(state.image);
+  fclose(state.fp);
+  option_free();
+  return ret;
+}
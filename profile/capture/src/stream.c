@@ -0,0 +1,112 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "stream.h"
+
+#include "common/util.h"
+
+int stream_frameRects(const KVMFRFrame * frame, FrameDamageRect * rects,
+    int * bpp)
+{
+  switch(frame->type)
+  {
+    case FRAME_TYPE_BGRA:
+    case FRAME_TYPE_RGBA:
+    case FRAME_TYPE_RGBA10:
+    case FRAME_TYPE_BGR_32:
+      *bpp = 4;
+      break;
+
+    case FRAME_TYPE_RGBA16F:
+      *bpp = 8;
+      break;
+
+    default:
+      // the packed 24-bit rows do not map onto the damage rects
+      return 0;
+  }
+
+  const int damageCount =
+    min(frame->damageRectsCount, (uint32_t)KVMFR_MAX_DAMAGE_RECTS);
+
+  int count = 0;
+  for(int i = 0; i < damageCount; ++i)
+  {
+    FrameDamageRect rect = frame->damageRects[i];
+
+    // the damage is in frame pixels which are packed, as done by the host
+    if (frame->type == FRAME_TYPE_BGR_32)
+    {
+      const uint32_t x = rect.x * 3 / 4;
+      rect.width = ((rect.x + rect.width) * 3 + 3) / 4 - x;
+      rect.x     = x;
+    }
+
+    if (rect.x >= frame->dataWidth || rect.y >= frame->dataHeight)
+      continue;
+
+    rect.width  = min(rect.width , frame->dataWidth  - rect.x);
+    rect.height = min(rect.height, frame->dataHeight - rect.y);
+    if (rect.width && rect.height)
+      rects[count++] = rect;
+  }
+
+  return count;
+}
+
+size_t stream_frameDataSize(const KVMFRFrame * frame,
+    const FrameDamageRect * rects, int count, int bpp)
+{
+  if (!count)
+    return (size_t)frame->dataHeight * frame->pitch;
+
+  size_t size = 0;
+  for(int i = 0; i < count; ++i)
+    size += (size_t)rects[i].width * rects[i].height * bpp;
+  return size;
+}
+
+bool stream_writeRects(FILE * fp, const uint8_t * image, unsigned int pitch,
+    const FrameDamageRect * rects, int count, int bpp)
+{
+  for(int i = 0; i < count; ++i)
+  {
+    const FrameDamageRect * rect = rects + i;
+    const uint8_t * src = image + rect->y * pitch + rect->x * bpp;
+    for(uint32_t y = 0; y < rect->height; ++y, src += pitch)
+      if (fwrite(src, bpp, rect->width, fp) != rect->width)
+        return false;
+  }
+  return true;
+}
+
+bool stream_readRects(FILE * fp, uint8_t * image, unsigned int pitch,
+    const FrameDamageRect * rects, int count, int bpp)
+{
+  for(int i = 0; i < count; ++i)
+  {
+    const FrameDamageRect * rect = rects + i;
+    uint8_t * dst = image + rect->y * pitch + rect->x * bpp;
+    for(uint32_t y = 0; y < rect->height; ++y, dst += pitch)
+      if (fread(dst, bpp, rect->width, fp) != rect->width)
+        return false;
+  }
+  return true;
+}
@@ -0,0 +1,87 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _H_LG_PROFILE_STREAM_
+#define _H_LG_PROFILE_STREAM_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "common/KVMFR.h"
+
+/* The stream written by profiler-record and played back by profiler-replay.
+ *
+ * It starts with a StreamHeader and the KVMFR user data the host published,
+ * followed by records, each a StreamRecord and then its payload:
+ *
+ *   STREAM_RECORD_FRAME  : the KVMFRFrame, then the pixel data of the rects
+ *                          given by stream_frameRects row by row, or the whole
+ *                          dataHeight * pitch bytes when there are none
+ *   STREAM_RECORD_CURSOR : the KVMFRCursorFlags and KVMFRCursor, then
+ *                          height * pitch bytes of shape with CURSOR_FLAG_SHAPE
+ *
+ * Values are stored in host byte order. */
+
+#define STREAM_MAGIC   "LGSTREAM"
+#define STREAM_VERSION 1
+
+typedef struct StreamHeader
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t kvmfrVersion;
+  uint32_t udataSize;
+}
+StreamHeader;
+
+enum
+{
+  STREAM_RECORD_FRAME = 1,
+  STREAM_RECORD_CURSOR
+};
+
+typedef struct StreamRecord
+{
+  uint32_t type;
+  uint32_t size;      // payload size in bytes
+  uint64_t timestamp; // ns since the start of the recording
+}
+StreamRecord;
+
+/* Converts the damage of the frame into rects in the packed frame data and
+ * returns their count along with the bytes per pixel of the data. Returns 0 if
+ * the whole frame is damaged or the damage can not be expressed this way. */
+int stream_frameRects(const KVMFRFrame * frame, FrameDamageRect * rects,
+    int * bpp);
+
+/* The size of the pixel data stored for a frame with the rects returned by
+ * stream_frameRects */
+size_t stream_frameDataSize(const KVMFRFrame * frame,
+    const FrameDamageRect * rects, int count, int bpp);
+
+/* Copies the rects between the packed frame image and the stream */
+bool stream_writeRects(FILE * fp, const uint8_t * image, unsigned int pitch,
+    const FrameDamageRect * rects, int count, int bpp);
+bool stream_readRects(FILE * fp, uint8_t * image, unsigned int pitch,
+    const FrameDamageRect * rects, int count, int bpp);
+
+#endif
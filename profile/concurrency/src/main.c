@@ -0,0 +1,484 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common/debug.h"
+#include "common/epoch.h"
+#include "common/ilist.h"
+#include "common/ll.h"
+#include "common/mpsc.h"
+#include "common/spsc.h"
+#include "common/thread.h"
+#include "common/time.h"
+#include "common/version.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Stress tests the lock-free primitives in common from several threads at
+ * once, verifying that nothing is lost, duplicated or reordered and that the
+ * epoch domain never frees an object a reader can still see, then reports
+ * their throughput next to the spinlocked ll they are used in place of. Build
+ * with -fsanitize=thread to have the data races checked as well. */
+
+#define PRODUCERS     4
+#define MPSC_ITEMS    (1000000 / PRODUCERS)
+#define SPSC_ITEMS    10000000
+#define SPSC_LENGTH   1024
+#define READERS       4
+#define EPOCH_UPDATES 1000000
+#define EPOCH_HOLD    16
+
+static atomic_bool start;
+
+static void waitStart(void)
+{
+  while(!atomic_load_explicit(&start, memory_order_acquire)) {}
+}
+
+static void report(const char * name, uint64_t ops, uint64_t time)
+{
+  fprintf(stdout, "%-24s %10.2f ms %8.2f Mops/s\n",
+      name, time / 1e6, ops * 1e3 / time);
+}
+
+/* MPSC, every producer pushes its own sequence and the consumer checks that
+ * each sequence arrives complete and in order */
+
+struct Item
+{
+  struct mpsc_node node;
+  uint32_t         producer;
+  uint32_t         seq;
+};
+
+struct Producer
+{
+  struct Item * items;
+  struct mpsc * queue;
+  struct ll   * list;
+};
+
+static int mpscProducer(void * opaque)
+{
+  struct Producer * p = opaque;
+  waitStart();
+
+  for(uint32_t i = 0; i < MPSC_ITEMS; ++i)
+  {
+    struct Item * item = p->items + i;
+    if (p->queue)
+      mpsc_push(p->queue, &item->node);
+    else
+      ll_push(p->list, item);
+  }
+
+  return 0;
+}
+
+static bool runMPSC(bool useLL)
+{
+  struct Item   * items = malloc(sizeof(*items) * PRODUCERS * MPSC_ITEMS);
+  struct mpsc     queue;
+  struct ll     * list  = NULL;
+  struct Producer producers[PRODUCERS];
+  LGThread      * threads  [PRODUCERS];
+  uint32_t        next     [PRODUCERS] = { 0 };
+  bool            ok = true;
+
+  if (!items)
+  {
+    DEBUG_ERROR("out of memory");
+    return false;
+  }
+
+  if (useLL)
+    list = ll_new();
+  else
+    mpsc_init(&queue);
+
+  atomic_store(&start, false);
+  for(int i = 0; i < PRODUCERS; ++i)
+  {
+    producers[i] = (struct Producer)
+    {
+      .items = items + i * MPSC_ITEMS,
+      .queue = useLL ? NULL : &queue,
+      .list  = list
+    };
+
+    for(uint32_t n = 0; n < MPSC_ITEMS; ++n)
+    {
+      producers[i].items[n].producer = i;
+      producers[i].items[n].seq      = n;
+    }
+
+    if (!lgCreateThread("mpscProducer", mpscProducer, producers + i,
+          threads + i))
+      DEBUG_FATAL("Failed to create the producer thread");
+  }
+
+  const uint64_t startTime = nanotime();
+  atomic_store_explicit(&start, true, memory_order_release);
+
+  for(uint64_t received = 0; received < PRODUCERS * MPSC_ITEMS; )
+  {
+    struct Item * item;
+    if (useLL)
+    {
+      void * data;
+      if (!ll_shift(list, &data))
+        continue;
+      item = data;
+    }
+    else
+    {
+      // NULL is also returned while a push is part way through
+      struct mpsc_node * node = mpsc_pop(&queue);
+      if (!node)
+        continue;
+      item = ilist_entry(node, struct Item, node);
+    }
+
+    if (item->producer >= PRODUCERS || item->seq != next[item->producer])
+    {
+      DEBUG_ERROR("producer %u item %u received out of order, expected %u",
+          item->producer, item->seq,
+          item->producer < PRODUCERS ? next[item->producer] : 0);
+      ok = false;
+      break;
+    }
+
+    ++next[item->producer];
+    ++received;
+  }
+
+  const uint64_t time = nanotime() - startTime;
+  for(int i = 0; i < PRODUCERS; ++i)
+    lgJoinThread(threads[i], NULL);
+
+  if (ok && !useLL && !mpsc_empty(&queue))
+  {
+    DEBUG_ERROR("mpsc not empty after every item was received");
+    ok = false;
+  }
+
+  if (ok)
+    report(useLL ? "ll   4:1" : "mpsc 4:1", PRODUCERS * MPSC_ITEMS, time);
+
+  if (list)
+    ll_free(list);
+  free(items);
+  return ok;
+}
+
+/* SPSC, the producer and consumer alternate between the copying and the
+ * zero-copy calls so both are exercised against each other */
+
+struct SPSCState
+{
+  SPSCRing    ring;
+  struct ll * list;
+};
+
+static int spscProducer(void * opaque)
+{
+  struct SPSCState * s = opaque;
+  waitStart();
+
+  for(uint64_t i = 0; i < SPSC_ITEMS; )
+  {
+    if (s->list)
+    {
+      // offset by one as a NULL value can not be told apart from an empty list
+      ll_push(s->list, (void *)(uintptr_t)(i + 1));
+      ++i;
+    }
+    else if (i & 1)
+    {
+      uint64_t * slot = spsc_reserve(s->ring);
+      if (!slot)
+        continue;
+
+      *slot = i++;
+      spsc_commit(s->ring);
+    }
+    else if (spsc_push(s->ring, &i))
+      ++i;
+  }
+
+  return 0;
+}
+
+static bool runSPSC(bool useLL)
+{
+  struct SPSCState s = { 0 };
+  LGThread * thread;
+  bool       ok = true;
+
+  if (useLL)
+    s.list = ll_new();
+  else if (!(s.ring = spsc_new(SPSC_LENGTH, sizeof(uint64_t))))
+  {
+    DEBUG_ERROR("Failed to create the ring");
+    return false;
+  }
+
+  atomic_store(&start, false);
+  if (!lgCreateThread("spscProducer", spscProducer, &s, &thread))
+    DEBUG_FATAL("Failed to create the producer thread");
+
+  const uint64_t startTime = nanotime();
+  atomic_store_explicit(&start, true, memory_order_release);
+
+  for(uint64_t i = 0; i < SPSC_ITEMS; )
+  {
+    uint64_t value;
+    if (useLL)
+    {
+      void * data;
+      if (!ll_shift(s.list, &data))
+        continue;
+      value = (uintptr_t)data - 1;
+    }
+    else if (i & 1)
+    {
+      const uint64_t * slot = spsc_peek(s.ring);
+      if (!slot)
+        continue;
+
+      value = *slot;
+      spsc_release(s.ring);
+    }
+    else if (!spsc_pop(s.ring, &value))
+      continue;
+
+    // keep draining after a failure so the producer can finish
+    if (value != i && ok)
+    {
+      DEBUG_ERROR("received %lu, expected %lu",
+          (unsigned long)value, (unsigned long)i);
+      ok = false;
+    }
+    ++i;
+  }
+
+  const uint64_t time = nanotime() - startTime;
+  lgJoinThread(thread, NULL);
+
+  if (ok && !useLL && spsc_getCount(s.ring) != 0)
+  {
+    DEBUG_ERROR("spsc not empty after every item was received");
+    ok = false;
+  }
+
+  if (ok)
+    report(useLL ? "ll   1:1" : "spsc 1:1", SPSC_ITEMS, time);
+
+  if (s.list)
+    ll_free(s.list);
+  spsc_free(&s.ring);
+  return ok;
+}
+
+/* Epoch reclamation, the readers dereference the current object while the
+ * writer keeps replacing and retiring it. The free function poisons the
+ * object so a reader that still holds it after it was freed sees it. */
+
+struct Obj
+{
+  struct epoch_node node;
+  uint64_t          value;
+  uint64_t          check;
+  atomic_bool       alive;
+};
+
+static struct
+{
+  EpochDomain           domain;
+  _Atomic(struct Obj *) current;
+  atomic_bool           running;
+  atomic_uint           ready;
+  atomic_uint_fast64_t  reads;
+  atomic_uint_fast64_t  errors;
+  atomic_uint_fast64_t  freed;
+}
+epoch;
+
+static void freeObj(struct epoch_node * node)
+{
+  struct Obj * obj = ilist_entry(node, struct Obj, node);
+  obj->check = obj->value;
+  atomic_store_explicit(&obj->alive, false, memory_order_relaxed);
+  atomic_fetch_add_explicit(&epoch.freed, 1, memory_order_relaxed);
+}
+
+static int epochReader(void * opaque)
+{
+  EpochThread * thread = epoch_register(epoch.domain);
+  if (!thread)
+  {
+    atomic_fetch_add(&epoch.errors, 1);
+    atomic_fetch_add(&epoch.ready , 1);
+    return -1;
+  }
+
+  atomic_fetch_add(&epoch.ready, 1);
+  waitStart();
+
+  uint64_t reads  = 0;
+  uint64_t errors = 0;
+  while(atomic_load_explicit(&epoch.running, memory_order_relaxed))
+  {
+    epoch_enter(thread);
+    struct Obj * obj = atomic_load_explicit(&epoch.current,
+        memory_order_acquire);
+
+    // hold on to the object for a while as a real reader would use it
+    for(int i = 0; i < EPOCH_HOLD; ++i)
+      if (!atomic_load_explicit(&obj->alive, memory_order_relaxed) ||
+          obj->check != ~obj->value)
+      {
+        ++errors;
+        break;
+      }
+
+    epoch_exit(thread);
+    ++reads;
+  }
+
+  epoch_unregister(thread);
+  atomic_fetch_add(&epoch.reads , reads );
+  atomic_fetch_add(&epoch.errors, errors);
+  return 0;
+}
+
+static bool runEpoch(void)
+{
+  struct Obj * objs = calloc(EPOCH_UPDATES + 1, sizeof(*objs));
+  LGThread   * threads[READERS];
+  bool         ok = true;
+
+  if (!objs)
+  {
+    DEBUG_ERROR("out of memory");
+    return false;
+  }
+
+  // the readers and the writer
+  epoch.domain = epoch_new(READERS + 1);
+  if (!epoch.domain)
+  {
+    DEBUG_ERROR("Failed to create the epoch domain");
+    free(objs);
+    return false;
+  }
+
+  for(uint64_t i = 0; i <= EPOCH_UPDATES; ++i)
+  {
+    objs[i].value = i;
+    objs[i].check = ~i;
+    atomic_init(&objs[i].alive, true);
+  }
+
+  atomic_store(&epoch.current, objs);
+  atomic_store(&epoch.running, true);
+  atomic_store(&start, false);
+
+  for(int i = 0; i < READERS; ++i)
+    if (!lgCreateThread("epochReader", epochReader, NULL, threads + i))
+      DEBUG_FATAL("Failed to create the reader thread");
+
+  EpochThread * thread = epoch_register(epoch.domain);
+  if (!thread)
+    DEBUG_FATAL("Failed to register the writer");
+
+  // the retirements are only checked if the readers are running alongside
+  while(atomic_load(&epoch.ready) != READERS)
+    nsleep(1000000);
+
+  const uint64_t startTime = nanotime();
+  atomic_store_explicit(&start, true, memory_order_release);
+
+  for(uint64_t i = 1; i <= EPOCH_UPDATES; ++i)
+  {
+    epoch_enter(thread);
+    struct Obj * old = atomic_exchange_explicit(&epoch.current, objs + i,
+        memory_order_acq_rel);
+    epoch_retire(thread, &old->node, freeObj);
+    epoch_exit(thread);
+  }
+
+  const uint64_t time = nanotime() - startTime;
+  atomic_store(&epoch.running, false);
+  for(int i = 0; i < READERS; ++i)
+    lgJoinThread(threads[i], NULL);
+
+  epoch_synchronize(thread);
+  epoch_unregister(thread);
+  epoch_free(&epoch.domain);
+
+  const uint64_t errors = atomic_load(&epoch.errors);
+  const uint64_t freed  = atomic_load(&epoch.freed );
+  if (errors)
+  {
+    DEBUG_ERROR("%lu reads saw a freed object", (unsigned long)errors);
+    ok = false;
+  }
+
+  if (freed != EPOCH_UPDATES)
+  {
+    DEBUG_ERROR("%lu of %d retired objects were freed",
+        (unsigned long)freed, EPOCH_UPDATES);
+    ok = false;
+  }
+
+  if (ok)
+  {
+    report("epoch retire", EPOCH_UPDATES, time);
+    report("epoch read (4 threads)", atomic_load(&epoch.reads), time);
+  }
+
+  free(objs);
+  return ok;
+}
+
+int main(int argc, char * argv[])
+{
+  debug_init();
+  DEBUG_INFO("Looking Glass (%s) - Concurrency Profiler", BUILD_VERSION);
+
+  bool ok = true;
+  ok &= runMPSC(false);
+  ok &= runMPSC(true );
+  ok &= runSPSC(false);
+  ok &= runSPSC(true );
+  ok &= runEpoch();
+
+  if (!ok)
+  {
+    DEBUG_ERROR("FAILED");
+    return -1;
+  }
+
+  fprintf(stdout, "PASSED\n");
+  return 0;
+}
@@ -0,0 +1,232 @@
+/**
+ * Looking Glass
+ * Copyright © 2017-2024 The Looking Glass Authors
+ * https://looking-glass.io
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common/array.h"
+#include "common/debug.h"
+#include "common/resampler.h"
+#include "common/time.h"
+#include "common/util.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <samplerate.h>
+
+/* Compares the built in resampler against the libsamplerate converter the
+ * client used previously, driving both the way audio_playbackData does: one
+ * SPICE period at a time with a ratio that wanders within the range the clock
+ * recovery loop produces. */
+
+#define SAMPLE_RATE 48000
+#define CHANNELS    2
+#define PERIOD      480
+#define SECONDS     60
+#define MAX_OUT     (PERIOD * 11 / 10)
+
+struct Impl
+{
+  const char * name;
+  bool (*init)(void * udata);
+  void (*reset)(void);
+  int  (*process)(const int16_t * in, int frames, float * out, int outFrames,
+      double ratio);
+  void (*free)(void);
+  void * udata;
+};
+
+static Resampler rs;
+
+static bool lgInit(void * udata)
+{
+  rs = resampler_new(CHANNELS, (int)(intptr_t)udata);
+  return rs;
+}
+
+static void lgReset(void)
+{
+  resampler_reset(rs);
+}
+
+static int lgProcess(const int16_t * in, int frames, float * out,
+    int outFrames, double ratio)
+{
+  int total = 0;
+  int generated;
+  do
+  {
+    generated = resampler_processS16(rs, in, frames,
+        out + total * CHANNELS, outFrames - total, ratio);
+    total += generated;
+    in     = NULL;
+    frames = 0;
+  }
+  while (generated > 0 && total < outFrames);
+  return total;
+}
+
+static void lgFree(void)
+{
+  resampler_free(&rs);
+}
+
+static SRC_STATE * src;
+static float srcIn[PERIOD * CHANNELS];
+
+static bool srcInit(void * udata)
+{
+  int error;
+  src = src_new((int)(intptr_t)udata, CHANNELS, &error);
+  if (!src)
+    DEBUG_ERROR("src_new: %s", src_strerror(error));
+  return src;
+}
+
+static void srcReset(void)
+{
+  src_reset(src);
+}
+
+static int srcProcess(const int16_t * in, int frames, float * out,
+    int outFrames, double ratio)
+{
+  src_short_to_float_array(in, srcIn, frames * CHANNELS);
+
+  int consumed = 0;
+  int total    = 0;
+  while (consumed < frames && total < outFrames)
+  {
+    SRC_DATA data =
+    {
+      .data_in       = srcIn + consumed * CHANNELS,
+      .data_out      = out + total * CHANNELS,
+      .input_frames  = frames - consumed,
+      .output_frames = outFrames - total,
+      .src_ratio     = ratio
+    };
+
+    int error = src_process(src, &data);
+    if (error)
+    {
+      DEBUG_ERROR("src_process: %s", src_strerror(error));
+      return total;
+    }
+
+    consumed += data.input_frames_used;
+    total    += data.output_frames_gen;
+  }
+  return total;
+}
+
+static void srcFree(void)
+{
+  src = src_delete(src);
+}
+
+static struct Impl impls[] =
+{
+  { "builtin q0", lgInit, lgReset, lgProcess, lgFree, (void *)0 },
+  { "builtin q1", lgInit, lgReset, lgProcess, lgFree, (void *)1 },
+  { "builtin q2", lgInit, lgReset, lgProcess, lgFree, (void *)2 },
+  { "builtin q3", lgInit, lgReset, lgProcess, lgFree, (void *)3 },
+  { "src fastest", srcInit, srcReset, srcProcess, srcFree,
+    (void *)SRC_SINC_FASTEST },
+  { "src medium" , srcInit, srcReset, srcProcess, srcFree,
+    (void *)SRC_SINC_MEDIUM_QUALITY }
+};
+
+// the ratio the clock recovery loop might produce, within +-0.5%
+static double ratioAt(int period)
+{
+  return 1.0 + 0.005 * sin(period * 0.01);
+}
+
+/* Latency is measured as the number of frames the converter holds back at a
+ * ratio of 1.0, this is the delay it adds in front of the playback buffer */
+static int measureLatency(struct Impl * impl)
+{
+  static int16_t in [PERIOD * CHANNELS];
+  static float   out[MAX_OUT * CHANNELS];
+
+  impl->reset();
+  memset(in, 0, sizeof(in));
+
+  int generated = 0;
+  for(int p = 0; p < 16; ++p)
+    generated += impl->process(in, PERIOD, out, MAX_OUT, 1.0);
+
+  return 16 * PERIOD - generated;
+}
+
+static void run(struct Impl * impl)
+{
+  if (!impl->init(impl->udata))
+    return;
+
+  const int periods = SECONDS * SAMPLE_RATE / PERIOD;
+  int16_t * in  = malloc(sizeof(*in) * PERIOD * CHANNELS * periods);
+  float   * out = malloc(sizeof(*out) * MAX_OUT * CHANNELS);
+
+  // a 1 kHz tone so the converters see realistic input
+  const double freq = 1000.0 / SAMPLE_RATE;
+  for(int i = 0; i < PERIOD * periods; ++i)
+    for(int ch = 0; ch < CHANNELS; ++ch)
+      in[i * CHANNELS + ch] = lrint(16384.0 * sin(2.0 * M_PI * freq * i));
+
+  uint64_t total = 0;
+  uint64_t worst = 0;
+
+  impl->reset();
+  for(int p = 0; p < periods; ++p)
+  {
+    const double   ratio = ratioAt(p);
+    const uint64_t start = nanotime();
+    impl->process(in + p * PERIOD * CHANNELS, PERIOD, out, MAX_OUT, ratio);
+    const uint64_t time  = nanotime() - start;
+
+    total += time;
+    worst  = max(worst, time);
+  }
+
+  const int latency = measureLatency(impl);
+  fprintf(stdout,
+      "%-12s avg:%7.2f us max:%7.2f us cpu:%6.3f%% latency:%3d frames "
+      "(%5.2f ms)\n",
+      impl->name,
+      total / 1e3 / periods,
+      worst / 1e3,
+      100.0 * total / (SECONDS * 1e9),
+      latency,
+      latency * 1000.0 / SAMPLE_RATE);
+
+  free(out);
+  free(in);
+  impl->free();
+}
+
+int main(int argc, char * argv[])
+{
+  DEBUG_INFO("Looking Glass (" BUILD_VERSION ") - Resampler Profiler");
+
+  for(int i = 0; i < ARRAY_LENGTH(impls); ++i)
+    run(impls + i);
+
+  return 0;
+}